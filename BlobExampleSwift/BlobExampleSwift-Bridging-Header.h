@@ -15,10 +15,22 @@
 #import "Blob.h"
 #import "TableEntity.h"
 #import "TableFetchRequest.h"
+#import "TableBatch.h"
+#import "TableBatchWriter.h"
+#import "BlobListRequest.h"
 #import "BlobContainer.h"
 #import "Queue.h"
 #import "QueueMessage.h"
+#import "QueueMessagePump.h"
 #import "TableEntity.h"
 #import "CloudURLRequest.h"
+#import "CloudPooledTransport.h"
+#import "CloudRetryPolicy.h"
+#import "CloudRequestMetrics.h"
+#import "BlobCache.h"
+#import "TableResultSet.h"
+#import "BlobListing.h"
+#import "CloudRequestHandle.h"
+#import "BlobBulkOperation.h"
 
 #endif
@@ -0,0 +1,93 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+#import "CloudStorageStandIn.h"
+#import "BlobContainer.h"
+#import "BlobListingParser.h"
+#import "BlobParser.h"
+#import <libxml/parser.h>
+
+@interface BlobListingTests : XCTestCase
+@end
+
+@implementation BlobListingTests
+
+- (void)testCompactListingMatchesBlobs
+{
+    BlobContainer* container = [[BlobContainer alloc] initContainerWithName:@"container" URL:@"http://benchaccount.blob.core.windows.net/container" metadata:nil];
+    NSData* page = [CloudStorageStandIn blobListingWithCount:200 payloadSize:64 * 1024];
+    BlobListing* listing = [[BlobListing alloc] initWithContainer:container];
+
+    // a second page that sorts before the first, as an interleaved sharded listing would deliver it
+    NSString* early = @"<?xml version=\"1.0\" encoding=\"utf-8\"?><EnumerationResults><Blobs>"
+                       "<Blob><Name>a/caf\u00e9 &amp; co</Name><Properties><Content-Type>text/plain</Content-Type></Properties></Blob>"
+                       "<Blob><Name>a/b</Name></Blob><BlobPrefix><Name>a/</Name></BlobPrefix></Blobs><NextMarker /></EnumerationResults>";
+    for(NSData* body in [NSArray arrayWithObjects:page, [early dataUsingEncoding:NSUTF8StringEncoding], nil])
+    {
+        BlobListingParser* parser = [[BlobListingParser alloc] initWithListing:listing];
+        // a byte at a time, so every value arrives split
+        for(NSUInteger offset = 0; offset < [body length]; offset++)
+        {
+            XCTAssertTrue([parser parseBytes:(const uint8_t*)[body bytes] + offset length:1]);
+        }
+        XCTAssertTrue([parser finish]);
+    }
+    [listing sort];
+
+    XCTAssertEqual(listing.count, (NSUInteger)202);
+    XCTAssertEqualObjects([listing nameAtIndex:0], @"a/b");
+    XCTAssertEqualObjects([listing nameAtIndex:1], @"a/caf\u00e9 & co");
+    XCTAssertEqualObjects([listing contentTypeAtIndex:1], @"text/plain");
+    XCTAssertEqual([listing contentLengthAtIndex:1], -1LL);
+    XCTAssertNil([listing lastModifiedAtIndex:1]);
+    XCTAssertNil([listing blobTypeAtIndex:0]);
+
+    XCTAssertEqual([listing indexOfBlobNamed:@"blob00000"], (NSUInteger)2);
+    XCTAssertEqual([listing indexOfBlobNamed:@"blob00199"], (NSUInteger)201);
+    XCTAssertEqual([listing indexOfBlobNamed:@"blob0019"], (NSUInteger)NSNotFound);
+    XCTAssertEqual([listing indexOfBlobNamed:@"zzz"], (NSUInteger)NSNotFound);
+    XCTAssertTrue(NSEqualRanges([listing rangeOfBlobsWithPrefix:@"blob001"], NSMakeRange(102, 100)));
+    XCTAssertTrue(NSEqualRanges([listing rangeOfBlobsWithPrefix:@"a/"], NSMakeRange(0, 2)));
+    XCTAssertEqual([listing rangeOfBlobsWithPrefix:@"c"].length, (NSUInteger)0);
+    XCTAssertEqualObjects(listing.prefixes, [NSArray arrayWithObject:@"a/"]);
+
+    __block NSUInteger visited = 0;
+    [listing enumerateNamesUsingBlock:^(const char* name, NSUInteger length, NSUInteger index, BOOL* stop) {
+        XCTAssertEqual(index, visited++);
+        if(index > 0)
+        {
+            XCTAssertTrue(strncmp(name, [[listing nameAtIndex:index - 1] UTF8String], length) >= 0);
+        }
+    }];
+    XCTAssertEqual(visited, (NSUInteger)202);
+
+    // the compact values round-trip to what the Blob path reads from the same page
+    xmlDocPtr doc = xmlReadMemory([page bytes], (int)[page length], NULL, NULL, (XML_PARSE_NOCDATA | XML_PARSE_NOBLANKS));
+    Blob* expected = [[BlobParser loadBlobs:doc container:container] objectAtIndex:7];
+    xmlFreeDoc(doc);
+
+    Blob* blob = [listing blobAtIndex:[listing indexOfBlobNamed:expected.name]];
+    XCTAssertEqualObjects(blob.name, expected.name);
+    XCTAssertEqual(blob.contentLength, expected.contentLength);
+    XCTAssertEqualObjects(blob.contentType, expected.contentType);
+    XCTAssertEqualObjects(blob.etag, expected.etag);
+    XCTAssertEqualObjects(blob.lastModified, expected.lastModified);
+    XCTAssertEqualObjects([blob.properties objectForKey:@"BlobType"], [expected.properties objectForKey:@"BlobType"]);
+    XCTAssertEqualObjects([[listing URLAtIndex:[listing indexOfBlobNamed:expected.name]] lastPathComponent], expected.name);
+}
+
+@end
@@ -0,0 +1,161 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "StandInTestCase.h"
+#import "BlobBulkOperation.h"
+#import "SimpleBase64.h"
+
+// Blob writes against the stand-in, which checks each SharedKey signature with the same all-zero
+// account key the client signs with.
+@interface BlobWriteTests : StandInTestCase
+@end
+
+@implementation BlobWriteTests
+
+- (void)configureStandIn:(CloudStorageStandIn*)standIn
+{
+    standIn.listingCount = 4;
+    standIn.sharedKey = _key;
+}
+
+- (NSArray*)listedBlobs
+{
+    __block NSArray* listed = nil;
+    [_client getBlobs:_container withBlock:^(NSArray* blobs, NSError* error) {
+        XCTAssertNil(error);
+        listed = blobs ? blobs : @[];
+    }];
+    XCTAssertTrue([self waitFor:^BOOL{ return listed != nil; } timeout:10]);
+    XCTAssertEqual([listed count], (NSUInteger)4);
+    return listed;
+}
+
+// Runs a write and returns its error, or nil once it has succeeded.
+- (NSError*)errorOfWrite:(void (^)(void (^done)(NSError*)))write
+{
+    __block BOOL finished = NO;
+    __block NSError* failure = nil;
+    write(^(NSError* error) {
+        failure = error;
+        finished = YES;
+    });
+    XCTAssertTrue([self waitFor:^BOOL{ return finished; } timeout:10]);
+    return failure;
+}
+
+- (void)testSetBlobMetadata
+{
+    Blob* blob = [[self listedBlobs] firstObject];
+    NSDictionary* metadata = @{ @"Owner" : @"someone", @"project" : @"archive 2026", @"Zone" : @"b" };
+
+    // names go out as typed but are signed lower-case and sorted, which the stand-in checks
+    NSError* error = [self errorOfWrite:^(void (^done)(NSError*)) {
+        [_client setBlobMetadata:blob metadata:metadata withBlock:done];
+    }];
+    XCTAssertNil(error);
+
+    NSDictionary* headers = _standIn.lastWriteHeaders;
+    XCTAssertEqualObjects([headers objectForKey:@"x-ms-meta-owner"], @"someone");
+    XCTAssertEqualObjects([headers objectForKey:@"x-ms-meta-project"], @"archive 2026");
+    XCTAssertEqualObjects([headers objectForKey:@"x-ms-meta-zone"], @"b");
+}
+
+- (void)testSetBlobProperties
+{
+    Blob* blob = [[self listedBlobs] firstObject];
+    NSDictionary* properties = @{ @"x-ms-blob-content-type" : @"text/plain", @"x-ms-blob-cache-control" : @"no-cache" };
+
+    NSError* error = [self errorOfWrite:^(void (^done)(NSError*)) {
+        [_client setBlobProperties:blob properties:properties withBlock:done];
+    }];
+    XCTAssertNil(error);
+
+    NSDictionary* headers = _standIn.lastWriteHeaders;
+    XCTAssertEqualObjects([headers objectForKey:@"x-ms-blob-content-type"], @"text/plain");
+    XCTAssertEqualObjects([headers objectForKey:@"x-ms-blob-cache-control"], @"no-cache");
+}
+
+- (void)testRunTimeHeadersAreSigned
+{
+    Blob* blob = [[self listedBlobs] firstObject];
+
+    // a client with another key signs the same headers; the stand-in turns it away
+    NSMutableData* otherKey = [NSMutableData dataWithLength:64];
+    ((uint8_t*)[otherKey mutableBytes])[0] = 1;
+    CloudStorageClient* impostor = [CloudStorageClient storageClientWithCredential:[AuthenticationCredential credentialWithAzureServiceAccount:@"benchaccount" accessKey:[SimpleBase64 encode:otherKey]]];
+    NSError* error = [self errorOfWrite:^(void (^done)(NSError*)) {
+        [impostor setBlobMetadata:blob metadata:@{ @"Owner" : @"someone" } withBlock:done];
+    }];
+    XCTAssertEqualObjects([[error userInfo] objectForKey:@"AzureReasonCode"], @"AuthenticationFailed");
+
+    // more metadata than can be signed fails before anything is sent
+    NSMutableDictionary* metadata = [NSMutableDictionary dictionary];
+    for(NSUInteger index = 0; index < 40; index++)
+    {
+        [metadata setObject:@"v" forKey:[NSString stringWithFormat:@"name%02lu", (unsigned long)index]];
+    }
+    NSUInteger requests = _standIn.requestCount;
+    error = [self errorOfWrite:^(void (^done)(NSError*)) {
+        [_client setBlobMetadata:blob metadata:metadata withBlock:done];
+    }];
+    XCTAssertEqualObjects([error domain], @"CloudStorageClient");
+    XCTAssertEqual(_standIn.requestCount, requests);
+}
+
+- (void)testCopyBlobNamesSourceOnBlobService
+{
+    Blob* blob = [[self listedBlobs] objectAtIndex:1];
+    BlobContainer* archive = [[BlobContainer alloc] initContainerWithName:@"archive" URL:@"http://benchaccount.blob.core.windows.net/archive" metadata:nil];
+
+    NSError* error = [self errorOfWrite:^(void (^done)(NSError*)) {
+        [_client copyBlob:blob toContainer:archive blobName:@"copied" withBlock:done];
+    }];
+    XCTAssertNil(error);
+
+    NSURL* source = [NSURL URLWithString:[_standIn.lastWriteHeaders objectForKey:@"x-ms-copy-source"]];
+    XCTAssertEqualObjects(source.host, @"benchaccount.blob.core.windows.net");
+    XCTAssertEqualObjects(source.path, [@"/container/" stringByAppendingString:blob.name]);
+}
+
+- (void)testDeleteOfMissingBlobCountsAsSuccess
+{
+    NSArray* blobs = [self listedBlobs];
+    Blob* missing = [blobs objectAtIndex:2];
+    _standIn.missingBlobNames = [NSSet setWithObject:missing.name];
+
+    // on its own the delete reports what the service said
+    NSError* error = [self errorOfWrite:^(void (^done)(NSError*)) {
+        [_client deleteBlob:missing withBlock:done];
+    }];
+    XCTAssertEqualObjects([[error userInfo] objectForKey:@"AzureReasonCode"], @"BlobNotFound");
+
+    // a bulk delete takes it as done, so a resumed run can go over blobs it deleted before
+    NSMutableArray* results = [NSMutableArray array];
+    BlobBulkOperation* operation = [BlobBulkOperation deleteOperationWithStorageClient:_client];
+    operation.resultBlock = ^(Blob* blob, NSError* resultError) {
+        XCTAssertNil(resultError, @"deleting %@ failed", blob.name);
+        [results addObject:blob.name];
+    };
+    error = [self errorOfWrite:^(void (^done)(NSError*)) {
+        [operation runWithBlobs:blobs withBlock:done];
+    }];
+    XCTAssertNil(error);
+    XCTAssertEqual([results count], [blobs count]);
+    XCTAssertEqual(operation.succeededCount, [blobs count]);
+    XCTAssertEqual(operation.failedCount, (NSUInteger)0);
+}
+
+@end
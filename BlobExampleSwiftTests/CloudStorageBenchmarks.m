@@ -0,0 +1,1028 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "StandInTestCase.h"
+#import "CloudRequestScheduler.h"
+#import "CloudRetryPolicy.h"
+#import "CloudRequestMetrics.h"
+#import "CloudPooledTransport.h"
+#import "QueueMessagePump.h"
+#import "BlobBulkOperation.h"
+#import "TableFetchRequest.h"
+#import "AuthenticationCredential+Private.h"
+#import "SimpleBase64.h"
+#import "XmlHelper.h"
+#import "XmlStreamParser.h"
+#import "JsonStreamParser.h"
+#import "BlobParser.h"
+#import "TableColumnParser.h"
+#import "TableResultSet+Private.h"
+#import "BlobListingParser.h"
+#import <libxml/parser.h>
+#import <fcntl.h>
+#import <libkern/OSAtomic.h>
+
+// Tunables, read from the environment so a scheme can scale a run without editing the tests:
+// BENCH_OPS, BENCH_CONCURRENCY, BENCH_PAYLOAD (bytes), BENCH_LATENCY_MS and BENCH_LISTING.
+static NSUInteger BenchSetting(NSString* name, NSUInteger fallback)
+{
+    NSString* value = [[[NSProcessInfo processInfo] environment] objectForKey:name];
+    return value ? (NSUInteger)[value longLongValue] : fallback;
+}
+
+typedef void (^BenchOperation)(NSUInteger index, void (^done)(NSUInteger bytes, NSError* error));
+
+@interface TableEntity (BenchmarkPrivate)
+- (NSString*)propertyString;
+- (NSData*)jsonBody;
+@end
+
+@interface CloudStorageBenchmarks : StandInTestCase
+{
+    NSUInteger _savedConcurrency;
+    NSTimeInterval _savedBaseDelay;
+
+    NSUInteger _operations;
+    NSUInteger _concurrency;
+    NSUInteger _payloadSize;
+}
+@end
+
+@implementation CloudStorageBenchmarks
+
+- (void)setUp
+{
+    _operations = BenchSetting(@"BENCH_OPS", 200);
+    _concurrency = MAX(BenchSetting(@"BENCH_CONCURRENCY", 8), 1);
+    _payloadSize = BenchSetting(@"BENCH_PAYLOAD", 64 * 1024);
+
+    [super setUp];
+
+    CloudRequestScheduler* scheduler = [CloudRequestScheduler sharedScheduler];
+    _savedConcurrency = scheduler.maxConcurrentRequestsPerHost;
+    _savedBaseDelay = scheduler.retryPolicy.baseDelay;
+    scheduler.maxConcurrentRequestsPerHost = MAX(_savedConcurrency, _concurrency);
+    scheduler.retryPolicy.baseDelay = 0.01;
+    [scheduler resetCounters];
+}
+
+- (void)tearDown
+{
+    CloudRequestScheduler* scheduler = [CloudRequestScheduler sharedScheduler];
+    scheduler.maxConcurrentRequestsPerHost = _savedConcurrency;
+    scheduler.retryPolicy.baseDelay = _savedBaseDelay;
+
+    [super tearDown];
+}
+
+- (void)configureStandIn:(CloudStorageStandIn*)standIn
+{
+    standIn.latency = BenchSetting(@"BENCH_LATENCY_MS", 0) / 1000.0;
+    standIn.listingCount = BenchSetting(@"BENCH_LISTING", 100);
+    standIn.payloadSize = _payloadSize;
+}
+
+#pragma mark Harness
+
+- (void)report:(NSString*)name latencies:(double*)latencies count:(NSUInteger)count elapsed:(NSTimeInterval)elapsed bytes:(unsigned long long)bytes
+{
+    qsort_b(latencies, count, sizeof(double), ^int(const void* a, const void* b) {
+        double left = *(const double*)a, right = *(const double*)b;
+        return (left > right) - (left < right);
+    });
+
+    double (^percentile)(double) = ^double(double p) {
+        if(count == 0)
+        {
+            return 0;
+        }
+        NSUInteger index = (NSUInteger)ceil(p * count);
+        return latencies[MIN(MAX(index, (NSUInteger)1), count) - 1] * 1000.0;
+    };
+
+    NSLog(@"[bench] %@: %lu ops in %.3fs, %.1f ops/s, %.2f MB/s, p50 %.3fms, p99 %.3fms, p999 %.3fms",
+          name, (unsigned long)count, elapsed, count / elapsed, bytes / elapsed / (1024.0 * 1024.0),
+          percentile(0.5), percentile(0.99), percentile(0.999));
+}
+
+// Keeps `concurrency` operations outstanding until `count` have completed, then reports on them.
+- (void)runBenchmark:(NSString*)name operations:(NSUInteger)count concurrency:(NSUInteger)concurrency operation:(BenchOperation)operation
+{
+    double* latencies = calloc(MAX(count, (NSUInteger)1), sizeof(double));
+    __block NSUInteger started = 0;
+    __block NSUInteger completed = 0;
+    __block unsigned long long bytes = 0;
+    __block NSError* failure = nil;
+    __block void (^launch)(void);
+
+    CFAbsoluteTime begin = CFAbsoluteTimeGetCurrent();
+
+    launch = ^{
+        NSUInteger index = started++;
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+
+        operation(index, ^(NSUInteger length, NSError* error) {
+            latencies[index] = CFAbsoluteTimeGetCurrent() - start;
+            bytes += length;
+            completed++;
+            if(error && !failure)
+            {
+                failure = error;
+            }
+            if(started < count && launch)
+            {
+                launch();
+            }
+        });
+    };
+
+    for(NSUInteger slot = 0; slot < concurrency && started < count; slot++)
+    {
+        launch();
+    }
+
+    BOOL finished = [self waitFor:^BOOL{ return completed == count; } timeout:MAX(60.0, count * 0.5)];
+    NSTimeInterval elapsed = CFAbsoluteTimeGetCurrent() - begin;
+
+    XCTAssertTrue(finished, @"%@ timed out after %lu of %lu operations", name, (unsigned long)completed, (unsigned long)count);
+    XCTAssertNil(failure, @"%@ failed: %@", name, failure);
+
+    if(finished)
+    {
+        [self report:name latencies:latencies count:count elapsed:elapsed bytes:bytes];
+    }
+    // breaks the cycle through the __block variable. After a timeout the stragglers may still
+    // complete, so they launch nothing more and the latency buffer is left for them to write to.
+    launch = nil;
+    if(finished)
+    {
+        free(latencies);
+    }
+}
+
+// Times `iterations` synchronous calls of block, each in its own autorelease pool.
+- (void)runMicroBenchmark:(NSString*)name iterations:(NSUInteger)iterations bytes:(NSUInteger)bytesPerIteration block:(void (^)(void))block
+{
+    double* latencies = calloc(iterations, sizeof(double));
+    CFAbsoluteTime begin = CFAbsoluteTimeGetCurrent();
+
+    for(NSUInteger index = 0; index < iterations; index++)
+    {
+        @autoreleasepool
+        {
+            CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+            block();
+            latencies[index] = CFAbsoluteTimeGetCurrent() - start;
+        }
+    }
+
+    [self report:name latencies:latencies count:iterations elapsed:CFAbsoluteTimeGetCurrent() - begin bytes:(unsigned long long)bytesPerIteration * iterations];
+    free(latencies);
+}
+
+// The error an operation's done callback reports: the operation's own error, or one standing in for a
+// result that didn't match what the stand-in served, so the mismatch fails the test where it happened.
+- (NSError*)resultError:(NSError*)error matched:(BOOL)matched
+{
+    if(error || matched)
+    {
+        return error;
+    }
+
+    XCTFail(@"the result did not match what the stand-in served");
+    return [NSError errorWithDomain:@"CloudStorageBenchmarks" code:-1 userInfo:nil];
+}
+
+- (Blob*)listedBlob
+{
+    __block Blob* blob = nil;
+    __block BOOL listed = NO;
+    [_client getBlobs:_container withBlock:^(NSArray* blobs, NSError* error) {
+        blob = [blobs firstObject];
+        listed = YES;
+    }];
+    [self waitFor:^BOOL{ return listed; } timeout:30];
+    XCTAssertNotNil(blob, @"the stand-in listing returned no blobs");
+    return blob;
+}
+
+#pragma mark Blob
+
+- (void)testBlobListing
+{
+    [self runBenchmark:@"blob list" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getBlobs:_container withBlock:^(NSArray* blobs, NSError* error) {
+            done(0, [self resultError:error matched:[blobs count] == _standIn.listingCount]);
+        }];
+    }];
+}
+
+- (void)testCompactBlobListing
+{
+    [self runBenchmark:@"blob list (compact)" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getBlobListing:[BlobListRequest listRequestForContainer:_container] shardPrefixes:nil withBlock:^(BlobListing* listing, NSError* error) {
+            done(0, [self resultError:error matched:listing.count == _standIn.listingCount]);
+        }];
+    }];
+}
+
+- (void)testBlobDownload
+{
+    Blob* blob = [self listedBlob];
+
+    [self runBenchmark:@"blob get" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+            done([data length], error);
+        }];
+    }];
+}
+
+- (void)testParallelBlobDownloadScaling
+{
+    _standIn.payloadSize = MAX(_payloadSize, (NSUInteger)(4 * 1024 * 1024));
+    Blob* blob = [self listedBlob];
+    NSUInteger segmentSize = _standIn.payloadSize / 16;
+    NSUInteger count = MAX(_operations / 10, (NSUInteger)5);
+
+    for(NSUInteger parallelism = 1; parallelism <= 16; parallelism *= 2)
+    {
+        _client.downloadSegmentSize = segmentSize;
+        _client.downloadParallelism = parallelism;
+
+        NSString* name = [NSString stringWithFormat:@"blob ranged get x%lu", (unsigned long)parallelism];
+        [self runBenchmark:name operations:count concurrency:1 operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+            [_client getBlobDataInParallel:blob withBlock:^(NSData* data, NSError* error) {
+                done([data length], [self resultError:error matched:[data length] == _standIn.payloadSize]);
+            }];
+        }];
+    }
+}
+
+- (void)testBlobUpload
+{
+    NSData* content = [NSMutableData dataWithLength:_payloadSize];
+
+    [self runBenchmark:@"blob put" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        NSString* name = [NSString stringWithFormat:@"upload%05lu", (unsigned long)index];
+        [_client addBlobToContainer:_container blobName:name contentData:content contentType:@"application/octet-stream" withBlock:^(NSError* error) {
+            done([content length], error);
+        }];
+    }];
+}
+
+- (void)testMappedFileUpload
+{
+    // four blocks per file, sent as windows onto one mapping of the file
+    NSUInteger fileSize = _payloadSize * 4;
+    NSString* path = [NSTemporaryDirectory() stringByAppendingPathComponent:@"bench-upload.bin"];
+    XCTAssertTrue([[NSMutableData dataWithLength:fileSize] writeToFile:path atomically:YES]);
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+    _client.uploadBlockSize = _payloadSize;
+
+    [self runBenchmark:@"blob put (mapped file)" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        NSString* name = [NSString stringWithFormat:@"file%05lu", (unsigned long)index];
+        [_client addBlobToContainer:_container blobName:name fileDescriptor:fd contentType:@"application/octet-stream" withBlock:^(NSError* error) {
+            done(fileSize, error);
+        }];
+    }];
+
+    // a file that fits in one block goes up without a block list
+    [_standIn resetCounters];
+    __block BOOL finished = NO;
+    _client.uploadBlockSize = fileSize;
+    [_client addBlobToContainer:_container blobName:@"single" fileDescriptor:fd contentType:@"application/octet-stream" withBlock:^(NSError* error) {
+        XCTAssertNil(error);
+        finished = YES;
+    }];
+    [self waitFor:^BOOL{ return finished; } timeout:30];
+    XCTAssertEqual(_standIn.requestCount, (NSUInteger)1);
+
+    close(fd);
+    [[NSFileManager defaultManager] removeItemAtPath:path error:nil];
+}
+
+- (void)testCachedBlobDownload
+{
+    NSString* directory = [NSTemporaryDirectory() stringByAppendingPathComponent:[[NSUUID UUID] UUIDString]];
+    BlobCache* cache = [[BlobCache alloc] initWithDirectory:directory capacity:64 * 1024 * 1024];
+    Blob* blob = [self listedBlob];
+    _client.blobCache = cache;
+
+    __block NSData* first = nil;
+    [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+        first = data;
+    }];
+    XCTAssertTrue([self waitFor:^BOOL{ return first && cache.blobCount == 1; } timeout:30]);
+    XCTAssertEqual(cache.missCount, (NSUInteger)1);
+
+    [self runBenchmark:@"cached blob get" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+            done([data length], [self resultError:error matched:[data isEqualToData:first]]);
+        }];
+    }];
+
+    XCTAssertEqual(cache.hitCount, _operations);
+    XCTAssertEqual(cache.revalidationCount, _operations);
+    XCTAssertEqual(cache.missCount, (NSUInteger)1);
+
+    _client.blobCache = nil;
+    [cache removeAllBlobs];
+    [[NSFileManager defaultManager] removeItemAtPath:directory error:NULL];
+}
+
+- (void)testProxySignatureCache
+{
+    __block BOOL answered = NO;
+    __block NSError* loginError = nil;
+    AuthenticationCredential* credential = [AuthenticationCredential authenticateCredentialWithProxyURL:[NSURL URLWithString:@"http://standin.cloudapp.net"] user:@"user" password:@"password" withBlock:^(NSError* error) {
+        loginError = error;
+        answered = YES;
+    }];
+    XCTAssertTrue([self waitFor:^BOOL{ return answered; } timeout:30]);
+    XCTAssertNil(loginError);
+
+    CloudStorageClient* client = [CloudStorageClient storageClientWithCredential:credential];
+    __block NSArray* listed = nil;
+    [client getBlobs:_container withBlock:^(NSArray* blobs, NSError* error) {
+        listed = blobs ? blobs : @[];
+    }];
+    XCTAssertTrue([self waitFor:^BOOL{ return listed != nil; } timeout:30]);
+    XCTAssertEqual([listed count], _standIn.listingCount);
+    Blob* blob = [listed firstObject];
+
+    NSData* content = [NSMutableData dataWithLength:_payloadSize];
+    [self runBenchmark:@"blob get/put via proxy signature" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        if(index % 2)
+        {
+            [client addBlobToContainer:_container blobName:[NSString stringWithFormat:@"upload%05lu", (unsigned long)index] contentData:content contentType:@"application/octet-stream" withBlock:^(NSError* error) {
+                done([content length], error);
+            }];
+            return;
+        }
+        [client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+            done([data length], error);
+        }];
+    }];
+
+    __block BOOL deleted = NO;
+    [client deleteBlob:blob withBlock:^(NSError* error) {
+        XCTAssertNil(error);
+        deleted = YES;
+    }];
+    XCTAssertTrue([self waitFor:^BOOL{ return deleted; } timeout:30]);
+
+    // one signature for the container, and every blob request went straight to storage with it
+    XCTAssertEqual(_standIn.signatureCount, (NSUInteger)1);
+    XCTAssertEqual(_standIn.proxiedRequestCount, (NSUInteger)0);
+}
+
+- (void)testBulkBlobDelete
+{
+    NSUInteger count = _operations * 10;
+    __block NSError* failure = nil;
+    __block BOOL finished = NO;
+
+    _standIn.listingCount = count;
+    BlobListRequest* listRequest = [BlobListRequest listRequestForContainer:_container];
+    listRequest.maxResults = 250;
+
+    BlobBulkOperation* operation = [BlobBulkOperation deleteOperationWithStorageClient:_client];
+    operation.concurrency = _concurrency * 2;
+    operation.resultBlock = ^(Blob* blob, NSError* error) {
+        XCTAssertNil(error, @"deleting %@ failed", blob.name);
+    };
+
+    CFAbsoluteTime begin = CFAbsoluteTimeGetCurrent();
+    [operation runWithListRequest:listRequest withBlock:^(NSError* error) {
+        failure = error;
+        finished = YES;
+    }];
+
+    XCTAssertTrue([self waitFor:^BOOL{ return finished; } timeout:MAX(60.0, count * 0.05)], @"%lu of %lu blobs deleted", (unsigned long)operation.succeededCount, (unsigned long)count);
+    NSTimeInterval elapsed = CFAbsoluteTimeGetCurrent() - begin;
+
+    XCTAssertNil(failure);
+    XCTAssertEqual(operation.listedCount, count);
+    XCTAssertEqual(operation.succeededCount, count);
+    XCTAssertEqual(operation.failedCount, (NSUInteger)0);
+    XCTAssertNil(operation.checkpoint, @"a finished listing leaves nothing to resume");
+    NSLog(@"[bench] bulk delete: %lu blobs in %.3fs, %.1f blobs/s, %lu requests", (unsigned long)count, elapsed, count / elapsed, (unsigned long)_standIn.requestCount);
+}
+
+- (void)testBulkCopyResumesFromCheckpoint
+{
+    NSUInteger count = 400;
+    NSUInteger stopAfter = 120;
+    NSMutableSet* copied = [NSMutableSet setWithCapacity:count];
+    __block NSError* failure = nil;
+    __block BOOL finished = NO;
+
+    _standIn.listingCount = count;
+    _standIn.latency = 0.005;
+    BlobContainer* archive = [[BlobContainer alloc] initContainerWithName:@"archive" URL:@"http://benchaccount.blob.core.windows.net/archive" metadata:nil];
+
+    BlobBulkOperation* operation = [BlobBulkOperation copyOperationWithStorageClient:_client toContainer:archive];
+    __weak BlobBulkOperation* weakOperation = operation;
+    operation.concurrency = 4;
+    operation.resultBlock = ^(Blob* blob, NSError* error) {
+        XCTAssertNil(error, @"copying %@ failed", blob.name);
+        [copied addObject:blob.name];
+        if(copied.count == stopAfter)
+        {
+            [weakOperation stop];
+        }
+    };
+
+    BlobListRequest* listRequest = [BlobListRequest listRequestForContainer:_container];
+    listRequest.maxResults = 50;
+    [operation runWithListRequest:listRequest withBlock:^(NSError* error) {
+        failure = error;
+        finished = YES;
+    }];
+    XCTAssertTrue([self waitFor:^BOOL{ return finished; } timeout:30]);
+    XCTAssertEqual([failure code], (NSInteger)NSURLErrorCancelled);
+
+    // everything listed ahead of the checkpoint was copied before the stop
+    NSString* checkpoint = operation.checkpoint;
+    XCTAssertNotNil(checkpoint);
+    NSUInteger resumeIndex = (NSUInteger)[[checkpoint substringFromIndex:4] integerValue];
+    XCTAssertGreaterThan(resumeIndex, (NSUInteger)0);
+    XCTAssertLessThanOrEqual(resumeIndex, stopAfter);
+    for(NSUInteger index = 0; index < resumeIndex; index++)
+    {
+        XCTAssertTrue([copied containsObject:[NSString stringWithFormat:@"blob%05lu", (unsigned long)index]]);
+    }
+
+    finished = NO;
+    listRequest.marker = checkpoint;
+    [operation runWithListRequest:listRequest withBlock:^(NSError* error) {
+        failure = error;
+        finished = YES;
+    }];
+    XCTAssertTrue([self waitFor:^BOOL{ return finished; } timeout:30]);
+
+    XCTAssertNil(failure);
+    XCTAssertEqual(operation.listedCount, count - resumeIndex, @"the second run should list from the checkpoint on");
+    XCTAssertEqual(copied.count, count);
+    XCTAssertNil(operation.checkpoint);
+}
+
+#pragma mark Queue
+
+- (void)testQueueGetAndDelete
+{
+    [self runBenchmark:@"queue get+delete" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getQueueMessage:@"benchqueue" withBlock:^(QueueMessage* message, NSError* error) {
+            if(error)
+            {
+                done(0, error);
+                return;
+            }
+            [_client deleteQueueMessage:message queueName:@"benchqueue" withBlock:^(NSError* error) {
+                done(0, error);
+            }];
+        }];
+    }];
+}
+
+- (void)testQueueMessagePump
+{
+    NSUInteger count = _operations * 10;
+    __block NSUInteger handled = 0;
+    __block BOOL stopped = NO;
+
+    QueueMessagePump* pump = [QueueMessagePump pumpWithStorageClient:_client queueName:@"benchqueue"];
+    __weak QueueMessagePump* weakPump = pump;
+    pump.concurrency = _concurrency;
+    pump.errorBlock = ^(QueueMessage* message, NSError* error) {
+        XCTFail(@"pump failed: %@", error);
+    };
+
+    CFAbsoluteTime begin = CFAbsoluteTimeGetCurrent();
+    [pump startWithHandler:^(QueueMessage* message, void (^done)(BOOL)) {
+        done(YES);
+        if(++handled == count)
+        {
+            [weakPump stopWithBlock:^{ stopped = YES; }];
+        }
+    }];
+
+    XCTAssertTrue([self waitFor:^BOOL{ return stopped; } timeout:120], @"the pump handled %lu of %lu messages", (unsigned long)handled, (unsigned long)count);
+    NSTimeInterval elapsed = CFAbsoluteTimeGetCurrent() - begin;
+    NSLog(@"[bench] queue pump: %lu messages in %.3fs, %.1f msgs/s, %lu requests", (unsigned long)handled, elapsed, handled / elapsed, (unsigned long)_standIn.requestCount);
+}
+
+#pragma mark Table
+
+- (void)testTableQuery
+{
+    TableFetchRequest* fetchRequest = [TableFetchRequest fetchRequestForTable:@"benchtable"];
+
+    [self runBenchmark:@"table query" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getEntities:fetchRequest withBlock:^(NSArray* entities, NSError* error) {
+            done(0, [self resultError:error matched:[entities count] == _standIn.listingCount]);
+        }];
+    }];
+}
+
+- (void)testTableQueryIntoColumns
+{
+    TableFetchRequest* fetchRequest = [TableFetchRequest fetchRequestForTable:@"benchtable"];
+
+    [self runBenchmark:@"table query (columns)" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getEntityResults:fetchRequest withBlock:^(TableResultSet* results, NSError* error) {
+            done(0, [self resultError:error matched:results.count == _standIn.listingCount]);
+        }];
+    }];
+}
+
+- (void)testTableQueryJSON
+{
+    TableFetchRequest* fetchRequest = [TableFetchRequest fetchRequestForTable:@"benchtable"];
+    _client.tableFormat = CloudTableFormatJSON;
+
+    [self runBenchmark:@"table query (json)" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getEntities:fetchRequest withBlock:^(NSArray* entities, NSError* error) {
+            done(0, [self resultError:error matched:[entities count] == _standIn.listingCount]);
+        }];
+    }];
+}
+
+- (void)testPartitionFanOutQuery
+{
+    // half of the 16 partitions the stand-in spreads its entities over
+    NSMutableArray* partitions = [NSMutableArray array];
+    for(NSUInteger partition = 0; partition < 8; partition++)
+    {
+        [partitions addObject:[NSString stringWithFormat:@"p%02lu", (unsigned long)partition]];
+    }
+    NSUInteger expected = 0;
+    NSUInteger count = _standIn.listingCount;
+    for(NSUInteger index = 0; index < count; index++)
+    {
+        expected += (index % 16 < 8) ? 1 : 0;
+    }
+
+    TableFetchRequest* planned = [TableFetchRequest fetchRequestForTable:@"benchtable" predicate:[NSPredicate predicateWithFormat:@"PartitionKey IN %@", partitions] error:NULL];
+    XCTAssertEqual([planned.queries count], [partitions count]);
+    NSUInteger operations = MAX(_operations / 10, (NSUInteger)1);
+
+    [self runBenchmark:@"table partition scan (serial)" operations:operations concurrency:1 operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        __block NSUInteger next = 0;
+        __block NSUInteger total = 0;
+        __block void (^fetchNext)(void);
+        fetchNext = ^{
+            NSPredicate* predicate = [NSPredicate predicateWithFormat:@"PartitionKey == %@", [partitions objectAtIndex:next++]];
+            [_client getEntities:[TableFetchRequest fetchRequestForTable:@"benchtable" predicate:predicate error:NULL] withBlock:^(NSArray* entities, NSError* error) {
+                total += [entities count];
+                if(error || next == [partitions count])
+                {
+                    fetchNext = nil;
+                    done(0, [self resultError:error matched:total == expected]);
+                    return;
+                }
+                fetchNext();
+            }];
+        };
+        fetchNext();
+    }];
+
+    [self runBenchmark:@"table partition scan (planned)" operations:operations concurrency:1 operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getEntities:planned withBlock:^(NSArray* entities, NSError* error) {
+            done(0, [self resultError:error matched:[entities count] == expected]);
+        }];
+    }];
+}
+
+- (void)testResidualQuery
+{
+    // the ENDSWITH is checked on the entities the two partition queries bring back
+    __block NSArray* matched = nil;
+    TableFetchRequest* request = [TableFetchRequest fetchRequestForTable:@"benchtable" predicate:[NSPredicate predicateWithFormat:@"PartitionKey IN {'p01', 'p02'} AND Name ENDSWITH '7'"] error:NULL];
+    [_client getEntities:request withBlock:^(NSArray* entities, NSError* error) {
+        XCTAssertNil(error);
+        matched = entities ? entities : @[];
+    }];
+    XCTAssertTrue([self waitFor:^BOOL{ return matched != nil; } timeout:10]);
+
+    NSUInteger expected = 0;
+    NSUInteger count = _standIn.listingCount;
+    for(NSUInteger index = 0; index < count; index++)
+    {
+        expected += ((index % 16 == 1 || index % 16 == 2) && index % 10 == 7) ? 1 : 0;
+    }
+    XCTAssertEqual([matched count], expected);
+}
+
+- (void)testTableInsert
+{
+    [self runBenchmark:@"table insert" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        TableEntity* entity = [TableEntity createEntityForTable:@"benchtable"];
+        entity.partitionKey = @"p00";
+        entity.rowKey = [NSString stringWithFormat:@"r%06lu", (unsigned long)index];
+        [entity setValue:@"inserted" forKey:@"Name"];
+        [_client insertEntity:entity withBlock:^(NSError* error) {
+            done(0, error);
+        }];
+    }];
+}
+
+#pragma mark Transport
+
+- (void)testConnectionReuse
+{
+    Blob* blob = [self listedBlob];
+    [_standIn resetCounters];
+
+    [self runBenchmark:@"keep-alive get" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+            done([data length], error);
+        }];
+    }];
+
+    NSUInteger connections = _standIn.connectionCount;
+    NSLog(@"[bench] keep-alive get: %lu requests over %lu connections", (unsigned long)_standIn.requestCount, (unsigned long)connections);
+    XCTAssertEqual(_standIn.requestCount, _operations);
+    XCTAssertLessThanOrEqual(connections, [CloudRequestScheduler sharedScheduler].maxConcurrentRequestsPerHost);
+}
+
+- (void)testCallbacksOnCallbackQueue
+{
+    // a concurrent queue, to check the client still hands its callbacks over one at a time
+    dispatch_queue_t queue = dispatch_queue_create("bench.callbacks", DISPATCH_QUEUE_CONCURRENT);
+    _client.callbackQueue = queue;
+
+    __block NSInteger inside = 0;
+    __block NSInteger overlapped = 0;
+    __block NSInteger onMain = 0;
+    __block NSInteger completed = 0;
+    __block NSError* failure = nil;
+    NSUInteger count = MAX(_concurrency, (NSUInteger)4);
+
+    void (^check)(NSUInteger, NSError*) = ^(NSUInteger found, NSError* error) {
+        if(OSAtomicIncrement64((int64_t*)&inside) > 1)
+        {
+            OSAtomicIncrement64((int64_t*)&overlapped);
+        }
+        if([NSThread isMainThread])
+        {
+            OSAtomicIncrement64((int64_t*)&onMain);
+        }
+        NSError* problem = [self resultError:error matched:found == _standIn.listingCount];
+        if(problem)
+        {
+            failure = problem;
+        }
+        // long enough for another response to arrive while this one is being handled
+        usleep(2000);
+        OSAtomicDecrement64((int64_t*)&inside);
+        OSAtomicIncrement64((int64_t*)&completed);
+    };
+
+    CFAbsoluteTime begin = CFAbsoluteTimeGetCurrent();
+    for(NSUInteger index = 0; index < count; index++)
+    {
+        [_client getBlobs:_container withBlock:^(NSArray* blobs, NSError* error) {
+            check([blobs count], error);
+        }];
+        [_client getEntities:[TableFetchRequest fetchRequestForTable:@"benchtable"] withBlock:^(NSArray* entities, NSError* error) {
+            check([entities count], error);
+        }];
+    }
+
+    XCTAssertTrue([self waitFor:^BOOL{ return OSAtomicAdd64(0, (int64_t*)&completed) == (int64_t)count * 2; } timeout:60.0]);
+    NSLog(@"[bench] off-main listing and query parse: %lu responses in %.1f ms", (unsigned long)count * 2, (CFAbsoluteTimeGetCurrent() - begin) * 1000.0);
+    XCTAssertNil(failure);
+    XCTAssertEqual(onMain, (NSInteger)0, @"callbacks ran on the main thread");
+    XCTAssertEqual(overlapped, (NSInteger)0, @"callbacks of one client overlapped");
+
+    _client.callbackQueue = nil;
+}
+
+- (void)testThrottlingRetry
+{
+    Blob* blob = [self listedBlob];
+    NSUInteger failures = 5;
+    NSUInteger count = 20;
+
+    [_standIn resetCounters];
+    _standIn.failuresToInject = failures;
+
+    [self runBenchmark:@"get under throttling" operations:count concurrency:MIN(_concurrency, (NSUInteger)4) operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+            done([data length], error);
+        }];
+    }];
+
+    XCTAssertEqual(_standIn.requestCount, count + failures, @"every 503 should cost exactly one extra request");
+    XCTAssertGreaterThan([CloudRequestScheduler sharedScheduler].throttledCount, (NSUInteger)0);
+}
+
+- (void)testHedgedReads
+{
+    Blob* blob = [self listedBlob];
+    NSUInteger count = 40;
+    __block NSTimeInterval slowest = 0;
+
+    // one at a time, so it is always an original request that stalls and never its duplicate
+    _standIn.stallEvery = 10;
+    _standIn.stallLatency = 1.0;
+    _client.hedgeDelay = 0.1;
+    [_standIn resetCounters];
+
+    [self runBenchmark:@"hedged get with stalls" operations:count concurrency:1 operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        CFAbsoluteTime start = CFAbsoluteTimeGetCurrent();
+        [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+            slowest = MAX(slowest, CFAbsoluteTimeGetCurrent() - start);
+            done([data length], error);
+        }];
+    }];
+
+    XCTAssertGreaterThan(_standIn.requestCount, count, @"the stalled reads should have been hedged");
+    XCTAssertLessThan(slowest, _standIn.stallLatency * 0.8, @"a duplicate should have answered before the stall ended");
+}
+
+- (void)testRequestCancelAndDeadline
+{
+    CloudRequestScheduler* scheduler = [CloudRequestScheduler sharedScheduler];
+    Blob* blob = [self listedBlob];
+    NSMutableArray* errors = [NSMutableArray array];
+    NSError* (^errorOf)(NSUInteger) = ^NSError*(NSUInteger index) {
+        id error = [errors objectAtIndex:index];
+        return (error == [NSNull null]) ? nil : error;
+    };
+
+    _standIn.latency = 0.3;
+    // the last read waits for a slot, so cancelling it has to take it back out of the queue
+    scheduler.maxConcurrentRequestsPerHost = 1;
+
+    [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+        [errors addObject:error ? error : [NSNull null]];
+    }];
+    CloudRequestHandle* timed = [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+        [errors addObject:error ? error : [NSNull null]];
+    }];
+    CloudRequestHandle* cancelled = [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+        [errors addObject:error ? error : [NSNull null]];
+    }];
+    [timed setTimeout:0.1];
+    [cancelled cancel];
+
+    XCTAssertTrue([self waitFor:^BOOL{ return [errors count] == 3; } timeout:30]);
+    XCTAssertTrue(cancelled.isCancelled);
+    XCTAssertEqual([errorOf(0) code], (NSInteger)NSURLErrorCancelled);
+    XCTAssertEqual([errorOf(1) code], (NSInteger)NSURLErrorTimedOut);
+    XCTAssertNil(errorOf(2), @"the read holding the slot should be untouched");
+
+    // neither of the stopped reads kept a slot or a place in the queue
+    XCTAssertTrue([self waitFor:^BOOL{ return scheduler.inFlightCount == 0 && scheduler.queueDepth == 0; } timeout:5]);
+}
+
+#pragma mark Metrics
+
+- (void)testRequestMetricsBreakdown
+{
+    CloudRequestMetrics* metrics = [CloudRequestMetrics sharedMetrics];
+    Blob* blob = [self listedBlob];
+
+    [metrics reset];
+    metrics.enabled = YES;
+
+    [self runBenchmark:@"measured blob get" operations:_operations concurrency:_concurrency operation:^(NSUInteger index, void (^done)(NSUInteger, NSError*)) {
+        [_client getBlobData:blob withBlock:^(NSData* data, NSError* error) {
+            done([data length], error);
+        }];
+    }];
+
+    metrics.enabled = NO;
+
+    CloudOperationMetrics* getBlob = nil;
+    for(CloudOperationMetrics* operation in [metrics snapshot])
+    {
+        if([operation.storageType isEqualToString:@"blob"] && [operation.operation isEqualToString:@"GetBlob"])
+        {
+            getBlob = operation;
+        }
+    }
+
+    XCTAssertNotNil(getBlob);
+    XCTAssertEqual(getBlob.requestCount, _operations);
+    XCTAssertEqual(getBlob.failureCount, (NSUInteger)0);
+    XCTAssertEqual(getBlob.bytesReceived, (unsigned long long)_operations * _payloadSize);
+
+    NSArray* names = @[ @"signing", @"queued", @"retrying", @"connecting", @"first byte", @"transfer", @"parsing", @"total" ];
+    for(NSUInteger phase = 0; phase < CloudRequestPhaseCount; phase++)
+    {
+        NSLog(@"[bench] GetBlob %@: mean %.3fms, p50 %.3fms, p99 %.3fms", [names objectAtIndex:phase],
+              [getBlob meanOfPhase:(CloudRequestPhase)phase] * 1000, [getBlob percentile:0.5 ofPhase:(CloudRequestPhase)phase] * 1000,
+              [getBlob percentile:0.99 ofPhase:(CloudRequestPhase)phase] * 1000);
+    }
+}
+
+#pragma mark Components
+
+- (void)testSigningMicroBenchmark
+{
+    AuthenticationCredential* credential = [AuthenticationCredential credentialWithAzureServiceAccount:@"benchaccount" accessKey:[SimpleBase64 encode:[NSMutableData dataWithLength:64]]];
+
+    [self runMicroBenchmark:@"sign blob get" iterations:10000 bytes:0 block:^{
+        [credential authenticatedRequestWithEndpoint:@"/container/blob00001" forStorageType:@"blob", @"x-ms-range", @"bytes=0-65535", nil];
+    }];
+    [self runMicroBenchmark:@"sign table query" iterations:10000 bytes:0 block:^{
+        [credential authenticatedRequestWithEndpoint:@"benchtable()?$top=100" forStorageType:@"table", nil];
+    }];
+}
+
+- (void)testBase64MicroBenchmark
+{
+    NSMutableData* block = [NSMutableData dataWithLength:_payloadSize];
+    uint8_t* bytes = [block mutableBytes];
+    for(NSUInteger index = 0; index < [block length]; index++)
+    {
+        bytes[index] = (uint8_t)(index * 131 + 7);
+    }
+    NSString* encoded = [SimpleBase64 encode:block];
+
+    XCTAssertEqualObjects([SimpleBase64 decode:encoded], block);
+
+    [self runMicroBenchmark:@"base64 encode" iterations:1000 bytes:[block length] block:^{
+        [SimpleBase64 encode:block];
+    }];
+    [self runMicroBenchmark:@"base64 decode" iterations:1000 bytes:[block length] block:^{
+        [SimpleBase64 decode:encoded];
+    }];
+
+    // the raw codec into reused buffers, vector kernels against the scalar loop they fall back to
+    NSUInteger length = [block length];
+    char* characters = malloc(Base64EncodedLength(length));
+    uint8_t* decoded = malloc(length + 3);
+    NSUInteger encodedLength = Base64Encode(bytes, length, characters);
+
+    XCTAssertEqual(Base64Decode(characters, encodedLength, decoded), (ssize_t)length);
+    XCTAssertEqual(memcmp(decoded, bytes, length), 0);
+    XCTAssertEqual(Base64EncodeScalar(bytes, length, characters), encodedLength);
+    XCTAssertEqual(Base64DecodeScalar(characters, encodedLength, decoded), (ssize_t)length);
+    XCTAssertEqual(memcmp(decoded, bytes, length), 0);
+
+    [self runMicroBenchmark:@"base64 encode (vector, buffer)" iterations:1000 bytes:length block:^{
+        Base64Encode(bytes, length, characters);
+    }];
+    [self runMicroBenchmark:@"base64 encode (scalar, buffer)" iterations:1000 bytes:length block:^{
+        Base64EncodeScalar(bytes, length, characters);
+    }];
+    [self runMicroBenchmark:@"base64 decode (vector, buffer)" iterations:1000 bytes:length block:^{
+        Base64Decode(characters, encodedLength, decoded);
+    }];
+    [self runMicroBenchmark:@"base64 decode (scalar, buffer)" iterations:1000 bytes:length block:^{
+        Base64DecodeScalar(characters, encodedLength, decoded);
+    }];
+
+    free(characters);
+    free(decoded);
+}
+
+- (void)testListingParseMicroBenchmark
+{
+    NSData* listing = [CloudStorageStandIn blobListingWithCount:5000 payloadSize:_payloadSize];
+
+    [self runMicroBenchmark:@"blob listing DOM parse" iterations:20 bytes:[listing length] block:^{
+        xmlDocPtr doc = xmlReadMemory([listing bytes], (int)[listing length], NULL, NULL, (XML_PARSE_NOCDATA | XML_PARSE_NOBLANKS));
+        NSArray* blobs = [BlobParser loadBlobs:doc container:_container];
+        xmlFreeDoc(doc);
+        XCTAssertEqual([blobs count], (NSUInteger)5000);
+    }];
+
+    [self runMicroBenchmark:@"blob listing stream parse" iterations:20 bytes:[listing length] block:^{
+        NSMutableArray* blobs = [NSMutableArray array];
+        XmlStreamParser* parser = [[XmlStreamParser alloc] init];
+        [BlobParser addBlobRecordsToParser:parser container:_container blobs:blobs prefixes:[NSMutableArray array]];
+
+        // fed in network-sized pieces, as the connection would
+        const uint8_t* bytes = [listing bytes];
+        for(NSUInteger offset = 0; offset < [listing length]; offset += 16 * 1024)
+        {
+            [parser parseBytes:bytes + offset length:MIN((NSUInteger)(16 * 1024), [listing length] - offset)];
+        }
+        [parser finish];
+        XCTAssertEqual([blobs count], (NSUInteger)5000);
+    }];
+
+    [self runMicroBenchmark:@"blob listing compact parse" iterations:20 bytes:[listing length] block:^{
+        BlobListing* blobs = [[BlobListing alloc] initWithContainer:_container];
+        BlobListingParser* parser = [[BlobListingParser alloc] initWithListing:blobs];
+
+        const uint8_t* bytes = [listing bytes];
+        for(NSUInteger offset = 0; offset < [listing length]; offset += 16 * 1024)
+        {
+            [parser parseBytes:bytes + offset length:MIN((NSUInteger)(16 * 1024), [listing length] - offset)];
+        }
+        [parser finish];
+        XCTAssertEqual(blobs.count, (NSUInteger)5000);
+    }];
+}
+
+- (void)testEntityFeedParseMicroBenchmark
+{
+    NSData* feed = [CloudStorageStandIn entityFeedWithCount:1000];
+
+    [self runMicroBenchmark:@"entity feed DOM parse" iterations:20 bytes:[feed length] block:^{
+        __block NSUInteger count = 0;
+        xmlDocPtr doc = xmlReadMemory([feed bytes], (int)[feed length], NULL, NULL, (XML_PARSE_NOCDATA | XML_PARSE_NOBLANKS));
+        [XmlHelper parseAtomPub:doc block:^(AtomPubEntry* entry) {
+            count++;
+        }];
+        xmlFreeDoc(doc);
+        XCTAssertEqual(count, (NSUInteger)1000);
+    }];
+
+    [self runMicroBenchmark:@"entity feed stream parse" iterations:20 bytes:[feed length] block:^{
+        __block NSUInteger count = 0;
+        XmlStreamParser* parser = [[XmlStreamParser alloc] init];
+        [XmlHelper addAtomPubRecordsToParser:parser block:^(NSMutableDictionary* properties) {
+            count++;
+        }];
+        [parser parseBytes:[feed bytes] length:[feed length]];
+        [parser finish];
+        XCTAssertEqual(count, (NSUInteger)1000);
+    }];
+
+    [self runMicroBenchmark:@"entity feed column parse + scan" iterations:20 bytes:[feed length] block:^{
+        TableResultSet* results = [[TableResultSet alloc] initWithTableName:@"benchtable"];
+        TableColumnParser* parser = [[TableColumnParser alloc] initWithResultSet:results];
+        [parser parseBytes:[feed bytes] length:[feed length]];
+        [parser finish];
+
+        const int32_t* counts = [results int32ValuesOfColumn:@"Count"];
+        int64_t sum = 0;
+        for(NSUInteger row = 0; row < results.count; row++)
+        {
+            sum += counts[row];
+        }
+        XCTAssertEqual(results.count, (NSUInteger)1000);
+        XCTAssertEqual(sum, (int64_t)(999 * 1000 / 2));
+    }];
+}
+
+- (void)testEntityFeedFormatsMicroBenchmark
+{
+    NSData* atom = [CloudStorageStandIn entityFeedWithCount:1000];
+    NSData* json = [CloudStorageStandIn entityJSONWithCount:1000];
+    NSLog(@"[bench] 1000 entities on the wire: atom %lu bytes, json %lu bytes (%.0f%%)",
+          (unsigned long)[atom length], (unsigned long)[json length], 100.0 * [json length] / [atom length]);
+
+    [self runMicroBenchmark:@"entity feed atom stream parse" iterations:20 bytes:[atom length] block:^{
+        __block NSUInteger count = 0;
+        XmlStreamParser* parser = [[XmlStreamParser alloc] init];
+        [XmlHelper addAtomPubRecordsToParser:parser block:^(NSMutableDictionary* properties) {
+            count++;
+        }];
+        [parser parseBytes:[atom bytes] length:[atom length]];
+        [parser finish];
+        XCTAssertEqual(count, (NSUInteger)1000);
+    }];
+
+    [self runMicroBenchmark:@"entity feed json stream parse" iterations:20 bytes:[json length] block:^{
+        __block NSUInteger count = 0;
+        JsonStreamParser* parser = [[JsonStreamParser alloc] init];
+        [parser addRecordArray:@"value" block:^(NSMutableDictionary* properties) {
+            count++;
+        }];
+        [parser parseBytes:[json bytes] length:[json length]];
+        [parser finish];
+        XCTAssertEqual(count, (NSUInteger)1000);
+    }];
+}
+
+- (void)testPropertyStringMicroBenchmark
+{
+    TableEntity* entity = [TableEntity createEntityForTable:@"benchtable"];
+    entity.partitionKey = @"partition";
+    entity.rowKey = @"row";
+    for(NSUInteger index = 0; index < 20; index++)
+    {
+        [entity setValue:[NSString stringWithFormat:@"value <%lu> & more", (unsigned long)index] forKey:[NSString stringWithFormat:@"Column%02lu", (unsigned long)index]];
+    }
+
+    [self runMicroBenchmark:@"entity propertyString" iterations:10000 bytes:0 block:^{
+        [entity propertyString];
+    }];
+
+    [self runMicroBenchmark:@"entity jsonBody" iterations:10000 bytes:0 block:^{
+        [entity jsonBody];
+    }];
+}
+
+@end
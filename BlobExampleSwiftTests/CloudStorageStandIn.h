@@ -0,0 +1,81 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "CloudTransport.h"
+
+@class CloudPooledTransport;
+
+// An in-process HTTP/1.1 server on 127.0.0.1 that answers the blob, queue and table REST calls the
+// storage client makes with canned XML, Atom and JSON bodies, as well as proxy logins and requests
+// for container signatures. Connections are kept alive, so the counters
+// show how many sockets the client really opened for the requests it sent.
+@interface CloudStorageStandIn : NSObject
+
+// The port the server is listening on, once started.
+@property (readonly) uint16_t port;
+// The tunables below are read on the stand-in's own queue, so their accessors hop onto it and may be
+// changed from the test thread while requests are in flight.
+// Delay added before each response is written.
+@property (assign) NSTimeInterval latency;
+// Every stallEvery-th request waits stallLatency rather than latency, standing in for a slow outlier.
+@property (assign) NSUInteger stallEvery;
+@property (assign) NSTimeInterval stallLatency;
+// Number of containers, blobs, queue messages or table entities returned by a listing.
+@property (assign) NSUInteger listingCount;
+// Size of each blob's content.
+@property (assign) NSUInteger payloadSize;
+// The next this many requests are answered with 503 Server Busy.
+@property (assign) NSUInteger failuresToInject;
+// When set, blob writes signed with SharedKey are checked against this account key the way the service
+// checks them: the standard header lines, the canonicalized x-ms-* headers and the resource with its
+// comp parameter. A mismatch is answered with 403 AuthenticationFailed.
+@property (copy) NSData* sharedKey;
+// Blobs whose delete is answered with 404 BlobNotFound, as if something else got there first.
+@property (copy) NSSet* missingBlobNames;
+// The headers of the last blob PUT or DELETE, with lower-case names.
+@property (readonly) NSDictionary* lastWriteHeaders;
+@property (readonly) NSUInteger connectionCount;
+@property (readonly) NSUInteger requestCount;
+// Shared access signatures handed out by the proxy's SharedAccessSignatureService, and requests that
+// carried a proxy AuthToken to anything other than the proxy's own login and signature services.
+@property (readonly) NSUInteger signatureCount;
+@property (readonly) NSUInteger proxiedRequestCount;
+
+- (BOOL)start;
+- (void)stop;
+- (void)resetCounters;
+
+// The bodies the server sends, for parser benchmarks that don't need the network.
++ (NSData*)blobListingWithCount:(NSUInteger)count payloadSize:(NSUInteger)payloadSize;
++ (NSData*)queueMessagesWithCount:(NSUInteger)count;
+// Entities are spread over partitions p00 to p15; a partition limits the feed to one of them.
++ (NSData*)entityFeedWithCount:(NSUInteger)count;
++ (NSData*)entityFeedWithCount:(NSUInteger)count partition:(NSString*)partition;
++ (NSData*)entityJSONWithCount:(NSUInteger)count;
++ (NSData*)entityJSONWithCount:(NSUInteger)count partition:(NSString*)partition;
+
+@end
+
+// Sends every request to a stand-in instead of the storage account it was signed for. The service
+// named in the original host travels in a header so one port can serve blobs, queues and tables.
+@interface CloudStandInTransport : NSObject <CloudTransport>
+
+@property (readonly) CloudPooledTransport* pooledTransport;
+
+- (id)initWithStandIn:(CloudStorageStandIn*)standIn;
+
+@end
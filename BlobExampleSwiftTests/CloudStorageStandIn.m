@@ -0,0 +1,1084 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "CloudStorageStandIn.h"
+#import "CloudPooledTransport.h"
+#import "SimpleBase64.h"
+#import <CommonCrypto/CommonHMAC.h>
+#import <sys/socket.h>
+#import <netinet/in.h>
+#import <netinet/tcp.h>
+#import <arpa/inet.h>
+#import <fcntl.h>
+#import <unistd.h>
+
+static NSString* const StandInDate = @"Sat, 17 Oct 2026 00:00:00 GMT";
+static NSString* const StandInTimestamp = @"2026-10-17T00:00:00.0000000Z";
+
+static NSString* QueryValue(NSString* query, NSString* name)
+{
+    for(NSString* pair in [query componentsSeparatedByString:@"&"])
+    {
+        NSRange equals = [pair rangeOfString:@"="];
+        NSString* key = (equals.location == NSNotFound) ? pair : [pair substringToIndex:equals.location];
+        if([key isEqualToString:name])
+        {
+            return (equals.location == NSNotFound) ? @"" : [[pair substringFromIndex:NSMaxRange(equals)] stringByRemovingPercentEncoding];
+        }
+    }
+    return nil;
+}
+
+#pragma mark -
+
+@interface StandInConnection : NSObject
+{
+@public
+    int _fd;
+    dispatch_source_t _source;
+    NSMutableData* _buffer;
+    BOOL _busy;
+    BOOL _closed;
+}
+@end
+
+@implementation StandInConnection
+@end
+
+@interface StandInRequest : NSObject
+@property (copy) NSString* method;
+@property (copy) NSString* path;
+@property (copy) NSString* query;
+@property (strong) NSDictionary* headers;
+@property (strong) NSData* body;
+@end
+
+@implementation StandInRequest
+@end
+
+#pragma mark -
+
+@implementation CloudStorageStandIn
+{
+    dispatch_queue_t _queue;
+    dispatch_source_t _listenSource;
+    NSMutableSet* _connections;
+    NSData* _payload;
+    NSUInteger _connectionCount;
+    NSUInteger _requestCount;
+    NSUInteger _signatureCount;
+    NSUInteger _proxiedRequestCount;
+    NSUInteger _messageSerial;
+    NSTimeInterval _latency;
+    NSUInteger _stallEvery;
+    NSTimeInterval _stallLatency;
+    NSUInteger _listingCount;
+    NSUInteger _payloadSize;
+    NSUInteger _failuresToInject;
+    NSData* _sharedKey;
+    NSSet* _missingBlobNames;
+    NSDictionary* _lastWriteHeaders;
+}
+
+@synthesize port = _port;
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        _queue = dispatch_queue_create("CloudStorageStandIn", DISPATCH_QUEUE_SERIAL);
+        _connections = [NSMutableSet set];
+        _listingCount = 100;
+        _payloadSize = 64 * 1024;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [self stop];
+}
+
+#pragma mark Tunables
+
+- (NSTimeInterval)latency
+{
+    __block NSTimeInterval value;
+    dispatch_sync(_queue, ^{ value = _latency; });
+    return value;
+}
+
+- (void)setLatency:(NSTimeInterval)latency
+{
+    dispatch_sync(_queue, ^{ _latency = latency; });
+}
+
+- (NSUInteger)stallEvery
+{
+    __block NSUInteger value;
+    dispatch_sync(_queue, ^{ value = _stallEvery; });
+    return value;
+}
+
+- (void)setStallEvery:(NSUInteger)stallEvery
+{
+    dispatch_sync(_queue, ^{ _stallEvery = stallEvery; });
+}
+
+- (NSTimeInterval)stallLatency
+{
+    __block NSTimeInterval value;
+    dispatch_sync(_queue, ^{ value = _stallLatency; });
+    return value;
+}
+
+- (void)setStallLatency:(NSTimeInterval)stallLatency
+{
+    dispatch_sync(_queue, ^{ _stallLatency = stallLatency; });
+}
+
+- (NSUInteger)listingCount
+{
+    __block NSUInteger value;
+    dispatch_sync(_queue, ^{ value = _listingCount; });
+    return value;
+}
+
+- (void)setListingCount:(NSUInteger)listingCount
+{
+    dispatch_sync(_queue, ^{ _listingCount = listingCount; });
+}
+
+- (NSUInteger)payloadSize
+{
+    __block NSUInteger value;
+    dispatch_sync(_queue, ^{ value = _payloadSize; });
+    return value;
+}
+
+- (void)setPayloadSize:(NSUInteger)payloadSize
+{
+    dispatch_sync(_queue, ^{ _payloadSize = payloadSize; });
+}
+
+- (NSUInteger)failuresToInject
+{
+    __block NSUInteger value;
+    dispatch_sync(_queue, ^{ value = _failuresToInject; });
+    return value;
+}
+
+- (void)setFailuresToInject:(NSUInteger)failuresToInject
+{
+    dispatch_sync(_queue, ^{ _failuresToInject = failuresToInject; });
+}
+
+- (NSData*)sharedKey
+{
+    __block NSData* value;
+    dispatch_sync(_queue, ^{ value = _sharedKey; });
+    return value;
+}
+
+- (void)setSharedKey:(NSData*)sharedKey
+{
+    dispatch_sync(_queue, ^{ _sharedKey = [sharedKey copy]; });
+}
+
+- (NSSet*)missingBlobNames
+{
+    __block NSSet* value;
+    dispatch_sync(_queue, ^{ value = _missingBlobNames; });
+    return value;
+}
+
+- (void)setMissingBlobNames:(NSSet*)missingBlobNames
+{
+    dispatch_sync(_queue, ^{ _missingBlobNames = [missingBlobNames copy]; });
+}
+
+#pragma mark Counters
+
+- (NSUInteger)connectionCount
+{
+    __block NSUInteger count;
+    dispatch_sync(_queue, ^{ count = _connectionCount; });
+    return count;
+}
+
+- (NSUInteger)requestCount
+{
+    __block NSUInteger count;
+    dispatch_sync(_queue, ^{ count = _requestCount; });
+    return count;
+}
+
+- (NSUInteger)signatureCount
+{
+    __block NSUInteger count;
+    dispatch_sync(_queue, ^{ count = _signatureCount; });
+    return count;
+}
+
+- (NSUInteger)proxiedRequestCount
+{
+    __block NSUInteger count;
+    dispatch_sync(_queue, ^{ count = _proxiedRequestCount; });
+    return count;
+}
+
+- (NSDictionary*)lastWriteHeaders
+{
+    __block NSDictionary* headers;
+    dispatch_sync(_queue, ^{ headers = _lastWriteHeaders; });
+    return headers;
+}
+
+- (void)resetCounters
+{
+    dispatch_sync(_queue, ^{
+        _connectionCount = 0;
+        _requestCount = 0;
+        _signatureCount = 0;
+        _proxiedRequestCount = 0;
+    });
+}
+
+#pragma mark Listening
+
+- (BOOL)start
+{
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    if(fd < 0)
+    {
+        return NO;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+    struct sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_len = sizeof(address);
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+
+    socklen_t length = sizeof(address);
+    if(bind(fd, (struct sockaddr*)&address, sizeof(address)) != 0 ||
+       listen(fd, 128) != 0 ||
+       getsockname(fd, (struct sockaddr*)&address, &length) != 0)
+    {
+        close(fd);
+        return NO;
+    }
+
+    _port = ntohs(address.sin_port);
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+    __weak CloudStorageStandIn* weakSelf = self;
+    _listenSource = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0, _queue);
+    dispatch_source_set_event_handler(_listenSource, ^{
+        [weakSelf acceptConnectionsOn:fd];
+    });
+    dispatch_source_set_cancel_handler(_listenSource, ^{
+        close(fd);
+    });
+    dispatch_resume(_listenSource);
+
+    return YES;
+}
+
+- (void)stop
+{
+    dispatch_sync(_queue, ^{
+        if(_listenSource)
+        {
+            dispatch_source_cancel(_listenSource);
+            _listenSource = nil;
+        }
+        for(StandInConnection* connection in _connections)
+        {
+            connection->_closed = YES;
+            dispatch_source_cancel(connection->_source);
+        }
+        [_connections removeAllObjects];
+    });
+}
+
+- (void)acceptConnectionsOn:(int)listenFd
+{
+    for(;;)
+    {
+        int fd = accept(listenFd, NULL, NULL);
+        if(fd < 0)
+        {
+            return;
+        }
+
+        // accepted sockets inherit O_NONBLOCK on Darwin; responses are written with plain blocking writes
+        fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+
+        StandInConnection* connection = [[StandInConnection alloc] init];
+        connection->_fd = fd;
+        connection->_buffer = [NSMutableData data];
+        connection->_source = dispatch_source_create(DISPATCH_SOURCE_TYPE_READ, fd, 0, _queue);
+
+        __weak CloudStorageStandIn* weakSelf = self;
+        __unsafe_unretained StandInConnection* weakConnection = connection;
+        dispatch_source_set_event_handler(connection->_source, ^{
+            [weakSelf readFromConnection:weakConnection];
+        });
+        dispatch_source_set_cancel_handler(connection->_source, ^{
+            close(fd);
+        });
+
+        [_connections addObject:connection];
+        _connectionCount++;
+        dispatch_resume(connection->_source);
+    }
+}
+
+- (void)closeConnection:(StandInConnection*)connection
+{
+    if(connection->_closed)
+    {
+        return;
+    }
+    connection->_closed = YES;
+    dispatch_source_cancel(connection->_source);
+    [_connections removeObject:connection];
+}
+
+- (void)readFromConnection:(StandInConnection*)connection
+{
+    uint8_t bytes[64 * 1024];
+    ssize_t count = read(connection->_fd, bytes, sizeof(bytes));
+
+    if(count <= 0)
+    {
+        if(count < 0 && errno == EINTR)
+        {
+            return;
+        }
+        [self closeConnection:connection];
+        return;
+    }
+
+    [connection->_buffer appendBytes:bytes length:count];
+    [self serviceConnection:connection];
+}
+
+#pragma mark HTTP framing
+
+- (NSData*)chunkedBodyFromBuffer:(NSData*)buffer offset:(NSUInteger)offset consumed:(NSUInteger*)consumed
+{
+    NSMutableData* body = [NSMutableData data];
+    NSData* crlf = [@"\r\n" dataUsingEncoding:NSASCIIStringEncoding];
+
+    for(;;)
+    {
+        NSRange line = [buffer rangeOfData:crlf options:0 range:NSMakeRange(offset, [buffer length] - offset)];
+        if(line.location == NSNotFound)
+        {
+            return nil;
+        }
+
+        NSString* size = [[NSString alloc] initWithBytes:(const uint8_t*)[buffer bytes] + offset length:line.location - offset encoding:NSASCIIStringEncoding];
+        unsigned long long length = strtoull([size UTF8String], NULL, 16);
+        NSUInteger start = NSMaxRange(line);
+
+        if([buffer length] < start + length + 2)
+        {
+            return nil;
+        }
+
+        offset = start + (NSUInteger)length + 2;
+        if(length == 0)
+        {
+            *consumed = offset;
+            return body;
+        }
+        [body appendBytes:(const uint8_t*)[buffer bytes] + start length:(NSUInteger)length];
+    }
+}
+
+- (StandInRequest*)takeRequestFromConnection:(StandInConnection*)connection
+{
+    NSMutableData* buffer = connection->_buffer;
+    NSRange end = [buffer rangeOfData:[@"\r\n\r\n" dataUsingEncoding:NSASCIIStringEncoding] options:0 range:NSMakeRange(0, [buffer length])];
+    if(end.location == NSNotFound)
+    {
+        return nil;
+    }
+
+    NSString* head = [[NSString alloc] initWithBytes:[buffer bytes] length:end.location encoding:NSUTF8StringEncoding];
+    NSArray* lines = [head componentsSeparatedByString:@"\r\n"];
+    NSArray* requestLine = [[lines firstObject] componentsSeparatedByString:@" "];
+    if([requestLine count] < 2)
+    {
+        [self closeConnection:connection];
+        return nil;
+    }
+
+    NSMutableDictionary* headers = [NSMutableDictionary dictionaryWithCapacity:[lines count]];
+    for(NSUInteger index = 1; index < [lines count]; index++)
+    {
+        NSString* line = [lines objectAtIndex:index];
+        NSRange colon = [line rangeOfString:@":"];
+        if(colon.location != NSNotFound)
+        {
+            NSString* value = [[line substringFromIndex:NSMaxRange(colon)] stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceCharacterSet]];
+            [headers setObject:value forKey:[[line substringToIndex:colon.location] lowercaseString]];
+        }
+    }
+
+    NSData* body;
+    NSUInteger consumed;
+    if([[[headers objectForKey:@"transfer-encoding"] lowercaseString] isEqualToString:@"chunked"])
+    {
+        body = [self chunkedBodyFromBuffer:buffer offset:NSMaxRange(end) consumed:&consumed];
+        if(!body)
+        {
+            return nil;
+        }
+    }
+    else
+    {
+        NSUInteger length = (NSUInteger)[[headers objectForKey:@"content-length"] longLongValue];
+        consumed = NSMaxRange(end) + length;
+        if([buffer length] < consumed)
+        {
+            return nil;
+        }
+        body = [buffer subdataWithRange:NSMakeRange(NSMaxRange(end), length)];
+    }
+    [buffer replaceBytesInRange:NSMakeRange(0, consumed) withBytes:NULL length:0];
+
+    NSString* target = [requestLine objectAtIndex:1];
+    NSRange question = [target rangeOfString:@"?"];
+
+    StandInRequest* request = [[StandInRequest alloc] init];
+    request.method = [requestLine objectAtIndex:0];
+    request.path = (question.location == NSNotFound) ? target : [target substringToIndex:question.location];
+    request.query = (question.location == NSNotFound) ? @"" : [target substringFromIndex:NSMaxRange(question)];
+    request.headers = headers;
+    request.body = body;
+    return request;
+}
+
+- (void)serviceConnection:(StandInConnection*)connection
+{
+    if(connection->_busy || connection->_closed)
+    {
+        return;
+    }
+
+    StandInRequest* request = [self takeRequestFromConnection:connection];
+    if(!request)
+    {
+        return;
+    }
+
+    _requestCount++;
+    connection->_busy = YES;
+
+    NSData* response = [self responseForRequest:request];
+    void (^write)(void) = ^{
+        if(!connection->_closed)
+        {
+            const uint8_t* bytes = [response bytes];
+            NSUInteger remaining = [response length];
+            while(remaining > 0)
+            {
+                ssize_t written = write(connection->_fd, bytes, remaining);
+                if(written < 0)
+                {
+                    if(errno == EINTR)
+                    {
+                        continue;
+                    }
+                    [self closeConnection:connection];
+                    return;
+                }
+                bytes += written;
+                remaining -= written;
+            }
+        }
+        connection->_busy = NO;
+        [self serviceConnection:connection];
+    };
+
+    NSTimeInterval latency = (_stallEvery > 0 && _requestCount % _stallEvery == 0) ? _stallLatency : _latency;
+    if(latency > 0)
+    {
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(latency * NSEC_PER_SEC)), _queue, write);
+    }
+    else
+    {
+        write();
+    }
+}
+
+- (NSData*)responseWithStatus:(NSInteger)status headers:(NSDictionary*)headers body:(NSData*)body
+{
+    NSMutableString* head = [NSMutableString stringWithFormat:@"HTTP/1.1 %ld %@\r\n", (long)status, [NSHTTPURLResponse localizedStringForStatusCode:status]];
+    [head appendFormat:@"Content-Length: %lu\r\n", (unsigned long)[body length]];
+    [head appendFormat:@"Date: %@\r\n", StandInDate];
+    [head appendString:@"Connection: keep-alive\r\n"];
+    for(NSString* name in headers)
+    {
+        [head appendFormat:@"%@: %@\r\n", name, [headers objectForKey:name]];
+    }
+    [head appendString:@"\r\n"];
+
+    NSMutableData* response = [NSMutableData dataWithData:[head dataUsingEncoding:NSUTF8StringEncoding]];
+    if(body)
+    {
+        [response appendData:body];
+    }
+    return response;
+}
+
+- (NSData*)xmlResponse:(NSData*)body
+{
+    return [self responseWithStatus:200 headers:@{ @"Content-Type" : @"application/xml" } body:body];
+}
+
+#pragma mark Canned responses
+
+- (NSString*)baseURL
+{
+    return [NSString stringWithFormat:@"http://127.0.0.1:%u", _port];
+}
+
+- (NSData*)payload
+{
+    if([_payload length] != _payloadSize)
+    {
+        NSMutableData* payload = [NSMutableData dataWithLength:_payloadSize];
+        uint8_t* bytes = [payload mutableBytes];
+        for(NSUInteger index = 0; index < _payloadSize; index++)
+        {
+            bytes[index] = (uint8_t)(index * 31);
+        }
+        _payload = payload;
+    }
+    return _payload;
+}
+
+- (NSData*)blobContentForRequest:(StandInRequest*)request
+{
+    NSData* payload = [self payload];
+    NSDictionary* headers = @{ @"Content-Type" : @"application/octet-stream",
+                               @"ETag" : @"\"0x8D0000000000000\"",
+                               @"Last-Modified" : StandInDate,
+                               @"x-ms-blob-type" : @"BlockBlob" };
+
+    if([[request.headers objectForKey:@"if-none-match"] isEqualToString:[headers objectForKey:@"ETag"]])
+    {
+        return [self responseWithStatus:304 headers:@{ @"ETag" : [headers objectForKey:@"ETag"] } body:nil];
+    }
+
+    NSString* ifMatch = [request.headers objectForKey:@"if-match"];
+    if(ifMatch && ![ifMatch isEqualToString:[headers objectForKey:@"ETag"]])
+    {
+        NSString* xml = @"<?xml version=\"1.0\" encoding=\"utf-8\"?><Error><Code>ConditionNotMet</Code><Message>The condition specified using HTTP conditional header(s) is not met.</Message></Error>";
+        return [self responseWithStatus:412 headers:@{ @"Content-Type" : @"application/xml" } body:[xml dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+
+    NSString* range = [request.headers objectForKey:@"x-ms-range"];
+    if(!range)
+    {
+        range = [request.headers objectForKey:@"range"];
+    }
+    if(![range hasPrefix:@"bytes="])
+    {
+        return [self responseWithStatus:200 headers:headers body:([request.method isEqualToString:@"HEAD"] ? nil : payload)];
+    }
+
+    NSArray* bounds = [[range substringFromIndex:6] componentsSeparatedByString:@"-"];
+    unsigned long long first = [[bounds firstObject] longLongValue];
+    unsigned long long last = ([bounds count] > 1 && [[bounds objectAtIndex:1] length]) ? [[bounds objectAtIndex:1] longLongValue] : [payload length] - 1;
+    if(first >= [payload length])
+    {
+        return [self responseWithStatus:416 headers:nil body:nil];
+    }
+    last = MIN(last, [payload length] - 1);
+
+    NSMutableDictionary* partial = [NSMutableDictionary dictionaryWithDictionary:headers];
+    [partial setObject:[NSString stringWithFormat:@"bytes %llu-%llu/%lu", first, last, (unsigned long)[payload length]] forKey:@"Content-Range"];
+    return [self responseWithStatus:206 headers:partial body:[payload subdataWithRange:NSMakeRange((NSUInteger)first, (NSUInteger)(last - first + 1))]];
+}
+
+- (NSData*)errorResponseWithStatus:(NSInteger)status code:(NSString*)code message:(NSString*)message
+{
+    NSString* xml = [NSString stringWithFormat:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><Error><Code>%@</Code><Message>%@</Message></Error>", code, message];
+    return [self responseWithStatus:status headers:@{ @"Content-Type" : @"application/xml" } body:[xml dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+// Recomputes a SharedKey signature for a blob request from what arrived on the wire. Requests that
+// aren't signed with a shared key, such as those carrying a SAS, pass.
+- (BOOL)hasValidSharedKey:(StandInRequest*)request
+{
+    NSDictionary* headers = request.headers;
+    NSString* authorization = [headers objectForKey:@"authorization"];
+    if(!_sharedKey || ![authorization hasPrefix:@"SharedKey "])
+    {
+        return YES;
+    }
+
+    NSString* credential = [authorization substringFromIndex:10];
+    NSRange colon = [credential rangeOfString:@":"];
+    if(colon.location == NSNotFound)
+    {
+        return NO;
+    }
+
+    // the client signs the length of the empty body it gives writes, which the transport may not send
+    // as a header; and CFNetwork gives a body sent without a Content-Type a form type of its own
+    NSString* contentLength = [headers objectForKey:@"content-length"];
+    if(!contentLength && ([request.method isEqualToString:@"PUT"] || [request.method isEqualToString:@"DELETE"]))
+    {
+        contentLength = [NSString stringWithFormat:@"%lu", (unsigned long)[request.body length]];
+    }
+    NSString* contentType = [headers objectForKey:@"content-type"];
+    if([contentType isEqualToString:@"application/x-www-form-urlencoded"])
+    {
+        contentType = nil;
+    }
+
+    NSMutableString* toSign = [NSMutableString stringWithFormat:@"%@\n", request.method];
+    NSArray* standard = @[ @"content-encoding", @"content-language", @"content-length", @"content-md5", @"content-type", @"date",
+                           @"if-modified-since", @"if-match", @"if-none-match", @"if-unmodified-since", @"range" ];
+    for(NSString* name in standard)
+    {
+        NSString* value = [headers objectForKey:name];
+        if([name isEqualToString:@"content-length"])
+        {
+            value = contentLength;
+        }
+        else if([name isEqualToString:@"content-type"])
+        {
+            value = contentType;
+        }
+        [toSign appendFormat:@"%@\n", value ? value : @""];
+    }
+
+    NSMutableArray* canonical = [NSMutableArray arrayWithCapacity:[headers count]];
+    for(NSString* name in [[headers allKeys] sortedArrayUsingSelector:@selector(compare:)])
+    {
+        if([name hasPrefix:@"x-ms-"])
+        {
+            [canonical addObject:[NSString stringWithFormat:@"%@:%@", name, [headers objectForKey:name]]];
+        }
+    }
+    [toSign appendString:[canonical componentsJoinedByString:@"\n"]];
+    [toSign appendFormat:@"\n/%@%@", [credential substringToIndex:colon.location], request.path];
+    NSString* comp = QueryValue(request.query, @"comp");
+    if(comp)
+    {
+        [toSign appendFormat:@"\ncomp:%@", comp];
+    }
+
+    NSData* bytes = [toSign dataUsingEncoding:NSUTF8StringEncoding];
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
+    CCHmac(kCCHmacAlgSHA256, [_sharedKey bytes], [_sharedKey length], [bytes bytes], [bytes length], digest);
+    return [[SimpleBase64 encode:digest length:CC_SHA256_DIGEST_LENGTH] isEqualToString:[credential substringFromIndex:NSMaxRange(colon)]];
+}
+
+// The service reads a copy source itself, so it has to be a blob service URL naming a container and a blob.
+- (BOOL)isValidCopySource:(NSString*)source
+{
+    NSURL* url = [NSURL URLWithString:source];
+    NSArray* segments = [[url.path substringFromIndex:MIN((NSUInteger)1, [url.path length])] componentsSeparatedByString:@"/"];
+    return url.scheme && [url.host rangeOfString:@".blob."].location != NSNotFound && [segments count] >= 2 && [[segments lastObject] length] > 0;
+}
+
+- (NSData*)blobResponseForRequest:(StandInRequest*)request
+{
+    NSString* method = request.method;
+    NSArray* segments = [[request.path substringFromIndex:1] componentsSeparatedByString:@"/"];
+
+    if([method isEqualToString:@"GET"] && [QueryValue(request.query, @"comp") isEqualToString:@"list"])
+    {
+        if(QueryValue(request.query, @"restype") || [[segments firstObject] length] > 0)
+        {
+            // pages of maxresults blobs, each marker naming the first blob of the page after it
+            NSString* container = [segments firstObject];
+            NSString* marker = QueryValue(request.query, @"marker");
+            NSUInteger first = ([marker hasPrefix:@"blob"]) ? MIN((NSUInteger)[[marker substringFromIndex:4] integerValue], _listingCount) : 0;
+            NSUInteger pageSize = [QueryValue(request.query, @"maxresults") integerValue];
+            NSUInteger count = (pageSize > 0) ? MIN(pageSize, _listingCount - first) : _listingCount - first;
+            return [self xmlResponse:[CloudStorageStandIn blobListingFrom:first count:count of:_listingCount payloadSize:_payloadSize container:container baseURL:[self baseURL]]];
+        }
+        return [self xmlResponse:[CloudStorageStandIn containerListingWithCount:_listingCount baseURL:[self baseURL]]];
+    }
+    if([method isEqualToString:@"GET"] || [method isEqualToString:@"HEAD"])
+    {
+        return [self blobContentForRequest:request];
+    }
+    if([method isEqualToString:@"PUT"] || [method isEqualToString:@"DELETE"])
+    {
+        _lastWriteHeaders = request.headers;
+        if(![self hasValidSharedKey:request])
+        {
+            return [self errorResponseWithStatus:403 code:@"AuthenticationFailed" message:@"The MAC signature found in the HTTP request is not the same as any computed signature."];
+        }
+    }
+    if([method isEqualToString:@"PUT"] && [request.headers objectForKey:@"x-ms-copy-source"])
+    {
+        if(![self isValidCopySource:[request.headers objectForKey:@"x-ms-copy-source"]])
+        {
+            return [self errorResponseWithStatus:400 code:@"InvalidHeaderValue" message:@"The value for one of the HTTP headers is not in the correct format."];
+        }
+        return [self responseWithStatus:202 headers:@{ @"ETag" : @"\"0x8D0000000000001\"", @"Last-Modified" : StandInDate, @"x-ms-copy-status" : @"success" } body:nil];
+    }
+    if([method isEqualToString:@"PUT"] && QueryValue(request.query, @"comp"))
+    {
+        NSString* comp = QueryValue(request.query, @"comp");
+        NSInteger status = ([comp isEqualToString:@"metadata"] || [comp isEqualToString:@"properties"]) ? 200 : 201;
+        return [self responseWithStatus:status headers:@{ @"ETag" : @"\"0x8D0000000000001\"", @"Last-Modified" : StandInDate } body:nil];
+    }
+    if([method isEqualToString:@"PUT"])
+    {
+        return [self responseWithStatus:201 headers:@{ @"ETag" : @"\"0x8D0000000000001\"", @"Last-Modified" : StandInDate } body:nil];
+    }
+    if([method isEqualToString:@"DELETE"])
+    {
+        NSString* name = [[[segments subarrayWithRange:NSMakeRange(1, [segments count] - 1)] componentsJoinedByString:@"/"] stringByRemovingPercentEncoding];
+        if([segments count] > 1 && [_missingBlobNames containsObject:name])
+        {
+            return [self errorResponseWithStatus:404 code:@"BlobNotFound" message:@"The specified blob does not exist."];
+        }
+        return [self responseWithStatus:202 headers:nil body:nil];
+    }
+    return [self responseWithStatus:400 headers:nil body:nil];
+}
+
+- (NSData*)queueResponseForRequest:(StandInRequest*)request
+{
+    NSString* method = request.method;
+    NSString* path = request.path;
+
+    if([method isEqualToString:@"GET"] && [path hasSuffix:@"/messages"])
+    {
+        NSInteger count = MAX([QueryValue(request.query, @"numofmessages") integerValue], 1);
+        NSData* body = [CloudStorageStandIn queueMessagesWithCount:count serial:_messageSerial];
+        _messageSerial += count;
+        return [self xmlResponse:body];
+    }
+    if([method isEqualToString:@"GET"])
+    {
+        NSMutableString* xml = [NSMutableString stringWithString:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><EnumerationResults><Queues>"];
+        for(NSUInteger index = 0; index < _listingCount; index++)
+        {
+            [xml appendFormat:@"<Queue><QueueName>queue%05lu</QueueName><Url>%@/queue%05lu</Url></Queue>", (unsigned long)index, [self baseURL], (unsigned long)index];
+        }
+        [xml appendString:@"</Queues><NextMarker /></EnumerationResults>"];
+        return [self xmlResponse:[xml dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+    if([method isEqualToString:@"PUT"] && [path rangeOfString:@"/messages/"].location != NSNotFound)
+    {
+        NSString* receipt = [NSString stringWithFormat:@"AgAAAAMAAAAAAAAA%08lu", (unsigned long)_messageSerial++];
+        return [self responseWithStatus:204 headers:@{ @"x-ms-popreceipt" : receipt, @"x-ms-time-next-visible" : StandInDate } body:nil];
+    }
+    if([method isEqualToString:@"PUT"] || [method isEqualToString:@"POST"])
+    {
+        return [self responseWithStatus:201 headers:nil body:nil];
+    }
+    if([method isEqualToString:@"DELETE"])
+    {
+        return [self responseWithStatus:204 headers:nil body:nil];
+    }
+    return [self responseWithStatus:400 headers:nil body:nil];
+}
+
+- (NSData*)tableResponseForRequest:(StandInRequest*)request
+{
+    NSString* method = request.method;
+    NSDictionary* atom = @{ @"Content-Type" : @"application/atom+xml;charset=utf-8" };
+    BOOL json = [[request.headers objectForKey:@"accept"] rangeOfString:@"json"].location != NSNotFound;
+
+    if([method isEqualToString:@"GET"])
+    {
+        // a partition query gets only that partition's share of the listing; other conditions are ignored
+        NSString* filter = QueryValue(request.query, @"$filter");
+        NSString* partition = nil;
+        NSRange key = filter ? [filter rangeOfString:@"PartitionKey eq '"] : NSMakeRange(NSNotFound, 0);
+        if(key.location != NSNotFound)
+        {
+            NSRange quote = [filter rangeOfString:@"'" options:0 range:NSMakeRange(NSMaxRange(key), [filter length] - NSMaxRange(key))];
+            partition = [filter substringWithRange:NSMakeRange(NSMaxRange(key), quote.location - NSMaxRange(key))];
+        }
+
+        if(json)
+        {
+            return [self responseWithStatus:200 headers:@{ @"Content-Type" : @"application/json;odata=nometadata;charset=utf-8" } body:[CloudStorageStandIn entityJSONWithCount:_listingCount partition:partition]];
+        }
+        return [self responseWithStatus:200 headers:atom body:[CloudStorageStandIn entityFeedWithCount:_listingCount partition:partition]];
+    }
+    if([method isEqualToString:@"POST"])
+    {
+        if([[request.headers objectForKey:@"prefer"] isEqualToString:@"return-no-content"])
+        {
+            return [self responseWithStatus:204 headers:nil body:nil];
+        }
+        // an insert is answered with the entry it sent
+        return [self responseWithStatus:201 headers:(json ? @{ @"Content-Type" : @"application/json" } : atom) body:request.body];
+    }
+    return [self responseWithStatus:204 headers:nil body:nil];
+}
+
+- (NSData*)proxyResponseForRequest:(StandInRequest*)request
+{
+    NSString* body = nil;
+    NSString* signaturePrefix = @"/SharedAccessSignatureService/container/";
+
+    if([request.path isEqualToString:@"/AuthenticationService/login"])
+    {
+        body = @"standin-token";
+    }
+    else if([request.path hasPrefix:signaturePrefix] && [[request.headers objectForKey:@"authtoken"] isEqualToString:@"standin-token"])
+    {
+        // good for an hour, like the signatures the proxy sample hands out
+        char expiry[32];
+        time_t now = time(NULL) + 3600;
+        strftime(expiry, sizeof(expiry), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+        body = [NSString stringWithFormat:@"http://standin.blob.core.windows.net/%@?sv=2012-02-12&amp;sr=c&amp;sp=rwdl&amp;se=%s&amp;sig=standin",
+                [request.path substringFromIndex:[signaturePrefix length]], expiry];
+        _signatureCount++;
+    }
+    else
+    {
+        _proxiedRequestCount++;
+        return nil;
+    }
+
+    NSString* xml = [NSString stringWithFormat:@"<string xmlns=\"http://schemas.microsoft.com/2003/10/Serialization/\">%@</string>", body];
+    return [self xmlResponse:[xml dataUsingEncoding:NSUTF8StringEncoding]];
+}
+
+- (NSData*)responseForRequest:(StandInRequest*)request
+{
+    if([request.headers objectForKey:@"authtoken"] || [request.path hasPrefix:@"/AuthenticationService/"])
+    {
+        NSData* response = [self proxyResponseForRequest:request];
+        if(response)
+        {
+            return response;
+        }
+    }
+
+    if(_failuresToInject > 0)
+    {
+        _failuresToInject--;
+        NSString* xml = @"<?xml version=\"1.0\" encoding=\"utf-8\"?><Error><Code>ServerBusy</Code><Message>The server is busy.</Message></Error>";
+        return [self responseWithStatus:503 headers:@{ @"Content-Type" : @"application/xml" } body:[xml dataUsingEncoding:NSUTF8StringEncoding]];
+    }
+
+    NSString* service = [request.headers objectForKey:@"x-stand-in-service"];
+    if([service isEqualToString:@"queue"])
+    {
+        return [self queueResponseForRequest:request];
+    }
+    if([service isEqualToString:@"table"])
+    {
+        return [self tableResponseForRequest:request];
+    }
+    return [self blobResponseForRequest:request];
+}
+
+#pragma mark Bodies
+
++ (NSData*)containerListingWithCount:(NSUInteger)count baseURL:(NSString*)baseURL
+{
+    NSMutableString* xml = [NSMutableString stringWithCapacity:64 + count * 256];
+    [xml appendString:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><EnumerationResults><Containers>"];
+    for(NSUInteger index = 0; index < count; index++)
+    {
+        [xml appendFormat:@"<Container><Name>container%05lu</Name><Url>%@/container%05lu</Url><Properties><Last-Modified>%@</Last-Modified><Etag>0x8D0000000000000</Etag></Properties></Container>",
+         (unsigned long)index, baseURL, (unsigned long)index, StandInDate];
+    }
+    [xml appendString:@"</Containers><NextMarker /></EnumerationResults>"];
+    return [xml dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (NSData*)blobListingWithCount:(NSUInteger)count payloadSize:(NSUInteger)payloadSize container:(NSString*)container baseURL:(NSString*)baseURL
+{
+    return [self blobListingFrom:0 count:count of:count payloadSize:payloadSize container:container baseURL:baseURL];
+}
+
++ (NSData*)blobListingFrom:(NSUInteger)first count:(NSUInteger)count of:(NSUInteger)total payloadSize:(NSUInteger)payloadSize container:(NSString*)container baseURL:(NSString*)baseURL
+{
+    NSMutableString* xml = [NSMutableString stringWithCapacity:128 + count * 384];
+    [xml appendFormat:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><EnumerationResults ContainerName=\"%@/%@\"><Blobs>", baseURL, container];
+    for(NSUInteger index = first; index < first + count; index++)
+    {
+        [xml appendFormat:@"<Blob><Name>blob%05lu</Name><Url>%@/%@/blob%05lu</Url><Properties><Last-Modified>%@</Last-Modified><Etag>0x8D0000000000000</Etag>"
+                           "<Content-Length>%lu</Content-Length><Content-Type>application/octet-stream</Content-Type><BlobType>BlockBlob</BlobType></Properties></Blob>",
+         (unsigned long)index, baseURL, container, (unsigned long)index, StandInDate, (unsigned long)payloadSize];
+    }
+    if(first + count < total)
+    {
+        [xml appendFormat:@"</Blobs><NextMarker>blob%05lu</NextMarker></EnumerationResults>", (unsigned long)(first + count)];
+    }
+    else
+    {
+        [xml appendString:@"</Blobs><NextMarker /></EnumerationResults>"];
+    }
+    return [xml dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (NSData*)blobListingWithCount:(NSUInteger)count payloadSize:(NSUInteger)payloadSize
+{
+    return [self blobListingWithCount:count payloadSize:payloadSize container:@"container" baseURL:@"http://127.0.0.1"];
+}
+
++ (NSData*)queueMessagesWithCount:(NSUInteger)count serial:(NSUInteger)serial
+{
+    NSMutableString* xml = [NSMutableString stringWithCapacity:64 + count * 384];
+    [xml appendString:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><QueueMessagesList>"];
+    for(NSUInteger index = serial; index < serial + count; index++)
+    {
+        [xml appendFormat:@"<QueueMessage><MessageId>00000000-0000-0000-0000-%012lu</MessageId><InsertionTime>%@</InsertionTime><ExpirationTime>%@</ExpirationTime>"
+                           "<PopReceipt>AgAAAAMAAAAAAAAA%08lu</PopReceipt><TimeNextVisible>%@</TimeNextVisible><DequeueCount>1</DequeueCount><MessageText>message %lu</MessageText></QueueMessage>",
+         (unsigned long)index, StandInDate, StandInDate, (unsigned long)index, StandInDate, (unsigned long)index];
+    }
+    [xml appendString:@"</QueueMessagesList>"];
+    return [xml dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (NSData*)queueMessagesWithCount:(NSUInteger)count
+{
+    return [self queueMessagesWithCount:count serial:0];
+}
+
++ (NSData*)entityFeedWithCount:(NSUInteger)count
+{
+    return [self entityFeedWithCount:count partition:nil];
+}
+
++ (NSData*)entityFeedWithCount:(NSUInteger)count partition:(NSString*)partition
+{
+    NSMutableString* xml = [NSMutableString stringWithCapacity:512 + count * 1024];
+    [xml appendFormat:@"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?>"
+                       "<feed xml:base=\"http://127.0.0.1/\" xmlns:d=\"http://schemas.microsoft.com/ado/2007/08/dataservices\" "
+                       "xmlns:m=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\" xmlns=\"http://www.w3.org/2005/Atom\">"
+                       "<title type=\"text\">benchtable</title><id>http://127.0.0.1/benchtable</id><updated>%@</updated>", StandInTimestamp];
+    for(NSUInteger index = 0; index < count; index++)
+    {
+        if(partition && ![partition isEqualToString:[NSString stringWithFormat:@"p%02lu", (unsigned long)(index % 16)]])
+        {
+            continue;
+        }
+        [xml appendFormat:@"<entry m:etag=\"W/&quot;datetime'2026-10-17T00%%3A00%%3A00.0000000Z'&quot;\">"
+                           "<id>http://127.0.0.1/benchtable(PartitionKey='p%02lu',RowKey='r%06lu')</id><title type=\"text\"></title><updated>%@</updated><author><name /></author>"
+                           "<link rel=\"edit\" title=\"benchtable\" href=\"benchtable(PartitionKey='p%02lu',RowKey='r%06lu')\" />"
+                           "<category term=\"benchaccount.benchtable\" scheme=\"http://schemas.microsoft.com/ado/2007/08/dataservices/scheme\" />"
+                           "<content type=\"application/xml\"><m:properties><d:PartitionKey>p%02lu</d:PartitionKey><d:RowKey>r%06lu</d:RowKey>"
+                           "<d:Timestamp m:type=\"Edm.DateTime\">%@</d:Timestamp><d:Name>entity %lu</d:Name><d:Count m:type=\"Edm.Int32\">%lu</d:Count>"
+                           "<d:Score m:type=\"Edm.Double\">%lu.5</d:Score><d:Active m:type=\"Edm.Boolean\">true</d:Active></m:properties></content></entry>",
+         (unsigned long)(index % 16), (unsigned long)index, StandInTimestamp, (unsigned long)(index % 16), (unsigned long)index,
+         (unsigned long)(index % 16), (unsigned long)index, StandInTimestamp, (unsigned long)index, (unsigned long)index, (unsigned long)index];
+    }
+    [xml appendString:@"</feed>"];
+    return [xml dataUsingEncoding:NSUTF8StringEncoding];
+}
+
++ (NSData*)entityJSONWithCount:(NSUInteger)count
+{
+    return [self entityJSONWithCount:count partition:nil];
+}
+
++ (NSData*)entityJSONWithCount:(NSUInteger)count partition:(NSString*)partition
+{
+    // the same entities as entityFeedWithCount:, as the service sends them with odata=nometadata
+    NSMutableString* json = [NSMutableString stringWithCapacity:16 + count * 160];
+    NSUInteger written = 0;
+    [json appendString:@"{\"value\":["];
+    for(NSUInteger index = 0; index < count; index++)
+    {
+        if(partition && ![partition isEqualToString:[NSString stringWithFormat:@"p%02lu", (unsigned long)(index % 16)]])
+        {
+            continue;
+        }
+        [json appendFormat:@"%@{\"PartitionKey\":\"p%02lu\",\"RowKey\":\"r%06lu\",\"Timestamp\":\"%@\",\"Name\":\"entity %lu\",\"Count\":%lu,\"Score\":%lu.5,\"Active\":true}",
+         (written++ ? @"," : @""), (unsigned long)(index % 16), (unsigned long)index, StandInTimestamp, (unsigned long)index, (unsigned long)index, (unsigned long)index];
+    }
+    [json appendString:@"]}"];
+    return [json dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+@end
+
+#pragma mark -
+
+@implementation CloudStandInTransport
+{
+    CloudStorageStandIn* _standIn;
+}
+
+@synthesize pooledTransport = _pooledTransport;
+
+- (id)initWithStandIn:(CloudStorageStandIn*)standIn
+{
+    if((self = [super init]))
+    {
+        _standIn = standIn;
+        _pooledTransport = [[CloudPooledTransport alloc] init];
+    }
+
+    return self;
+}
+
+- (id)startRequest:(NSURLRequest*)request client:(id<CloudTransportClient>)client
+{
+    // <account>.<service>.core.windows.net
+    NSURLComponents* components = [NSURLComponents componentsWithURL:[request URL] resolvingAgainstBaseURL:YES];
+    NSArray* labels = [components.host componentsSeparatedByString:@"."];
+    NSString* service = ([labels count] > 1) ? [labels objectAtIndex:1] : @"blob";
+
+    components.scheme = @"http";
+    components.host = @"127.0.0.1";
+    components.port = @(_standIn.port);
+
+    NSMutableURLRequest* redirected = [NSMutableURLRequest requestWithURL:components.URL cachePolicy:[request cachePolicy] timeoutInterval:[request timeoutInterval]];
+    redirected.HTTPMethod = [request HTTPMethod];
+    redirected.allHTTPHeaderFields = [request allHTTPHeaderFields];
+    if([request HTTPBodyStream])
+    {
+        redirected.HTTPBodyStream = [request HTTPBodyStream];
+    }
+    else
+    {
+        redirected.HTTPBody = [request HTTPBody];
+    }
+    [redirected setValue:service forHTTPHeaderField:@"X-Stand-In-Service"];
+
+    return [_pooledTransport startRequest:redirected client:client];
+}
+
+- (void)cancelTransfer:(id)transfer
+{
+    [_pooledTransport cancelTransfer:transfer];
+}
+
+@end
@@ -0,0 +1,38 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+#import "SimpleBase64.h"
+
+@interface SimpleBase64Tests : XCTestCase
+@end
+
+@implementation SimpleBase64Tests
+
+- (void)testBase64RejectsMalformedInput
+{
+    XCTAssertEqualObjects([[NSString alloc] initWithData:[SimpleBase64 decode:@"aGVsbG8gd29ybGQ="] encoding:NSASCIIStringEncoding], @"hello world");
+    XCTAssertEqualObjects([SimpleBase64 encode:[@"hello world" dataUsingEncoding:NSASCIIStringEncoding]], @"aGVsbG8gd29ybGQ=");
+    XCTAssertNil([SimpleBase64 decode:@"aGVsbG8gd29ybGQ"]);
+    XCTAssertNil([SimpleBase64 decode:@"aGVsbG8-d29ybGQ="]);
+
+    // a bad character inside a block the vector kernels would take
+    NSMutableString* text = [NSMutableString stringWithString:[SimpleBase64 encode:[NSMutableData dataWithLength:300]]];
+    [text replaceCharactersInRange:NSMakeRange(100, 1) withString:@"*"];
+    XCTAssertNil([SimpleBase64 decode:text]);
+}
+
+@end
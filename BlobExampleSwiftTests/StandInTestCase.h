@@ -0,0 +1,41 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+#import "CloudStorageStandIn.h"
+#import "CloudStorageClient.h"
+
+// A test case run against a CloudStorageStandIn. Each test gets a started stand-in, the shared
+// scheduler's transport pointed at it, and a client for "benchaccount" that signs with the all-zero
+// key in _key; the scheduler's transport is put back afterwards.
+@interface StandInTestCase : XCTestCase
+{
+    CloudStorageStandIn* _standIn;
+    CloudStandInTransport* _transport;
+    id<CloudTransport> _savedTransport;
+
+    NSData* _key;
+    CloudStorageClient* _client;
+    BlobContainer* _container;
+}
+
+// Called before the stand-in starts, to set its tunables. Does nothing by default.
+- (void)configureStandIn:(CloudStorageStandIn*)standIn;
+
+// Runs the current run loop until condition holds, returning NO if timeout passes first.
+- (BOOL)waitFor:(BOOL (^)(void))condition timeout:(NSTimeInterval)timeout;
+
+@end
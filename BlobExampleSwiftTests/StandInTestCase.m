@@ -0,0 +1,70 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "StandInTestCase.h"
+#import "CloudRequestScheduler.h"
+#import "SimpleBase64.h"
+
+@implementation StandInTestCase
+
+- (void)setUp
+{
+    [super setUp];
+
+    _key = [NSMutableData dataWithLength:64];
+    _standIn = [[CloudStorageStandIn alloc] init];
+    [self configureStandIn:_standIn];
+    XCTAssertTrue([_standIn start], @"the stand-in could not listen on the loopback interface");
+
+    CloudRequestScheduler* scheduler = [CloudRequestScheduler sharedScheduler];
+    _transport = [[CloudStandInTransport alloc] initWithStandIn:_standIn];
+    _savedTransport = scheduler.transport;
+    scheduler.transport = _transport;
+
+    _client = [CloudStorageClient storageClientWithCredential:[AuthenticationCredential credentialWithAzureServiceAccount:@"benchaccount" accessKey:[SimpleBase64 encode:_key]]];
+    _container = [[BlobContainer alloc] initContainerWithName:@"container" URL:@"http://benchaccount.blob.core.windows.net/container" metadata:nil];
+}
+
+- (void)tearDown
+{
+    [CloudRequestScheduler sharedScheduler].transport = _savedTransport;
+    [_standIn stop];
+    _standIn = nil;
+    _transport = nil;
+    _client = nil;
+
+    [super tearDown];
+}
+
+- (void)configureStandIn:(CloudStorageStandIn*)standIn
+{
+}
+
+- (BOOL)waitFor:(BOOL (^)(void))condition timeout:(NSTimeInterval)timeout
+{
+    NSDate* deadline = [NSDate dateWithTimeIntervalSinceNow:timeout];
+    while(!condition())
+    {
+        if([deadline timeIntervalSinceNow] < 0)
+        {
+            return NO;
+        }
+        [[NSRunLoop currentRunLoop] runMode:NSDefaultRunLoopMode beforeDate:[NSDate dateWithTimeIntervalSinceNow:0.01]];
+    }
+    return YES;
+}
+
+@end
@@ -0,0 +1,146 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+#import "CloudStorageStandIn.h"
+#import "TableEntity.h"
+#import "XmlHelper.h"
+#import "XmlStreamParser.h"
+#import "JsonStreamParser.h"
+#import "TableColumnParser.h"
+#import "TableResultSet+Private.h"
+
+@interface TableEntity (ParsingTestsPrivate)
+- (NSString*)propertyString;
+- (NSData*)jsonBody;
+@end
+
+@interface TableEntityParsingTests : XCTestCase
+@end
+
+@implementation TableEntityParsingTests
+
+- (void)testEntityJSONMatchesAtom
+{
+    NSMutableArray* atomRecords = [NSMutableArray array];
+    XmlStreamParser* xmlParser = [[XmlStreamParser alloc] init];
+    [XmlHelper addAtomPubRecordsToParser:xmlParser block:^(NSMutableDictionary* properties) {
+        [atomRecords addObject:properties];
+    }];
+    NSData* atom = [CloudStorageStandIn entityFeedWithCount:10];
+    [xmlParser parseBytes:[atom bytes] length:[atom length]];
+    XCTAssertTrue([xmlParser finish]);
+
+    // fed a byte at a time, so every token straddles a read
+    NSMutableArray* jsonRecords = [NSMutableArray array];
+    JsonStreamParser* jsonParser = [[JsonStreamParser alloc] init];
+    [jsonParser addRecordArray:@"value" block:^(NSMutableDictionary* properties) {
+        [jsonRecords addObject:properties];
+    }];
+    NSData* json = [CloudStorageStandIn entityJSONWithCount:10];
+    for(NSUInteger offset = 0; offset < [json length]; offset++)
+    {
+        XCTAssertTrue([jsonParser parseBytes:(const uint8_t*)[json bytes] + offset length:1]);
+    }
+    XCTAssertTrue([jsonParser finish]);
+    XCTAssertNil([jsonParser error]);
+    XCTAssertEqualObjects(jsonRecords, atomRecords);
+
+    NSString* escaped = @"{\"value\":[{\"Name\":\"tab\\there \\u00e9 \\ud83d\\ude00\",\"Name@odata.type\":\"Edm.String\",\"Nested\":{\"a\":[1,2]},\"Gone\":null}]}";
+    __block NSDictionary* record = nil;
+    jsonParser = [[JsonStreamParser alloc] init];
+    [jsonParser addRecordArray:@"value" block:^(NSMutableDictionary* properties) {
+        record = properties;
+    }];
+    XCTAssertTrue([jsonParser parseBytes:[[escaped dataUsingEncoding:NSUTF8StringEncoding] bytes] length:[escaped lengthOfBytesUsingEncoding:NSUTF8StringEncoding]]);
+    XCTAssertTrue([jsonParser finish]);
+    XCTAssertEqualObjects(record, @{ @"Name" : @"tab\there \u00e9 \U0001F600" });
+
+    NSData* errorBody = [@"{\"odata.error\":{\"code\":\"EntityAlreadyExists\",\"message\":{\"lang\":\"en-US\",\"value\":\"The specified entity already exists.\"}}}" dataUsingEncoding:NSUTF8StringEncoding];
+    NSError* error = [JsonStreamParser errorInBody:errorBody];
+    XCTAssertEqualObjects([[error userInfo] objectForKey:@"AzureReasonCode"], @"EntityAlreadyExists");
+    XCTAssertEqualObjects([error localizedDescription], @"The specified entity already exists.");
+    XCTAssertNil([JsonStreamParser errorInBody:json]);
+
+    TableEntity* entity = [TableEntity createEntityForTable:@"benchtable"];
+    entity.partitionKey = @"p";
+    entity.rowKey = @"r\"1\"";
+    [entity setValue:@((int64_t)1 << 40) forKey:@"Big"];
+    NSString* body = [[NSString alloc] initWithData:[entity jsonBody] encoding:NSUTF8StringEncoding];
+    XCTAssertEqualObjects(body, @"{\"PartitionKey\":\"p\",\"RowKey\":\"r\\\"1\\\"\",\"Big\":\"1099511627776\"}");
+}
+
+- (void)testOutgoingIntegerTypes
+{
+    // a plain entity sends its values untyped, as it always has
+    TableEntity* plain = [TableEntity createEntityForTable:@"benchtable"];
+    plain.partitionKey = @"p";
+    plain.rowKey = @"r";
+    [plain setValue:@(7) forKey:@"Small"];
+    XCTAssertTrue([[plain propertyString] rangeOfString:@"<d:Small>7</d:Small>"].location != NSNotFound);
+    NSString* plainBody = [[NSString alloc] initWithData:[plain jsonBody] encoding:NSUTF8StringEncoding];
+    XCTAssertTrue([plainBody rangeOfString:@"\"Small\":\"7\""].location != NSNotFound);
+
+    // a row read into a result set goes back out typed
+    TableResultSet* results = [[TableResultSet alloc] initWithTableName:@"benchtable"];
+    TableColumnParser* parser = [[TableColumnParser alloc] initWithResultSet:results];
+    NSData* feed = [CloudStorageStandIn entityFeedWithCount:1];
+    XCTAssertTrue([parser parseBytes:[feed bytes] length:[feed length]]);
+    XCTAssertTrue([parser finish]);
+
+    TableEntity* entity = [results entityAtIndex:0];
+    XCTAssertTrue([[entity propertyString] rangeOfString:@"<d:Count m:type=\"Edm.Int32\">0</d:Count>"].location != NSNotFound);
+    [entity setValue:@((NSUInteger)INT64_MAX) forKey:@"Big"];
+    [entity setValue:@(7) forKey:@"Small"];
+    NSString* body = [[NSString alloc] initWithData:[entity jsonBody] encoding:NSUTF8StringEncoding];
+    XCTAssertTrue([body rangeOfString:@"\"Big@odata.type\":\"Edm.Int64\",\"Big\":\"9223372036854775807\""].location != NSNotFound);
+    XCTAssertTrue([body rangeOfString:@"\"Small\":7"].location != NSNotFound);
+
+    // no EDM type holds the top half of the unsigned range, so the entity can't be written
+    [entity setValue:@((unsigned long long)INT64_MAX + 1) forKey:@"Big"];
+    XCTAssertNil([entity jsonBody]);
+    XCTAssertNil([entity propertyString]);
+}
+
+- (void)testEntityFeedColumnValues
+{
+    TableResultSet* results = [[TableResultSet alloc] initWithTableName:@"benchtable"];
+    TableColumnParser* parser = [[TableColumnParser alloc] initWithResultSet:results];
+    NSData* feed = [CloudStorageStandIn entityFeedWithCount:10];
+    XCTAssertTrue([parser parseBytes:[feed bytes] length:[feed length]]);
+    XCTAssertTrue([parser finish]);
+
+    XCTAssertEqual(results.count, (NSUInteger)10);
+    XCTAssertEqual([results typeOfColumn:@"Score"], TableColumnTypeDouble);
+    XCTAssertEqual([results doubleValuesOfColumn:@"Score"][3], 3.5);
+    XCTAssertTrue([results booleanValuesOfColumn:@"Active"][9]);
+    XCTAssertEqualObjects([results stringInColumn:@"RowKey" row:7], @"r000007");
+
+    // the row view answers like an entity read the old way
+    TableEntity* entity = [results entityAtIndex:4];
+    XCTAssertEqualObjects(entity.partitionKey, @"p04");
+    XCTAssertEqualObjects([entity valueForKey:@"Count"], @4);
+    XCTAssertEqualObjects([entity valueForKey:@"Name"], @"entity 4");
+    XCTAssertNil([entity valueForKey:@"RowKey"]);
+    XCTAssertNotNil(entity.timeStamp);
+
+    [entity setValue:@"changed" forKey:@"Name"];
+    XCTAssertEqualObjects([entity valueForKey:@"Name"], @"changed");
+    XCTAssertEqualObjects([entity valueForKey:@"Score"], @4.5);
+    XCTAssertEqualObjects([results stringInColumn:@"Name" row:4], @"entity 4");
+}
+
+@end
@@ -0,0 +1,73 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <XCTest/XCTest.h>
+#import "TableFetchRequest.h"
+
+@interface TableFetchRequestTests : XCTestCase
+@end
+
+@implementation TableFetchRequestTests
+
+- (void)testQueryPlans
+{
+    TableFetchRequest* request = [TableFetchRequest fetchRequestForTable:@"t" predicate:[NSPredicate predicateWithFormat:@"RowKey == 'r' AND PartitionKey == 'p'"] error:NULL];
+    XCTAssertNil(request.queries);
+    XCTAssertEqualObjects(request.filter, @"(PartitionKey eq 'p') and (RowKey eq 'r')");
+    XCTAssertNil(request.residualPredicate);
+
+    request = [TableFetchRequest fetchRequestForTable:@"t" predicate:[NSPredicate predicateWithFormat:@"PartitionKey IN {'a', 'b', 'a'} AND Count > 3"] error:NULL];
+    XCTAssertEqual([request.queries count], (NSUInteger)2);
+    XCTAssertEqualObjects([[request.queries objectAtIndex:1] filter], @"(PartitionKey eq 'b') and (Count gt 3)");
+
+    // a condition the service can't evaluate is checked on the results; the rest still goes up
+    request = [TableFetchRequest fetchRequestForTable:@"t" predicate:[NSPredicate predicateWithFormat:@"Name LIKE 'entity 1*' AND Count > 3"] error:NULL];
+    XCTAssertNil(request.queries);
+    XCTAssertEqualObjects(request.filter, @"Count gt 3");
+    XCTAssertEqualObjects(request.residualPredicate, [NSPredicate predicateWithFormat:@"Name LIKE 'entity 1*'"]);
+
+    // an alternative without a partition means a scan, so the OR isn't split
+    request = [TableFetchRequest fetchRequestForTable:@"t" predicate:[NSPredicate predicateWithFormat:@"PartitionKey == 'a' OR Count > 3"] error:NULL];
+    XCTAssertNil(request.queries);
+    XCTAssertEqualObjects(request.filter, @"(PartitionKey eq 'a') or (Count gt 3)");
+
+    // two rows of one partition become two point queries
+    request = [TableFetchRequest fetchRequestForTable:@"t" predicate:[NSPredicate predicateWithFormat:@"PartitionKey == 'a' AND (RowKey == '1' OR RowKey == '2')"] error:NULL];
+    XCTAssertEqual([request.queries count], (NSUInteger)2);
+    XCTAssertEqualObjects([[request.queries objectAtIndex:0] filter], @"(PartitionKey eq 'a') and (RowKey eq '1')");
+}
+
+- (void)testResidualComparesOnlyStrings
+{
+    // the whole OR is checked on the entities, whose Count arrives as a string
+    NSError* error = nil;
+    TableFetchRequest* request = [TableFetchRequest fetchRequestForTable:@"t" predicate:[NSPredicate predicateWithFormat:@"Count > 3 OR Name LIKE 'x*'"] error:&error];
+    XCTAssertNil(request);
+    XCTAssertNotNil(error);
+
+    error = nil;
+    request = [TableFetchRequest fetchRequestForTable:@"t" predicate:[NSPredicate predicateWithFormat:@"Name LIKE 'x*' OR Name == nil OR Timestamp > %@", [NSDate date]] error:&error];
+    XCTAssertNotNil(request.residualPredicate);
+    XCTAssertNil(error);
+
+    // a numeric condition the service evaluates doesn't hold up a string one beside it
+    request = [TableFetchRequest fetchRequestForTable:@"t" predicate:[NSPredicate predicateWithFormat:@"Name ==[c] 'x' AND Score < 2.5"] error:&error];
+    XCTAssertEqualObjects(request.filter, @"Score lt 2.5");
+    XCTAssertNotNil(request.residualPredicate);
+    XCTAssertNil(error);
+}
+
+@end
@@ -24,7 +24,7 @@
 - (void)loginDidFailWithError:(NSError *)error;
 @end
 
-/*! The AuthenticationCredential class is used to create an authentication object that can be passed to the CloudStorageClient.  This class can be initialized using a Windows Azure account name and key, or with a proxy server URL, username, and password. */
+/*! The AuthenticationCredential class is used to create an authentication object that can be passed to the CloudStorageClient.  This class can be initialized using a Windows Azure account name and key, or with a proxy server URL, username, and password. With the proxy, blob listings, downloads, uploads and deletes go straight to the storage service under a shared access signature for their container, fetched from the proxy's SharedAccessSignatureService once and replaced in the background before it expires; a container the proxy grants no signature for is reached through the proxy as before. */
 @interface AuthenticationCredential : NSObject <NSXMLParserDelegate>
 {
 	BOOL					_usesProxy;
@@ -38,6 +38,13 @@
 	NSString				*_password;
 	NSString				*_tableServiceURL;
 	NSString				*_blobServiceURL;
+	void					*_signingContext;
+	NSLock					*_dateLock;
+	NSString				*_dateString;
+	long					_dateSecond;
+	NSLock					*_signatureLock;
+	NSMutableDictionary		*_signatures;
+	dispatch_queue_t		_signatureQueue;
 }
 
 /*! Boolean value indicating whether this authentication credential uses the proxy service. */
@@ -19,14 +19,171 @@
 #import <CommonCrypto/CommonDigest.h>
 #import <CommonCrypto/CommonHMAC.h>	
 #import <stdarg.h>
+#import <time.h>
+#import <xlocale.h>
 #import "SimpleBase64.h"
 #import "CloudURLRequest.h"
 #import "XmlHelper.h"
+#import "SharedAccessSignature.h"
+#import "NSString+URLEncode.h"
 
 static NSString* PROXY_LOGIN_REQUEST_STRING =@"<Login xmlns:i=\"http://www.w3.org/2001/XMLSchema-instance\" xmlns=\"http://schemas.datacontract.org/2004/07/Microsoft.Samples.WindowsPhoneCloud.StorageClient.Credentials\"><Password>{password}</Password><UserName>{username}</UserName></Login>";
 
 const int AUTHENTICATION_DELAY = 2;
 
+// A signature is not handed out in its last minute, so requests made with it reach the service before it expires.
+#define SIGNATURE_EXPIRY_MARGIN 60
+// How long a signature without an se= expiry is trusted.
+#define SIGNATURE_ASSUMED_LIFETIME 300
+// After the proxy had no signature to give, requests for that container go through it for this long before asking again.
+#define SIGNATURE_RETRY_INTERVAL 60
+
+// Upper bound on the x-ms-* headers signed for one request, including x-ms-date, x-ms-version and
+// any x-ms-meta-* headers carrying blob metadata.
+#define MAX_SIGNED_HEADERS 32
+
+// The string to sign is assembled here rather than through NSMutableString; it only touches the
+// heap when a request outgrows the inline storage.
+typedef struct
+{
+    char*   bytes;
+    size_t  length;
+    size_t  capacity;
+    char    storage[1024];
+} SigningBuffer;
+
+static void SigningBufferInit(SigningBuffer* buffer)
+{
+    buffer->bytes = buffer->storage;
+    buffer->length = 0;
+    buffer->capacity = sizeof(buffer->storage);
+}
+
+static void SigningBufferFree(SigningBuffer* buffer)
+{
+    if(buffer->bytes != buffer->storage)
+    {
+        free(buffer->bytes);
+    }
+}
+
+static void SigningBufferReserve(SigningBuffer* buffer, size_t extra)
+{
+    if(buffer->length + extra <= buffer->capacity)
+    {
+        return;
+    }
+    
+    size_t capacity = buffer->capacity * 2;
+    while(capacity < buffer->length + extra)
+    {
+        capacity *= 2;
+    }
+    
+    if(buffer->bytes == buffer->storage)
+    {
+        buffer->bytes = malloc(capacity);
+        memcpy(buffer->bytes, buffer->storage, buffer->length);
+    }
+    else
+    {
+        buffer->bytes = realloc(buffer->bytes, capacity);
+    }
+    buffer->capacity = capacity;
+}
+
+static void SigningBufferAppendBytes(SigningBuffer* buffer, const char* bytes, size_t length)
+{
+    SigningBufferReserve(buffer, length);
+    memcpy(buffer->bytes + buffer->length, bytes, length);
+    buffer->length += length;
+}
+
+static void SigningBufferAppendString(SigningBuffer* buffer, NSString* string)
+{
+    NSUInteger maxLength = [string maximumLengthOfBytesUsingEncoding:NSUTF8StringEncoding];
+    NSUInteger usedLength = 0;
+    
+    if(maxLength == 0)
+    {
+        return;
+    }
+    
+    SigningBufferReserve(buffer, maxLength);
+    [string getBytes:buffer->bytes + buffer->length maxLength:maxLength usedLength:&usedLength encoding:NSUTF8StringEncoding options:0 range:NSMakeRange(0, [string length]) remainingRange:NULL];
+    buffer->length += usedLength;
+}
+
+static void SigningBufferAppendHeaders(SigningBuffer* buffer, NSString** names, NSString** values, NSUInteger count)
+{
+    for(NSUInteger n = 0; n < count; n++)
+    {
+        if(n > 0)
+        {
+            SigningBufferAppendBytes(buffer, "\n", 1);
+        }
+        SigningBufferAppendString(buffer, names[n]);
+        SigningBufferAppendBytes(buffer, ":", 1);
+        SigningBufferAppendString(buffer, values[n]);
+    }
+}
+
+// NO when the list is full; a header left out of the string to sign would still be sent, and the
+// service would refuse the request, so the caller has to give up on it instead.
+static BOOL InsertSignedHeader(NSString** names, NSString** values, NSUInteger* count, NSString* name, NSString* value)
+{
+    if(*count >= MAX_SIGNED_HEADERS)
+    {
+        return NO;
+    }
+    
+    NSUInteger n = *count;
+    while(n > 0 && [names[n - 1] compare:name] == NSOrderedDescending)
+    {
+        names[n] = names[n - 1];
+        values[n] = values[n - 1];
+        n--;
+    }
+    names[n] = name;
+    values[n] = value;
+    (*count)++;
+    
+    return YES;
+}
+
+@interface SignatureCacheEntry : NSObject
+{
+@public
+    SharedAccessSignature* _signature;
+    // requests waiting for the proxy's answer; non-nil while a fetch is out
+    NSMutableArray* _waiters;
+    NSTimeInterval _retryAfter;
+    // handed out since it was fetched, so worth replacing before it runs out
+    BOOL _used;
+}
+@end
+
+@implementation SignatureCacheEntry
+
+- (void)dealloc
+{
+    [_signature release];
+    [_waiters release];
+    
+    [super dealloc];
+}
+
+@end
+
+@interface AuthenticationCredential (RequestOwner) <CloudRequestOwner>
+@end
+
+// Three quarters of the way through the time the signature may be handed out.
+static NSTimeInterval SignatureRefreshTime(SharedAccessSignature* signature)
+{
+    return signature.issued + (signature.expiry - SIGNATURE_EXPIRY_MARGIN - signature.issued) * 3 / 4;
+}
+
 @implementation AuthenticationCredential
 
 @synthesize usesProxy   = _usesProxy;
@@ -44,6 +201,11 @@ const int AUTHENTICATION_DELAY = 2;
 		_usesProxy = NO;
 		_accountName = [name copy];
 		_accessKey = [key copy];
+		
+		NSData* keyData = [SimpleBase64 decode:_accessKey];
+		_signingContext = malloc(sizeof(CCHmacContext));
+		CCHmacInit(_signingContext, kCCHmacAlgSHA256, [keyData bytes], [keyData length]);
+		_dateLock = [[NSLock alloc] init];
 	}
 	
 	return self;
@@ -57,6 +219,9 @@ const int AUTHENTICATION_DELAY = 2;
 		_proxyURL = [service retain];
         _username = [user copy];
         _password = [password copy];
+        _signatureLock = [[NSLock alloc] init];
+        _signatures = [[NSMutableDictionary alloc] initWithCapacity:8];
+        _signatureQueue = dispatch_queue_create("com.microsoft.AzureIOSToolkit.signatures", DISPATCH_QUEUE_SERIAL);
 	}
 
 	return self;
@@ -72,6 +237,9 @@ const int AUTHENTICATION_DELAY = 2;
 		_blobServiceURL = [blobsService retain];
         _username = [user copy];
         _password = [password copy];
+        _signatureLock = [[NSLock alloc] init];
+        _signatures = [[NSMutableDictionary alloc] initWithCapacity:8];
+        _signatureQueue = dispatch_queue_create("com.microsoft.AzureIOSToolkit.signatures", DISPATCH_QUEUE_SERIAL);
 		}
 	
 	return self;
@@ -236,187 +404,84 @@ const int AUTHENTICATION_DELAY = 2;
     return serviceURL;
 }
 
-- (CloudURLRequest *)authenticatedRequestWithURL:(NSURL *)serviceURL blobSemantics:(BOOL)blobSemantics httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType args:(va_list)args
+#pragma mark Signing
+
+- (NSString*)signatureForBytes:(const void*)bytes length:(size_t)length
 {
-    NSString* contentLength = contentData ? [NSString stringWithFormat:@"%d", contentData.length] : @"";
+    // start from a copy of the keyed state so the key schedule is only computed once per credential
+    CCHmacContext context;
+    unsigned char digest[CC_SHA256_DIGEST_LENGTH];
     
-	if (!serviceURL)
-	{
-		return nil;
-	}
-
-	CloudURLRequest* authenticatedrequest = [CloudURLRequest requestWithURL:serviceURL];
-    [authenticatedrequest setHTTPMethod:httpMethod];
+    memcpy(&context, _signingContext, sizeof(CCHmacContext));
+    CCHmacUpdate(&context, bytes, length);
+    CCHmacFinal(&context, digest);
     
-    if (_usesProxy)
-	{
-		[authenticatedrequest setValue:@"identity" forHTTPHeaderField:@"Accept-Encoding"];
-		[authenticatedrequest setValue:_token forHTTPHeaderField:@"AuthToken"];
-		if(contentType)
-		{
-			[authenticatedrequest addValue:contentType forHTTPHeaderField:@"Content-Type"];
-		}
-		
-		if(contentData)
-		{
-			[authenticatedrequest setHTTPBody:contentData];
-		}
-	}
-	else
-	{
-        NSString* endpoint = [[[serviceURL path] copy] autorelease];
-        NSString* query = [serviceURL query];
-        if(query && query.length > 0)
-        {
-            // for table storage, look for the comp= parameter
-            NSArray* args = [query componentsSeparatedByString:@"&"];
+    return [SimpleBase64 encode:digest length:CC_SHA256_DIGEST_LENGTH];
+}
 
-            if(blobSemantics)
-            {
-                NSMutableString* q = [NSMutableString stringWithCapacity:100];
-                
-                for(NSString* arg in [args sortedArrayUsingSelector:@selector(compare:)])
-                {
-                    [q appendString:@"\n"];
-                    [q appendString:[arg stringByReplacingOccurrencesOfString:@"=" withString:@":"]];
-                }
-                
-                query = q;
-            }
-            else
-            {
-                query = nil;
-                
-                for(NSString* arg in args)
-                {
-                    if(arg.length > 5 && [[arg substringToIndex:5] isEqualToString:@"comp="])
-                    {
-                        arg = [arg stringByReplacingOccurrencesOfString:@"=" withString:@":"];
-                        query = [@"\n" stringByAppendingString:arg];
-                        break;
-                    }
-                }
-            }
-        }
-        
-        // Construct the date in the right format
-		NSDate *date = [NSDate date];
-		NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
-		[dateFormatter setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
-		[dateFormatter setDateFormat:@"EEE, dd MMM yyyy HH:mm:ss 'GMT'"];
-		NSString *dateString = [dateFormatter stringFromDate:date];
-        [dateFormatter release];
-		
-		NSMutableArray* headers = [NSMutableArray arrayWithCapacity:20];
-        NSString* name;
-        NSString* header;
-        BOOL isName = YES;
-        while((header = va_arg(args, NSString*)))
-        {
-            if(isName)
-            {
-                name = header;
-            }
-            else
-            {
-                [headers addObject:[NSString stringWithFormat:@"%@:%@", name, header]];
-                [authenticatedrequest setValue:header forHTTPHeaderField:name];
-            }
-            isName = !isName;
-        }
-        [headers addObject:[NSString stringWithFormat:@"x-ms-date:%@", dateString]];
-        [headers addObject:@"x-ms-version:2009-09-19"];
-        [headers sortUsingSelector:@selector(compare:)];
+- (NSString*)signingDateString
+{
+    // the header has one-second resolution, so requests signed within the same second share a string
+    time_t now = time(NULL);
+    NSString* dateString;
+    
+    [_dateLock lock];
+    if(now != _dateSecond || !_dateString)
+    {
+        char buffer[32];
+        struct tm components;
         
-        NSString* headerString = [headers componentsJoinedByString:@"\n"];        
-        NSMutableString *requestString;
-
-        const NSData *cKey  = [SimpleBase64 decode:_accessKey];
+        gmtime_r(&now, &components);
+        strftime_l(buffer, sizeof(buffer), "%a, %d %b %Y %H:%M:%S GMT", &components, NULL);
         
-        if(blobSemantics)
-        {
-            requestString = [NSMutableString stringWithFormat:@"%@\n\n\n%@\n\n%@\n\n\n\n\n\n\n%@\n/%@/", 
-                             httpMethod, contentLength, contentType ? contentType : @"", headerString, _accountName];
-        }
-        else
-        {
-            NSString *contentMD5;
-            
-            if(contentData)
-            {
-                void* buffer = malloc(CC_SHA256_DIGEST_LENGTH);
-                CCHmac(kCCHmacAlgSHA256, [cKey bytes], [cKey length], [contentData bytes], [contentData length], buffer);
-                NSData *encodedData = [NSData dataWithBytesNoCopy:buffer length:CC_SHA256_DIGEST_LENGTH freeWhenDone:YES];
-                contentMD5 = [SimpleBase64 encode:encodedData];
-
-                [authenticatedrequest addValue:contentMD5 forHTTPHeaderField:@"content-md5"];
-            }
-            else
-            {
-                contentMD5 = @"";
-            }
-
-            requestString = [NSMutableString stringWithFormat:@"%@\n%@\n%@\n%@\n/%@/", 
-                             httpMethod, contentMD5, contentType ? contentType : @"", dateString, _accountName];
-        }
+        [_dateString release];
+        _dateString = [[NSString alloc] initWithUTF8String:buffer];
+        _dateSecond = now;
+    }
+    dateString = [[_dateString retain] autorelease];
+    [_dateLock unlock];
     
-        if(endpoint.length > 1)
-        {
-            [requestString appendString:[endpoint substringFromIndex:1]];
-        }             
-        if(query)
-        {
-            [requestString appendString:query];
-        }
-		// Create the hash
-		const NSData *cData = [requestString dataUsingEncoding:NSASCIIStringEncoding];
-		
-        void* buffer = malloc(CC_SHA256_DIGEST_LENGTH);
-		CCHmac(kCCHmacAlgSHA256, [cKey bytes], [cKey length], [cData bytes], [cData length], buffer);
-		
-		NSData *encodedData = [NSData dataWithBytesNoCopy:buffer length:CC_SHA256_DIGEST_LENGTH freeWhenDone:YES];
-		NSString *hash = [SimpleBase64 encode:encodedData];
+    return dateString;
+}
 
-#if FULL_LOGGING
-        // NSLog(@"Request string: %@", requestString);
-        // NSLog(@"Request hash: %@", hash);
-#endif
-        
-		// Append to the Authorization Header
-		NSString *authHeader = [NSString stringWithFormat:@"SharedKey %@:%@", _accountName, hash];
-        
-        // Set the request headers
-        [authenticatedrequest addValue:dateString forHTTPHeaderField:@"x-ms-date"];
-        if(blobSemantics)
-        {
-            [authenticatedrequest addValue:@"2009-09-19" forHTTPHeaderField:@"x-ms-version"];
-        }
-        [authenticatedrequest addValue:authHeader forHTTPHeaderField:@"Authorization"];
-        
-        if(contentType)
-        {
-            [authenticatedrequest addValue:contentType forHTTPHeaderField:@"Content-Type"];
-        }
-            
-        if(contentData && [contentData length] > 0 )
-        {
-            [authenticatedrequest setHTTPBody:contentData];
-        }
-	}
-	return (authenticatedrequest);
+- (CloudURLRequest *)authenticatedRequestWithURL:(NSURL *)serviceURL blobSemantics:(BOOL)blobSemantics httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType args:(va_list)args
+{
+    return [self authenticatedRequestWithURL:serviceURL
+                               blobSemantics:blobSemantics
+                              queueSemantics:NO
+                                  httpMethod:httpMethod
+                                 contentData:contentData
+                                 contentType:contentType
+                                        args:args];
 }
 
 - (CloudURLRequest *)authenticatedRequestWithURL:(NSURL *)serviceURL blobSemantics:(BOOL)blobSemantics queueSemantics:(BOOL)queueSemantics httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType args:(va_list)args
 {
-    NSString* contentLength = contentData ? [NSString stringWithFormat:@"%d", contentData.length] : @"";
-    
+    return [self authenticatedRequestWithURL:serviceURL
+                               blobSemantics:blobSemantics
+                              queueSemantics:queueSemantics
+                                  httpMethod:httpMethod
+                                 contentData:contentData
+                                 contentType:contentType
+                                     headers:nil
+                                        args:args];
+}
+
+- (CloudURLRequest *)authenticatedRequestWithURL:(NSURL *)serviceURL blobSemantics:(BOOL)blobSemantics queueSemantics:(BOOL)queueSemantics httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType headers:(NSDictionary *)headers args:(va_list)args
+{
 	if (!serviceURL)
 	{
 		return nil;
 	}
     
 	CloudURLRequest* authenticatedrequest = [CloudURLRequest requestWithURL:serviceURL];
+    NSTimeInterval signStart = authenticatedrequest.measured ? [NSDate timeIntervalSinceReferenceDate] : 0;
     [authenticatedrequest setHTTPMethod:httpMethod];
+    if(blobSemantics)
+    {
+        // blob traffic yields to table and queue operations; data transfers lower it further
+        authenticatedrequest.priority = CloudRequestPriorityNormal;
+    }
     
     if (_usesProxy)
 	{
@@ -447,8 +512,17 @@ const int AUTHENTICATION_DELAY = 2;
                 
                 for(NSString* arg in [args sortedArrayUsingSelector:@selector(compare:)])
                 {
+                    // the service signs the decoded value, so escaped prefixes and markers have to be unescaped here
+                    NSRange equals = [arg rangeOfString:@"="];
                     [q appendString:@"\n"];
-                    [q appendString:[arg stringByReplacingOccurrencesOfString:@"=" withString:@":"]];
+                    if(equals.location == NSNotFound)
+                    {
+                        [q appendString:arg];
+                        continue;
+                    }
+                    [q appendString:[arg substringToIndex:equals.location]];
+                    [q appendString:@":"];
+                    [q appendString:[[arg substringFromIndex:NSMaxRange(equals)] stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding]];
                 }
                 
                 query = q;
@@ -482,108 +556,135 @@ const int AUTHENTICATION_DELAY = 2;
             }
         }
         
-        // Construct the date in the right format
-		NSDate *date = [NSDate date];
-		NSDateFormatter *dateFormatter = [[NSDateFormatter alloc] init];
-		[dateFormatter setTimeZone:[NSTimeZone timeZoneForSecondsFromGMT:0]];
-		[dateFormatter setDateFormat:@"EEE, dd MMM yyyy HH:mm:ss 'GMT'"];
-		NSString *dateString = [dateFormatter stringFromDate:date];
-        [dateFormatter release];
+        NSString *dateString = [self signingDateString];
 		
-		NSMutableArray* headers = [NSMutableArray arrayWithCapacity:20];
+        // the caller's x-ms-* headers plus our own, kept sorted by name as they are added
+        NSString* names[MAX_SIGNED_HEADERS];
+        NSString* values[MAX_SIGNED_HEADERS];
+        NSUInteger headerCount = 0;
         NSString* name;
         NSString* header;
-        BOOL isName = YES;
-        while((header = va_arg(args, NSString*)))
+        NSString* ifMatch = nil;
+        NSString* ifNoneMatch = nil;
+        BOOL versioned = NO;
+        while((name = va_arg(args, NSString*)) && (header = va_arg(args, NSString*)))
         {
-            if(isName)
+            if([name caseInsensitiveCompare:@"If-None-Match"] == NSOrderedSame || [name caseInsensitiveCompare:@"If-Match"] == NSOrderedSame)
             {
-                name = header;
+                // standard headers with a line of their own in the blob string to sign
+                if([name caseInsensitiveCompare:@"If-Match"] == NSOrderedSame)
+                {
+                    ifMatch = header;
+                }
+                else
+                {
+                    ifNoneMatch = header;
+                }
+                [authenticatedrequest setValue:header forHTTPHeaderField:name];
+                continue;
             }
-            else
+            // operations newer than our default protocol version pin their own
+            versioned = versioned || [name isEqualToString:@"x-ms-version"];
+            if(!InsertSignedHeader(names, values, &headerCount, name, header))
             {
-                [headers addObject:[NSString stringWithFormat:@"%@:%@", name, header]];
-                [authenticatedrequest setValue:header forHTTPHeaderField:name];
+                return nil;
             }
-            isName = !isName;
+            [authenticatedrequest setValue:header forHTTPHeaderField:name];
         }
-        [headers addObject:[NSString stringWithFormat:@"x-ms-date:%@", dateString]];
-        if (!queueSemantics) {
-            [headers addObject:@"x-ms-version:2009-09-19"];
+        for(name in headers)
+        {
+            // metadata names come from the caller as typed, but are signed in their canonical lower case
+            header = [headers objectForKey:name];
+            name = [name lowercaseString];
+            versioned = versioned || [name isEqualToString:@"x-ms-version"];
+            if(!InsertSignedHeader(names, values, &headerCount, name, header))
+            {
+                return nil;
+            }
+            [authenticatedrequest setValue:header forHTTPHeaderField:name];
+        }
+        if(!InsertSignedHeader(names, values, &headerCount, @"x-ms-date", dateString) ||
+           (!queueSemantics && !versioned && !InsertSignedHeader(names, values, &headerCount, @"x-ms-version", @"2009-09-19")))
+        {
+            return nil;
         }
-        [headers sortUsingSelector:@selector(compare:)];
-        
-        NSString* headerString = [headers componentsJoinedByString:@"\n"];        
-        NSMutableString *requestString;
         
-        const NSData *cKey  = [SimpleBase64 decode:_accessKey];
+        SigningBuffer requestString;
+        SigningBufferInit(&requestString);
+        SigningBufferAppendString(&requestString, httpMethod);
         
         if(blobSemantics)
         {
-            requestString = [NSMutableString stringWithFormat:@"%@\n\n\n%@\n\n%@\n\n\n\n\n\n\n%@\n/%@/", 
-                             httpMethod, contentLength, contentType ? contentType : @"", headerString, _accountName];
+            char contentLength[24] = "";
+            if(contentData)
+            {
+                snprintf(contentLength, sizeof(contentLength), "%lu", (unsigned long)[contentData length]);
+            }
+            
+            SigningBufferAppendBytes(&requestString, "\n\n\n", 3);
+            SigningBufferAppendBytes(&requestString, contentLength, strlen(contentLength));
+            SigningBufferAppendBytes(&requestString, "\n\n", 2);
+            SigningBufferAppendString(&requestString, contentType);
+            // Date and If-Modified-Since, then If-Match, If-None-Match, If-Unmodified-Since and Range
+            SigningBufferAppendBytes(&requestString, "\n\n\n", 3);
+            SigningBufferAppendString(&requestString, ifMatch);
+            SigningBufferAppendBytes(&requestString, "\n", 1);
+            SigningBufferAppendString(&requestString, ifNoneMatch);
+            SigningBufferAppendBytes(&requestString, "\n\n\n", 3);
+            SigningBufferAppendHeaders(&requestString, names, values, headerCount);
         }
         else if(queueSemantics)
         {
-            if (contentType != nil && [contentType length] > 0) {
-                requestString = [NSMutableString stringWithFormat:@"%@\n\n%@\n\n%@\n/%@/", 
-                                 httpMethod, contentType, headerString, _accountName];
-            }
-            else {
-                requestString = [NSMutableString stringWithFormat:@"%@\n\n\n\n%@\n/%@/", 
-                                 httpMethod, headerString, _accountName];
-            }
+            SigningBufferAppendBytes(&requestString, "\n\n", 2);
+            SigningBufferAppendString(&requestString, contentType);
+            SigningBufferAppendBytes(&requestString, "\n\n", 2);
+            SigningBufferAppendHeaders(&requestString, names, values, headerCount);
         }
         else
         {
-            NSString *contentMD5;
+            NSString *contentMD5 = nil;
             
             if(contentData)
             {
-                void* buffer = malloc(CC_SHA256_DIGEST_LENGTH);
-                CCHmac(kCCHmacAlgSHA256, [cKey bytes], [cKey length], [contentData bytes], [contentData length], buffer);
-                NSData *encodedData = [NSData dataWithBytesNoCopy:buffer length:CC_SHA256_DIGEST_LENGTH freeWhenDone:YES];
-                contentMD5 = [SimpleBase64 encode:encodedData];
-                
+                contentMD5 = [self signatureForBytes:[contentData bytes] length:[contentData length]];
                 [authenticatedrequest addValue:contentMD5 forHTTPHeaderField:@"content-md5"];
             }
-            else
-            {
-                contentMD5 = @"";
-            }
             
-            requestString = [NSMutableString stringWithFormat:@"%@\n%@\n%@\n%@\n/%@/", 
-                             httpMethod, contentMD5, contentType ? contentType : @"", dateString, _accountName];
+            SigningBufferAppendBytes(&requestString, "\n", 1);
+            SigningBufferAppendString(&requestString, contentMD5);
+            SigningBufferAppendBytes(&requestString, "\n", 1);
+            SigningBufferAppendString(&requestString, contentType);
+            SigningBufferAppendBytes(&requestString, "\n", 1);
+            SigningBufferAppendString(&requestString, dateString);
         }
         
+        SigningBufferAppendBytes(&requestString, "\n/", 2);
+        SigningBufferAppendString(&requestString, _accountName);
+        SigningBufferAppendBytes(&requestString, "/", 1);
         if(endpoint.length > 1)
         {
-            [requestString appendString:[endpoint substringFromIndex:1]];
+            SigningBufferAppendString(&requestString, [endpoint substringFromIndex:1]);
         }             
         if(query)
         {
-            [requestString appendString:query];
+            SigningBufferAppendString(&requestString, query);
         }
+        
 		// Create the hash
-		const NSData *cData = [requestString dataUsingEncoding:NSASCIIStringEncoding];
-		
-        void* buffer = malloc(CC_SHA256_DIGEST_LENGTH);
-		CCHmac(kCCHmacAlgSHA256, [cKey bytes], [cKey length], [cData bytes], [cData length], buffer);
-		
-		NSData *encodedData = [NSData dataWithBytesNoCopy:buffer length:CC_SHA256_DIGEST_LENGTH freeWhenDone:YES];
-		NSString *hash = [SimpleBase64 encode:encodedData];
+		NSString *hash = [self signatureForBytes:requestString.bytes length:requestString.length];
         
 #if FULL_LOGGING
-         NSLog(@"Request string: %@", requestString);
+         NSLog(@"Request string: %@", [[[NSString alloc] initWithBytes:requestString.bytes length:requestString.length encoding:NSUTF8StringEncoding] autorelease]);
         // NSLog(@"Request hash: %@", hash);
 #endif
+        SigningBufferFree(&requestString);
         
 		// Append to the Authorization Header
 		NSString *authHeader = [NSString stringWithFormat:@"SharedKey %@:%@", _accountName, hash];
         
         // Set the request headers
         [authenticatedrequest addValue:dateString forHTTPHeaderField:@"x-ms-date"];
-        if(blobSemantics)
+        if(blobSemantics && !versioned)
         {
             [authenticatedrequest addValue:@"2009-09-19" forHTTPHeaderField:@"x-ms-version"];
         }
@@ -599,6 +700,11 @@ const int AUTHENTICATION_DELAY = 2;
             [authenticatedrequest setHTTPBody:contentData];
         }
 	}
+    
+    if(signStart)
+    {
+        [authenticatedrequest markSignedSince:signStart];
+    }
 	return (authenticatedrequest);
 }
 
@@ -742,6 +848,29 @@ const int AUTHENTICATION_DELAY = 2;
     return request;
 }
 
+- (CloudURLRequest *)authenticatedRequestWithEndpoint:(NSString *)endpoint forStorageType:(NSString *)storageType httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType headers:(NSDictionary *)headers, ...
+{
+    va_list arg;
+    va_start(arg, headers);
+    
+    BOOL blobSemantics = [[storageType lowercaseString] isEqualToString:@"blob"];
+    BOOL queueSemantics = [[storageType lowercaseString] isEqualToString:@"queue"];
+    NSURL* serviceURL = [self URLforEndpoint:endpoint forStorageType:storageType];
+    
+    CloudURLRequest* request = [self authenticatedRequestWithURL:serviceURL 
+                                                   blobSemantics:blobSemantics
+                                                  queueSemantics:queueSemantics
+                                                      httpMethod:httpMethod 
+                                                     contentData:contentData 
+                                                     contentType:contentType
+                                                         headers:headers
+                                                            args:arg];
+    
+    va_end(arg);
+    
+    return request;
+}
+
 - (CloudURLRequest *)authenticatedBlobRequestWithURL:(NSURL *)serviceURL forStorageType:(NSString *)storageType httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType, ...
 {
     
@@ -761,6 +890,192 @@ const int AUTHENTICATION_DELAY = 2;
     return request;
 }
 
+- (CloudURLRequest *)authenticatedRequestWithEndpoint:(NSString *)endpoint signature:(SharedAccessSignature *)signature httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType, ...
+{
+    NSURL* serviceURL = [signature URLForEndpoint:endpoint];
+    if(!serviceURL)
+    {
+        return nil;
+    }
+    
+    CloudURLRequest* request = [CloudURLRequest requestWithURL:serviceURL];
+    [request setHTTPMethod:httpMethod];
+    request.priority = CloudRequestPriorityNormal;
+    
+    va_list args;
+    va_start(args, contentType);
+    NSString* name;
+    NSString* header;
+    while((name = va_arg(args, NSString*)) && (header = va_arg(args, NSString*)))
+    {
+        [request setValue:header forHTTPHeaderField:name];
+    }
+    va_end(args);
+    
+    if(contentType)
+    {
+        [request addValue:contentType forHTTPHeaderField:@"Content-Type"];
+    }
+    
+    if(contentData && [contentData length] > 0)
+    {
+        [request setHTTPBody:contentData];
+    }
+    
+    return request;
+}
+
+#pragma mark Shared access signatures
+
+- (dispatch_queue_t)requestCallbackQueue
+{
+    return _signatureQueue;
+}
+
+- (void)sharedAccessSignatureForContainer:(NSString *)containerName withBlock:(void (^)(SharedAccessSignature *))block
+{
+    if(!_usesProxy || !containerName)
+    {
+        block(nil);
+        return;
+    }
+    
+    NSString* key = [containerName lowercaseString];
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    SharedAccessSignature* signature = nil;
+    BOOL fetch = NO;
+    
+    [_signatureLock lock];
+    SignatureCacheEntry* entry = [_signatures objectForKey:key];
+    if(!entry)
+    {
+        entry = [[[SignatureCacheEntry alloc] init] autorelease];
+        [_signatures setObject:entry forKey:key];
+    }
+    
+    if(entry->_signature && now < entry->_signature.expiry - SIGNATURE_EXPIRY_MARGIN)
+    {
+        signature = [[entry->_signature retain] autorelease];
+        entry->_used = YES;
+        // normally the refresh timer has already seen to this
+        fetch = !entry->_waiters && now >= SignatureRefreshTime(signature) && now >= entry->_retryAfter;
+        if(fetch)
+        {
+            entry->_waiters = [[NSMutableArray alloc] initWithCapacity:4];
+        }
+    }
+    else if(now >= entry->_retryAfter)
+    {
+        fetch = !entry->_waiters;
+        if(fetch)
+        {
+            entry->_waiters = [[NSMutableArray alloc] initWithCapacity:4];
+        }
+        [entry->_waiters addObject:[[block copy] autorelease]];
+        block = nil;
+    }
+    [_signatureLock unlock];
+    
+    if(fetch)
+    {
+        [self fetchSignatureForContainer:key];
+    }
+    if(block)
+    {
+        block(signature);
+    }
+}
+
+- (void)fetchSignatureForContainer:(NSString *)key
+{
+    NSString* endpoint = [NSString stringWithFormat:@"/SharedAccessSignatureService/container/%@", [key URLEncode]];
+    CloudURLRequest* request = [self authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob", nil];
+    
+    request.owner = self;
+    [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
+     {
+         SharedAccessSignature* signature = nil;
+         
+         if(!error)
+         {
+             signature = [SharedAccessSignature signatureWithURLString:[XmlHelper getElementValue:(xmlNodePtr)doc name:@"string"]
+                                                       assumedLifetime:SIGNATURE_ASSUMED_LIFETIME];
+         }
+         
+         [self storeSignature:signature forContainer:key];
+     }];
+}
+
+- (void)storeSignature:(SharedAccessSignature *)signature forContainer:(NSString *)key
+{
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    
+    if(signature.expiry - SIGNATURE_EXPIRY_MARGIN <= now)
+    {
+        // too short-lived to be of any use
+        signature = nil;
+    }
+    
+    [_signatureLock lock];
+    SignatureCacheEntry* entry = [_signatures objectForKey:key];
+    NSArray* waiters = [entry->_waiters autorelease];
+    entry->_waiters = nil;
+    
+    if(signature)
+    {
+        [entry->_signature release];
+        entry->_signature = [signature retain];
+        entry->_used = NO;
+    }
+    else
+    {
+        // a failed refresh leaves the signature in hand in use until it runs out
+        entry->_retryAfter = now + SIGNATURE_RETRY_INTERVAL;
+    }
+    
+    SharedAccessSignature* current = entry->_signature;
+    if(current && now >= current.expiry - SIGNATURE_EXPIRY_MARGIN)
+    {
+        current = nil;
+    }
+    current = [[current retain] autorelease];
+    [_signatureLock unlock];
+    
+    if(signature)
+    {
+        NSTimeInterval delay = SignatureRefreshTime(signature) - now;
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _signatureQueue, ^{
+            [self refreshSignature:signature forContainer:key];
+        });
+    }
+    
+    for(void (^waiter)(SharedAccessSignature*) in waiters)
+    {
+        waiter(current);
+    }
+}
+
+- (void)refreshSignature:(SharedAccessSignature *)signature forContainer:(NSString *)key
+{
+    BOOL fetch = NO;
+    
+    [_signatureLock lock];
+    SignatureCacheEntry* entry = [_signatures objectForKey:key];
+    // containers that saw no requests since the last fetch are left to lapse, and a signature
+    // already replaced by a fetch made on demand has nothing left to refresh
+    if(entry->_signature == signature && entry->_used && !entry->_waiters)
+    {
+        entry->_waiters = [[NSMutableArray alloc] initWithCapacity:4];
+        fetch = YES;
+    }
+    [_signatureLock unlock];
+    
+    if(fetch)
+    {
+        [self fetchSignatureForContainer:key];
+    }
+}
+
 #pragma mark -
 
 - (void)dealloc
@@ -773,6 +1088,15 @@ const int AUTHENTICATION_DELAY = 2;
 	[_password release];
 	[_blobServiceURL release];
 	[_tableServiceURL release];
+	[_dateLock release];
+	[_dateString release];
+	[_signatureLock release];
+	[_signatures release];
+	if(_signatureQueue)
+	{
+		dispatch_release(_signatureQueue);
+	}
+	free(_signingContext);
 	
 	[super dealloc];
 }
@@ -0,0 +1,90 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "Blob.h"
+#import "BlobContainer.h"
+#import "BlobListRequest.h"
+
+@class CloudStorageClient;
+
+/*! What a BlobBulkOperation does to each blob. */
+typedef enum
+{
+    BlobBulkActionDelete = 0,
+    BlobBulkActionCopy,
+    BlobBulkActionSetMetadata,
+    BlobBulkActionSetProperties
+} BlobBulkAction;
+
+/*! BlobBulkOperation applies one action to every blob of a listing, or of a given array: a delete, a server-side copy into another container, or a metadata or properties update. Up to concurrency blobs are worked on at once, and listing pages are fetched one at a time as that work drains, so only about a page of blobs is held however large the container. Each outcome is reported to resultBlock as it arrives. A blob that fails does not stop the run; it is counted and reported, and the run moves on. The operation stays alive while it is running. Its state is changed by the storage client's callbacks, so call the run methods and stop on the client's callbackQueue, the main queue by default; resultBlock and the run's block are called there too. */
+@interface BlobBulkOperation : NSObject
+{
+    CloudStorageClient* _client;
+    BlobBulkAction _action;
+    BlobContainer* _destination;
+    NSDictionary* _values;
+    NSUInteger _concurrency;
+    void (^_resultBlock)(Blob *, NSError *);
+    
+    BOOL _running;
+    BOOL _listing;
+    BOOL _dispatching;
+    BlobListRequest* _nextRequest;
+    NSMutableArray* _pages;
+    NSUInteger _activeCount;
+    NSUInteger _listedCount;
+    NSUInteger _succeededCount;
+    NSUInteger _failedCount;
+    NSString* _checkpoint;
+    NSError* _error;
+    void (^_completion)(NSError *);
+}
+
+/*! The action applied to each blob. */
+@property (readonly) BlobBulkAction action;
+/*! The most blobs worked on at once. Defaults to 16. */
+@property (assign) NSUInteger concurrency;
+/*! Called with each blob once its request has been answered, with the error when it failed. A delete of a blob that is already gone counts as a success, so a resumed run can go over blobs it handled before. */
+@property (copy) void (^resultBlock)(Blob *, NSError *);
+/*! Blobs listed, or given, so far in the current run. */
+@property (readonly) NSUInteger listedCount;
+/*! Blobs the action succeeded for so far in the current run. */
+@property (readonly) NSUInteger succeededCount;
+/*! Blobs the action failed for so far in the current run. */
+@property (readonly) NSUInteger failedCount;
+/*! The marker to resume a listing from: every blob listed ahead of it has been handled. Set it as the marker of the list request of a later run to carry on after a stop, a crash or a listing failure; some blobs may be handled a second time. nil until the first page is done when the run started at the beginning of the listing, and once the listing has been worked through. */
+@property (readonly) NSString* checkpoint;
+/*! Whether the operation is running. */
+@property (readonly) BOOL running;
+
+/*! Applies the action to each blob of a listing, page by page. Blob names rolled up by the request's delimiter are not descended into. The block is called once every listed blob has been handled, with nil, or with the error that ended the listing early, or with NSURLErrorCancelled after stop. */
+- (void)runWithListRequest:(BlobListRequest *)listRequest withBlock:(void (^)(NSError *))block;
+/*! Applies the action to each blob in an array. The block is called once all have been handled, or with NSURLErrorCancelled after stop. */
+- (void)runWithBlobs:(NSArray *)blobs withBlock:(void (^)(NSError *))block;
+/*! Stops starting work on further blobs. Requests already sent are answered and reported as usual, then the run's block is called. */
+- (void)stop;
+
+/*! Creates an operation that deletes blobs. */
++ (BlobBulkOperation*)deleteOperationWithStorageClient:(CloudStorageClient*)client;
+/*! Creates an operation that copies blobs into the specified container under their own names. */
++ (BlobBulkOperation*)copyOperationWithStorageClient:(CloudStorageClient*)client toContainer:(BlobContainer*)container;
+/*! Creates an operation that replaces the metadata of blobs with the specified names and values. */
++ (BlobBulkOperation*)metadataOperationWithStorageClient:(CloudStorageClient*)client metadata:(NSDictionary*)metadata;
+/*! Creates an operation that sets the properties of blobs, keyed by header name as for setBlobProperties:properties:withBlock:. */
++ (BlobBulkOperation*)propertiesOperationWithStorageClient:(CloudStorageClient*)client properties:(NSDictionary*)properties;
+
+@end
@@ -0,0 +1,403 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "BlobBulkOperation.h"
+#import "CloudStorageClient+Private.h"
+
+// A page of blobs being worked through, with the marker it was listed from. The checkpoint only
+// moves past a page once every blob on it has been answered.
+@interface BlobBulkPage : NSObject
+{
+@public
+    NSString* _marker;
+    NSArray* _blobs;
+    NSUInteger _started;
+    NSUInteger _finished;
+}
+@end
+
+@implementation BlobBulkPage
+
+- (void)dealloc
+{
+    [_marker release];
+    [_blobs release];
+    
+    [super dealloc];
+}
+
+@end
+
+@implementation BlobBulkOperation
+
+@synthesize action = _action;
+@synthesize concurrency = _concurrency;
+@synthesize resultBlock = _resultBlock;
+@synthesize listedCount = _listedCount;
+@synthesize succeededCount = _succeededCount;
+@synthesize failedCount = _failedCount;
+@synthesize checkpoint = _checkpoint;
+@synthesize running = _running;
+
+- (id)initWithStorageClient:(CloudStorageClient*)client action:(BlobBulkAction)action destination:(BlobContainer*)destination values:(NSDictionary*)values
+{
+    if((self = [super init]))
+    {
+        _client = [client retain];
+        _action = action;
+        _destination = [destination retain];
+        _values = [values copy];
+        _concurrency = 16;
+        _pages = [[NSMutableArray alloc] initWithCapacity:2];
+    }
+    
+    return self;
+}
+
++ (BlobBulkOperation*)deleteOperationWithStorageClient:(CloudStorageClient*)client
+{
+    return [[[BlobBulkOperation alloc] initWithStorageClient:client action:BlobBulkActionDelete destination:nil values:nil] autorelease];
+}
+
++ (BlobBulkOperation*)copyOperationWithStorageClient:(CloudStorageClient*)client toContainer:(BlobContainer*)container
+{
+    return [[[BlobBulkOperation alloc] initWithStorageClient:client action:BlobBulkActionCopy destination:container values:nil] autorelease];
+}
+
++ (BlobBulkOperation*)metadataOperationWithStorageClient:(CloudStorageClient*)client metadata:(NSDictionary*)metadata
+{
+    return [[[BlobBulkOperation alloc] initWithStorageClient:client action:BlobBulkActionSetMetadata destination:nil values:metadata] autorelease];
+}
+
++ (BlobBulkOperation*)propertiesOperationWithStorageClient:(CloudStorageClient*)client properties:(NSDictionary*)properties
+{
+    return [[[BlobBulkOperation alloc] initWithStorageClient:client action:BlobBulkActionSetProperties destination:nil values:properties] autorelease];
+}
+
+- (void)dealloc
+{
+    [_client release];
+    [_destination release];
+    [_values release];
+    [_resultBlock release];
+    [_nextRequest release];
+    [_pages release];
+    [_checkpoint release];
+    [_error release];
+    [_completion release];
+    
+    [super dealloc];
+}
+
+#pragma mark Checkpoint
+
+- (void)setCheckpoint:(NSString*)checkpoint
+{
+    if(checkpoint != _checkpoint)
+    {
+        [_checkpoint release];
+        _checkpoint = [checkpoint copy];
+    }
+}
+
+- (void)advanceCheckpoint
+{
+    BOOL advanced = NO;
+    
+    while(_pages.count > 0)
+    {
+        BlobBulkPage* page = [_pages objectAtIndex:0];
+        if(page->_finished < page->_blobs.count)
+        {
+            break;
+        }
+        [_pages removeObjectAtIndex:0];
+        advanced = YES;
+    }
+    
+    if(!advanced)
+    {
+        return;
+    }
+    
+    if(_pages.count > 0)
+    {
+        BlobBulkPage* page = [_pages objectAtIndex:0];
+        [self setCheckpoint:page->_marker];
+    }
+    else
+    {
+        [self setCheckpoint:_nextRequest.marker];
+    }
+}
+
+#pragma mark Working
+
+- (NSUInteger)waitingCount
+{
+    NSUInteger count = 0;
+    
+    for(BlobBulkPage* page in _pages)
+    {
+        count += page->_blobs.count - page->_started;
+    }
+    
+    return count;
+}
+
+- (BOOL)isDeleteOfMissingBlob:(NSError*)error
+{
+    // an earlier run, or another client, got there first
+    return _action == BlobBulkActionDelete && [[[error userInfo] objectForKey:@"AzureReasonCode"] isEqualToString:@"BlobNotFound"];
+}
+
+- (void)applyToBlob:(Blob*)blob withBlock:(void (^)(NSError*))block
+{
+    switch(_action)
+    {
+        case BlobBulkActionDelete:
+            [_client deleteBlob:blob withBlock:block];
+            break;
+        case BlobBulkActionCopy:
+            [_client copyBlob:blob toContainer:_destination blobName:blob.name withBlock:block];
+            break;
+        case BlobBulkActionSetMetadata:
+            [_client setBlobMetadata:blob metadata:_values withBlock:block];
+            break;
+        case BlobBulkActionSetProperties:
+            [_client setBlobProperties:blob properties:_values withBlock:block];
+            break;
+    }
+}
+
+- (void)finishIfDone
+{
+    if(!_completion || _listing || _activeCount > 0)
+    {
+        return;
+    }
+    
+    if(_running && !_error && ([self waitingCount] > 0 || _nextRequest))
+    {
+        return;
+    }
+    
+    NSError* error = _error;
+    if(!error && !_running)
+    {
+        error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil];
+    }
+    
+    void (^completion)(NSError*) = [_completion autorelease];
+    _completion = nil;
+    _running = NO;
+    
+    completion(error);
+}
+
+- (BlobBulkPage*)nextPage
+{
+    for(BlobBulkPage* page in _pages)
+    {
+        if(page->_started < page->_blobs.count)
+        {
+            return page;
+        }
+    }
+    
+    return nil;
+}
+
+- (void)dispatch
+{
+    // a request that fails before it is sent answers straight away; rather than recursing once per
+    // blob, that answer leaves the next one to the loop already running
+    if(_dispatching)
+    {
+        return;
+    }
+    _dispatching = YES;
+    
+    BlobBulkPage* page;
+    while(_running && _activeCount < MAX(_concurrency, (NSUInteger)1) && (page = [self nextPage]))
+    {
+        Blob* blob = [page->_blobs objectAtIndex:page->_started++];
+        
+        __block BOOL finished = NO;
+        _activeCount++;
+        [self applyToBlob:blob withBlock:^(NSError* error)
+         {
+             if(finished)
+             {
+                 return;
+             }
+             finished = YES;
+             _activeCount--;
+             page->_finished++;
+             
+             if(error && [self isDeleteOfMissingBlob:error])
+             {
+                 error = nil;
+             }
+             
+             if(error)
+             {
+                 _failedCount++;
+             }
+             else
+             {
+                 _succeededCount++;
+             }
+             
+             if(_resultBlock)
+             {
+                 _resultBlock(blob, error);
+             }
+             
+             [self advanceCheckpoint];
+             [self dispatch];
+             [self fill];
+             [self finishIfDone];
+         }];
+    }
+    
+    _dispatching = NO;
+}
+
+- (void)fill
+{
+    if(!_running || _listing || _error || !_nextRequest)
+    {
+        return;
+    }
+    
+    // the next page is asked for while the one before is still being worked on, so the requests never run dry
+    if([self waitingCount] >= MAX(_concurrency, (NSUInteger)1))
+    {
+        return;
+    }
+    
+    BlobListRequest* listRequest = [[_nextRequest retain] autorelease];
+    
+    _listing = YES;
+    [_client privateGetListPage:listRequest withBlock:^(NSArray* blobs, NSArray* prefixes, BlobListRequest* nextRequest, NSError* error)
+     {
+         _listing = NO;
+         
+         if(error)
+         {
+             // the checkpoint stays at the failed page, so a later run can retry it
+             [_error release];
+             _error = [error retain];
+         }
+         else if(_running)
+         {
+             _listedCount += blobs.count;
+             
+             [_nextRequest release];
+             _nextRequest = [nextRequest retain];
+             
+             if(blobs.count > 0)
+             {
+                 BlobBulkPage* page = [[BlobBulkPage alloc] init];
+                 page->_marker = [listRequest.marker copy];
+                 page->_blobs = [blobs retain];
+                 [_pages addObject:page];
+                 [page release];
+             }
+             else if(_pages.count == 0)
+             {
+                 [self setCheckpoint:_nextRequest.marker];
+             }
+         }
+         
+         [self dispatch];
+         [self fill];
+         [self finishIfDone];
+     }];
+}
+
+#pragma mark Running
+
+- (void)resetForRun
+{
+    [_pages removeAllObjects];
+    [_error release];
+    _error = nil;
+    _listedCount = 0;
+    _succeededCount = 0;
+    _failedCount = 0;
+}
+
+- (void)startWithBlock:(void (^)(NSError *))block
+{
+    [_completion release];
+    _completion = [(block ? block : ^(NSError* error) {}) copy];
+    _running = YES;
+    
+    [self dispatch];
+    [self fill];
+    [self finishIfDone];
+}
+
+- (void)runWithListRequest:(BlobListRequest *)listRequest withBlock:(void (^)(NSError *))block
+{
+    // a stopped run is still winding down until its block has been called
+    if(_running || _completion)
+    {
+        return;
+    }
+    
+    [self resetForRun];
+    [_nextRequest release];
+    _nextRequest = [listRequest retain];
+    [self setCheckpoint:listRequest.marker];
+    
+    [self startWithBlock:block];
+}
+
+- (void)runWithBlobs:(NSArray *)blobs withBlock:(void (^)(NSError *))block
+{
+    if(_running || _completion)
+    {
+        return;
+    }
+    
+    [self resetForRun];
+    [_nextRequest release];
+    _nextRequest = nil;
+    [self setCheckpoint:nil];
+    _listedCount = blobs.count;
+    
+    if(blobs.count > 0)
+    {
+        BlobBulkPage* page = [[BlobBulkPage alloc] init];
+        page->_blobs = [blobs copy];
+        [_pages addObject:page];
+        [page release];
+    }
+    
+    [self startWithBlock:block];
+}
+
+- (void)stop
+{
+    _running = NO;
+    
+    [self finishIfDone];
+}
+
+@end
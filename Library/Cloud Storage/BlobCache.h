@@ -0,0 +1,67 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/*! A size-bounded on-disk cache of blob contents. Each blob is stored with the ETag it was downloaded with, so a storage client can revalidate it with If-None-Match and skip the download when the service answers 304 Not Modified. Cached contents are returned memory-mapped rather than read into memory. When the cache grows past its capacity, the least recently used blobs are removed. */
+@interface BlobCache : NSObject
+{
+    NSLock* _lock;
+    NSString* _directory;
+    unsigned long long _capacity;
+    unsigned long long _size;
+    NSMutableDictionary* _entries;
+    NSOperationQueue* _writeQueue;
+    NSUInteger _hitCount;
+    NSUInteger _missCount;
+    NSUInteger _revalidationCount;
+}
+
+/*! The directory holding the cached blobs. */
+@property (readonly) NSString* directory;
+/*! The largest number of bytes the cache holds. Lowering it evicts blobs right away. */
+@property (assign) unsigned long long capacity;
+/*! The number of bytes currently cached. */
+@property (readonly) unsigned long long size;
+/*! The number of blobs currently cached. */
+@property (readonly) NSUInteger blobCount;
+/*! The number of downloads answered from the cache after the service confirmed the cached copy was current. */
+@property (readonly) NSUInteger hitCount;
+/*! The number of downloads that had to fetch the blob contents, because nothing was cached or the cached copy had changed. */
+@property (readonly) NSUInteger missCount;
+/*! The number of conditional downloads sent to revalidate a cached copy. */
+@property (readonly) NSUInteger revalidationCount;
+
+/*! Opens, or creates, a cache in directory. Blobs cached there by an earlier run are kept. */
+- (id)initWithDirectory:(NSString*)directory capacity:(unsigned long long)capacity;
+
+/*! Returns the cached copy of a blob, memory-mapped, or nil if it isn't cached. */
+- (NSData*)dataForContainer:(NSString*)containerName blobName:(NSString*)blobName;
+/*! Returns the ETag of the cached copy of a blob, or nil if it isn't cached. */
+- (NSString*)etagForContainer:(NSString*)containerName blobName:(NSString*)blobName;
+/*! Stores a blob's contents with the ETag they were downloaded with. The file is written in the background; until it is complete the blob is not cached. */
+- (void)storeData:(NSData*)data etag:(NSString*)etag container:(NSString*)containerName blobName:(NSString*)blobName;
+/*! Removes one blob from the cache. */
+- (void)removeBlobForContainer:(NSString*)containerName blobName:(NSString*)blobName;
+/*! Removes every blob from the cache. */
+- (void)removeAllBlobs;
+/*! Resets the hit, miss and revalidation counters. */
+- (void)resetCounters;
+
+/*! Returns a cache in the application's Caches directory. */
++ (BlobCache*)cacheWithCapacity:(unsigned long long)capacity;
+
+@end
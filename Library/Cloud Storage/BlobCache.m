@@ -0,0 +1,381 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "BlobCache.h"
+#import <CommonCrypto/CommonDigest.h>
+#import <sys/xattr.h>
+#import <sys/time.h>
+
+// the ETag travels with the file, so an entry is never half-described after a crash
+#define ETAG_ATTRIBUTE "com.microsoft.AzureIOSToolkit.etag"
+
+@interface BlobCacheEntry : NSObject
+{
+@public
+    NSString* _etag;
+    unsigned long long _size;
+    NSTimeInterval _lastAccess;
+}
+@end
+
+@implementation BlobCacheEntry
+
+- (void)dealloc
+{
+    [_etag release];
+    
+    [super dealloc];
+}
+
+@end
+
+@implementation BlobCache
+
+@synthesize directory = _directory;
+
+- (id)initWithDirectory:(NSString*)directory capacity:(unsigned long long)capacity
+{
+    if((self = [super init]))
+    {
+        _lock = [[NSLock alloc] init];
+        _directory = [directory copy];
+        _capacity = capacity;
+        _entries = [[NSMutableDictionary alloc] initWithCapacity:64];
+        _writeQueue = [[NSOperationQueue alloc] init];
+        [_writeQueue setMaxConcurrentOperationCount:1];
+        
+        [[NSFileManager defaultManager] createDirectoryAtPath:_directory withIntermediateDirectories:YES attributes:nil error:NULL];
+        [self loadEntries];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_writeQueue waitUntilAllOperationsAreFinished];
+    [_lock release];
+    [_directory release];
+    [_entries release];
+    [_writeQueue release];
+    
+    [super dealloc];
+}
+
++ (BlobCache*)cacheWithCapacity:(unsigned long long)capacity
+{
+    NSString* caches = [NSSearchPathForDirectoriesInDomains(NSCachesDirectory, NSUserDomainMask, YES) lastObject];
+    return [[[BlobCache alloc] initWithDirectory:[caches stringByAppendingPathComponent:@"BlobCache"] capacity:capacity] autorelease];
+}
+
+#pragma mark Files
+
+- (NSString*)fileNameForContainer:(NSString*)containerName blobName:(NSString*)blobName
+{
+    NSData* key = [[NSString stringWithFormat:@"%@/%@", containerName, blobName] dataUsingEncoding:NSUTF8StringEncoding];
+    unsigned char digest[CC_SHA1_DIGEST_LENGTH];
+    CC_SHA1([key bytes], (CC_LONG)[key length], digest);
+    
+    NSMutableString* name = [NSMutableString stringWithCapacity:CC_SHA1_DIGEST_LENGTH * 2];
+    for(NSUInteger index = 0; index < CC_SHA1_DIGEST_LENGTH; index++)
+    {
+        [name appendFormat:@"%02x", digest[index]];
+    }
+    
+    return name;
+}
+
+- (NSString*)pathForFileName:(NSString*)fileName
+{
+    return [_directory stringByAppendingPathComponent:fileName];
+}
+
+// Rebuilds the index from the directory; the modification date stands in for the last access.
+- (void)loadEntries
+{
+    NSFileManager* fileManager = [NSFileManager defaultManager];
+    
+    for(NSString* fileName in [fileManager contentsOfDirectoryAtPath:_directory error:NULL])
+    {
+        NSString* path = [self pathForFileName:fileName];
+        char etag[256];
+        ssize_t length = getxattr([path fileSystemRepresentation], ETAG_ATTRIBUTE, etag, sizeof(etag), 0, 0);
+        
+        if([[fileName pathExtension] length] > 0 || length <= 0)
+        {
+            // an interrupted write
+            [fileManager removeItemAtPath:path error:NULL];
+            continue;
+        }
+        
+        NSDictionary* attributes = [fileManager attributesOfItemAtPath:path error:NULL];
+        BlobCacheEntry* entry = [[BlobCacheEntry alloc] init];
+        entry->_etag = [[NSString alloc] initWithBytes:etag length:length encoding:NSUTF8StringEncoding];
+        entry->_size = [attributes fileSize];
+        entry->_lastAccess = [[attributes fileModificationDate] timeIntervalSinceReferenceDate];
+        
+        _size += entry->_size;
+        [_entries setObject:entry forKey:fileName];
+        [entry release];
+    }
+    
+    [self evictToCapacity];
+}
+
+// called with the lock held
+- (void)evictToCapacity
+{
+    while(_size > _capacity && [_entries count] > 0)
+    {
+        NSString* oldestName = nil;
+        BlobCacheEntry* oldest = nil;
+        
+        for(NSString* fileName in _entries)
+        {
+            BlobCacheEntry* entry = [_entries objectForKey:fileName];
+            if(!oldest || entry->_lastAccess < oldest->_lastAccess)
+            {
+                oldest = entry;
+                oldestName = fileName;
+            }
+        }
+        
+        // mapped copies handed out earlier stay readable after the unlink
+        unlink([[self pathForFileName:oldestName] fileSystemRepresentation]);
+        _size -= oldest->_size;
+        [_entries removeObjectForKey:oldestName];
+    }
+}
+
+#pragma mark Counters
+
+- (unsigned long long)capacity
+{
+    [_lock lock];
+    unsigned long long capacity = _capacity;
+    [_lock unlock];
+    
+    return capacity;
+}
+
+- (void)setCapacity:(unsigned long long)capacity
+{
+    [_lock lock];
+    _capacity = capacity;
+    [self evictToCapacity];
+    [_lock unlock];
+}
+
+- (unsigned long long)size
+{
+    [_lock lock];
+    unsigned long long size = _size;
+    [_lock unlock];
+    
+    return size;
+}
+
+- (NSUInteger)blobCount
+{
+    [_lock lock];
+    NSUInteger count = [_entries count];
+    [_lock unlock];
+    
+    return count;
+}
+
+- (NSUInteger)hitCount
+{
+    [_lock lock];
+    NSUInteger count = _hitCount;
+    [_lock unlock];
+    
+    return count;
+}
+
+- (NSUInteger)missCount
+{
+    [_lock lock];
+    NSUInteger count = _missCount;
+    [_lock unlock];
+    
+    return count;
+}
+
+- (NSUInteger)revalidationCount
+{
+    [_lock lock];
+    NSUInteger count = _revalidationCount;
+    [_lock unlock];
+    
+    return count;
+}
+
+- (void)resetCounters
+{
+    [_lock lock];
+    _hitCount = 0;
+    _missCount = 0;
+    _revalidationCount = 0;
+    [_lock unlock];
+}
+
+- (void)noteHit
+{
+    [_lock lock];
+    _hitCount++;
+    [_lock unlock];
+}
+
+- (void)noteMiss
+{
+    [_lock lock];
+    _missCount++;
+    [_lock unlock];
+}
+
+- (void)noteRevalidation
+{
+    [_lock lock];
+    _revalidationCount++;
+    [_lock unlock];
+}
+
+#pragma mark Lookup
+
+- (NSString*)etagForContainer:(NSString*)containerName blobName:(NSString*)blobName
+{
+    NSString* fileName = [self fileNameForContainer:containerName blobName:blobName];
+    
+    [_lock lock];
+    BlobCacheEntry* entry = [_entries objectForKey:fileName];
+    NSString* etag = entry ? [[entry->_etag retain] autorelease] : nil;
+    [_lock unlock];
+    
+    return etag;
+}
+
+- (NSData*)dataForContainer:(NSString*)containerName blobName:(NSString*)blobName
+{
+    NSString* fileName = [self fileNameForContainer:containerName blobName:blobName];
+    NSString* path = [self pathForFileName:fileName];
+    
+    [_lock lock];
+    BlobCacheEntry* entry = [_entries objectForKey:fileName];
+    unsigned long long size = entry ? entry->_size : 0;
+    if(entry)
+    {
+        entry->_lastAccess = [NSDate timeIntervalSinceReferenceDate];
+    }
+    [_lock unlock];
+    
+    if(!entry)
+    {
+        return nil;
+    }
+    
+    // keeps the LRU order across launches
+    utimes([path fileSystemRepresentation], NULL);
+    
+    if(size == 0)
+    {
+        return [NSData data];
+    }
+    
+    NSData* data = [NSData dataWithContentsOfFile:path options:NSDataReadingMappedAlways error:NULL];
+    if(!data)
+    {
+        [self removeBlobForContainer:containerName blobName:blobName];
+    }
+    
+    return data;
+}
+
+#pragma mark Storing
+
+- (void)storeData:(NSData*)data etag:(NSString*)etag container:(NSString*)containerName blobName:(NSString*)blobName
+{
+    if(!etag || !data || [data length] > [self capacity])
+    {
+        return;
+    }
+    
+    NSString* fileName = [self fileNameForContainer:containerName blobName:blobName];
+    NSString* path = [self pathForFileName:fileName];
+    NSString* temporaryPath = [path stringByAppendingPathExtension:@"tmp"];
+    
+    [_writeQueue addOperationWithBlock:^
+     {
+         const char* etagBytes = [etag UTF8String];
+         
+         if(![data writeToFile:temporaryPath atomically:NO] ||
+            setxattr([temporaryPath fileSystemRepresentation], ETAG_ATTRIBUTE, etagBytes, strlen(etagBytes), 0, 0) != 0 ||
+            rename([temporaryPath fileSystemRepresentation], [path fileSystemRepresentation]) != 0)
+         {
+             unlink([temporaryPath fileSystemRepresentation]);
+             return;
+         }
+         
+         BlobCacheEntry* entry = [[BlobCacheEntry alloc] init];
+         entry->_etag = [etag copy];
+         entry->_size = [data length];
+         entry->_lastAccess = [NSDate timeIntervalSinceReferenceDate];
+         
+         [_lock lock];
+         BlobCacheEntry* previous = [_entries objectForKey:fileName];
+         if(previous)
+         {
+             _size -= previous->_size;
+         }
+         [_entries setObject:entry forKey:fileName];
+         _size += entry->_size;
+         [self evictToCapacity];
+         [_lock unlock];
+         
+         [entry release];
+     }];
+}
+
+- (void)removeBlobForContainer:(NSString*)containerName blobName:(NSString*)blobName
+{
+    NSString* fileName = [self fileNameForContainer:containerName blobName:blobName];
+    
+    [_lock lock];
+    BlobCacheEntry* entry = [_entries objectForKey:fileName];
+    if(entry)
+    {
+        unlink([[self pathForFileName:fileName] fileSystemRepresentation]);
+        _size -= entry->_size;
+        [_entries removeObjectForKey:fileName];
+    }
+    [_lock unlock];
+}
+
+- (void)removeAllBlobs
+{
+    [_writeQueue waitUntilAllOperationsAreFinished];
+    
+    [_lock lock];
+    for(NSString* fileName in _entries)
+    {
+        unlink([[self pathForFileName:fileName] fileSystemRepresentation]);
+    }
+    [_entries removeAllObjects];
+    _size = 0;
+    [_lock unlock];
+}
+
+@end
@@ -0,0 +1,47 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class BlobContainer;
+
+/*! BlobListRequest describes a listing of the blobs in a container, or of the containers in the account, narrowed by prefix and grouped by delimiter. */
+@interface BlobListRequest : NSObject
+{
+    BlobContainer* _container;
+    NSString* _prefix;
+    NSString* _delimiter;
+    NSString* _marker;
+    NSInteger _maxResults;
+}
+
+/*! The container whose blobs are listed, or nil when listing containers. */
+@property (readonly) BlobContainer* container;
+/*! Only names starting with this prefix are returned. */
+@property (copy) NSString* prefix;
+/*! Blob names containing the delimiter after the prefix are rolled up into a single prefix entry, like a directory. */
+@property (copy) NSString* delimiter;
+/*! The NextMarker of a previous page to resume the listing from. */
+@property (copy) NSString* marker;
+/*! The largest number of results per page, up to the service limit of 5000. 0 leaves it to the service. */
+@property (assign) NSInteger maxResults;
+
+/*! Creates a request to list the blobs in a container. */
++ (BlobListRequest*)listRequestForContainer:(BlobContainer*)container;
+/*! Creates a request to list the containers in the account. */
++ (BlobListRequest*)listRequestForContainers;
+
+@end
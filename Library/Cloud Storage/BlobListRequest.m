@@ -0,0 +1,109 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "BlobListRequest.h"
+#import "BlobContainer.h"
+#import "NSString+URLEncode.h"
+
+@implementation BlobListRequest
+
+@synthesize container = _container;
+@synthesize prefix = _prefix;
+@synthesize delimiter = _delimiter;
+@synthesize marker = _marker;
+@synthesize maxResults = _maxResults;
+
+- (id)initWithContainer:(BlobContainer*)container
+{
+    if((self = [super init]))
+    {
+        _container = [container retain];
+    }
+    
+    return self;
+}
+
++ (BlobListRequest*)listRequestForContainer:(BlobContainer*)container
+{
+    return [[[BlobListRequest alloc] initWithContainer:container] autorelease];
+}
+
++ (BlobListRequest*)listRequestForContainers
+{
+    return [[[BlobListRequest alloc] initWithContainer:nil] autorelease];
+}
+
+- (BlobListRequest*)listRequestWithPrefix:(NSString*)prefix marker:(NSString*)marker
+{
+    BlobListRequest* request = [[[BlobListRequest alloc] initWithContainer:_container] autorelease];
+    
+    request.prefix = prefix;
+    request.delimiter = _delimiter;
+    request.marker = marker;
+    request.maxResults = _maxResults;
+    
+    return request;
+}
+
+- (NSString*)endpoint
+{
+    NSMutableString* endpoint;
+    
+    if (_container)
+    {
+        endpoint = [NSMutableString stringWithFormat:@"/%@?comp=list&restype=container", [_container.name URLEncode]];
+    }
+    else
+    {
+        endpoint = [NSMutableString stringWithString:@"?comp=list&include=metadata"];
+    }
+    
+    if (_prefix.length)
+    {
+        [endpoint appendFormat:@"&prefix=%@", [_prefix URLEncode]];
+    }
+    if (_delimiter.length && _container)
+    {
+        [endpoint appendFormat:@"&delimiter=%@", [_delimiter URLEncode]];
+    }
+    if (_marker.length)
+    {
+        [endpoint appendFormat:@"&marker=%@", [_marker URLEncode]];
+    }
+    if (_maxResults > 0)
+    {
+        [endpoint appendFormat:@"&maxresults=%ld", (long)_maxResults];
+    }
+    
+    return endpoint;
+}
+
+- (NSString*) description
+{
+    return [NSString stringWithFormat:@"BlobListRequest { container = %@, prefix = %@, delimiter = %@, marker = %@, maxResults = %ld }", _container.name, _prefix, _delimiter, _marker, (long)_maxResults];
+}
+
+- (void)dealloc
+{
+    [_container release];
+    [_prefix release];
+    [_delimiter release];
+    [_marker release];
+    
+    [super dealloc];
+}
+
+@end
@@ -0,0 +1,62 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "CloudTransport.h"
+
+/*! The default transport. It keeps a pool of persistent HTTP connections for each storage endpoint, so back-to-back operations skip the TCP and TLS handshakes. A pool that has been idle for idleTimeout is closed. Connection events are handled on one private networking queue, never on the main thread. */
+@interface CloudPooledTransport : NSObject <CloudTransport, NSURLSessionDataDelegate>
+{
+    NSLock* _lock;
+    NSMutableDictionary* _pools;
+    NSOperationQueue* _delegateQueue;
+    CFMutableDictionaryRef _clients;
+    NSUInteger _maxConnectionsPerHost;
+    NSTimeInterval _idleTimeout;
+    NSTimer* _evictionTimer;
+    
+    NSUInteger _requestCount;
+    NSUInteger _connectionCount;
+    NSUInteger _reusedCount;
+    NSUInteger _evictedCount;
+}
+
+/*! The most connections kept open to a single storage endpoint. Defaults to 6. Applies to pools opened after it is set. */
+@property (assign) NSUInteger maxConnectionsPerHost;
+/*! How long, in seconds, a pool may go unused before its connections are closed. Defaults to 30. */
+@property (assign) NSTimeInterval idleTimeout;
+/*! The number of endpoints with an open pool. */
+@property (readonly) NSUInteger poolCount;
+/*! The number of requests completed since the counters were last reset. */
+@property (readonly) NSUInteger requestCount;
+/*! The number of completed requests that had to open a new connection. Connection reuse is only reported on iOS 10 and later; before that both this and reusedCount stay at 0. */
+@property (readonly) NSUInteger connectionCount;
+/*! The number of completed requests sent on a connection that was already open. */
+@property (readonly) NSUInteger reusedCount;
+/*! The number of idle pools closed since the counters were last reset. */
+@property (readonly) NSUInteger evictedCount;
+/*! reusedCount as a fraction of the requests whose connection use was reported, from 0 to 1. */
+@property (readonly) double reuseRate;
+
+/*! Resets the request, connection and eviction counters. */
+- (void)resetCounters;
+/*! Closes every pool with no request in flight, whatever its idle time. */
+- (void)evictIdlePools;
+
+/*! Returns the transport shared by all storage clients. */
++ (CloudPooledTransport*)sharedTransport;
+
+@end
@@ -0,0 +1,396 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "CloudPooledTransport.h"
+
+// One endpoint's connections. The session owns the sockets; invalidating it closes them.
+@interface CloudTransportPool : NSObject
+{
+@public
+    NSURLSession* _session;
+    NSUInteger _inFlight;
+    NSTimeInterval _lastUsed;
+}
+@end
+
+@implementation CloudTransportPool
+
+- (void)dealloc
+{
+    [_session release];
+    
+    [super dealloc];
+}
+
+@end
+
+static CloudPooledTransport* _sharedTransport = nil;
+
+@implementation CloudPooledTransport
+
+@synthesize idleTimeout = _idleTimeout;
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        _lock = [[NSLock alloc] init];
+        _pools = [[NSMutableDictionary alloc] initWithCapacity:4];
+        // keyed by task; tasks aren't copyable, so the keys are only retained
+        _clients = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, &kCFTypeDictionaryKeyCallBacks, &kCFTypeDictionaryValueCallBacks);
+        _maxConnectionsPerHost = 6;
+        _idleTimeout = 30.0;
+        
+        // every session reports here, one event at a time, rather than on the main thread
+        _delegateQueue = [[NSOperationQueue alloc] init];
+        _delegateQueue.maxConcurrentOperationCount = 1;
+        _delegateQueue.name = @"com.microsoft.AzureIOSToolkit.networking";
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_evictionTimer invalidate];
+    for(CloudTransportPool* pool in [_pools allValues])
+    {
+        [pool->_session invalidateAndCancel];
+    }
+    [_lock release];
+    [_pools release];
+    [_delegateQueue release];
+    CFRelease(_clients);
+    
+    [super dealloc];
+}
+
++ (CloudPooledTransport*)sharedTransport
+{
+    @synchronized(self)
+    {
+        if(!_sharedTransport)
+        {
+            _sharedTransport = [[CloudPooledTransport alloc] init];
+        }
+    }
+    
+    return _sharedTransport;
+}
+
+#pragma mark Counters
+
+- (NSUInteger)maxConnectionsPerHost
+{
+    [_lock lock];
+    NSUInteger max = _maxConnectionsPerHost;
+    [_lock unlock];
+    
+    return max;
+}
+
+- (void)setMaxConnectionsPerHost:(NSUInteger)maxConnectionsPerHost
+{
+    [_lock lock];
+    _maxConnectionsPerHost = maxConnectionsPerHost ? maxConnectionsPerHost : 1;
+    [_lock unlock];
+}
+
+- (NSUInteger)poolCount
+{
+    [_lock lock];
+    NSUInteger count = [_pools count];
+    [_lock unlock];
+    
+    return count;
+}
+
+- (NSUInteger)requestCount
+{
+    [_lock lock];
+    NSUInteger count = _requestCount;
+    [_lock unlock];
+    
+    return count;
+}
+
+- (NSUInteger)connectionCount
+{
+    [_lock lock];
+    NSUInteger count = _connectionCount;
+    [_lock unlock];
+    
+    return count;
+}
+
+- (NSUInteger)reusedCount
+{
+    [_lock lock];
+    NSUInteger count = _reusedCount;
+    [_lock unlock];
+    
+    return count;
+}
+
+- (NSUInteger)evictedCount
+{
+    [_lock lock];
+    NSUInteger count = _evictedCount;
+    [_lock unlock];
+    
+    return count;
+}
+
+- (double)reuseRate
+{
+    [_lock lock];
+    NSUInteger reported = _connectionCount + _reusedCount;
+    double rate = reported ? (double)_reusedCount / reported : 0;
+    [_lock unlock];
+    
+    return rate;
+}
+
+- (void)resetCounters
+{
+    [_lock lock];
+    _requestCount = 0;
+    _connectionCount = 0;
+    _reusedCount = 0;
+    _evictedCount = 0;
+    [_lock unlock];
+}
+
+#pragma mark Pools
+
+// called with the lock held
+- (CloudTransportPool*)poolForHost:(NSString*)name
+{
+    CloudTransportPool* pool = [_pools objectForKey:name];
+    
+    if(!pool)
+    {
+        NSURLSessionConfiguration* configuration = [NSURLSessionConfiguration defaultSessionConfiguration];
+        configuration.HTTPMaximumConnectionsPerHost = _maxConnectionsPerHost;
+        // storage responses are never served again from a cache, so don't spend disk writing them to one
+        configuration.URLCache = nil;
+        
+        pool = [[[CloudTransportPool alloc] init] autorelease];
+        pool->_session = [[NSURLSession sessionWithConfiguration:configuration delegate:self delegateQueue:_delegateQueue] retain];
+        [_pools setObject:pool forKey:name];
+        
+        if(!_evictionTimer)
+        {
+            [self performSelectorOnMainThread:@selector(scheduleEvictionTimer) withObject:nil waitUntilDone:NO];
+        }
+    }
+    
+    return pool;
+}
+
+// The timer lives on the main run loop, so it is only ever scheduled and invalidated there; the
+// pointer to it is guarded by the lock like the pools it looks after.
+- (void)scheduleEvictionTimer
+{
+    [_lock lock];
+    if(!_evictionTimer && _idleTimeout > 0 && [_pools count] > 0)
+    {
+        NSTimeInterval interval = MAX(_idleTimeout / 2, 1.0);
+        _evictionTimer = [NSTimer scheduledTimerWithTimeInterval:interval target:self selector:@selector(evictionTimerFired:) userInfo:nil repeats:YES];
+    }
+    [_lock unlock];
+}
+
+- (void)evictPoolsIdleSince:(NSTimeInterval)cutoff
+{
+    NSMutableArray* sessions = [NSMutableArray arrayWithCapacity:1];
+    
+    [_lock lock];
+    for(NSString* name in [_pools allKeys])
+    {
+        CloudTransportPool* pool = [_pools objectForKey:name];
+        if(pool->_inFlight == 0 && pool->_lastUsed <= cutoff)
+        {
+            [sessions addObject:pool->_session];
+            [_pools removeObjectForKey:name];
+            _evictedCount++;
+        }
+    }
+    
+    NSTimer* timer = nil;
+    if([_pools count] == 0)
+    {
+        timer = _evictionTimer;
+        _evictionTimer = nil;
+    }
+    [_lock unlock];
+    
+    for(NSURLSession* session in sessions)
+    {
+        [session finishTasksAndInvalidate];
+    }
+    
+    // evictIdlePools may be called from any thread
+    [timer performSelectorOnMainThread:@selector(invalidate) withObject:nil waitUntilDone:NO];
+}
+
+- (void)evictionTimerFired:(NSTimer*)timer
+{
+    [self evictPoolsIdleSince:[NSDate timeIntervalSinceReferenceDate] - _idleTimeout];
+}
+
+- (void)evictIdlePools
+{
+    [self evictPoolsIdleSince:DBL_MAX];
+}
+
+#pragma mark CloudTransport
+
+- (id)startRequest:(NSURLRequest *)request client:(id<CloudTransportClient>)client
+{
+    NSString* name = [[request URL] host];
+    NSURLSessionDataTask* task;
+    
+    [_lock lock];
+    @try
+    {
+        CloudTransportPool* pool = [self poolForHost:(name ? name : @"")];
+        pool->_inFlight++;
+        pool->_lastUsed = [NSDate timeIntervalSinceReferenceDate];
+        
+        task = [pool->_session dataTaskWithRequest:request];
+        CFDictionarySetValue(_clients, task, client);
+    }
+    @finally
+    {
+        [_lock unlock];
+    }
+    
+    [task resume];
+    
+    return task;
+}
+
+- (id<CloudTransportClient>)clientForTask:(NSURLSessionTask*)task
+{
+    [_lock lock];
+    id<CloudTransportClient> client = [[(id)CFDictionaryGetValue(_clients, task) retain] autorelease];
+    [_lock unlock];
+    
+    return client;
+}
+
+// Drops the task's client and frees its slot; returns the client if it was still registered.
+- (id<CloudTransportClient>)endTask:(NSURLSessionTask*)task
+{
+    NSString* name = [[[task originalRequest] URL] host];
+    id<CloudTransportClient> client;
+    
+    [_lock lock];
+    client = [[(id)CFDictionaryGetValue(_clients, task) retain] autorelease];
+    if(client)
+    {
+        CFDictionaryRemoveValue(_clients, task);
+        
+        CloudTransportPool* pool = [_pools objectForKey:(name ? name : @"")];
+        pool->_inFlight--;
+        pool->_lastUsed = [NSDate timeIntervalSinceReferenceDate];
+    }
+    [_lock unlock];
+    
+    return client;
+}
+
+- (void)cancelTransfer:(id)transfer
+{
+    if([self endTask:transfer])
+    {
+        [(NSURLSessionTask*)transfer cancel];
+    }
+}
+
+#pragma mark NSURLSessionDataDelegate
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveResponse:(NSURLResponse *)response completionHandler:(void (^)(NSURLSessionResponseDisposition))completionHandler
+{
+    [[self clientForTask:dataTask] transportDidReceiveResponse:response];
+    completionHandler(NSURLSessionResponseAllow);
+}
+
+- (void)URLSession:(NSURLSession *)session dataTask:(NSURLSessionDataTask *)dataTask didReceiveData:(NSData *)data
+{
+    [[self clientForTask:dataTask] transportDidReceiveData:data];
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didFinishCollectingMetrics:(NSURLSessionTaskMetrics *)metrics API_AVAILABLE(ios(10.0))
+{
+    // only the final transaction carried the response; earlier ones were redirects
+    NSURLSessionTaskTransactionMetrics* transaction = [[metrics transactionMetrics] lastObject];
+    if(!transaction || transaction.resourceFetchType != NSURLSessionTaskMetricsResourceFetchTypeNetworkLoad)
+    {
+        return;
+    }
+    
+    [_lock lock];
+    if(transaction.reusedConnection)
+    {
+        _reusedCount++;
+    }
+    else
+    {
+        _connectionCount++;
+    }
+    [_lock unlock];
+    
+    NSDate* connectStart = transaction.domainLookupStartDate ? transaction.domainLookupStartDate : transaction.connectStartDate;
+    NSDate* connectEnd = transaction.connectEndDate;
+    if(!transaction.reusedConnection && connectStart && connectEnd)
+    {
+        // the session reports metrics just before completion, while the client is still registered
+        id<CloudTransportClient> client = [self clientForTask:task];
+        if([client respondsToSelector:@selector(transportDidMeasureConnectTime:)])
+        {
+            [client transportDidMeasureConnectTime:[connectEnd timeIntervalSinceDate:connectStart]];
+        }
+    }
+}
+
+- (void)URLSession:(NSURLSession *)session task:(NSURLSessionTask *)task didCompleteWithError:(NSError *)error
+{
+    id<CloudTransportClient> client = [self endTask:task];
+    if(!client)
+    {
+        // cancelled by its client
+        return;
+    }
+    
+    [_lock lock];
+    _requestCount++;
+    [_lock unlock];
+    
+    if(error)
+    {
+        [client transportDidFailWithError:error];
+    }
+    else
+    {
+        [client transportDidFinishLoading];
+    }
+}
+
+#pragma mark -
+
+@end
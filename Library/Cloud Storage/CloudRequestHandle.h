@@ -0,0 +1,38 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/*! A handle on one storage client operation, returned by the operations that can be stopped early. Cancelling it stops whatever the operation has in flight, waiting for a slot or waiting to retry, and its completion is called with an NSURLErrorCancelled error. Once the deadline passes the operation fails the same way with NSURLErrorTimedOut, and a retry that could not start before the deadline is not attempted. Requests the operation sends later, such as its next page, are covered too. */
+@interface CloudRequestHandle : NSObject
+{
+    NSLock* _lock;
+    NSMutableArray* _members;
+    NSTimeInterval _deadline;
+    BOOL _cancelled;
+}
+
+/*! Whether the operation has been cancelled. */
+@property (readonly, getter=isCancelled) BOOL cancelled;
+/*! When the operation has to be complete by, as a reference-date interval, or 0 for no limit. Starts out at the client's requestTimeout from the time the operation began. */
+@property (assign) NSTimeInterval deadline;
+
+/*! Sets the deadline to timeout seconds from now; 0 removes it. */
+- (void)setTimeout:(NSTimeInterval)timeout;
+/*! Stops the operation. Does nothing if it has already completed. */
+- (void)cancel;
+
+@end
@@ -0,0 +1,136 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "CloudRequestHandle.h"
+#import "CloudRequestHandle+Private.h"
+
+@implementation CloudRequestHandle
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        _lock = [[NSLock alloc] init];
+        _members = [[NSMutableArray alloc] initWithCapacity:2];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_lock release];
+    [_members release];
+
+    [super dealloc];
+}
+
+- (BOOL)isCancelled
+{
+    [_lock lock];
+    BOOL value = _cancelled;
+    [_lock unlock];
+
+    return value;
+}
+
+- (NSTimeInterval)deadline
+{
+    [_lock lock];
+    NSTimeInterval value = _deadline;
+    [_lock unlock];
+
+    return value;
+}
+
+- (void)setDeadline:(NSTimeInterval)deadline
+{
+    [_lock lock];
+    _deadline = deadline;
+    NSArray* members = [NSArray arrayWithArray:_members];
+    [_lock unlock];
+
+    for(id<CloudRequestHandleMember> member in members)
+    {
+        [member setDeadline:deadline];
+    }
+}
+
+- (void)setTimeout:(NSTimeInterval)timeout
+{
+    [self setDeadline:(timeout > 0) ? [NSDate timeIntervalSinceReferenceDate] + timeout : 0];
+}
+
+- (void)cancel
+{
+    [_lock lock];
+    _cancelled = YES;
+    NSArray* members = [NSArray arrayWithArray:_members];
+    [_members removeAllObjects];
+    [_lock unlock];
+
+    for(id<CloudRequestHandleMember> member in members)
+    {
+        [member cancel];
+    }
+}
+
+#pragma mark Private
+
+- (BOOL)isFinished
+{
+    // a child handle is cancelled once its hedged read has an answer
+    return [self isCancelled];
+}
+
+- (void)addMember:(id<CloudRequestHandleMember>)member
+{
+    [_lock lock];
+    BOOL cancelled = _cancelled;
+    NSTimeInterval deadline = _deadline;
+    if(!cancelled)
+    {
+        // a paged operation adds a request per page; don't hold on to the ones that are done
+        NSIndexSet* finished = [_members indexesOfObjectsPassingTest:^BOOL(id other, NSUInteger index, BOOL* stop)
+                                {
+                                    return [other isFinished];
+                                }];
+        [_members removeObjectsAtIndexes:finished];
+        [_members addObject:member];
+    }
+    [_lock unlock];
+
+    if(cancelled)
+    {
+        [member cancel];
+    }
+    else if(deadline > 0)
+    {
+        [member setDeadline:deadline];
+    }
+}
+
+- (CloudRequestHandle*)childHandle
+{
+    CloudRequestHandle* child = [[[CloudRequestHandle alloc] init] autorelease];
+    [self addMember:child];
+
+    return child;
+}
+
+#pragma mark -
+
+@end
@@ -0,0 +1,97 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/*! The phases of a request's life that are timed separately. Signing covers building and signing the request, queued the wait for a scheduler slot, retrying the time from the first send to the last (failed attempts and back-off), connecting the DNS, TCP and TLS setup of a new connection, first byte the wait for the response headers, transfer the arrival of the body, and parsing the time spent handling the complete response. Total runs from signing to completion. */
+typedef enum
+{
+    CloudRequestPhaseSigning = 0,
+    CloudRequestPhaseQueued,
+    CloudRequestPhaseRetrying,
+    CloudRequestPhaseConnecting,
+    CloudRequestPhaseFirstByte,
+    CloudRequestPhaseTransfer,
+    CloudRequestPhaseParsing,
+    CloudRequestPhaseTotal,
+    CloudRequestPhaseCount
+} CloudRequestPhase;
+
+/*! A snapshot of the requests recorded for one operation, or for every operation against one storage type. Phase times are kept in logarithmic buckets, so percentiles are accurate to within about 20%. */
+@interface CloudOperationMetrics : NSObject
+{
+    NSString* _storageType;
+    NSString* _operation;
+    NSUInteger _requestCount;
+    NSUInteger _failureCount;
+    NSUInteger _retryCount;
+    unsigned long long _bytesSent;
+    unsigned long long _bytesReceived;
+    void* _histograms;
+}
+
+/*! The storage type: blob, queue or table. */
+@property (readonly) NSString* storageType;
+/*! The operation, such as GetBlob or PutMessage; nil for a storage type's totals. */
+@property (readonly) NSString* operation;
+/*! The number of requests completed, successfully or not. */
+@property (readonly) NSUInteger requestCount;
+/*! The number of requests that ended in an error status or a network failure. */
+@property (readonly) NSUInteger failureCount;
+/*! The number of times requests were sent again. */
+@property (readonly) NSUInteger retryCount;
+/*! The request body bytes sent. */
+@property (readonly) unsigned long long bytesSent;
+/*! The response body bytes received. */
+@property (readonly) unsigned long long bytesReceived;
+
+/*! Returns the time, in seconds, below which the given fraction (0 to 1) of requests spent in a phase. */
+- (NSTimeInterval)percentile:(double)fraction ofPhase:(CloudRequestPhase)phase;
+/*! Returns the mean time, in seconds, requests spent in a phase. */
+- (NSTimeInterval)meanOfPhase:(CloudRequestPhase)phase;
+
+@end
+
+/*! Collects phase timings, byte counts and retries for every request the storage clients send. Recording is off by default and costs next to nothing until it is enabled. */
+@interface CloudRequestMetrics : NSObject
+{
+    NSLock* _lock;
+    NSMutableDictionary* _operations;
+    NSMutableDictionary* _storageTypes;
+    NSTimer* _reportTimer;
+    BOOL _resetAfterReport;
+    void (^_reportBlock)(NSArray*);
+}
+
+/*! Whether requests are being recorded. Defaults to NO. */
+@property (assign) BOOL enabled;
+
+/*! Returns a CloudOperationMetrics for each operation recorded since the last reset. */
+- (NSArray*)snapshot;
+/*! Returns a CloudOperationMetrics for each storage type recorded since the last reset. */
+- (NSArray*)storageTypeSnapshot;
+/*! Discards everything recorded so far. */
+- (void)reset;
+
+/*! Calls block on the main thread every interval seconds with the operation snapshot. When reset is YES the metrics are cleared after each call, so each snapshot covers one interval. */
+- (void)startReportingWithInterval:(NSTimeInterval)interval resetAfterReport:(BOOL)reset block:(void (^)(NSArray*))block;
+/*! Stops the periodic snapshots. */
+- (void)stopReporting;
+
+/*! Returns the metrics shared by all storage clients. */
++ (CloudRequestMetrics*)sharedMetrics;
+
+@end
@@ -0,0 +1,419 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "CloudRequestMetrics.h"
+#import <math.h>
+
+// four buckets per doubling, starting at a microsecond; the last one also holds anything past two minutes
+#define HISTOGRAM_BUCKETS 108
+
+typedef struct
+{
+    uint32_t counts[CloudRequestPhaseCount][HISTOGRAM_BUCKETS];
+    double sums[CloudRequestPhaseCount];
+} CloudPhaseHistograms;
+
+static NSUInteger BucketForDuration(NSTimeInterval duration)
+{
+    double micros = duration * 1e6;
+    if(micros <= 1)
+    {
+        return 0;
+    }
+    
+    return MIN((NSUInteger)(log2(micros) * 4), (NSUInteger)(HISTOGRAM_BUCKETS - 1));
+}
+
+static NSTimeInterval DurationForBucket(NSUInteger bucket)
+{
+    // the upper edge, so a percentile never understates
+    return exp2((bucket + 1) / 4.0) / 1e6;
+}
+
+static BOOL _recording = NO;
+static CloudRequestMetrics* _sharedMetrics = nil;
+
+@implementation CloudOperationMetrics
+
+@synthesize storageType = _storageType;
+@synthesize operation = _operation;
+@synthesize requestCount = _requestCount;
+@synthesize failureCount = _failureCount;
+@synthesize retryCount = _retryCount;
+@synthesize bytesSent = _bytesSent;
+@synthesize bytesReceived = _bytesReceived;
+
+- (id)initWithStorageType:(NSString*)storageType operation:(NSString*)operation
+{
+    if((self = [super init]))
+    {
+        _storageType = [storageType copy];
+        _operation = [operation copy];
+        _histograms = calloc(1, sizeof(CloudPhaseHistograms));
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_storageType release];
+    [_operation release];
+    free(_histograms);
+    
+    [super dealloc];
+}
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"%@ %@: %lu requests, %lu failed, %lu retries, %llu bytes out, %llu bytes in, total p50 %.1fms p99 %.1fms", 
+            _storageType, _operation ? _operation : @"(all)", (unsigned long)_requestCount, (unsigned long)_failureCount, (unsigned long)_retryCount, 
+            _bytesSent, _bytesReceived, [self percentile:0.5 ofPhase:CloudRequestPhaseTotal] * 1000, [self percentile:0.99 ofPhase:CloudRequestPhaseTotal] * 1000];
+}
+
+- (void)addPhases:(const NSTimeInterval*)phases bytesSent:(unsigned long long)bytesSent bytesReceived:(unsigned long long)bytesReceived retries:(NSUInteger)retries failed:(BOOL)failed
+{
+    CloudPhaseHistograms* histograms = _histograms;
+    
+    for(NSUInteger phase = 0; phase < CloudRequestPhaseCount; phase++)
+    {
+        histograms->counts[phase][BucketForDuration(phases[phase])]++;
+        histograms->sums[phase] += phases[phase];
+    }
+    
+    _requestCount++;
+    _failureCount += failed ? 1 : 0;
+    _retryCount += retries;
+    _bytesSent += bytesSent;
+    _bytesReceived += bytesReceived;
+}
+
+- (CloudOperationMetrics*)snapshotCopy
+{
+    CloudOperationMetrics* copy = [[CloudOperationMetrics alloc] initWithStorageType:_storageType operation:_operation];
+    
+    memcpy(copy->_histograms, _histograms, sizeof(CloudPhaseHistograms));
+    copy->_requestCount = _requestCount;
+    copy->_failureCount = _failureCount;
+    copy->_retryCount = _retryCount;
+    copy->_bytesSent = _bytesSent;
+    copy->_bytesReceived = _bytesReceived;
+    
+    return [copy autorelease];
+}
+
+- (NSTimeInterval)percentile:(double)fraction ofPhase:(CloudRequestPhase)phase
+{
+    if(_requestCount == 0 || phase >= CloudRequestPhaseCount)
+    {
+        return 0;
+    }
+    
+    const uint32_t* counts = ((CloudPhaseHistograms*)_histograms)->counts[phase];
+    unsigned long long target = (unsigned long long)ceil(MIN(MAX(fraction, 0.0), 1.0) * _requestCount);
+    unsigned long long seen = 0;
+    
+    for(NSUInteger bucket = 0; bucket < HISTOGRAM_BUCKETS; bucket++)
+    {
+        seen += counts[bucket];
+        if(seen >= MAX(target, 1ULL))
+        {
+            return DurationForBucket(bucket);
+        }
+    }
+    
+    return DurationForBucket(HISTOGRAM_BUCKETS - 1);
+}
+
+- (NSTimeInterval)meanOfPhase:(CloudRequestPhase)phase
+{
+    if(_requestCount == 0 || phase >= CloudRequestPhaseCount)
+    {
+        return 0;
+    }
+    
+    return ((CloudPhaseHistograms*)_histograms)->sums[phase] / _requestCount;
+}
+
+@end
+
+@implementation CloudRequestMetrics
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        _lock = [[NSLock alloc] init];
+        _operations = [[NSMutableDictionary alloc] initWithCapacity:3];
+        _storageTypes = [[NSMutableDictionary alloc] initWithCapacity:3];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_reportTimer invalidate];
+    [_lock release];
+    [_operations release];
+    [_storageTypes release];
+    [_reportBlock release];
+    
+    [super dealloc];
+}
+
++ (CloudRequestMetrics*)sharedMetrics
+{
+    @synchronized(self)
+    {
+        if(!_sharedMetrics)
+        {
+            _sharedMetrics = [[CloudRequestMetrics alloc] init];
+        }
+    }
+    
+    return _sharedMetrics;
+}
+
+// Requests check this once, when they are created, so nothing else is paid while recording is off.
++ (BOOL)isRecording
+{
+    return _recording;
+}
+
+- (BOOL)enabled
+{
+    return _recording;
+}
+
+- (void)setEnabled:(BOOL)enabled
+{
+    _recording = enabled;
+}
+
+#pragma mark Classification
+
++ (NSString*)storageTypeForURL:(NSURL*)URL
+{
+    // <account>.<type>.core.windows.net; through the proxy only tables have a path of their own
+    NSString* host = [URL host];
+    NSRange suffix = [host rangeOfString:@".core.windows.net" options:(NSBackwardsSearch | NSAnchoredSearch | NSCaseInsensitiveSearch)];
+    if(suffix.location != NSNotFound)
+    {
+        NSRange dot = [host rangeOfString:@"."];
+        if(dot.location < suffix.location)
+        {
+            return [[host substringWithRange:NSMakeRange(NSMaxRange(dot), suffix.location - NSMaxRange(dot))] lowercaseString];
+        }
+    }
+    
+    return ([[URL path] rangeOfString:@"AzureTablesProxy.axd"].location != NSNotFound) ? @"table" : @"blob";
+}
+
++ (NSString*)operationForRequest:(NSURLRequest*)request storageType:(NSString*)storageType
+{
+    NSString* method = [request HTTPMethod];
+    NSString* path = [[request URL] path];
+    NSString* query = [[request URL] query];
+    BOOL get = [method isEqualToString:@"GET"] || [method isEqualToString:@"HEAD"];
+    BOOL put = [method isEqualToString:@"PUT"];
+    BOOL remove = [method isEqualToString:@"DELETE"];
+    
+    if([storageType isEqualToString:@"queue"])
+    {
+        if([query rangeOfString:@"comp=list"].location != NSNotFound)
+        {
+            return @"ListQueues";
+        }
+        if([path hasSuffix:@"/messages"])
+        {
+            if(get)
+            {
+                return ([query rangeOfString:@"peekonly=true"].location != NSNotFound) ? @"PeekMessages" : @"GetMessages";
+            }
+            return remove ? @"ClearMessages" : @"PutMessage";
+        }
+        if([path rangeOfString:@"/messages/"].location != NSNotFound)
+        {
+            return put ? @"UpdateMessage" : @"DeleteMessage";
+        }
+        return put ? @"CreateQueue" : (remove ? @"DeleteQueue" : @"QueueRequest");
+    }
+    
+    if([storageType isEqualToString:@"table"])
+    {
+        if([path rangeOfString:@"$batch"].location != NSNotFound)
+        {
+            return @"Batch";
+        }
+        if([path rangeOfString:@"Tables"].location != NSNotFound && [path rangeOfString:@"("].location == NSNotFound)
+        {
+            return get ? @"QueryTables" : (remove ? @"DeleteTable" : @"CreateTable");
+        }
+        if(get)
+        {
+            return @"QueryEntities";
+        }
+        if([method isEqualToString:@"POST"])
+        {
+            return @"InsertEntity";
+        }
+        if([method isEqualToString:@"MERGE"])
+        {
+            return @"MergeEntity";
+        }
+        return put ? @"UpdateEntity" : @"DeleteEntity";
+    }
+    
+    if([query rangeOfString:@"comp=list"].location != NSNotFound)
+    {
+        return ([path length] <= 1) ? @"ListContainers" : @"ListBlobs";
+    }
+    if([query rangeOfString:@"comp=blocklist"].location != NSNotFound)
+    {
+        return @"PutBlockList";
+    }
+    if([query rangeOfString:@"comp=block"].location != NSNotFound)
+    {
+        return @"PutBlock";
+    }
+    if([query rangeOfString:@"restype=container"].location != NSNotFound)
+    {
+        return put ? @"CreateContainer" : (remove ? @"DeleteContainer" : @"GetContainerProperties");
+    }
+    if(get)
+    {
+        return ([request valueForHTTPHeaderField:@"x-ms-range"]) ? @"GetBlobRange" : @"GetBlob";
+    }
+    return put ? @"PutBlob" : (remove ? @"DeleteBlob" : @"BlobRequest");
+}
+
+#pragma mark Recording
+
+- (void)recordRequest:(NSURLRequest*)request phases:(const NSTimeInterval*)phases bytesSent:(unsigned long long)bytesSent bytesReceived:(unsigned long long)bytesReceived retries:(NSUInteger)retries failed:(BOOL)failed
+{
+    NSString* storageType = [CloudRequestMetrics storageTypeForURL:[request URL]];
+    NSString* operation = [CloudRequestMetrics operationForRequest:request storageType:storageType];
+    
+    [_lock lock];
+    
+    NSMutableDictionary* operations = [_operations objectForKey:storageType];
+    if(!operations)
+    {
+        operations = [NSMutableDictionary dictionaryWithCapacity:8];
+        [_operations setObject:operations forKey:storageType];
+    }
+    
+    CloudOperationMetrics* metrics = [operations objectForKey:operation];
+    if(!metrics)
+    {
+        metrics = [[[CloudOperationMetrics alloc] initWithStorageType:storageType operation:operation] autorelease];
+        [operations setObject:metrics forKey:operation];
+    }
+    [metrics addPhases:phases bytesSent:bytesSent bytesReceived:bytesReceived retries:retries failed:failed];
+    
+    CloudOperationMetrics* totals = [_storageTypes objectForKey:storageType];
+    if(!totals)
+    {
+        totals = [[[CloudOperationMetrics alloc] initWithStorageType:storageType operation:nil] autorelease];
+        [_storageTypes setObject:totals forKey:storageType];
+    }
+    [totals addPhases:phases bytesSent:bytesSent bytesReceived:bytesReceived retries:retries failed:failed];
+    
+    [_lock unlock];
+}
+
+#pragma mark Snapshots
+
+- (NSArray*)snapshot
+{
+    NSMutableArray* snapshot = [NSMutableArray arrayWithCapacity:16];
+    
+    [_lock lock];
+    for(NSDictionary* operations in [_operations allValues])
+    {
+        for(CloudOperationMetrics* metrics in [operations allValues])
+        {
+            [snapshot addObject:[metrics snapshotCopy]];
+        }
+    }
+    [_lock unlock];
+    
+    return snapshot;
+}
+
+- (NSArray*)storageTypeSnapshot
+{
+    NSMutableArray* snapshot = [NSMutableArray arrayWithCapacity:3];
+    
+    [_lock lock];
+    for(CloudOperationMetrics* metrics in [_storageTypes allValues])
+    {
+        [snapshot addObject:[metrics snapshotCopy]];
+    }
+    [_lock unlock];
+    
+    return snapshot;
+}
+
+- (void)reset
+{
+    [_lock lock];
+    [_operations removeAllObjects];
+    [_storageTypes removeAllObjects];
+    [_lock unlock];
+}
+
+#pragma mark Reporting
+
+- (void)reportTimerFired:(NSTimer*)timer
+{
+    NSArray* snapshot = [self snapshot];
+    if(_resetAfterReport)
+    {
+        [self reset];
+    }
+    
+    _reportBlock(snapshot);
+}
+
+- (void)scheduleReportTimer:(NSNumber*)interval
+{
+    [_reportTimer invalidate];
+    _reportTimer = [NSTimer scheduledTimerWithTimeInterval:[interval doubleValue] target:self selector:@selector(reportTimerFired:) userInfo:nil repeats:YES];
+}
+
+- (void)startReportingWithInterval:(NSTimeInterval)interval resetAfterReport:(BOOL)reset block:(void (^)(NSArray*))block
+{
+    [_reportBlock release];
+    _reportBlock = [block copy];
+    _resetAfterReport = reset;
+    
+    [self performSelectorOnMainThread:@selector(scheduleReportTimer:) withObject:[NSNumber numberWithDouble:interval] waitUntilDone:NO];
+}
+
+- (void)cancelReportTimer
+{
+    [_reportTimer invalidate];
+    _reportTimer = nil;
+}
+
+- (void)stopReporting
+{
+    [self performSelectorOnMainThread:@selector(cancelReportTimer) withObject:nil waitUntilDone:NO];
+}
+
+@end
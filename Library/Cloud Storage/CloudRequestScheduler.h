@@ -0,0 +1,89 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "CloudTransport.h"
+
+@class CloudRetryPolicy;
+
+@class CloudURLRequest;
+
+/*! Request priorities, most urgent first. Table and queue operations run at high priority, blob listing and management at normal, and blob data transfers at low. */
+typedef enum
+{
+    CloudRequestPriorityHigh = 0,
+    CloudRequestPriorityNormal,
+    CloudRequestPriorityLow,
+    CloudRequestPriorityCount
+} CloudRequestPriority;
+
+/*! The request scheduler limits how many requests are in flight against each storage endpoint. Waiting requests are started in priority order, and requests of the same priority take turns between storage clients so one busy client cannot starve the others. With adaptive concurrency on, each endpoint's limit is halved when the service throttles and grows back by about one request per round of successes, so the load settles at what the account allows. */
+@interface CloudRequestScheduler : NSObject
+{
+    NSLock* _lock;
+    NSMutableDictionary* _hosts;
+    NSUInteger _maxConcurrentRequestsPerHost;
+    id<CloudTransport> _transport;
+    CloudRetryPolicy* _retryPolicy;
+    BOOL _adaptiveConcurrency;
+    NSUInteger _throttledCount;
+
+    NSUInteger _queueDepth;
+    NSUInteger _inFlightCount;
+    NSUInteger _startedCount;
+    NSTimeInterval _totalWaitTime;
+    NSTimeInterval _maxWaitTime;
+}
+
+/*! The largest number of requests in flight against a single storage endpoint. Defaults to 6. */
+@property (assign) NSUInteger maxConcurrentRequestsPerHost;
+/*! Whether each endpoint's limit shrinks under throttling and grows back after. Defaults to YES. */
+@property (assign) BOOL adaptiveConcurrency;
+/*! The retry policy given to new requests. Defaults to a CloudRetryPolicy with the default limits; nil turns retries off. */
+@property (retain) CloudRetryPolicy* retryPolicy;
+/*! The number of throttling responses seen since the counters were last reset. */
+@property (readonly) NSUInteger throttledCount;
+/*! The transport started requests are sent through. Defaults to the shared CloudPooledTransport. */
+@property (retain) id<CloudTransport> transport;
+/*! The number of requests waiting for a free slot. */
+@property (readonly) NSUInteger queueDepth;
+/*! The number of requests currently in flight. */
+@property (readonly) NSUInteger inFlightCount;
+/*! The number of requests started since the counters were last reset. */
+@property (readonly) NSUInteger startedCount;
+/*! The total time started requests spent waiting for a slot, in seconds. */
+@property (readonly) NSTimeInterval totalWaitTime;
+/*! The longest time a started request spent waiting for a slot, in seconds. */
+@property (readonly) NSTimeInterval maxWaitTime;
+
+/*! Returns the number of requests of a given priority waiting for a free slot. */
+- (NSUInteger)queueDepthForPriority:(CloudRequestPriority)priority;
+/*! Returns the current concurrency limit for the endpoint on the named host. */
+- (NSUInteger)concurrencyLimitForHost:(NSString*)host;
+/*! Resets the started count, wait time and throttling counters. */
+- (void)resetCounters;
+
+/*! Queues a request, starting it right away if its endpoint has a free slot. */
+- (void)enqueueRequest:(CloudURLRequest*)request;
+/*! Releases the slot held by a finished request and starts the next waiting one. */
+- (void)requestDidFinish:(CloudURLRequest*)request;
+/*! Takes a request that is still waiting for a slot back out of the queue, as when it is cancelled. Returns NO if it was not waiting. */
+- (BOOL)removeRequest:(CloudURLRequest*)request;
+
+/*! Returns the scheduler shared by all storage clients. */
++ (CloudRequestScheduler*)sharedScheduler;
+
+@end
@@ -0,0 +1,515 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "CloudRequestScheduler.h"
+#import "CloudURLRequest.h"
+#import "CloudPooledTransport.h"
+#import "CloudRetryPolicy.h"
+
+// Per-endpoint state. Each priority holds a list of lanes, one per owner, each a FIFO of
+// requests; lanes are served round-robin so owners take turns. _limit is the adaptive
+// concurrency limit, kept fractional so additive increase can accumulate.
+@interface CloudRequestHost : NSObject
+{
+@public
+    NSUInteger _inFlight;
+    double _limit;
+    NSTimeInterval _lastDecrease;
+    NSMutableArray* _lanes[CloudRequestPriorityCount];
+}
+@end
+
+@implementation CloudRequestHost
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        for(int priority = 0; priority < CloudRequestPriorityCount; priority++)
+        {
+            _lanes[priority] = [[NSMutableArray alloc] initWithCapacity:4];
+        }
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    for(int priority = 0; priority < CloudRequestPriorityCount; priority++)
+    {
+        [_lanes[priority] release];
+    }
+
+    [super dealloc];
+}
+
+- (void)addRequest:(CloudURLRequest*)request
+{
+    NSMutableArray* lanes = _lanes[request.priority];
+
+    for(NSMutableArray* lane in lanes)
+    {
+        if([[lane objectAtIndex:0] owner] == request.owner)
+        {
+            [lane addObject:request];
+            return;
+        }
+    }
+
+    [lanes addObject:[NSMutableArray arrayWithObject:request]];
+}
+
+- (BOOL)removeRequest:(CloudURLRequest*)request
+{
+    NSMutableArray* lanes = _lanes[request.priority];
+
+    for(NSUInteger index = 0; index < [lanes count]; index++)
+    {
+        NSMutableArray* lane = [lanes objectAtIndex:index];
+        NSUInteger position = [lane indexOfObjectIdenticalTo:request];
+        if(position == NSNotFound)
+        {
+            continue;
+        }
+
+        [lane removeObjectAtIndex:position];
+        if([lane count] == 0)
+        {
+            [lanes removeObjectAtIndex:index];
+        }
+        return YES;
+    }
+
+    return NO;
+}
+
+- (NSUInteger)countForPriority:(CloudRequestPriority)priority
+{
+    NSUInteger count = 0;
+
+    for(NSMutableArray* lane in _lanes[priority])
+    {
+        count += [lane count];
+    }
+
+    return count;
+}
+
+- (CloudURLRequest*)nextRequest
+{
+    for(int priority = 0; priority < CloudRequestPriorityCount; priority++)
+    {
+        NSMutableArray* lanes = _lanes[priority];
+        if([lanes count] == 0)
+        {
+            continue;
+        }
+
+        NSMutableArray* lane = [[lanes objectAtIndex:0] retain];
+        CloudURLRequest* request = [[[lane objectAtIndex:0] retain] autorelease];
+
+        // take the head of the first lane, then send that lane to the back of the line
+        [lane removeObjectAtIndex:0];
+        [lanes removeObjectAtIndex:0];
+        if([lane count] > 0)
+        {
+            [lanes addObject:lane];
+        }
+        [lane release];
+
+        return request;
+    }
+
+    return nil;
+}
+
+@end
+
+static CloudRequestScheduler* _sharedScheduler = nil;
+
+@implementation CloudRequestScheduler
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        _lock = [[NSLock alloc] init];
+        _hosts = [[NSMutableDictionary alloc] initWithCapacity:4];
+        _maxConcurrentRequestsPerHost = 6;
+        _transport = [[CloudPooledTransport sharedTransport] retain];
+        _retryPolicy = [[CloudRetryPolicy alloc] init];
+        _adaptiveConcurrency = YES;
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_lock release];
+    [_hosts release];
+    [_transport release];
+    [_retryPolicy release];
+
+    [super dealloc];
+}
+
++ (CloudRequestScheduler*)sharedScheduler
+{
+    @synchronized(self)
+    {
+        if(!_sharedScheduler)
+        {
+            _sharedScheduler = [[CloudRequestScheduler alloc] init];
+        }
+    }
+
+    return _sharedScheduler;
+}
+
+#pragma mark Counters
+
+- (NSUInteger)maxConcurrentRequestsPerHost
+{
+    [_lock lock];
+    NSUInteger value = _maxConcurrentRequestsPerHost;
+    [_lock unlock];
+
+    return value;
+}
+
+- (void)setMaxConcurrentRequestsPerHost:(NSUInteger)maxConcurrentRequestsPerHost
+{
+    [_lock lock];
+    _maxConcurrentRequestsPerHost = maxConcurrentRequestsPerHost ? maxConcurrentRequestsPerHost : 1;
+    [_lock unlock];
+}
+
+- (BOOL)adaptiveConcurrency
+{
+    [_lock lock];
+    BOOL value = _adaptiveConcurrency;
+    [_lock unlock];
+
+    return value;
+}
+
+- (void)setAdaptiveConcurrency:(BOOL)adaptiveConcurrency
+{
+    [_lock lock];
+    _adaptiveConcurrency = adaptiveConcurrency;
+    [_lock unlock];
+}
+
+- (CloudRetryPolicy*)retryPolicy
+{
+    [_lock lock];
+    CloudRetryPolicy* policy = [[_retryPolicy retain] autorelease];
+    [_lock unlock];
+
+    return policy;
+}
+
+- (void)setRetryPolicy:(CloudRetryPolicy*)retryPolicy
+{
+    [_lock lock];
+    [retryPolicy retain];
+    [_retryPolicy release];
+    _retryPolicy = retryPolicy;
+    [_lock unlock];
+}
+
+- (NSUInteger)throttledCount
+{
+    [_lock lock];
+    NSUInteger value = _throttledCount;
+    [_lock unlock];
+
+    return value;
+}
+
+- (id<CloudTransport>)transport
+{
+    [_lock lock];
+    id<CloudTransport> transport = [[_transport retain] autorelease];
+    [_lock unlock];
+
+    return transport;
+}
+
+- (void)setTransport:(id<CloudTransport>)transport
+{
+    [_lock lock];
+    [transport retain];
+    [_transport release];
+    _transport = transport;
+    [_lock unlock];
+}
+
+- (NSUInteger)queueDepth
+{
+    [_lock lock];
+    NSUInteger value = _queueDepth;
+    [_lock unlock];
+
+    return value;
+}
+
+- (NSUInteger)inFlightCount
+{
+    [_lock lock];
+    NSUInteger value = _inFlightCount;
+    [_lock unlock];
+
+    return value;
+}
+
+- (NSUInteger)startedCount
+{
+    [_lock lock];
+    NSUInteger value = _startedCount;
+    [_lock unlock];
+
+    return value;
+}
+
+- (NSTimeInterval)totalWaitTime
+{
+    [_lock lock];
+    NSTimeInterval value = _totalWaitTime;
+    [_lock unlock];
+
+    return value;
+}
+
+- (NSTimeInterval)maxWaitTime
+{
+    [_lock lock];
+    NSTimeInterval value = _maxWaitTime;
+    [_lock unlock];
+
+    return value;
+}
+
+- (NSUInteger)queueDepthForPriority:(CloudRequestPriority)priority
+{
+    NSUInteger count = 0;
+
+    [_lock lock];
+    for(CloudRequestHost* host in [_hosts allValues])
+    {
+        count += [host countForPriority:priority];
+    }
+    [_lock unlock];
+
+    return count;
+}
+
+- (void)resetCounters
+{
+    [_lock lock];
+    _startedCount = 0;
+    _totalWaitTime = 0;
+    _maxWaitTime = 0;
+    _throttledCount = 0;
+    [_lock unlock];
+}
+
+#pragma mark Scheduling
+
+- (CloudRequestHost*)hostForRequest:(CloudURLRequest*)request
+{
+    NSString* name = [[request URL] host];
+    if(!name)
+    {
+        name = @"";
+    }
+
+    CloudRequestHost* host = [_hosts objectForKey:name];
+    if(!host)
+    {
+        host = [[CloudRequestHost alloc] init];
+        host->_limit = _maxConcurrentRequestsPerHost;
+        [_hosts setObject:host forKey:name];
+        [host release];
+    }
+
+    return host;
+}
+
+// called with the lock held
+- (NSUInteger)limitForHost:(CloudRequestHost*)host
+{
+    if(!_adaptiveConcurrency)
+    {
+        return _maxConcurrentRequestsPerHost;
+    }
+
+    return MAX(MIN((NSUInteger)host->_limit, _maxConcurrentRequestsPerHost), (NSUInteger)1);
+}
+
+// called with the lock held
+- (void)adaptLimitOnHost:(CloudRequestHost*)host forRequest:(CloudURLRequest*)request reasonCode:(NSString*)reasonCode
+{
+    NSInteger statusCode = [request.response statusCode];
+
+    if([CloudRetryPolicy isThrottlingStatus:statusCode reasonCode:reasonCode])
+    {
+        _throttledCount++;
+
+        // requests queued before the last cut were already sent at the old rate; one cut per round trip
+        if(request.enqueueTime >= host->_lastDecrease)
+        {
+            host->_limit = MAX(MIN(host->_limit, (double)_maxConcurrentRequestsPerHost) / 2, 1.0);
+            host->_lastDecrease = [NSDate timeIntervalSinceReferenceDate];
+        }
+    }
+    else if(statusCode > 0)
+    {
+        host->_limit = MIN(host->_limit + 1.0 / host->_limit, (double)_maxConcurrentRequestsPerHost);
+    }
+}
+
+- (NSUInteger)concurrencyLimitForHost:(NSString*)name
+{
+    [_lock lock];
+    CloudRequestHost* host = [_hosts objectForKey:name];
+    NSUInteger limit = host ? [self limitForHost:host] : _maxConcurrentRequestsPerHost;
+    [_lock unlock];
+
+    return limit;
+}
+
+// called with the lock held
+- (void)claimSlotOnHost:(CloudRequestHost*)host forRequest:(CloudURLRequest*)request
+{
+    NSTimeInterval wait = [NSDate timeIntervalSinceReferenceDate] - request.enqueueTime;
+
+    host->_inFlight++;
+    _inFlightCount++;
+    _startedCount++;
+    _totalWaitTime += wait;
+    if(wait > _maxWaitTime)
+    {
+        _maxWaitTime = wait;
+    }
+}
+
+- (void)enqueueRequest:(CloudURLRequest*)request
+{
+    BOOL startNow = NO;
+
+    [request retain];
+    request.enqueueTime = [NSDate timeIntervalSinceReferenceDate];
+
+    [_lock lock];
+    @try
+    {
+        CloudRequestHost* host = [self hostForRequest:request];
+
+        if(host->_inFlight < [self limitForHost:host])
+        {
+            [self claimSlotOnHost:host forRequest:request];
+            startNow = YES;
+        }
+        else
+        {
+            [host addRequest:request];
+            _queueDepth++;
+        }
+    }
+    @finally
+    {
+        [_lock unlock];
+    }
+
+    if(startNow)
+    {
+        [request sendWithTransport:[self transport]];
+    }
+}
+
+- (void)requestDidFinish:(CloudURLRequest*)request
+{
+    NSMutableArray* ready = [NSMutableArray arrayWithCapacity:1];
+    // only a 500 needs its body read to tell a timeout under load from a server fault; done outside the lock
+    NSString* reasonCode = (_adaptiveConcurrency && [request.response statusCode] == 500) ? [request reasonCode] : nil;
+
+    [_lock lock];
+    @try
+    {
+        CloudRequestHost* host = [self hostForRequest:request];
+        host->_inFlight--;
+        _inFlightCount--;
+        if(_adaptiveConcurrency)
+        {
+            [self adaptLimitOnHost:host forRequest:request reasonCode:reasonCode];
+        }
+
+        CloudURLRequest* next;
+        while(host->_inFlight < [self limitForHost:host] && (next = [host nextRequest]))
+        {
+            _queueDepth--;
+            [self claimSlotOnHost:host forRequest:next];
+            [ready addObject:next];
+        }
+    }
+    @finally
+    {
+        [_lock unlock];
+    }
+
+    // we're inside the finished request's own delegate callback, so let it go later
+    [request autorelease];
+
+    id<CloudTransport> transport = [self transport];
+    for(CloudURLRequest* next in ready)
+    {
+        [next sendWithTransport:transport];
+    }
+}
+
+- (BOOL)removeRequest:(CloudURLRequest*)request
+{
+    BOOL removed;
+
+    [_lock lock];
+    @try
+    {
+        removed = [[self hostForRequest:request] removeRequest:request];
+        if(removed)
+        {
+            _queueDepth--;
+        }
+    }
+    @finally
+    {
+        [_lock unlock];
+    }
+
+    if(removed)
+    {
+        // the reference taken when it was queued
+        [request autorelease];
+    }
+
+    return removed;
+}
+
+#pragma mark -
+
+@end
@@ -0,0 +1,45 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/*! CloudRetryPolicy decides whether a failed request is sent again and how long to wait first. Waits grow exponentially with each attempt and are spread with random jitter so that throttled clients don't retry in lockstep. Requests that may have changed state on the service are only retried when the failure shows they were never processed. */
+@interface CloudRetryPolicy : NSObject
+{
+    NSUInteger _maxRetries;
+    NSTimeInterval _baseDelay;
+    NSTimeInterval _maxDelay;
+}
+
+/*! The most times one request is sent again. Defaults to 3. */
+@property (assign) NSUInteger maxRetries;
+/*! The wait ceiling for the first retry, in seconds; it doubles with each further attempt. Defaults to 0.5. */
+@property (assign) NSTimeInterval baseDelay;
+/*! The largest wait before any retry, in seconds. Defaults to 30. */
+@property (assign) NSTimeInterval maxDelay;
+
+/*! Returns YES if a request that got statusCode, or failed with error before a response arrived, should be sent again. attempt counts the retries already made. */
+- (BOOL)shouldRetryRequest:(NSURLRequest *)request statusCode:(NSInteger)statusCode error:(NSError *)error attempt:(NSUInteger)attempt;
+/*! Returns how long to wait before the retry that follows attempt earlier retries, honouring any Retry-After the service sent. */
+- (NSTimeInterval)delayForAttempt:(NSUInteger)attempt response:(NSHTTPURLResponse *)response;
+
+/*! Returns YES for responses that mean the account or partition is being throttled: 503 Server Busy, and 500 when reasonCode is OperationTimedOut. Any other 500 is an ordinary server error. */
++ (BOOL)isThrottlingStatus:(NSInteger)statusCode reasonCode:(NSString *)reasonCode;
+
+/*! Creates a policy with the default limits. */
++ (CloudRetryPolicy *)policy;
+
+@end
@@ -0,0 +1,136 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "CloudRetryPolicy.h"
+#import <stdlib.h>
+
+@implementation CloudRetryPolicy
+
+@synthesize maxRetries = _maxRetries;
+@synthesize baseDelay = _baseDelay;
+@synthesize maxDelay = _maxDelay;
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        _maxRetries = 3;
+        _baseDelay = 0.5;
+        _maxDelay = 30.0;
+    }
+    
+    return self;
+}
+
++ (CloudRetryPolicy *)policy
+{
+    return [[[CloudRetryPolicy alloc] init] autorelease];
+}
+
++ (BOOL)isThrottlingStatus:(NSInteger)statusCode reasonCode:(NSString *)reasonCode
+{
+    // 503 is ServerBusy; a 500 only means load when the operation timed out, rather than an InternalError
+    return statusCode == 503 || (statusCode == 500 && [reasonCode isEqualToString:@"OperationTimedOut"]);
+}
+
+// Failures that happen before the request leaves the device, so nothing on the service can have changed.
+- (BOOL)isUnsentError:(NSError *)error
+{
+    if(![[error domain] isEqualToString:NSURLErrorDomain])
+    {
+        return NO;
+    }
+    
+    switch([error code])
+    {
+        case NSURLErrorCannotFindHost:
+        case NSURLErrorCannotConnectToHost:
+        case NSURLErrorDNSLookupFailed:
+        case NSURLErrorNotConnectedToInternet:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+- (BOOL)isTransientError:(NSError *)error
+{
+    if([self isUnsentError:error])
+    {
+        return YES;
+    }
+    
+    if(![[error domain] isEqualToString:NSURLErrorDomain])
+    {
+        return NO;
+    }
+    
+    switch([error code])
+    {
+        case NSURLErrorTimedOut:
+        case NSURLErrorNetworkConnectionLost:
+            return YES;
+        default:
+            return NO;
+    }
+}
+
+- (BOOL)shouldRetryRequest:(NSURLRequest *)request statusCode:(NSInteger)statusCode error:(NSError *)error attempt:(NSUInteger)attempt
+{
+    if(attempt >= _maxRetries)
+    {
+        return NO;
+    }
+    
+    // POST inserts entities, posts messages and runs batches; sending one twice can apply it twice
+    BOOL idempotent = ![[[request HTTPMethod] uppercaseString] isEqualToString:@"POST"];
+    
+    if(error)
+    {
+        return idempotent ? [self isTransientError:error] : [self isUnsentError:error];
+    }
+    
+    switch(statusCode)
+    {
+        case 503:
+            // ServerBusy is returned before the operation runs
+            return YES;
+        case 500:
+        case 408:
+            return idempotent;
+        default:
+            return NO;
+    }
+}
+
+- (NSTimeInterval)delayForAttempt:(NSUInteger)attempt response:(NSHTTPURLResponse *)response
+{
+    NSTimeInterval ceiling = _baseDelay * (double)(1ull << MIN(attempt, (NSUInteger)30));
+    ceiling = MIN(ceiling, _maxDelay);
+    
+    // full jitter: anywhere between no wait and the ceiling
+    NSTimeInterval delay = ceiling * ((double)arc4random_uniform(1 << 20) / (double)(1 << 20));
+    
+    NSString* retryAfter = [[response allHeaderFields] objectForKey:@"Retry-After"];
+    if(retryAfter)
+    {
+        delay = MAX(delay, MIN([retryAfter doubleValue], _maxDelay));
+    }
+    
+    return delay;
+}
+
+@end
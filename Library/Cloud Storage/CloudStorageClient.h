@@ -19,24 +19,70 @@
 #import "Blob.h"
 #import "BlobContainer.h"
 #import "TableEntity.h"
+#import "TableResultSet.h"
+#import "BlobListing.h"
 #import "TableFetchRequest.h"
+#import "TableBatch.h"
+#import "BlobListRequest.h"
 #import "QueueMessage.h"
+#import "BlobCache.h"
+#import "CloudRequestHandle.h"
 
 @protocol CloudStorageClientDelegate;
 
+/*! The wire format of table entity queries and writes. JSON needs service version 2013-08-15 and is roughly a third of the size of AtomPub. */
+typedef enum
+{
+    CloudTableFormatAtom = 0,
+    CloudTableFormatJSON
+} CloudTableFormat;
+
 /*! The cloud storage client is used to invoke operations on, and return data from, Windows Azure storage. */
 @interface CloudStorageClient : NSObject
 {
 	AuthenticationCredential* _credential;
 	id<CloudStorageClientDelegate> _delegate;
+	NSUInteger _streamingWindowSize;
+	NSUInteger _downloadSegmentSize;
+	NSUInteger _downloadParallelism;
+	NSUInteger _uploadBlockSize;
+	NSUInteger _uploadParallelism;
+	BlobCache* _blobCache;
+	CloudTableFormat _tableFormat;
+	NSTimeInterval _requestTimeout;
+	NSTimeInterval _hedgeDelay;
+	dispatch_queue_t _callbackQueue;
+	dispatch_queue_t _deliveryQueue;
 }
 
 @property (assign) id<CloudStorageClientDelegate> delegate;
+/*! The largest number of bytes buffered by a streaming blob download before it is handed on. Defaults to 256 KB. */
+@property (assign) NSUInteger streamingWindowSize;
+/*! The size of each x-ms-range segment fetched by a parallel blob download. Defaults to 4 MB. */
+@property (assign) NSUInteger downloadSegmentSize;
+/*! The largest number of segments a parallel blob download keeps in flight. Defaults to 4. */
+@property (assign) NSUInteger downloadParallelism;
+/*! The size of each block sent by a block blob upload. Defaults to 4 MB. */
+@property (assign) NSUInteger uploadBlockSize;
+/*! The largest number of blocks a block blob upload keeps in flight. Defaults to 4. */
+@property (assign) NSUInteger uploadParallelism;
+/*! When set, getBlobData:withBlock: keeps downloaded blobs here and revalidates them by ETag instead of downloading them again. Defaults to nil. */
+@property (retain) BlobCache* blobCache;
+/*! The format getEntities:, insertEntity:, updateEntity: and mergeEntity: use on the wire. Table management, batches and getEntityResults:withBlock: always use AtomPub. Defaults to CloudTableFormatAtom. */
+@property (assign) CloudTableFormat tableFormat;
+/*! The time, in seconds, each operation that returns a CloudRequestHandle has to complete before it fails with NSURLErrorTimedOut; the handle can move it afterwards. Defaults to 0, no limit. */
+@property (assign) NSTimeInterval requestTimeout;
+/*! When non-zero, getBlobData:withBlock:, the peek methods and each page of getEntities: send a second copy of their request if the first has not answered within this many seconds, take whichever answer arrives first and cancel the other. This trims slow outliers at the cost of some duplicate reads; only idempotent reads are hedged. Defaults to 0, off. */
+@property (assign) NSTimeInterval hedgeDelay;
+/*! The queue completion blocks and delegate methods are called on. Requests are sent from a networking thread and their responses parsed on a shared concurrent queue, so only the callbacks themselves run here. The callbacks of one client never run concurrently with each other, even on a concurrent queue. QueueMessagePump and TableBatchWriter run their timers here too, and BlobBulkOperation moves on from its callbacks, so they should be driven from this queue. Defaults to the main queue. */
+@property (assign) dispatch_queue_t callbackQueue;
 
 /*! Returns a list of blob containers. */
 - (void)getBlobContainers;
 /*! Returns a list of blob containers. */
 - (void)getBlobContainersWithBlock:(void (^)(NSArray*, NSError *))block;
+/*! Hands the blob containers matching a list request to pageBlock one page at a time, following NextMarker until the listing ends; return NO to stop. The next page is requested before pageBlock is called. */
+- (void)getBlobContainers:(BlobListRequest *)listRequest pageBlock:(BOOL (^)(NSArray *))pageBlock withBlock:(void (^)(NSError *))block;
 /*! Adds a blob container, given a specified container name.  Returns error if the container already exists, or where the name is an invalid format.*/
 - (BOOL)addBlobContainer:(NSString *)containerName;
 /*! Adds a blob container, given a specified container name.  Returns error if the container already exists, or where the name is an invalid format.*/
@@ -49,18 +95,46 @@
 - (void)getBlobs:(BlobContainer *)container;
 /*! Returns an array of blobs from the specified blob container. */
 - (void)getBlobs:(BlobContainer *)container withBlock:(void (^)(NSArray *, NSError *))block;
+/*! Hands the blobs matching a list request to pageBlock one page at a time, following NextMarker until the listing ends; return NO to stop. With a delimiter, the second array holds the rolled-up prefixes of the page. The next page is requested before pageBlock is called. Through the proxy this needs a container the proxy grants a shared access signature for. */
+- (void)getBlobs:(BlobListRequest *)listRequest pageBlock:(BOOL (^)(NSArray *, NSArray *))pageBlock withBlock:(void (^)(NSError *))block;
+/*! Lists a container as several independent listings run side by side, one per shard prefix appended to the request's prefix. Pages from different shards arrive interleaved. The shards should cover the name space, for example the characters 0-9 and a-z for evenly distributed names. */
+- (void)getBlobs:(BlobListRequest *)listRequest shardPrefixes:(NSArray *)shardPrefixes pageBlock:(BOOL (^)(NSArray *, NSArray *))pageBlock withBlock:(void (^)(NSError *))block;
+/*! Reads a whole listing into one compact BlobListing, following NextMarker until the listing ends, for listings too large to hold as Blob objects. With shard prefixes (which may be nil) the shards are listed side by side, as in getBlobs:shardPrefixes:pageBlock:withBlock:, and the listing is put in name order once all of them are done. Not available through the proxy. */
+- (void)getBlobListing:(BlobListRequest *)listRequest shardPrefixes:(NSArray *)shardPrefixes withBlock:(void (^)(BlobListing *, NSError *))block;
 /*! Returns the binary data (NSData) object for the specified blob. */
 - (void)getBlobData:(Blob *)blob;
-/*! Returns the binary data (NSData) object for the specified blob. */
-- (void)getBlobData:(Blob *)blob withBlock:(void (^)(NSData *, NSError *))block;
+/*! Returns the binary data (NSData) object for the specified blob. The returned handle cancels the download or sets its deadline. */
+- (CloudRequestHandle *)getBlobData:(Blob *)blob withBlock:(void (^)(NSData *, NSError *))block;
+/*! Streams the binary data for the specified blob to chunkBlock without buffering the whole blob. Each chunk is at most streamingWindowSize bytes and is only valid for the duration of the call; return NO to cancel the download. chunkBlock is called in order on a background queue, not the callbackQueue. The returned handle cancels the download or sets its deadline. */
+- (CloudRequestHandle *)getBlobData:(Blob *)blob chunkBlock:(BOOL (^)(NSData *))chunkBlock withBlock:(void (^)(NSError *))block;
+/*! Streams the binary data for the specified blob into an output stream, opening it if needed and closing it when done. Writes block until the stream accepts the data. */
+- (void)getBlobData:(Blob *)blob toOutputStream:(NSOutputStream *)stream withBlock:(void (^)(NSError *))block;
+/*! Streams the binary data for the specified blob to an open file descriptor. Writes block until the descriptor accepts the data. */
+- (void)getBlobData:(Blob *)blob toFileDescriptor:(int)fd withBlock:(void (^)(NSError *))block;
+/*! Returns the binary data for the specified blob, fetched as downloadParallelism concurrent ranged requests and reassembled in order. Failed segments are retried individually. Through the proxy this needs a container the proxy grants a shared access signature for. */
+- (void)getBlobDataInParallel:(Blob *)blob withBlock:(void (^)(NSData *, NSError *))block;
+/*! Downloads the specified blob into a file, fetched as downloadParallelism concurrent ranged requests that are written in place as they arrive. Failed segments are retried individually. Through the proxy this needs a container the proxy grants a shared access signature for. */
+- (void)getBlobData:(Blob *)blob toFile:(NSString *)path withBlock:(void (^)(NSError *))block;
 /*! Adds a new blob to a container, given the name of the blob, binary data for the blob, and content type. */
 - (void)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString*)contentType;
-/*! Adds a new blob to a container, given the name of the blob, binary data for the blob, and content type. */
-- (void)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString*)contentType withBlock:(void (^)(NSError *))block;
+/*! Adds a new blob to a container, given the name of the blob, binary data for the blob, and content type. The returned handle cancels the upload or sets its deadline. */
+- (CloudRequestHandle *)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString*)contentType withBlock:(void (^)(NSError *))block;
+/*! Uploads a file as a block blob, sending uploadBlockSize blocks uploadParallelism at a time and committing them once all have arrived. Failed blocks are resent individually. The file is memory-mapped rather than read into buffers. Through the proxy this needs a container the proxy grants a shared access signature for. Always returns YES; failures are reported through the block or the delegate. */
+- (BOOL)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentsOfFile:(NSString *)path contentType:(NSString*)contentType withBlock:(void (^)(NSError *))block;
+/*! Uploads a file from an open descriptor, read from offset 0, as a block blob. A regular file is memory-mapped and sent without being copied into memory first; one that fits in uploadBlockSize goes up as a single request. The descriptor is not closed. Through the proxy this needs a container the proxy grants a shared access signature for. Always returns YES; failures are reported through the block or the delegate. */
+- (BOOL)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName fileDescriptor:(int)fd contentType:(NSString*)contentType withBlock:(void (^)(NSError *))block;
+/*! Uploads the contents of a stream as a block blob, sending uploadBlockSize blocks uploadParallelism at a time and committing them once all have arrived. Failed blocks are resent individually. Through the proxy this needs a container the proxy grants a shared access signature for. Always returns YES; failures are reported through the block or the delegate. */
+- (BOOL)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentStream:(NSInputStream *)stream contentType:(NSString*)contentType withBlock:(void (^)(NSError *))block;
 /*! Deletes a blob.  Returns error if the blob doesn't exist or could not be deleted. */
 - (void)deleteBlob:(Blob *)blob;
-/*! Deletes a blob.  Returns error if the blob doesn't exist or could not be deleted. */
-- (void)deleteBlob:(Blob *)blob withBlock:(void (^)(NSError *))block;
+/*! Deletes a blob.  Returns error if the blob doesn't exist or could not be deleted. The returned handle cancels the request or sets its deadline. */
+- (CloudRequestHandle *)deleteBlob:(Blob *)blob withBlock:(void (^)(NSError *))block;
+/*! Starts a server-side copy of a blob to blobName in the specified container; the data never passes through the device. The block is called once the service has accepted the copy, which for a large blob may still be running. Through the proxy, both containers need a shared access signature from it. */
+- (CloudRequestHandle *)copyBlob:(Blob *)blob toContainer:(BlobContainer *)container blobName:(NSString *)blobName withBlock:(void (^)(NSError *))block;
+/*! Replaces the user-defined metadata of a blob with the names and string values in metadata. An empty dictionary clears it. */
+- (CloudRequestHandle *)setBlobMetadata:(Blob *)blob metadata:(NSDictionary *)metadata withBlock:(void (^)(NSError *))block;
+/*! Sets the system properties of a blob from a dictionary keyed by header name, for example x-ms-blob-content-type or x-ms-blob-cache-control. The service clears the properties that are left out. */
+- (CloudRequestHandle *)setBlobProperties:(Blob *)blob properties:(NSDictionary *)properties withBlock:(void (^)(NSError *))block;
 
 /*! Returns a list of queues. */
 - (void)getQueues;
@@ -86,22 +160,28 @@
 - (void)getQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount;
 /*! Gets a batch of messages from the specified queue. Returns error if failed. */
 - (void)getQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount withBlock:(void (^)(NSArray *, NSError *))block;
+/*! Gets a batch of up to 32 messages from the specified queue, hidden from other consumers for visibilityTimeout seconds. Returns error if failed. The returned handle cancels the request or sets its deadline; messages the service handed out before a cancel stay hidden until the timeout. */
+- (CloudRequestHandle *)getQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount visibilityTimeout:(NSInteger)visibilityTimeout withBlock:(void (^)(NSArray *, NSError *))block;
 /*! Peeks a single message from the specified queue. Peek is like Get, but the message is not marked for removal. */
 - (void)peekQueueMessage:(NSString *)queueName;
-/*! Peeks a single message from the specified queue. Peek is like Get, but the message is not marked for removal. Returns error if failed. */
-- (void)peekQueueMessage:(NSString *)queueName withBlock:(void (^)(QueueMessage *, NSError *))block;
+/*! Peeks a single message from the specified queue. Peek is like Get, but the message is not marked for removal. Returns error if failed. The returned handle cancels the request or sets its deadline. */
+- (CloudRequestHandle *)peekQueueMessage:(NSString *)queueName withBlock:(void (^)(QueueMessage *, NSError *))block;
 /*! Peeks a batch of messages from the specified queue. Peek is like Get, but the message is not marked for removal. */
 - (void)peekQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount;
-/*! Peeks a batch of messages from the specified queue. Peek is like Get, but the message is not marked for removal. Returns error if failed. */
-- (void)peekQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount withBlock:(void (^)(NSArray *, NSError *))block;
+/*! Peeks a batch of messages from the specified queue. Peek is like Get, but the message is not marked for removal. Returns error if failed. The returned handle cancels the request or sets its deadline. */
+- (CloudRequestHandle *)peekQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount withBlock:(void (^)(NSArray *, NSError *))block;
 /*! Deletes a message, given a specified queue name and queueMessage. */
 - (void)deleteQueueMessage:(QueueMessage *)queueMessage queueName:(NSString *)queueName;
 /*! Deletes a message, given a specified queue name and queueMessage. Returns error if failed. */
 - (void)deleteQueueMessage:(QueueMessage *)queueMessage queueName:(NSString *)queueName withBlock:(void (^)(NSError *))block;
+/*! Keeps a message hidden for another visibilityTimeout seconds from now. On success the message carries the new pop receipt, which later updates and deletes must use. Returns error if failed. */
+- (void)updateQueueMessage:(QueueMessage *)queueMessage queueName:(NSString *)queueName visibilityTimeout:(NSInteger)visibilityTimeout withBlock:(void (^)(NSError *))block;
 /*! Puts a message into a queue, given a specified queue name and message. */
 - (void)putMessageToQueue:(NSString *)message queueName:(NSString *)queueName;
 /*! Puts a message into a queue, given a specified queue name and message. Returns error if failed. */
 - (void)putMessageToQueue:(NSString *)message queueName:(NSString *)queueName withBlock:(void (^)(NSError *))block;
+/*! Adds a binary message to a queue, base64-encoded as the service requires. The data may be a memory-mapped file; it is encoded straight into the request body. Messages are limited to 64 KB once encoded. */
+- (void)putMessageData:(NSData *)data queueName:(NSString *)queueName withBlock:(void (^)(NSError *))block;
 
 /*! Returns a list of tables. */
 - (void)getTables;
@@ -117,8 +197,12 @@
 - (void)deleteTableNamed:(NSString *)tableName withBlock:(void (^)(NSError *))block;
 /*! Returns the entities for a given table. */
 - (void)getEntities:(TableFetchRequest*)fetchRequest;
-/*! Returns the entities for a given table. */
-- (void)getEntities:(TableFetchRequest*)fetchRequest withBlock:(void (^)(NSArray *, NSError *))block;
+/*! Returns the entities for a given table, following continuation tokens until topRows entities or the whole result have been read. The returned handle cancels the query or sets a deadline for all of its pages. */
+- (CloudRequestHandle *)getEntities:(TableFetchRequest*)fetchRequest withBlock:(void (^)(NSArray *, NSError *))block;
+/*! Hands the entities for a given table to pageBlock one page at a time, following continuation tokens. topRows sets the page size. The next page is requested before pageBlock is called, so it downloads while the current page is processed; return NO to stop. The queries of a request planned from a predicate run concurrently, and their pages arrive in whatever order the queries answer. The returned handle cancels the query or sets a deadline for all of its pages. */
+- (CloudRequestHandle *)getEntities:(TableFetchRequest*)fetchRequest pageBlock:(BOOL (^)(NSArray *))pageBlock withBlock:(void (^)(NSError *))block;
+/*! Reads the entities for a given table into one column-wise TableResultSet, following continuation tokens until topRows entities or the whole result have been read. Properties are stored as the native type named by their m:type, for scans that don't need an object per entity. Always reads AtomPub, which carries those types. The queries of a planned request are read one after another; a request with a residualPredicate fails, since rows can't be filtered out of the columns. */
+- (void)getEntityResults:(TableFetchRequest*)fetchRequest withBlock:(void (^)(TableResultSet *, NSError *))block;
 /*! Inserts a new entity into an existing table. */
 - (BOOL)insertEntity:(TableEntity *)newEntity;
 /*! Inserts a new entity into an existing table. */
@@ -135,6 +219,10 @@
 - (BOOL)deleteEntity:(TableEntity *)existingEntity;
 /*! Merges an existing entity within a table. */
 - (BOOL)deleteEntity:(TableEntity *)existingEntity withBlock:(void (^)(NSError *))block;
+/*! Sends the operations in a batch as one Entity Group Transaction. Returns NO through the proxy service or for an empty batch. */
+- (BOOL)executeBatch:(TableBatch *)batch;
+/*! Sends the operations in a batch as one Entity Group Transaction. The results array holds NSNull or an NSError for each operation, in the order they were added; when one operation fails the others are rolled back and report that instead. */
+- (BOOL)executeBatch:(TableBatch *)batch withBlock:(void (^)(NSArray *, NSError *))block;
 
 /*! Initializes a new cloud storage client, based on a passed set of authentication credentials. */
 + (CloudStorageClient*) storageClientWithCredential:(AuthenticationCredential*)credential;
@@ -157,8 +245,14 @@
 - (void)storageClient:(CloudStorageClient *)client didDeleteBlobContainer:(BlobContainer *)name;
 /*! Called when the client successfully returns blobs from an existing container. */
 - (void)storageClient:(CloudStorageClient *)client didGetBlobs:(NSArray *)blobs inContainer:(BlobContainer *)container;
+/*! Called when the client finishes a paged listing of blob containers. */
+- (void)storageClientDidListBlobContainers:(CloudStorageClient *)client;
+/*! Called when the client finishes a paged listing of the blobs in a container. */
+- (void)storageClient:(CloudStorageClient *)client didListBlobsInContainer:(BlobContainer *)container;
 /*! Called when the client successfully returns blob data for a given blob. */
 - (void)storageClient:(CloudStorageClient *)client didGetBlobData:(NSData *)data blob:(Blob *)blob;
+/*! Called when the client finishes streaming the data for a given blob. */
+- (void)storageClient:(CloudStorageClient *)client didStreamBlobData:(Blob *)blob;
 /*! Called when the client successfully adds a blob to a specified container. */
 - (void)storageClient:(CloudStorageClient *)client didAddBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName;
 /*! Called when the client successfully deletes a blob. */
@@ -180,6 +274,8 @@
 - (void)storageClient:(CloudStorageClient *)client didPeekQueueMessages:(NSArray *)queueMessages;
 /*! Called when the client successfully delete a message from the specified queue */
 - (void)storageClient:(CloudStorageClient *)client didDeleteQueueMessage:(QueueMessage *)queueMessage queueName:(NSString *)queueName;
+/*! Called when the client successfully extended the visibility timeout of a message in the specified queue */
+- (void)storageClient:(CloudStorageClient *)client didUpdateQueueMessage:(QueueMessage *)queueMessage queueName:(NSString *)queueName;
 /*! Called when the client successfully put a message into the specified queue */
 - (void)storageClient:(CloudStorageClient *)client didPutMessageToQueue:(NSString *)message queueName:(NSString *)queueName;
 
@@ -191,6 +287,8 @@
 - (void)storageClient:(CloudStorageClient *)client didDeleteTableNamed:(NSString *)tableName;
 /*! Called when the client successfully returns a list of entities from a table. */
 - (void)storageClient:(CloudStorageClient *)client didGetEntities:(NSArray *)entities fromTableNamed:(NSString *)tableName;
+/*! Called when the client finishes paging through the entities of a table. */
+- (void)storageClient:(CloudStorageClient *)client didGetAllEntityPagesFromTableNamed:(NSString *)tableName;
 
 /*! Called when the client successfully inserts an entity into a table. */
 - (void)storageClient:(CloudStorageClient *)client didInsertEntity:(TableEntity *)entity;
@@ -200,6 +298,8 @@
 - (void)storageClient:(CloudStorageClient *)client didMergeEntity:(TableEntity *)entity;
 /*! Called when the client successfully deletes an entity from a table. */
 - (void)storageClient:(CloudStorageClient *)client didDeleteEntity:(TableEntity *)entity;
+/*! Called when the service answers a batch. The results array holds NSNull or an NSError for each operation, in the order they were added. */
+- (void)storageClient:(CloudStorageClient *)client didExecuteBatch:(TableBatch *)batch results:(NSArray *)results;
 /*
 - (void)storageClient:(CloudStorageClient *)client didInsertEntity:(NSDictionary *)entity intoTableNamed:(NSString *)tableName;
 - (void)storageClient:(CloudStorageClient *)client didUpdateEntity:(NSDictionary *)entity inTableNamed:(NSString *)tableName;
@@ -15,7 +15,9 @@
  */
 
 #import "CloudStorageClient.h"
+#import "CloudStorageClient+Private.h"
 #import "CloudURLRequest.h"
+#import "CloudRequestHandle+Private.h"
 #import "ContainerParser.h"
 #import "BlobParser.h"
 #import "Blob.h"
@@ -26,32 +28,104 @@
 #import "TableEntity.h"
 #import "QueueParser.h"
 #import "QueueMessageParser.h"
+#import "BlobRangeDownloader.h"
+#import "BlobBlockUploader.h"
+#import "TableBatchParser.h"
+#import "XmlStreamParser.h"
+#import "JsonStreamParser.h"
+#import "TableColumnParser.h"
+#import "SimpleBase64.h"
+#import "TableResultSet+Private.h"
+#import "BlobListingParser.h"
+#import "SharedAccessSignature.h"
+#import <unistd.h>
+#import <fcntl.h>
+
+// by default a fetched message stays hidden for a minute, long enough to turn around and delete it
+static const NSInteger QUEUE_DEFAULT_VISIBILITY_TIMEOUT = 60;
+
+// number of times a single failed segment of a parallel download, or block of an upload, is re-requested
+static const NSUInteger SEGMENT_RETRY_COUNT = 3;
 
 static NSString *CREATE_TABLE_REQUEST_STRING = @"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?><entry xmlns:d=\"http://schemas.microsoft.com/ado/2007/08/dataservices\" xmlns:m=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\" xmlns=\"http://www.w3.org/2005/Atom\"><title /><updated>$UPDATEDDATE$</updated><author><name/></author><id/><content type=\"application/xml\"><m:properties><d:TableName>$TABLENAME$</d:TableName></m:properties></content></entry>";
 static NSString *TABLE_INSERT_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?><entry xmlns:d=\"http://schemas.microsoft.com/ado/2007/08/dataservices\" xmlns:m=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\" xmlns=\"http://www.w3.org/2005/Atom\"><title /><updated>$UPDATEDDATE$</updated><author><name /></author><id /><content type=\"application/xml\"><m:properties>$PROPERTIES$</m:properties></content></entry>";
 static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" encoding=\"utf-8\" standalone=\"yes\"?><entry xmlns:d=\"http://schemas.microsoft.com/ado/2007/08/dataservices\" xmlns:m=\"http://schemas.microsoft.com/ado/2007/08/dataservices/metadata\" xmlns=\"http://www.w3.org/2005/Atom\"><title /><updated>$UPDATEDDATE$</updated><author><name /></author><id>$ENTITYID$</id><content type=\"application/xml\"><m:properties>$PROPERTIES$</m:properties></content></entry>";
 
-@interface CloudStorageClient (Private)
-- (void)privateGetQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount useBlockError:(BOOL)useBlockError peekOnly:(BOOL)peekOnly withBlock:(void (^)(NSArray *, NSError *))block;
+@interface CloudStorageClient ()
+- (void)privateGetQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount visibilityTimeout:(NSInteger)visibilityTimeout useBlockError:(BOOL)useBlockError peekOnly:(BOOL)peekOnly handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSArray *, NSError *))block;
+- (void)privateGetBlobData:(Blob *)blob chunkBlock:(BOOL (^)(NSData *))chunkBlock finally:(NSError* (^)(NSError *))finally handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSError *))block;
+- (void)privateDownloadBlob:(BlobRangeDownloader *)downloader container:(BlobContainer *)container finally:(void (^)(void))finally withBlock:(void (^)(NSData *, NSError *))block;
+- (void)privateUploadBlob:(BlobBlockUploader *)uploader container:(BlobContainer *)container blobName:(NSString *)blobName finally:(void (^)(void))finally withBlock:(void (^)(NSError *))block;
+- (NSData *)privateBodyForEntity:(TableEntity *)entity template:(NSString *)template entityID:(NSString *)entityID contentType:(NSString **)contentType;
+- (NSData *)privateBodyForBatch:(TableBatch *)batch batchBoundary:(NSString *)batchBoundary changesetBoundary:(NSString *)changesetBoundary;
+- (void)privateGetEntityPages:(TableFetchRequest *)fetchRequest handle:(CloudRequestHandle *)handle pageBlock:(BOOL (^)(NSArray *))pageBlock withBlock:(void (^)(NSError *))block;
+- (NSArray *)privateEntities:(NSArray *)entities matching:(NSPredicate *)predicate unseen:(NSMutableSet *)seen;
+- (void)privateGetEntityPage:(TableFetchRequest *)fetchRequest handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSArray *, TableFetchRequest *, NSError *))block;
+- (void)privateGetEntityResultsPage:(TableFetchRequest *)fetchRequest results:(TableResultSet *)results withBlock:(void (^)(TableFetchRequest *, NSError *))block;
+- (TableFetchRequest *)privateContinuationOf:(TableFetchRequest *)fetchRequest response:(NSHTTPURLResponse *)response;
+- (void)privateListPages:(BlobListRequest *)listRequest pageBlock:(BOOL (^)(NSArray *, NSArray *))pageBlock withBlock:(void (^)(NSError *))block;
+- (void)privateGetListPage:(BlobListRequest *)listRequest signature:(SharedAccessSignature *)signature withBlock:(void (^)(NSArray *, NSArray *, BlobListRequest *, NSError *))block;
+- (void)privateGetBlobs:(BlobContainer *)container withBlock:(void (^)(NSArray *, NSError *))block;
+- (void)privateGetBlobData:(Blob *)blob signature:(SharedAccessSignature *)signature handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSData *, NSError *))block;
+- (void)privateAddBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString *)contentType signature:(SharedAccessSignature *)signature handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSError *))block;
+- (void)privateDeleteBlob:(Blob *)blob signature:(SharedAccessSignature *)signature handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSError *))block;
+- (void)privatePutBlob:(NSString *)blobName container:(NSString *)containerName query:(NSString *)query headers:(NSDictionary *)headers signature:(SharedAccessSignature *)signature handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSError *))block;
+- (void)privateGetListing:(BlobListRequest *)listRequest listing:(BlobListing *)listing withBlock:(void (^)(NSError *))block;
+- (CloudRequestHandle *)privateHandle;
+- (void)privateRead:(CloudRequestHandle *)handle hedged:(BOOL)hedged attempt:(void (^)(CloudRequestHandle *, void (^)(BOOL, dispatch_block_t)))attempt;
+@end
+
+@interface BlobCache (Private)
+- (void)noteHit;
+- (void)noteMiss;
+- (void)noteRevalidation;
+@end
+
+@interface BlobListRequest (Private)
+
+- (NSString*)endpoint;
+- (BlobListRequest*)listRequestWithPrefix:(NSString*)prefix marker:(NSString*)marker;
+
 @end
 
 @interface TableEntity (Private)
 
 - (id)initWithDictionary:(NSMutableDictionary*)dictionary fromTable:(NSString*)tableName;
 - (NSString*)propertyString;
+- (NSData*)jsonBody;
 - (NSString*)endpoint;
 
 @end
 
+@interface QueueMessage (Private)
+
+- (void)setPopReceipt:(NSString *)popReceipt timeNextVisible:(NSString *)timeNextVisible;
+
+@end
+
 @interface TableFetchRequest (Private)
 
 - (NSString*)endpoint;
+- (TableFetchRequest*)continuationRequestWithNextPartitionKey:(NSString*)nextPartitionKey nextRowKey:(NSString*)nextRowKey;
+- (BOOL)queriesOverlap;
+
+@end
 
+@interface CloudStorageClient (RequestOwner) <CloudRequestOwner>
 @end
 
 @implementation CloudStorageClient
 
 @synthesize delegate = _delegate;
+@synthesize streamingWindowSize = _streamingWindowSize;
+@synthesize downloadSegmentSize = _downloadSegmentSize;
+@synthesize downloadParallelism = _downloadParallelism;
+@synthesize uploadBlockSize = _uploadBlockSize;
+@synthesize uploadParallelism = _uploadParallelism;
+@synthesize blobCache = _blobCache;
+@synthesize tableFormat = _tableFormat;
+@synthesize requestTimeout = _requestTimeout;
+@synthesize hedgeDelay = _hedgeDelay;
 
 #pragma mark Creation
 
@@ -60,6 +134,17 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 	if((self = [super init]))
 	{
 		_credential = [credential retain];
+		_streamingWindowSize = 256 * 1024;
+		_downloadSegmentSize = 4 * 1024 * 1024;
+		_downloadParallelism = 4;
+		_uploadBlockSize = 4 * 1024 * 1024;
+		_uploadParallelism = 4;
+		
+		// one serial queue per client keeps its callbacks in order whatever queue they end up on
+		_callbackQueue = dispatch_get_main_queue();
+		dispatch_retain(_callbackQueue);
+		_deliveryQueue = dispatch_queue_create("com.microsoft.AzureIOSToolkit.callbacks", DISPATCH_QUEUE_SERIAL);
+		dispatch_set_target_queue(_deliveryQueue, _callbackQueue);
 	}
 	
 	return self;
@@ -70,13 +155,132 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 	return [[[self alloc] initWithCredential:credential] autorelease];
 }
 
-- (void)prepareTableRequest:(CloudURLRequest*)request
+- (dispatch_queue_t)callbackQueue
+{
+    @synchronized(self)
+    {
+        return _callbackQueue;
+    }
+}
+
+- (void)setCallbackQueue:(dispatch_queue_t)callbackQueue
+{
+    callbackQueue = callbackQueue ? callbackQueue : dispatch_get_main_queue();
+    
+    @synchronized(self)
+    {
+        dispatch_retain(callbackQueue);
+        dispatch_release(_callbackQueue);
+        _callbackQueue = callbackQueue;
+        // callbacks already waiting move over with the rest
+        dispatch_set_target_queue(_deliveryQueue, callbackQueue);
+    }
+}
+
+- (dispatch_queue_t)requestCallbackQueue
+{
+    return _deliveryQueue;
+}
+
+- (dispatch_source_t)privateTimerWithInterval:(NSTimeInterval)interval repeats:(BOOL)repeats handler:(dispatch_block_t)handler
+{
+    dispatch_source_t timer = dispatch_source_create(DISPATCH_SOURCE_TYPE_TIMER, 0, 0, _deliveryQueue);
+    uint64_t nanoseconds = (uint64_t)(interval * NSEC_PER_SEC);
+    
+    dispatch_source_set_timer(timer, dispatch_time(DISPATCH_TIME_NOW, (int64_t)nanoseconds), repeats ? nanoseconds : DISPATCH_TIME_FOREVER, nanoseconds / 10);
+    dispatch_source_set_event_handler(timer, handler);
+    dispatch_resume(timer);
+    
+    return timer;
+}
+
+- (CloudRequestHandle *)privateHandle
+{
+    CloudRequestHandle* handle = [[[CloudRequestHandle alloc] init] autorelease];
+    [handle setTimeout:self.requestTimeout];
+    
+    return handle;
+}
+
+// Runs one attempt at a read. When hedged, and the attempt hasn't finished after hedgeDelay, a second
+// one is started alongside it; the first attempt to succeed has its result handed on and the other is
+// cancelled, while a failure is only handed on once no attempt is left. Attempts report back on the
+// delivery queue, which is also where the second one starts, so the shared state needs no lock.
+- (void)privateRead:(CloudRequestHandle *)handle hedged:(BOOL)hedged attempt:(void (^)(CloudRequestHandle *, void (^)(BOOL, dispatch_block_t)))attempt
+{
+    NSTimeInterval hedgeDelay = self.hedgeDelay;
+    
+    if(!hedged || hedgeDelay <= 0)
+    {
+        attempt(handle, ^(BOOL succeeded, dispatch_block_t result)
+        {
+            result();
+        });
+        return;
+    }
+    
+    // the caller may not hold a handle, but the slower attempt still has to be stopped
+    handle = handle ? handle : [self privateHandle];
+    
+    NSMutableArray* attempts = [NSMutableArray arrayWithCapacity:2];
+    __block NSUInteger running = 0;
+    __block BOOL decided = NO;
+    
+    void (^done)(BOOL, dispatch_block_t) = ^(BOOL succeeded, dispatch_block_t result)
+    {
+        running--;
+        if(decided || (!succeeded && running > 0))
+        {
+            return;
+        }
+        
+        decided = YES;
+        // the finished attempt has nothing left to stop, so it's simplest to cancel both
+        [attempts makeObjectsPerformSelector:@selector(cancel)];
+        result();
+    };
+    
+    void (^launch)(void) = ^
+    {
+        CloudRequestHandle* attemptHandle = [handle childHandle];
+        [attempts addObject:attemptHandle];
+        running++;
+        attempt(attemptHandle, done);
+    };
+    
+    launch();
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(hedgeDelay * NSEC_PER_SEC)), _deliveryQueue, ^
+    {
+        if(!decided)
+        {
+            launch();
+        }
+    });
+}
+
+- (void)prepareTableRequest:(CloudURLRequest*)request format:(CloudTableFormat)format
 {
-    [request setValue:@"2.0;NetFx" forHTTPHeaderField:@"MaxDataServiceVersion"];
-    [request setValue:@"application/atom+xml,application/xml" forHTTPHeaderField:@"Accept"];
+    if(format == CloudTableFormatJSON)
+    {
+        // x-ms-* headers aren't part of the table string to sign, so the version can be set after signing
+        [request setValue:@"2013-08-15" forHTTPHeaderField:@"x-ms-version"];
+        [request setValue:@"3.0;NetFx" forHTTPHeaderField:@"DataServiceVersion"];
+        [request setValue:@"3.0;NetFx" forHTTPHeaderField:@"MaxDataServiceVersion"];
+        [request setValue:@"application/json;odata=nometadata" forHTTPHeaderField:@"Accept"];
+    }
+    else
+    {
+        [request setValue:@"2.0;NetFx" forHTTPHeaderField:@"MaxDataServiceVersion"];
+        [request setValue:@"application/atom+xml,application/xml" forHTTPHeaderField:@"Accept"];
+    }
     [request setValue:@"NativeHost" forHTTPHeaderField:@"User-Agent"];
 }
 
+- (void)prepareTableRequest:(CloudURLRequest*)request
+{
+    [self prepareTableRequest:request format:CloudTableFormatAtom];
+}
+
 #pragma mark -
 #pragma mark Queue API methods
 
@@ -89,6 +293,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 {
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:@"?comp=list" forStorageType:@"queue", nil];
     
+    request.owner = self;
     [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
      {
          if(error)
@@ -132,6 +337,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     NSString* endpoint = [NSString stringWithFormat:@"/%@", [queueName URLEncode]];
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"queue" httpMethod:@"PUT", nil];
     
+	request.owner = self;
 	[request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
      {
          if(error)
@@ -171,6 +377,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     NSString* endpoint = [NSString stringWithFormat:@"/%@", [queueName URLEncode]];
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"queue" httpMethod:@"DELETE", nil];
     
+	request.owner = self;
 	[request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
      {
          if(error)
@@ -200,7 +407,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 - (void)getQueueMessage:(NSString *)queueName
 {
-	[self privateGetQueueMessages:queueName fetchCount:1 useBlockError:NO peekOnly:NO withBlock:^(NSArray* items, NSError* error) 
+	[self privateGetQueueMessages:queueName fetchCount:1 visibilityTimeout:QUEUE_DEFAULT_VISIBILITY_TIMEOUT useBlockError:NO peekOnly:NO handle:nil withBlock:^(NSArray* items, NSError* error) 
 	 {
 		 if(![(NSObject*)_delegate respondsToSelector:@selector(storageClient:didGetQueueMessage:)])
 		 {
@@ -220,7 +427,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 - (void)getQueueMessage:(NSString *)queueName withBlock:(void (^)(QueueMessage *, NSError *))block
 {
-	[self privateGetQueueMessages:queueName fetchCount:1 useBlockError:!!block peekOnly:NO withBlock:^(NSArray* items, NSError* error) 
+	[self privateGetQueueMessages:queueName fetchCount:1 visibilityTimeout:QUEUE_DEFAULT_VISIBILITY_TIMEOUT useBlockError:!!block peekOnly:NO handle:nil withBlock:^(NSArray* items, NSError* error) 
 	{
 		if(error)
 		{
@@ -262,7 +469,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 - (void)getQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount
 {
-	[self privateGetQueueMessages:queueName fetchCount:fetchCount useBlockError:NO peekOnly:NO withBlock:^(NSArray* items, NSError* error)
+	[self privateGetQueueMessages:queueName fetchCount:fetchCount visibilityTimeout:QUEUE_DEFAULT_VISIBILITY_TIMEOUT useBlockError:NO peekOnly:NO handle:nil withBlock:^(NSArray* items, NSError* error)
 	 {
 		 if(![(NSObject*)_delegate respondsToSelector:@selector(storageClient:didGetQueueMessages:)])
 		 {
@@ -275,7 +482,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 - (void)getQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount withBlock:(void (^)(NSArray *, NSError *))block
 {
-	[self privateGetQueueMessages:queueName fetchCount:fetchCount useBlockError:!!block peekOnly:NO withBlock:^(NSArray* items, NSError* error)
+	[self privateGetQueueMessages:queueName fetchCount:fetchCount visibilityTimeout:QUEUE_DEFAULT_VISIBILITY_TIMEOUT useBlockError:!!block peekOnly:NO handle:nil withBlock:^(NSArray* items, NSError* error)
 	 {
 		 if(error)
 		 {
@@ -301,9 +508,41 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 	 }];
 }
 
+- (CloudRequestHandle *)getQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount visibilityTimeout:(NSInteger)visibilityTimeout withBlock:(void (^)(NSArray *, NSError *))block
+{
+	CloudRequestHandle* handle = [self privateHandle];
+	
+	[self privateGetQueueMessages:queueName fetchCount:fetchCount visibilityTimeout:visibilityTimeout useBlockError:!!block peekOnly:NO handle:handle withBlock:^(NSArray* items, NSError* error)
+	 {
+		 if(error)
+		 {
+			 if(block)
+			 {
+				 block(nil, error);
+			 }
+			 else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+			 {
+				 [_delegate storageClient:self didFailRequest:nil withError:error];
+			 }
+			 return;
+		 }
+		 
+		 if(block)
+		 {
+			 block(items, nil);
+		 }
+		 else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didGetQueueMessages:)])
+		 {
+			 [_delegate storageClient:self didGetQueueMessages:items];
+		 }
+	 }];
+	
+	return handle;
+}
+
 - (void)peekQueueMessage:(NSString *)queueName
 {
-	[self privateGetQueueMessages:queueName fetchCount:1 useBlockError:NO peekOnly:YES withBlock:^(NSArray* items, NSError* error) 
+	[self privateGetQueueMessages:queueName fetchCount:1 visibilityTimeout:QUEUE_DEFAULT_VISIBILITY_TIMEOUT useBlockError:NO peekOnly:YES handle:nil withBlock:^(NSArray* items, NSError* error) 
 	 {
 		 if(![(NSObject*)_delegate respondsToSelector:@selector(storageClient:didPeekQueueMessage:)])
 		 {
@@ -321,9 +560,11 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 	 }];
 }
 
-- (void)peekQueueMessage:(NSString *)queueName withBlock:(void (^)(QueueMessage *, NSError *))block
+- (CloudRequestHandle *)peekQueueMessage:(NSString *)queueName withBlock:(void (^)(QueueMessage *, NSError *))block
 {
-	[self privateGetQueueMessages:queueName fetchCount:1 useBlockError:!!block peekOnly:YES withBlock:^(NSArray* items, NSError* error) 
+	CloudRequestHandle* handle = [self privateHandle];
+	
+	[self privateGetQueueMessages:queueName fetchCount:1 visibilityTimeout:QUEUE_DEFAULT_VISIBILITY_TIMEOUT useBlockError:!!block peekOnly:YES handle:handle withBlock:^(NSArray* items, NSError* error) 
 	 {
 		 if(error)
 		 {
@@ -361,11 +602,13 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 			 }
 		 }
 	 }];
+	
+	return handle;
 }
 
 - (void)peekQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount
 {
-	[self privateGetQueueMessages:queueName fetchCount:1 useBlockError:NO peekOnly:YES withBlock:^(NSArray* items, NSError* error)
+	[self privateGetQueueMessages:queueName fetchCount:fetchCount visibilityTimeout:QUEUE_DEFAULT_VISIBILITY_TIMEOUT useBlockError:NO peekOnly:YES handle:nil withBlock:^(NSArray* items, NSError* error)
 	 {
 		 if(![(NSObject*)_delegate respondsToSelector:@selector(storageClient:didPeekQueueMessages:)])
 		 {
@@ -376,9 +619,11 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 	 }];
 }
 
-- (void)peekQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount withBlock:(void (^)(NSArray *, NSError *))block
+- (CloudRequestHandle *)peekQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount withBlock:(void (^)(NSArray *, NSError *))block
 {
-	[self privateGetQueueMessages:queueName fetchCount:1 useBlockError:!!block peekOnly:YES withBlock:^(NSArray* items, NSError* error)
+	CloudRequestHandle* handle = [self privateHandle];
+	
+	[self privateGetQueueMessages:queueName fetchCount:fetchCount visibilityTimeout:QUEUE_DEFAULT_VISIBILITY_TIMEOUT useBlockError:!!block peekOnly:YES handle:handle withBlock:^(NSArray* items, NSError* error)
 	 {
 		 if(error)
 		 {
@@ -402,6 +647,8 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 			 [_delegate storageClient:self didPeekQueueMessages:items];
 		 }
 	 }];
+	
+	return handle;
 }
 
 - (void)getQueueMessages:(NSString *)queueName
@@ -414,7 +661,13 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     queueName = [queueName lowercaseString];
     NSString* endpoint = [NSString stringWithFormat:@"/%@/messages?numofmessages=32", [queueName URLEncode]];
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"queue", nil];
-    [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
+    request.owner = self;
+    
+    XmlStreamParser* parser = [[[XmlStreamParser alloc] init] autorelease];
+    NSMutableArray* queueMessages = [NSMutableArray arrayWithCapacity:32];
+    [QueueMessageParser addQueueMessageRecordsToParser:parser queueMessages:queueMessages];
+    
+    [request fetchWithStreamParser:parser completion:^(NSError* error)
      {
          if(error)
          {
@@ -429,7 +682,6 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
              return;
          }
          
-         NSArray* queueMessages = [QueueMessageParser loadQueueMessages:doc];
          
          if(block)
          {
@@ -450,9 +702,10 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 - (void)deleteQueueMessage:(QueueMessage *)queueMessage queueName:(NSString *)queueName withBlock:(void (^)(NSError *))block
 {
     queueName = [queueName lowercaseString];
-    NSString* endpoint = [NSString stringWithFormat:@"/%@/messages/%@?popreceipt=%@", [queueName URLEncode], queueMessage.messageId, queueMessage.popReceipt];
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/messages/%@?popreceipt=%@", [queueName URLEncode], queueMessage.messageId, [queueMessage.popReceipt URLEncode]];
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"queue" httpMethod:@"DELETE", nil];
     
+	request.owner = self;
 	[request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
      {
          if(error)
@@ -479,6 +732,68 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
      }];
 }
 
+- (void)updateQueueMessage:(QueueMessage *)queueMessage queueName:(NSString *)queueName visibilityTimeout:(NSInteger)visibilityTimeout withBlock:(void (^)(NSError *))block
+{
+    queueName = [queueName lowercaseString];
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/messages/%@?popreceipt=%@&visibilitytimeout=%ld", [queueName URLEncode], queueMessage.messageId, [queueMessage.popReceipt URLEncode], (long)visibilityTimeout];
+    
+    // the text came back unescaped from the parser, so it has to be escaped again to be sent unchanged
+    NSMutableString* text = [NSMutableString stringWithString:(queueMessage.messageText ? queueMessage.messageText : @"")];
+    [text replaceOccurrencesOfString:@"&" withString:@"&amp;" options:0 range:NSMakeRange(0, text.length)];
+    [text replaceOccurrencesOfString:@"<" withString:@"&lt;" options:0 range:NSMakeRange(0, text.length)];
+    [text replaceOccurrencesOfString:@">" withString:@"&gt;" options:0 range:NSMakeRange(0, text.length)];
+    NSData* contentData = [[NSString stringWithFormat:@"<QueueMessage><MessageText>%@</MessageText></QueueMessage>", text] dataUsingEncoding:NSUTF8StringEncoding];
+    
+    // Update Message only exists from the 2011-08-18 protocol on, which signs queue requests the way blob requests are signed
+    NSURL* serviceURL = [_credential URLforEndpoint:endpoint forStorageType:@"queue"];
+    CloudURLRequest* request = [_credential authenticatedBlobRequestWithURL:serviceURL forStorageType:@"blob" httpMethod:@"PUT" contentData:contentData contentType:@"application/xml",
+                                @"x-ms-version", @"2011-08-18", nil];
+    
+    // a lapsed lease hands the message to another consumer, so this must not wait behind blob traffic
+    __block CloudURLRequest* updateRequest = request;
+    request.priority = CloudRequestPriorityHigh;
+    request.owner = self;
+    [request fetchNoResponseWithBlock:^(NSError* error)
+     {
+         if(!error)
+         {
+             NSDictionary* headers = [updateRequest.response allHeaderFields];
+             NSString* popReceipt = nil;
+             NSString* timeNextVisible = nil;
+             
+             for(NSString* name in headers)
+             {
+                 if([name caseInsensitiveCompare:@"x-ms-popreceipt"] == NSOrderedSame)
+                 {
+                     popReceipt = [headers objectForKey:name];
+                 }
+                 else if([name caseInsensitiveCompare:@"x-ms-time-next-visible"] == NSOrderedSame)
+                 {
+                     timeNextVisible = [headers objectForKey:name];
+                 }
+             }
+             
+             if(popReceipt)
+             {
+                 [queueMessage setPopReceipt:popReceipt timeNextVisible:timeNextVisible];
+             }
+         }
+         
+         if(block)
+         {
+             block(error);
+         }
+         else if(error && [(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+         {
+             [_delegate storageClient:self didFailRequest:request withError:error];
+         }
+         else if(!error && [(NSObject*)_delegate respondsToSelector:@selector(storageClient:didUpdateQueueMessage:queueName:)])
+         {
+             [_delegate storageClient:self didUpdateQueueMessage:queueMessage queueName:queueName];
+         }
+     }];
+}
+
 - (void)putMessageToQueue:(NSString *)message queueName:(NSString *)queueName
 {
     [self putMessageToQueue:message queueName:queueName withBlock:nil];
@@ -494,6 +809,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     NSData *contentData = [queueMsg dataUsingEncoding:NSUTF8StringEncoding];
     CloudURLRequest *request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"queue" httpMethod:@"POST" contentData:contentData contentType:@"text/xml", nil];
     
+    request.owner = self;
     [request fetchNoResponseWithBlock:^(NSError* error)
      {
          if(error)
@@ -521,6 +837,37 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     
 }
 
+- (void)putMessageData:(NSData *)data queueName:(NSString *)queueName withBlock:(void (^)(NSError *))block
+{
+    static const char messageStart[] = "<QueueMessage><MessageText>";
+    static const char messageEnd[] = "</MessageText></QueueMessage>";
+    
+    // the payload is encoded straight into the body, between the element tags
+    size_t encodedLength = Base64EncodedLength([data length]);
+    NSMutableData* contentData = [NSMutableData dataWithLength:sizeof(messageStart) - 1 + encodedLength + sizeof(messageEnd) - 1];
+    char* body = [contentData mutableBytes];
+    
+    memcpy(body, messageStart, sizeof(messageStart) - 1);
+    Base64Encode([data bytes], [data length], body + sizeof(messageStart) - 1);
+    memcpy(body + sizeof(messageStart) - 1 + encodedLength, messageEnd, sizeof(messageEnd) - 1);
+    
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/messages", [queueName URLEncode]];
+    CloudURLRequest *request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"queue" httpMethod:@"POST" contentData:contentData contentType:@"text/xml", nil];
+    
+    request.owner = self;
+    [request fetchNoResponseWithBlock:^(NSError* error)
+     {
+         if(block)
+         {
+             block(error);
+         }
+         else if(error && [(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+         {
+             [_delegate storageClient:self didFailRequest:request withError:error];
+         }
+     }];
+}
+
 #pragma mark -
 #pragma mark Blob API methods
 
@@ -535,6 +882,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     {
         CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:@"/SharedAccessSignatureService/container" forStorageType:@"blob", nil];
         
+        request.owner = self;
         [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
          {
              if(error)
@@ -564,10 +912,14 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     }
     else
     {
-        CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:@"?comp=list&include=metadata" forStorageType:@"blob",
-                                    @"x-ms-blob-type", @"BlockBlob", nil];
+        NSMutableArray* containers = [NSMutableArray arrayWithCapacity:30];
         
-        [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
+        [self getBlobContainers:[BlobListRequest listRequestForContainers] pageBlock:^BOOL(NSArray* page)
+         {
+             [containers addObjectsFromArray:page];
+             return YES;
+         }
+        withBlock:^(NSError* error)
          {
              if(error)
              {
@@ -577,13 +929,11 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
                  }
                  else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
                  {
-                     [_delegate storageClient:self didFailRequest:request withError:error];
+                     [_delegate storageClient:self didFailRequest:nil withError:error];
                  }
                  return;
              }
              
-             NSArray* containers = [ContainerParser loadContainers:doc];
-             
              if(block)
              {
                  block(containers, nil);
@@ -596,6 +946,15 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     }
 }
 
+- (void)getBlobContainers:(BlobListRequest *)listRequest pageBlock:(BOOL (^)(NSArray *))pageBlock withBlock:(void (^)(NSError *))block
+{
+    [self privateListPages:listRequest pageBlock:^BOOL(NSArray* items, NSArray* prefixes)
+     {
+         return pageBlock(items);
+     }
+    withBlock:block];
+}
+
 - (BOOL)addBlobContainer:(NSString *)containerName
 {
     return [self addBlobContainer:containerName withBlock:nil];
@@ -612,6 +971,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     NSString* endpoint = [NSString stringWithFormat:@"/%@?restype=container", [containerName URLEncode]];
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"PUT" contentData:[NSData data] contentType:nil, nil];
 
+	request.owner = self;
 	[request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
      {
          if(error)
@@ -656,6 +1016,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     NSString* endpoint = [NSString stringWithFormat:@"/%@?restype=container", [containerName URLEncode]];
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"DELETE" contentData:[NSData data] contentType:nil, nil];
     	
+	request.owner = self;
 	[request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
      {
          if(error)
@@ -692,69 +1053,183 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 - (void)getBlobs:(BlobContainer *)container withBlock:(void (^)(NSArray*, NSError*))block
 {
-    if(_credential.usesProxy)
+    if(!_credential.usesProxy)
+    {
+        [self privateGetBlobs:container withBlock:block];
+        return;
+    }
+    
+    [_credential sharedAccessSignatureForContainer:container.name withBlock:^(SharedAccessSignature* signature)
+     {
+         if(signature)
+         {
+             // with a signature the pages come straight from the storage service
+             [self privateGetBlobs:container withBlock:block];
+             return;
+         }
+         
+         CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:@"/SharedAccessSignatureService/blob" forStorageType:@"blob",
+                                     @"x-ms-blob-type", @"BlockBlob", nil];
+         
+         request.owner = self;
+         [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
+          {
+              if(error)
+              {
+                  if(block)
+                  {
+                      block(nil, error);
+                  }
+                  else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+                  {
+                      [_delegate storageClient:self didFailRequest:request withError:error];
+                  }
+                  return;
+              }
+              
+              NSArray* items = [BlobParser loadBlobsForProxy:doc container:container];
+              
+              if(block)
+              {
+                  block(items, nil);
+              }
+              else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didGetBlobs:inContainer:)])
+              {
+                  [_delegate storageClient:self didGetBlobs:items inContainer:container];
+              }
+          }];
+     }];
+}
+
+- (void)getBlobs:(BlobListRequest *)listRequest pageBlock:(BOOL (^)(NSArray *, NSArray *))pageBlock withBlock:(void (^)(NSError *))block
+{
+    [self privateListPages:listRequest pageBlock:pageBlock withBlock:block];
+}
+
+- (void)getBlobs:(BlobListRequest *)listRequest shardPrefixes:(NSArray *)shardPrefixes pageBlock:(BOOL (^)(NSArray *, NSArray *))pageBlock withBlock:(void (^)(NSError *))block
+{
+    if(shardPrefixes.count == 0)
     {
-        CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:@"/SharedAccessSignatureService/blob" forStorageType:@"blob",
-                                    @"x-ms-blob-type", @"BlockBlob", nil];
+        [self privateListPages:listRequest pageBlock:pageBlock withBlock:block];
+        return;
+    }
+    
+    __block NSUInteger remaining = shardPrefixes.count;
+    __block BOOL stopped = NO;
+    __block BOOL finished = NO;
+    
+    // every shard follows its own markers; pages from different shards interleave as they arrive
+    for(NSString* shard in shardPrefixes)
+    {
+        NSString* prefix = listRequest.prefix ? [listRequest.prefix stringByAppendingString:shard] : shard;
         
-        [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
+        [self privateListPages:[listRequest listRequestWithPrefix:prefix marker:nil] pageBlock:^BOOL(NSArray* items, NSArray* prefixes)
          {
-             if(error)
+             if(!stopped && !pageBlock(items, prefixes))
+             {
+                 stopped = YES;
+             }
+             return !stopped;
+         }
+        withBlock:^(NSError* error)
+         {
+             if(finished)
              {
-                 if(block)
-                 {
-                     block(nil, error);
-                 }
-                 else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
-                 {
-                     [_delegate storageClient:self didFailRequest:request withError:error];
-                 }
                  return;
              }
              
-             NSArray* items = [BlobParser loadBlobsForProxy:doc container:container];
+             if(error)
+             {
+                 // the other shards wind down at their next page
+                 finished = YES;
+                 stopped = YES;
+             }
+             else if(--remaining > 0)
+             {
+                 return;
+             }
              
+             finished = YES;
              if(block)
              {
-                 block(items, nil);
+                 block(error);
+             }
+             else if(error && [(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+             {
+                 [_delegate storageClient:self didFailRequest:nil withError:error];
              }
-             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didGetBlobs:inContainer:)])
+             else if(!error && [(NSObject*)_delegate respondsToSelector:@selector(storageClient:didListBlobsInContainer:)])
              {
-                 [_delegate storageClient:self didGetBlobs:items inContainer:container];
+                 [_delegate storageClient:self didListBlobsInContainer:listRequest.container];
              }
          }];
     }
-    else
+}
+
+- (void)getBlobListing:(BlobListRequest *)listRequest shardPrefixes:(NSArray *)shardPrefixes withBlock:(void (^)(BlobListing *, NSError *))block
+{
+    void (^fail)(NSError*) = ^(NSError* error)
+    {
+        if(block)
+        {
+            block(nil, error);
+        }
+        else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+        {
+            [_delegate storageClient:self didFailRequest:nil withError:error];
+        }
+    };
+    
+    if(_credential.usesProxy || !listRequest.container)
+    {
+        NSString* reason = _credential.usesProxy ? @"Compact listing is not supported through the proxy service" : @"Compact listing needs a blob container";
+        NSError* error = [NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:reason forKey:NSLocalizedDescriptionKey]];
+        dispatch_async(_deliveryQueue, ^
+        {
+            fail(error);
+        });
+        return;
+    }
+    
+    BlobListing* listing = [[[BlobListing alloc] initWithContainer:listRequest.container] autorelease];
+    NSArray* shards = shardPrefixes.count ? shardPrefixes : [NSArray arrayWithObject:@""];
+    __block NSUInteger remaining = shards.count;
+    __block BOOL finished = NO;
+    
+    // shards are parsed at the same time, so each fills a listing of its own; they are joined and put in order at the end
+    for(NSString* shard in shards)
     {
-        NSString* containerName = container.name;
-        NSString* endpoint = [NSString stringWithFormat:@"/%@?comp=list&restype=container", [containerName URLEncode]];
-        CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob",
-                                    @"x-ms-blob-type", @"BlockBlob", nil];
+        BlobListing* shardListing = (shards.count > 1) ? [[[BlobListing alloc] initWithContainer:listRequest.container] autorelease] : listing;
+
+        BlobListRequest* shardRequest = listRequest;
+        if(shard.length)
+        {
+            shardRequest = [listRequest listRequestWithPrefix:(listRequest.prefix ? [listRequest.prefix stringByAppendingString:shard] : shard) marker:nil];
+        }
         
-        [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
+        [self privateGetListing:shardRequest listing:shardListing withBlock:^(NSError* error)
          {
-             if(error)
+             if(shardListing != listing && !error)
              {
-                 if(block)
-                 {
-                     block(nil, error);
-                 }
-                 else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
-                 {
-                     [_delegate storageClient:self didFailRequest:request withError:error];
-                 }
-                 return;
+                 [listing addEntriesFromListing:shardListing];
              }
              
-             NSArray* items = [BlobParser loadBlobs:doc container:container];
+             if(finished || (!error && --remaining > 0))
+             {
+                 return;
+             }
              
-             if(block)
+             finished = YES;
+             if(error)
              {
-                 block(items, nil);
+                 fail(error);
+                 return;
              }
-             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didGetBlobs:inContainer:)])
+             
+             [listing sort];
+             if(block)
              {
-                 [_delegate storageClient:self didGetBlobs:items inContainer:container];
+                 block(listing, nil);
              }
          }];
     }
@@ -765,24 +1240,147 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     [self getBlobData:blob withBlock:nil];
 }
 
-- (void)getBlobData:(Blob *)blob withBlock:(void (^)(NSData*, NSError*))block
+- (CloudRequestHandle *)getBlobData:(Blob *)blob withBlock:(void (^)(NSData*, NSError*))block
 {
-    //CloudURLRequest* request = [_credential authenticatedBlobRequestWithURL:blob.URL forStorageType:@"blob", nil];
+    CloudRequestHandle* handle = [self privateHandle];
     
-    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", blob.container.name, blob.name];
-    CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob", nil];
+    [self privateRead:handle hedged:YES attempt:^(CloudRequestHandle* attemptHandle, void (^done)(BOOL, dispatch_block_t))
+     {
+         [_credential sharedAccessSignatureForContainer:blob.container.name withBlock:^(SharedAccessSignature* signature)
+          {
+              [self privateGetBlobData:blob signature:signature handle:attemptHandle withBlock:^(NSData* data, NSError* error)
+               {
+                   done(!error, ^
+                   {
+                       if(error)
+                       {
+                           if(block)
+                           {
+                               block(nil, error);
+                           }
+                           else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+                           {
+                               [_delegate storageClient:self didFailRequest:nil withError:error];
+                           }
+                           return;
+                       }
+                       
+                       if(block)
+                       {
+                           block(data, nil);
+                       }
+                       else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didGetBlobData:blob:)])
+                       {
+                           [_delegate storageClient:self didGetBlobData:data blob:blob];
+                       }
+                   });
+               }];
+          }];
+     }];
     
-    [request fetchDataWithBlock:^(NSData* data, NSError* error)
+    return handle;
+}
+
+- (CloudRequestHandle *)getBlobData:(Blob *)blob chunkBlock:(BOOL (^)(NSData *))chunkBlock withBlock:(void (^)(NSError *))block
+{
+    CloudRequestHandle* handle = [self privateHandle];
+    
+    [self privateGetBlobData:blob chunkBlock:chunkBlock finally:nil handle:handle withBlock:block];
+    
+    return handle;
+}
+
+- (void)getBlobData:(Blob *)blob toOutputStream:(NSOutputStream *)stream withBlock:(void (^)(NSError *))block
+{
+    if([stream streamStatus] == NSStreamStatusNotOpen)
+    {
+        [stream open];
+    }
+    
+    [self privateGetBlobData:blob chunkBlock:^BOOL(NSData* chunk)
      {
-         if(error)
+         const uint8_t* bytes = [chunk bytes];
+         NSUInteger remaining = [chunk length];
+         
+         while(remaining > 0)
          {
-             if(block)
+             NSInteger written = [stream write:bytes maxLength:remaining];
+             if(written <= 0)
              {
-                 block(nil, error);
+                 return NO;
              }
-             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
-             {
-                 [_delegate storageClient:self didFailRequest:request withError:error];
+             bytes += written;
+             remaining -= written;
+         }
+         
+         return YES;
+     }
+                     finally:^NSError*(NSError* error)
+     {
+         NSError* streamError = [[[stream streamError] retain] autorelease];
+         [stream close];
+         
+         return (error && streamError) ? streamError : error;
+     }
+                      handle:nil
+                   withBlock:block];
+}
+
+- (void)getBlobData:(Blob *)blob toFileDescriptor:(int)fd withBlock:(void (^)(NSError *))block
+{
+    __block int writeError = 0;
+    
+    [self privateGetBlobData:blob chunkBlock:^BOOL(NSData* chunk)
+     {
+         const uint8_t* bytes = [chunk bytes];
+         NSUInteger remaining = [chunk length];
+         
+         while(remaining > 0)
+         {
+             ssize_t written = write(fd, bytes, remaining);
+             if(written < 0)
+             {
+                 if(errno == EINTR)
+                 {
+                     continue;
+                 }
+                 writeError = errno;
+                 return NO;
+             }
+             bytes += written;
+             remaining -= written;
+         }
+         
+         return YES;
+     }
+                     finally:^NSError*(NSError* error)
+     {
+         return writeError ? [NSError errorWithDomain:NSPOSIXErrorDomain code:writeError userInfo:nil] : error;
+     }
+                      handle:nil
+                   withBlock:block];
+}
+
+- (void)getBlobDataInParallel:(Blob *)blob withBlock:(void (^)(NSData *, NSError *))block
+{
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [blob.container.name URLEncode], [blob.name URLEncode]];
+    BlobRangeDownloader* downloader = [[BlobRangeDownloader alloc] initWithCredential:_credential 
+                                                                             endpoint:endpoint 
+                                                                          segmentSize:_downloadSegmentSize 
+                                                                          parallelism:_downloadParallelism 
+                                                                           maxRetries:SEGMENT_RETRY_COUNT];
+    
+    [self privateDownloadBlob:downloader container:blob.container finally:nil withBlock:^(NSData* data, NSError* error)
+     {
+         if(error)
+         {
+             if(block)
+             {
+                 block(nil, error);
+             }
+             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+             {
+                 [_delegate storageClient:self didFailRequest:nil withError:error];
              }
              return;
          }
@@ -796,33 +1394,35 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
              [_delegate storageClient:self didGetBlobData:data blob:blob];
          }
      }];
+    [downloader release];
 }
 
-- (void)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString*)contentType
-{
-    [self addBlobToContainer:container blobName:blobName contentData:contentData contentType:contentType withBlock:nil];
-}
-
-- (void)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString*)contentType withBlock:(void (^)(NSError*))block
+- (void)getBlobData:(Blob *)blob toFile:(NSString *)path withBlock:(void (^)(NSError *))block
 {
-    CloudURLRequest* request;
-
-    if(_credential.usesProxy)
+    int fd = open([path fileSystemRepresentation], O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0)
     {
-        //NSURL* serviceURL = [[NSURL URLWithString:[@"./%@" stringByAppendingString:blobName] relativeToURL:container.URL] absoluteURL];
-        //NSString * tempString = [NSString stringWithFormat:@"%@/%@", container.name, blobName];
-        //NSURL* serviceURL = [[NSURL URLWithString:tempString relativeToURL:container.URL] absoluteURL];
-        request = [_credential authenticatedRequestWithEndpoint:@"/SharedAccessSignatureService/blob" forStorageType:@"blob" httpMethod:@"PUT" contentData:contentData contentType:contentType, @"x-ms-blob-type", @"BlockBlob", nil];
-        //request = [_credential authenticatedBlobRequestWithURL:serviceURL forStorageType:@"blob" httpMethod:@"PUT" contentData:contentData contentType:contentType, @"x-ms-blob-type", @"BlockBlob", nil];
-    }
-    else
-    {
-        NSString* containerName = [container.name lowercaseString];
-        NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [containerName URLEncode], [blobName URLEncode]];
-        request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"PUT" contentData:contentData contentType:contentType, @"x-ms-blob-type", @"BlockBlob", nil];
+        NSError* error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        if(block)
+        {
+            block(error);
+        }
+        else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+        {
+            [_delegate storageClient:self didFailRequest:nil withError:error];
+        }
+        return;
     }
     
-    [request fetchNoResponseWithBlock:^(NSError* error)
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [blob.container.name URLEncode], [blob.name URLEncode]];
+    BlobRangeDownloader* downloader = [[BlobRangeDownloader alloc] initWithCredential:_credential 
+                                                                             endpoint:endpoint 
+                                                                          segmentSize:_downloadSegmentSize 
+                                                                          parallelism:_downloadParallelism 
+                                                                           maxRetries:SEGMENT_RETRY_COUNT 
+                                                                       fileDescriptor:fd];
+    
+    [self privateDownloadBlob:downloader container:blob.container finally:^{ close(fd); } withBlock:^(NSData* data, NSError* error)
      {
          if(error)
          {
@@ -832,7 +1432,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
              }
              else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
              {
-                 [_delegate storageClient:self didFailRequest:request withError:error];
+                 [_delegate storageClient:self didFailRequest:nil withError:error];
              }
              return;
          }
@@ -841,11 +1441,95 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
          {
              block(nil);
          }
-         else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didAddBlobToContainer:blobName:)])
+         else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didStreamBlobData:)])
          {
-             [_delegate storageClient:self didAddBlobToContainer:container blobName:blobName];
+             [_delegate storageClient:self didStreamBlobData:blob];
          }
      }];
+    [downloader release];
+}
+
+- (void)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString*)contentType
+{
+    [self addBlobToContainer:container blobName:blobName contentData:contentData contentType:contentType withBlock:nil];
+}
+
+- (CloudRequestHandle *)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString*)contentType withBlock:(void (^)(NSError*))block
+{
+    CloudRequestHandle* handle = [self privateHandle];
+    
+    [_credential sharedAccessSignatureForContainer:container.name withBlock:^(SharedAccessSignature* signature)
+     {
+         [self privateAddBlobToContainer:container blobName:blobName contentData:contentData contentType:contentType signature:signature handle:handle withBlock:block];
+     }];
+    
+    return handle;
+}
+
+- (BOOL)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentsOfFile:(NSString *)path contentType:(NSString*)contentType withBlock:(void (^)(NSError *))block
+{
+    int fd = open([path fileSystemRepresentation], O_RDONLY);
+    if(fd < 0)
+    {
+        NSError* error = [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        if(block)
+        {
+            block(error);
+        }
+        else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+        {
+            [_delegate storageClient:self didFailRequest:nil withError:error];
+        }
+        return YES;
+    }
+    
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [[container.name lowercaseString] URLEncode], [blobName URLEncode]];
+    BlobBlockUploader* uploader = [[BlobBlockUploader alloc] initWithCredential:_credential 
+                                                                       endpoint:endpoint 
+                                                                    contentType:contentType 
+                                                                      blockSize:_uploadBlockSize 
+                                                                    parallelism:_uploadParallelism 
+                                                                     maxRetries:SEGMENT_RETRY_COUNT 
+                                                                 fileDescriptor:fd];
+    
+    [self privateUploadBlob:uploader container:container blobName:blobName finally:^{ close(fd); } withBlock:block];
+    [uploader release];
+    
+    return YES;
+}
+
+- (BOOL)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName fileDescriptor:(int)fd contentType:(NSString*)contentType withBlock:(void (^)(NSError *))block
+{
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [[container.name lowercaseString] URLEncode], [blobName URLEncode]];
+    BlobBlockUploader* uploader = [[BlobBlockUploader alloc] initWithCredential:_credential 
+                                                                       endpoint:endpoint 
+                                                                    contentType:contentType 
+                                                                      blockSize:_uploadBlockSize 
+                                                                    parallelism:_uploadParallelism 
+                                                                     maxRetries:SEGMENT_RETRY_COUNT 
+                                                                 fileDescriptor:fd];
+    
+    [self privateUploadBlob:uploader container:container blobName:blobName finally:nil withBlock:block];
+    [uploader release];
+    
+    return YES;
+}
+
+- (BOOL)addBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentStream:(NSInputStream *)stream contentType:(NSString*)contentType withBlock:(void (^)(NSError *))block
+{
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [[container.name lowercaseString] URLEncode], [blobName URLEncode]];
+    BlobBlockUploader* uploader = [[BlobBlockUploader alloc] initWithCredential:_credential 
+                                                                       endpoint:endpoint 
+                                                                    contentType:contentType 
+                                                                      blockSize:_uploadBlockSize 
+                                                                    parallelism:_uploadParallelism 
+                                                                     maxRetries:SEGMENT_RETRY_COUNT 
+                                                                         stream:stream];
+    
+    [self privateUploadBlob:uploader container:container blobName:blobName finally:^{ [stream close]; } withBlock:block];
+    [uploader release];
+    
+    return YES;
 }
 
 - (void)deleteBlob:(Blob *)blob 
@@ -853,50 +1537,85 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     [self deleteBlob:blob withBlock:nil];
 }
 
-- (void)deleteBlob:(Blob *)blob withBlock:(void (^)(NSError*))block
+- (CloudRequestHandle *)deleteBlob:(Blob *)blob withBlock:(void (^)(NSError*))block
 {
-    //CloudURLRequest* request = [_credential authenticatedBlobRequestWithURL:blob.URL forStorageType:@"blob" httpMethod:@"DELETE", nil];
-    CloudURLRequest* request;
-    if (_credential.usesProxy) {
-        //NSURL* serviceURL = [[NSURL URLWithString:[@"./%@" stringByAppendingString:blob.name] relativeToURL:blob.container.URL] absoluteURL];
-        //NSString * tempString = [NSString stringWithFormat:@"%@/%@", blob.container.name, blob.name];
-        //NSURL* serviceURL = [[NSURL URLWithString:tempString relativeToURL:blob.container.URL] absoluteURL];
-        
-        //request = [_credential authenticatedBlobRequestWithURL:serviceURL forStorageType:@"blob" httpMethod:@"DELETE" contentData:[NSData data] contentType:nil, nil];
-        request = [_credential authenticatedRequestWithEndpoint:@"/SharedAccessSignatureService/blob" forStorageType:@"blob" httpMethod:@"DELETE" contentData:[NSData data] contentType:nil, nil];
-    }
-    else {
-        NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [blob.container.name URLEncode], [blob.name URLEncode]];
-        request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"DELETE" contentData:[NSData data] contentType:nil, nil];
-        
-    }
-//  NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", blob.container, blob.name];
-//  CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"DELETE", nil];
+    CloudRequestHandle* handle = [self privateHandle];
     
-    [request fetchNoResponseWithBlock:^(NSError* error)
+    [_credential sharedAccessSignatureForContainer:blob.container.name withBlock:^(SharedAccessSignature* signature)
      {
-         if(error)
+         [self privateDeleteBlob:blob signature:signature handle:handle withBlock:block];
+     }];
+    
+    return handle;
+}
+
+- (CloudRequestHandle *)copyBlob:(Blob *)blob toContainer:(BlobContainer *)container blobName:(NSString *)blobName withBlock:(void (^)(NSError *))block
+{
+    CloudRequestHandle* handle = [self privateHandle];
+    NSString* source = [NSString stringWithFormat:@"/%@/%@", [[blob.container.name lowercaseString] URLEncode], [blob.name URLEncode]];
+    
+    [_credential sharedAccessSignatureForContainer:blob.container.name withBlock:^(SharedAccessSignature* sourceSignature)
+     {
+         if(_credential.usesProxy && !sourceSignature)
          {
+             // the only other URL for the source is the proxy's, which the service can't read from
+             NSError* error = [NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:@"The proxy service did not grant access to the container" forKey:NSLocalizedDescriptionKey]];
              if(block)
              {
                  block(error);
              }
              else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
              {
-                 [_delegate storageClient:self didFailRequest:request withError:error];
+                 [_delegate storageClient:self didFailRequest:nil withError:error];
              }
              return;
          }
          
-         if(block)
-         {
-             block(nil);
-         }
-         else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didDeleteBlob:)])
-         {
-             [_delegate storageClient:self didDeleteBlob:blob];
-         }
+         // the service fetches the source itself, so it has to carry its own authorization when it is private
+         NSURL* sourceURL = sourceSignature ? [sourceSignature URLForEndpoint:source] : [_credential URLforEndpoint:source forStorageType:@"blob"];
+         // a source given as a URL needs a newer protocol version than the default
+         NSDictionary* headers = [NSDictionary dictionaryWithObjectsAndKeys:
+                                  [sourceURL absoluteString], @"x-ms-copy-source",
+                                  @"2012-02-12", @"x-ms-version", nil];
+         
+         [_credential sharedAccessSignatureForContainer:container.name withBlock:^(SharedAccessSignature* signature)
+          {
+              [self privatePutBlob:blobName container:container.name query:nil headers:headers signature:signature handle:handle withBlock:block];
+          }];
+     }];
+    
+    return handle;
+}
+
+- (CloudRequestHandle *)setBlobMetadata:(Blob *)blob metadata:(NSDictionary *)metadata withBlock:(void (^)(NSError *))block
+{
+    CloudRequestHandle* handle = [self privateHandle];
+    NSMutableDictionary* headers = [NSMutableDictionary dictionaryWithCapacity:metadata.count];
+    
+    for(NSString* name in metadata)
+    {
+        [headers setObject:[metadata objectForKey:name] forKey:[@"x-ms-meta-" stringByAppendingString:name]];
+    }
+    
+    [_credential sharedAccessSignatureForContainer:blob.container.name withBlock:^(SharedAccessSignature* signature)
+     {
+         [self privatePutBlob:blob.name container:blob.container.name query:@"comp=metadata" headers:headers signature:signature handle:handle withBlock:block];
+     }];
+    
+    return handle;
+}
+
+- (CloudRequestHandle *)setBlobProperties:(Blob *)blob properties:(NSDictionary *)properties withBlock:(void (^)(NSError *))block
+{
+    CloudRequestHandle* handle = [self privateHandle];
+    NSDictionary* headers = [[properties copy] autorelease];
+    
+    [_credential sharedAccessSignatureForContainer:blob.container.name withBlock:^(SharedAccessSignature* signature)
+     {
+         [self privatePutBlob:blob.name container:blob.container.name query:@"comp=properties" headers:headers signature:signature handle:handle withBlock:block];
      }];
+    
+    return handle;
 }
 
 #pragma mark -
@@ -912,6 +1631,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:@"Tables" forStorageType:@"table" httpMethod:@"GET", nil];
     [self prepareTableRequest:request];
     
+    request.owner = self;
     [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
      {
          if(error)
@@ -974,6 +1694,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
                                                                  contentType:@"application/atom+xml", nil];    
     [self prepareTableRequest:request];
 
+    request.owner = self;
     [request fetchNoResponseWithBlock:^(NSError* error)
      {
          if(error)
@@ -1010,6 +1731,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:[@"Tables" stringByAppendingFormat:@"(\'%@\')", tableName] forStorageType:@"table" httpMethod:@"DELETE", nil];
 	[self prepareTableRequest:request];
 	
+    request.owner = self;
     [request fetchNoResponseWithBlock:^(NSError* error)
      {
          if (error)
@@ -1041,14 +1763,17 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     [self getEntities:fetchRequest withBlock:nil];
 }
 
-- (void)getEntities:(TableFetchRequest*)fetchRequest withBlock:(void (^)(NSArray*, NSError *))block
+- (CloudRequestHandle *)getEntities:(TableFetchRequest*)fetchRequest withBlock:(void (^)(NSArray*, NSError *))block
 {
-	NSString* endpoint = [fetchRequest endpoint];
-    CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"table" httpMethod:@"GET", nil];
-	
-    [self prepareTableRequest:request];
+    // a query with $top asks for that many rows in all; otherwise every page is wanted
+    NSMutableArray* entities = [NSMutableArray arrayWithCapacity:(fetchRequest.topRows > 0) ? fetchRequest.topRows : 50];
     
-	[request fetchXMLWithBlock:^(xmlDocPtr doc, NSError *error)
+    return [self getEntities:fetchRequest pageBlock:^BOOL(NSArray* page)
+     {
+         [entities addObjectsFromArray:page];
+         return (fetchRequest.topRows <= 0 || (NSInteger)entities.count < fetchRequest.topRows);
+     }
+    withBlock:^(NSError* error)
      {
          if (error)
          {
@@ -1058,26 +1783,15 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
              }
              else if ([(id)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
              {
-                 [_delegate storageClient:self didFailRequest:request withError:error];
+                 [_delegate storageClient:self didFailRequest:nil withError:error];
              }
              return;
          }
          
-         // NSArray *entities = [self parseEntities:doc];
-         NSMutableArray* entities = [NSMutableArray arrayWithCapacity:50];
-         [XmlHelper parseAtomPub:doc block:^(AtomPubEntry* entry) 
-          {
-              NSMutableDictionary* dict = [NSMutableDictionary dictionaryWithCapacity:10];
-              
-              [entry processContentPropertiesWithBlock:^(NSString * name, NSString * value) 
-              {
-                  [dict setObject:value forKey:name];
-              }];
-              
-              TableEntity* entity = [[TableEntity alloc] initWithDictionary:dict fromTable:fetchRequest.tableName];
-              [entities addObject:entity];
-              [entity release];
-          }];
+         if (fetchRequest.topRows > 0 && (NSInteger)entities.count > fetchRequest.topRows)
+         {
+             [entities removeObjectsInRange:NSMakeRange(fetchRequest.topRows, entities.count - fetchRequest.topRows)];
+         }
          
          if (block)
          {
@@ -1090,6 +1804,146 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
      }];
 }
 
+- (void)getEntityResults:(TableFetchRequest*)fetchRequest withBlock:(void (^)(TableResultSet *, NSError *))block
+{
+    NSArray* queries = fetchRequest.queries ? fetchRequest.queries : [NSArray arrayWithObject:fetchRequest];
+    
+    void (^fail)(NSError*) = ^(NSError* error)
+    {
+        if (block)
+        {
+            block (nil, error);
+        }
+        else if ([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+        {
+            [_delegate storageClient:self didFailRequest:nil withError:error];
+        }
+    };
+    
+    for (TableFetchRequest* query in queries)
+    {
+        if (query.residualPredicate || [fetchRequest queriesOverlap])
+        {
+            // rows can't be taken back out of the columns once they are parsed in
+            NSError* error = [NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:@"The predicate needs conditions checked on each entity; use getEntities:withBlock:" forKey:NSLocalizedDescriptionKey]];
+            dispatch_async(_deliveryQueue, ^
+            {
+                fail(error);
+            });
+            return;
+        }
+    }
+    
+    TableResultSet* results = [[[TableResultSet alloc] initWithTableName:fetchRequest.tableName] autorelease];
+    __block NSUInteger queryIndex = 0;
+    __block void (^fetchPage)(TableFetchRequest*) = nil;
+    
+    // every page of every query is parsed into the same columns, one page at a time
+    fetchPage = [^(TableFetchRequest* pageRequest)
+    {
+        [self privateGetEntityResultsPage:pageRequest results:results withBlock:^(TableFetchRequest* nextRequest, NSError* error)
+         {
+             if (error)
+             {
+                 [fetchPage release];
+                 fail(error);
+                 return;
+             }
+             
+             BOOL enough = (fetchRequest.topRows > 0 && (NSInteger)results.count >= fetchRequest.topRows);
+             if (!nextRequest && ++queryIndex < [queries count])
+             {
+                 nextRequest = [queries objectAtIndex:queryIndex];
+             }
+             
+             if (nextRequest && !enough)
+             {
+                 fetchPage(nextRequest);
+                 return;
+             }
+             
+             [fetchPage release];
+             
+             if (enough)
+             {
+                 [results truncateToCount:fetchRequest.topRows];
+             }
+             if (block)
+             {
+                 block (results, nil);
+             }
+         }];
+    } copy];
+    
+    fetchPage([queries objectAtIndex:0]);
+}
+
+- (CloudRequestHandle *)getEntities:(TableFetchRequest*)fetchRequest pageBlock:(BOOL (^)(NSArray *))pageBlock withBlock:(void (^)(NSError *))block
+{
+    CloudRequestHandle* handle = [self privateHandle];
+    NSArray* queries = fetchRequest.queries ? fetchRequest.queries : [NSArray arrayWithObject:fetchRequest];
+    NSMutableSet* seen = [fetchRequest queriesOverlap] ? [NSMutableSet setWithCapacity:50] : nil;
+    __block NSUInteger running = [queries count];
+    __block BOOL finished = NO;
+    
+    void (^finish)(NSError*) = ^(NSError* error)
+    {
+        finished = YES;
+        
+        if (error)
+        {
+            if (block)
+            {
+                block (error);
+            }
+            else if ([(id)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+            {
+                [_delegate storageClient:self didFailRequest:nil withError:error];
+            }
+            return;
+        }
+        
+        if (block)
+        {
+            block (nil);
+        }
+        else if ([(id)_delegate respondsToSelector:@selector(storageClient:didGetAllEntityPagesFromTableNamed:)])
+        {
+            [_delegate storageClient:self didGetAllEntityPagesFromTableNamed:fetchRequest.tableName];
+        }
+    };
+    
+    // the queries of a split request all start at once; pages are handed on from whichever answers first
+    for (TableFetchRequest* query in queries)
+    {
+        [self privateGetEntityPages:query handle:handle pageBlock:^BOOL(NSArray* entities)
+         {
+             if (finished)
+             {
+                 return NO;
+             }
+             
+             NSArray* page = [self privateEntities:entities matching:query.residualPredicate unseen:seen];
+             if ([page count] > 0 && !pageBlock(page))
+             {
+                 finish (nil);
+                 return NO;
+             }
+             return YES;
+         }
+        withBlock:^(NSError* error)
+         {
+             running--;
+             if (!finished && (error || running == 0))
+             {
+                 finish (error);
+             }
+         }];
+    }
+    
+    return handle;
+}
+
 - (BOOL)insertEntity:(TableEntity *)newEntity
 {
     return [self insertEntity:newEntity withBlock:nil];
@@ -1097,10 +1951,10 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 - (BOOL)insertEntity:(TableEntity *)newEntity withBlock:(void (^)(NSError *))block
 {
-    NSString	*requestDataString = nil;
-	NSString	*properties = [newEntity propertyString];
+    NSString* contentType = nil;
+    NSData* contentData = [self privateBodyForEntity:newEntity template:TABLE_INSERT_ENTITY_REQUEST_STRING entityID:nil contentType:&contentType];
     
-    if(!properties)
+    if(!contentData)
     {
 		if (block)
 		{
@@ -1113,21 +1967,19 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
         return NO;
     }
     
-	// Construct the date in the right format
-	NSDate *date = [NSDate date];
-	NSDateFormatter *dateFormatter = [[[NSDateFormatter alloc]init] autorelease];
-	[dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ssZ"];
-	NSString *dateString = [NSString stringWithFormat:@"%@",[dateFormatter stringFromDate:date]];
-	
-	requestDataString = [[TABLE_INSERT_ENTITY_REQUEST_STRING stringByReplacingOccurrencesOfString:@"$UPDATEDDATE$" withString:dateString] stringByReplacingOccurrencesOfString:@"$PROPERTIES$" withString:properties];
-	
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:newEntity.tableName 
                                                               forStorageType:@"table" 
                                                                   httpMethod:@"POST" 
-                                                                 contentData:[requestDataString dataUsingEncoding:NSASCIIStringEncoding] 
-                                                                 contentType:@"application/atom+xml", nil];
-    [self prepareTableRequest:request];
+                                                                 contentData:contentData 
+                                                                 contentType:contentType, nil];
+    [self prepareTableRequest:request format:_tableFormat];
+    if(_tableFormat == CloudTableFormatJSON)
+    {
+        // nothing reads the entity echoed back, so don't have it sent
+        [request setValue:@"return-no-content" forHTTPHeaderField:@"Prefer"];
+    }
     
+    request.owner = self;
     [request fetchNoResponseWithBlock:^(NSError* error)
      {
          if (error)
@@ -1163,9 +2015,12 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 - (BOOL)updateEntity:(TableEntity *)existingEntity withBlock:(void (^)(NSError *))block
 {
-	NSString* properties = [existingEntity propertyString];
+	NSString* endpoint = [existingEntity endpoint];
+    NSURL* serviceURL = endpoint ? [_credential URLforEndpoint:endpoint forStorageType:@"table"] : nil;
+    NSString* contentType = nil;
+    NSData* contentData = [self privateBodyForEntity:existingEntity template:TABLE_UPDATE_ENTITY_REQUEST_STRING entityID:[serviceURL absoluteString] contentType:&contentType];
     
-    if(!properties)
+    if(!contentData)
     {
 		if (block)
 		{
@@ -1177,28 +2032,16 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 		}
 		return NO;
     }
-
-    NSString* requestDataString = nil;
-	NSString* endpoint = [existingEntity endpoint];
-	
-    // Construct the date in the right format
-	NSDate *date = [NSDate date];
-	NSDateFormatter *dateFormatter = [[[NSDateFormatter alloc]init] autorelease];
-	[dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ssZ"];
-	NSString *dateString = [NSString stringWithFormat:@"%@",[dateFormatter stringFromDate:date]];
-    
-    NSURL* serviceURL = [_credential URLforEndpoint:endpoint forStorageType:@"table"];
-    
-	requestDataString = [[[TABLE_UPDATE_ENTITY_REQUEST_STRING stringByReplacingOccurrencesOfString:@"$UPDATEDDATE$" withString:dateString] stringByReplacingOccurrencesOfString:@"$PROPERTIES$" withString:properties] stringByReplacingOccurrencesOfString:@"$ENTITYID$" withString:[serviceURL absoluteString]];
 	
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint 
                                                               forStorageType:@"table" 
                                                                   httpMethod:@"PUT"
-                                                                 contentData:[requestDataString dataUsingEncoding:NSASCIIStringEncoding]
-                                                                 contentType:@"application/atom+xml", nil];
-    [self prepareTableRequest:request];
+                                                                 contentData:contentData
+                                                                 contentType:contentType, nil];
+    [self prepareTableRequest:request format:_tableFormat];
 	[request setValue:@"*" forHTTPHeaderField:@"If-Match"];
 	
+    request.owner = self;
     [request fetchNoResponseWithBlock:^(NSError* error)
      {
          if (error)
@@ -1234,9 +2077,12 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 - (BOOL)mergeEntity:(TableEntity *)existingEntity withBlock:(void (^)(NSError *))block
 {
-	NSString* properties = [existingEntity propertyString];
+	NSString* endpoint = [existingEntity endpoint];
+    NSURL* serviceURL = endpoint ? [_credential URLforEndpoint:endpoint forStorageType:@"table"] : nil;
+    NSString* contentType = nil;
+    NSData* contentData = [self privateBodyForEntity:existingEntity template:TABLE_UPDATE_ENTITY_REQUEST_STRING entityID:[serviceURL path] contentType:&contentType];
     
-    if(!properties)
+    if(!contentData)
     {
 		if (block)
 		{
@@ -1249,26 +2095,15 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 		return NO;
     }
     
-    NSString* requestDataString = nil;
-	NSString* endpoint = [existingEntity endpoint];
-
-	// Construct the date in the right format
-	NSDate *date = [NSDate date];
-	NSDateFormatter *dateFormatter = [[[NSDateFormatter alloc] init] autorelease];
-	[dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ssZ"];
-	NSString *dateString = [NSString stringWithFormat:@"%@",[dateFormatter stringFromDate:date]];
-	
-    NSURL* serviceURL = [_credential URLforEndpoint:endpoint forStorageType:@"table"];
-	requestDataString = [[[TABLE_UPDATE_ENTITY_REQUEST_STRING stringByReplacingOccurrencesOfString:@"$UPDATEDDATE$" withString:dateString] stringByReplacingOccurrencesOfString:@"$PROPERTIES$" withString:properties] stringByReplacingOccurrencesOfString:@"$ENTITYID$" withString:[serviceURL path]];
-    
     CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint 
                                                               forStorageType:@"table" 
                                                                   httpMethod:@"MERGE"
-                                                                 contentData:[requestDataString dataUsingEncoding:NSASCIIStringEncoding]
-                                                                 contentType:@"application/atom+xml", nil];
-    [self prepareTableRequest:request];
+                                                                 contentData:contentData
+                                                                 contentType:contentType, nil];
+    [self prepareTableRequest:request format:_tableFormat];
 	[request setValue:@"*" forHTTPHeaderField:@"If-Match"];
 	
+    request.owner = self;
     [request fetchNoResponseWithBlock:^(NSError* error)
      {
          if (error)
@@ -1326,6 +2161,7 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
 
 	[request setValue:@"*" forHTTPHeaderField:@"If-Match"];
 	
+    request.owner = self;
     [request fetchNoResponseWithBlock:^(NSError* error)
      {
          if (error)
@@ -1354,48 +2190,995 @@ static NSString *TABLE_UPDATE_ENTITY_REQUEST_STRING = @"<?xml version=\"1.0\" en
     return YES;
 }
 
-#pragma mark -
-#pragma mark Private methods
+- (BOOL)executeBatch:(TableBatch *)batch
+{
+    return [self executeBatch:batch withBlock:nil];
+}
 
-- (void)privateGetQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount useBlockError:(BOOL)useBlockError peekOnly:(BOOL)peekOnly withBlock:(void (^)(NSArray *, NSError *))block
+- (BOOL)executeBatch:(TableBatch *)batch withBlock:(void (^)(NSArray *, NSError *))block
 {
-	queueName = [queueName lowercaseString];
-    NSString* endpoint = [NSString stringWithFormat:@"/%@/messages?numofmessages=%d", [queueName URLEncode], fetchCount];
-	if(peekOnly)
-	{
-		endpoint = [endpoint stringByAppendingString:@"&peekonly=true"];
-	}
-	else
-	{
-		// allow 60 seconds to turn around and delete the message
-		endpoint = [endpoint stringByAppendingString:@"&visibilitytimeout=60"];
-	}
-	
-    CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"queue", nil];
-    [request fetchXMLWithBlock:^(xmlDocPtr doc, NSError* error)
-     {
-         if(error)
-         {
-             if(useBlockError)
-             {
-                 block(nil, error);
-             }
-             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
-             {
-                 [_delegate storageClient:self didFailRequest:request withError:error];
-             }
-             return;
-         }
-         
-         NSArray* queueMessages = [QueueMessageParser loadQueueMessages:doc];
-		 block(queueMessages, nil);
-     }];
+    CFUUIDRef uuid = CFUUIDCreate(kCFAllocatorDefault);
+    NSString* boundaryId = [(NSString*)CFUUIDCreateString(kCFAllocatorDefault, uuid) autorelease];
+    CFRelease(uuid);
+    
+    NSString* batchBoundary = [@"batch_" stringByAppendingString:boundaryId];
+    NSString* changesetBoundary = [@"changeset_" stringByAppendingString:boundaryId];
+    NSData* body = nil;
+    NSString* reason = nil;
+    
+    if(_credential.usesProxy)
+    {
+        reason = @"Batch operations are not supported through the proxy service";
+    }
+    else if(batch.count == 0)
+    {
+        reason = @"The batch has no operations";
+    }
+    else if(!(body = [self privateBodyForBatch:batch batchBoundary:batchBoundary changesetBoundary:changesetBoundary]))
+    {
+        reason = @"Required properties not found in a batch entity";
+    }
+    
+    if(reason)
+    {
+		if (block)
+		{
+			block (nil, [NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:reason forKey:NSLocalizedDescriptionKey]]);
+		}
+		else if ([(id)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+		{
+			[_delegate storageClient:self didFailRequest:nil withError:[NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:reason forKey:NSLocalizedDescriptionKey]]];
+		}
+        return NO;
+    }
+    
+    CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:@"$batch" 
+                                                              forStorageType:@"table" 
+                                                                  httpMethod:@"POST" 
+                                                                 contentData:body 
+                                                                 contentType:[@"multipart/mixed; boundary=" stringByAppendingString:batchBoundary], nil];
+    [self prepareTableRequest:request];
+    [request setValue:@"1.0;NetFx" forHTTPHeaderField:@"DataServiceVersion"];
+    
+    __block CloudURLRequest* batchRequest = request;
+    request.owner = self;
+    [request fetchDataWithBlock:^(NSData* data, NSError* error)
+     {
+         NSArray* results = nil;
+         NSHTTPURLResponse* response = batchRequest.response;
+         
+         if (!error && [response statusCode] >= 300)
+         {
+             error = [TableBatchParser errorForStatus:[response statusCode] data:data];
+         }
+         else if (!error)
+         {
+             results = [TableBatchParser loadResults:data contentType:[[response allHeaderFields] objectForKey:@"Content-Type"] count:batch.count];
+             if (!results)
+             {
+                 error = [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" code:-1 userInfo:[NSDictionary dictionaryWithObject:@"Unable to read the batch response" forKey:NSLocalizedDescriptionKey]];
+             }
+         }
+         
+         if (!results)
+         {
+             if (block)
+             {
+                 block (nil, error);
+             }
+             else if ([(id)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+             {
+                 [_delegate storageClient:self didFailRequest:request withError:error];
+             }
+             return;
+         }
+         
+         if (block)
+         {
+             // the transaction is all-or-nothing, so every result carries an error when one does;
+             // rolled-back operations point at the one that failed
+             NSError* failure = [results objectAtIndex:0];
+             if ((id)failure == [NSNull null])
+             {
+                 failure = nil;
+             }
+             else if ([[failure userInfo] objectForKey:NSUnderlyingErrorKey])
+             {
+                 failure = [[failure userInfo] objectForKey:NSUnderlyingErrorKey];
+             }
+             block (results, failure);
+         }
+         else if ([(id)_delegate respondsToSelector:@selector(storageClient:didExecuteBatch:results:)])
+         {
+             [_delegate storageClient:self didExecuteBatch:batch results:results];
+         }
+     }];
+    
+    return YES;
+}
+
+#pragma mark -
+#pragma mark Private methods
+
+- (void)privateGetQueueMessages:(NSString *)queueName fetchCount:(NSInteger)fetchCount visibilityTimeout:(NSInteger)visibilityTimeout useBlockError:(BOOL)useBlockError peekOnly:(BOOL)peekOnly handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSArray *, NSError *))block
+{
+	queueName = [queueName lowercaseString];
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/messages?numofmessages=%d", [queueName URLEncode], fetchCount];
+	if(peekOnly)
+	{
+		endpoint = [endpoint stringByAppendingString:@"&peekonly=true"];
+	}
+	else
+	{
+		endpoint = [endpoint stringByAppendingFormat:@"&visibilitytimeout=%ld", (long)visibilityTimeout];
+	}
+	
+    // a peek leaves the messages where they are, so it can be sent twice; a get hides what it returns
+    [self privateRead:handle hedged:peekOnly attempt:^(CloudRequestHandle* attemptHandle, void (^done)(BOOL, dispatch_block_t))
+     {
+         CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"queue", nil];
+         request.owner = self;
+         
+         XmlStreamParser* parser = [[[XmlStreamParser alloc] init] autorelease];
+         NSMutableArray* queueMessages = [NSMutableArray arrayWithCapacity:fetchCount];
+         [QueueMessageParser addQueueMessageRecordsToParser:parser queueMessages:queueMessages];
+         
+         [request fetchWithStreamParser:parser completion:^(NSError* error)
+          {
+              done(!error, ^
+              {
+                  if(error)
+                  {
+                      if(useBlockError)
+                      {
+                          block(nil, error);
+                      }
+                      else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+                      {
+                          [_delegate storageClient:self didFailRequest:request withError:error];
+                      }
+                      return;
+                  }
+                  
+                  block(queueMessages, nil);
+              });
+          }];
+         [attemptHandle addMember:request];
+     }];
+}
+
+- (void)privateGetBlobData:(Blob *)blob chunkBlock:(BOOL (^)(NSData *))chunkBlock finally:(NSError* (^)(NSError *))finally handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSError *))block
+{
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [blob.container.name URLEncode], [blob.name URLEncode]];
+    CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob", nil];
+    
+    request.priority = CloudRequestPriorityLow;
+    request.owner = self;
+    [request fetchStreamWithWindowSize:_streamingWindowSize chunkBlock:chunkBlock completion:^(NSError* error)
+     {
+         if(finally)
+         {
+             error = finally(error);
+         }
+         
+         if(error)
+         {
+             if(block)
+             {
+                 block(error);
+             }
+             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+             {
+                 [_delegate storageClient:self didFailRequest:request withError:error];
+             }
+             return;
+         }
+         
+         if(block)
+         {
+             block(nil);
+         }
+         else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didStreamBlobData:)])
+         {
+             [_delegate storageClient:self didStreamBlobData:blob];
+         }
+     }];
+    [handle addMember:request];
+}
+
+- (void)privateDownloadBlob:(BlobRangeDownloader *)downloader container:(BlobContainer *)container finally:(void (^)(void))finally withBlock:(void (^)(NSData *, NSError *))block
+{
+    [_credential sharedAccessSignatureForContainer:container.name withBlock:^(SharedAccessSignature* signature)
+     {
+         // the downloader schedules segments from the callback queue, where their completions arrive
+         dispatch_async(_deliveryQueue, ^
+         {
+             if(_credential.usesProxy && !signature)
+             {
+                 if(finally)
+                 {
+                     finally();
+                 }
+                 block(nil, [NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:@"The proxy service did not grant access to the container" forKey:NSLocalizedDescriptionKey]]);
+                 return;
+             }
+             
+             downloader.signature = signature;
+             downloader.owner = self;
+             [downloader startWithBlock:^(NSData* data, NSError* error)
+              {
+                  if(finally)
+                  {
+                      finally();
+                  }
+                  block(data, error);
+              }];
+         });
+     }];
+}
+
+- (void)privateUploadBlob:(BlobBlockUploader *)uploader container:(BlobContainer *)container blobName:(NSString *)blobName finally:(void (^)(void))finally withBlock:(void (^)(NSError *))block
+{
+    void (^completion)(NSError*) = ^(NSError* error)
+    {
+        if(finally)
+        {
+            finally();
+        }
+        
+        if(error)
+        {
+            if(block)
+            {
+                block(error);
+            }
+            else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+            {
+                [_delegate storageClient:self didFailRequest:nil withError:error];
+            }
+            return;
+        }
+        
+        if(block)
+        {
+            block(nil);
+        }
+        else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didAddBlobToContainer:blobName:)])
+        {
+            [_delegate storageClient:self didAddBlobToContainer:container blobName:blobName];
+        }
+    };
+    
+    [_credential sharedAccessSignatureForContainer:container.name withBlock:^(SharedAccessSignature* signature)
+     {
+         // the uploader schedules blocks from the callback queue, where their completions arrive
+         dispatch_async(_deliveryQueue, ^
+         {
+             if(_credential.usesProxy && !signature)
+             {
+                 completion([NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:@"The proxy service did not grant access to the container" forKey:NSLocalizedDescriptionKey]]);
+                 return;
+             }
+             
+             uploader.signature = signature;
+             uploader.owner = self;
+             [uploader startWithBlock:completion];
+         });
+     }];
+}
+
+- (void)privateGetBlobs:(BlobContainer *)container withBlock:(void (^)(NSArray *, NSError *))block
+{
+    NSMutableArray* items = [NSMutableArray arrayWithCapacity:30];
+    
+    [self getBlobs:[BlobListRequest listRequestForContainer:container] pageBlock:^BOOL(NSArray* page, NSArray* prefixes)
+     {
+         [items addObjectsFromArray:page];
+         return YES;
+     }
+    withBlock:^(NSError* error)
+     {
+         if(error)
+         {
+             if(block)
+             {
+                 block(nil, error);
+             }
+             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+             {
+                 [_delegate storageClient:self didFailRequest:nil withError:error];
+             }
+             return;
+         }
+         
+         if(block)
+         {
+             block(items, nil);
+         }
+         else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didGetBlobs:inContainer:)])
+         {
+             [_delegate storageClient:self didGetBlobs:items inContainer:container];
+         }
+     }];
+}
+
+- (void)privateGetBlobData:(Blob *)blob signature:(SharedAccessSignature *)signature handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSData *, NSError *))block
+{
+    BlobCache* cache = [[_blobCache retain] autorelease];
+    NSString* etag = [cache etagForContainer:blob.container.name blobName:blob.name];
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [blob.container.name URLEncode], [blob.name URLEncode]];
+    CloudURLRequest* request;
+    if(signature)
+    {
+        request = etag ? [_credential authenticatedRequestWithEndpoint:endpoint signature:signature httpMethod:@"GET" contentData:nil contentType:nil, @"If-None-Match", etag, nil]
+                       : [_credential authenticatedRequestWithEndpoint:endpoint signature:signature httpMethod:@"GET" contentData:nil contentType:nil, nil];
+    }
+    else if(etag)
+    {
+        // while the cached copy is current the service answers 304 with no body
+        request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob", @"If-None-Match", etag, nil];
+    }
+    else
+    {
+        request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob", nil];
+    }
+    if(etag)
+    {
+        [cache noteRevalidation];
+    }
+    request.priority = CloudRequestPriorityLow;
+    
+    request.owner = self;
+    [request fetchDataWithBlock:^(NSData* data, NSError* error)
+     {
+         NSInteger statusCode = [request.response statusCode];
+         if(!error && cache && statusCode == 304)
+         {
+             data = [cache dataForContainer:blob.container.name blobName:blob.name];
+             if(!data)
+             {
+                 // evicted while the request was out; fetch it in full
+                 [self privateGetBlobData:blob signature:signature handle:handle withBlock:block];
+                 return;
+             }
+             [cache noteHit];
+         }
+         else if(!error && cache && statusCode == 200)
+         {
+             NSDictionary* headers = [request.response allHeaderFields];
+             NSString* responseETag = [headers objectForKey:@"ETag"] ? [headers objectForKey:@"ETag"] : [headers objectForKey:@"Etag"];
+             [cache noteMiss];
+             [cache storeData:data etag:responseETag container:blob.container.name blobName:blob.name];
+         }
+         
+         block(error ? nil : data, error);
+     }];
+    [handle addMember:request];
+}
+
+- (void)privateAddBlobToContainer:(BlobContainer *)container blobName:(NSString *)blobName contentData:(NSData *)contentData contentType:(NSString *)contentType signature:(SharedAccessSignature *)signature handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSError *))block
+{
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [[container.name lowercaseString] URLEncode], [blobName URLEncode]];
+    CloudURLRequest* request;
+
+    if(signature)
+    {
+        request = [_credential authenticatedRequestWithEndpoint:endpoint signature:signature httpMethod:@"PUT" contentData:contentData contentType:contentType, @"x-ms-blob-type", @"BlockBlob", nil];
+    }
+    else if(_credential.usesProxy)
+    {
+        request = [_credential authenticatedRequestWithEndpoint:@"/SharedAccessSignatureService/blob" forStorageType:@"blob" httpMethod:@"PUT" contentData:contentData contentType:contentType, @"x-ms-blob-type", @"BlockBlob", nil];
+    }
+    else
+    {
+        request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"PUT" contentData:contentData contentType:contentType, @"x-ms-blob-type", @"BlockBlob", nil];
+    }
+    request.priority = CloudRequestPriorityLow;
+    
+    request.owner = self;
+    [request fetchNoResponseWithBlock:^(NSError* error)
+     {
+         if(error)
+         {
+             if(block)
+             {
+                 block(error);
+             }
+             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+             {
+                 [_delegate storageClient:self didFailRequest:request withError:error];
+             }
+             return;
+         }
+         
+         if(block)
+         {
+             block(nil);
+         }
+         else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didAddBlobToContainer:blobName:)])
+         {
+             [_delegate storageClient:self didAddBlobToContainer:container blobName:blobName];
+         }
+     }];
+    [handle addMember:request];
+}
+
+- (void)privateDeleteBlob:(Blob *)blob signature:(SharedAccessSignature *)signature handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSError *))block
+{
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [blob.container.name URLEncode], [blob.name URLEncode]];
+    CloudURLRequest* request;
+    
+    if(signature)
+    {
+        request = [_credential authenticatedRequestWithEndpoint:endpoint signature:signature httpMethod:@"DELETE" contentData:[NSData data] contentType:nil, nil];
+    }
+    else if(_credential.usesProxy)
+    {
+        request = [_credential authenticatedRequestWithEndpoint:@"/SharedAccessSignatureService/blob" forStorageType:@"blob" httpMethod:@"DELETE" contentData:[NSData data] contentType:nil, nil];
+    }
+    else
+    {
+        request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"DELETE" contentData:[NSData data] contentType:nil, nil];
+    }
+    
+    request.owner = self;
+    [request fetchNoResponseWithBlock:^(NSError* error)
+     {
+         if(error)
+         {
+             if(block)
+             {
+                 block(error);
+             }
+             else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+             {
+                 [_delegate storageClient:self didFailRequest:request withError:error];
+             }
+             return;
+         }
+         
+         [_blobCache removeBlobForContainer:blob.container.name blobName:blob.name];
+         
+         if(block)
+         {
+             block(nil);
+         }
+         else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didDeleteBlob:)])
+         {
+             [_delegate storageClient:self didDeleteBlob:blob];
+         }
+     }];
+    [handle addMember:request];
+}
+
+// Copy Blob, Set Blob Metadata and Set Blob Properties: a bodiless PUT whose work is all in its headers.
+- (void)privatePutBlob:(NSString *)blobName container:(NSString *)containerName query:(NSString *)query headers:(NSDictionary *)headers signature:(SharedAccessSignature *)signature handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSError *))block
+{
+    NSString* endpoint = [NSString stringWithFormat:@"/%@/%@", [[containerName lowercaseString] URLEncode], [blobName URLEncode]];
+    if(query)
+    {
+        endpoint = [endpoint stringByAppendingFormat:@"?%@", query];
+    }
+    
+    CloudURLRequest* request = nil;
+    
+    if(signature)
+    {
+        // a signature covers the request whatever its headers, so they are simply added
+        request = [_credential authenticatedRequestWithEndpoint:endpoint signature:signature httpMethod:@"PUT" contentData:[NSData data] contentType:nil, nil];
+        for(NSString* name in headers)
+        {
+            [request setValue:[headers objectForKey:name] forHTTPHeaderField:name];
+        }
+    }
+    else if(!_credential.usesProxy)
+    {
+        request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"PUT" contentData:[NSData data] contentType:nil headers:headers, nil];
+    }
+    
+    if(!request)
+    {
+        // the proxy's own blob service only knows how to put and delete content, and shared key signing
+        // gives up on more metadata headers than it can sign
+        NSString* reason = _credential.usesProxy ? @"The proxy service did not grant access to the container" : @"The request has more headers than can be signed";
+        NSError* error = [NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:reason forKey:NSLocalizedDescriptionKey]];
+        if(block)
+        {
+            block(error);
+        }
+        else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+        {
+            [_delegate storageClient:self didFailRequest:nil withError:error];
+        }
+        return;
+    }
+    
+    request.owner = self;
+    [request fetchNoResponseWithBlock:^(NSError* error)
+     {
+         if(!error)
+         {
+             // the blob has a new ETag, so a cached copy could never be revalidated
+             [_blobCache removeBlobForContainer:containerName blobName:blobName];
+         }
+         
+         if(block)
+         {
+             block(error);
+         }
+         else if(error && [(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+         {
+             [_delegate storageClient:self didFailRequest:request withError:error];
+         }
+     }];
+    [handle addMember:request];
+}
+
+- (void)privateListPages:(BlobListRequest *)listRequest pageBlock:(BOOL (^)(NSArray *, NSArray *))pageBlock withBlock:(void (^)(NSError *))block
+{
+    if(_credential.usesProxy && !listRequest.container)
+    {
+        NSError* error = [NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:@"Paged container listing is not supported through the proxy service" forKey:NSLocalizedDescriptionKey]];
+        if(block)
+        {
+            block(error);
+        }
+        else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+        {
+            [_delegate storageClient:self didFailRequest:nil withError:error];
+        }
+        return;
+    }
+    
+    __block BOOL stopped = NO;
+    __block void (^fetchPage)(BlobListRequest*) = nil;
+    
+    // same shape as the entity pager: one page outstanding, the next requested before the current one is handed over
+    fetchPage = [^(BlobListRequest* pageRequest)
+    {
+        [self privateGetListPage:pageRequest withBlock:^(NSArray* items, NSArray* prefixes, BlobListRequest* nextRequest, NSError* error)
+         {
+             if(stopped)
+             {
+                 [fetchPage release];
+                 return;
+             }
+             
+             if(error)
+             {
+                 [fetchPage release];
+                 
+                 if(block)
+                 {
+                     block(error);
+                 }
+                 else if([(NSObject*)_delegate respondsToSelector:@selector(storageClient:didFailRequest:withError:)])
+                 {
+                     [_delegate storageClient:self didFailRequest:nil withError:error];
+                 }
+                 return;
+             }
+             
+             if(nextRequest)
+             {
+                 fetchPage(nextRequest);
+             }
+             else
+             {
+                 [fetchPage release];
+             }
+             
+             if(!pageBlock(items, prefixes))
+             {
+                 stopped = YES;
+             }
+             
+             if(stopped || !nextRequest)
+             {
+                 if(block)
+                 {
+                     block(nil);
+                 }
+                 else if(listRequest.container && [(NSObject*)_delegate respondsToSelector:@selector(storageClient:didListBlobsInContainer:)])
+                 {
+                     [_delegate storageClient:self didListBlobsInContainer:listRequest.container];
+                 }
+                 else if(!listRequest.container && [(NSObject*)_delegate respondsToSelector:@selector(storageClientDidListBlobContainers:)])
+                 {
+                     [_delegate storageClientDidListBlobContainers:self];
+                 }
+             }
+         }];
+    } copy];
+    
+    fetchPage(listRequest);
+}
+
+- (void)privateGetListPage:(BlobListRequest *)listRequest withBlock:(void (^)(NSArray *, NSArray *, BlobListRequest *, NSError *))block
+{
+    [_credential sharedAccessSignatureForContainer:listRequest.container.name withBlock:^(SharedAccessSignature* signature)
+     {
+         if(_credential.usesProxy && !signature)
+         {
+             block(nil, nil, nil, [NSError errorWithDomain:@"CloudStorageClient" code:-1 userInfo:[NSDictionary dictionaryWithObject:@"The proxy service did not grant access to the container" forKey:NSLocalizedDescriptionKey]]);
+             return;
+         }
+         
+         [self privateGetListPage:listRequest signature:signature withBlock:block];
+     }];
+}
+
+- (void)privateGetListPage:(BlobListRequest *)listRequest signature:(SharedAccessSignature *)signature withBlock:(void (^)(NSArray *, NSArray *, BlobListRequest *, NSError *))block
+{
+    CloudURLRequest* request;
+    if(signature)
+    {
+        request = [_credential authenticatedRequestWithEndpoint:[listRequest endpoint] signature:signature httpMethod:@"GET" contentData:nil contentType:nil, nil];
+    }
+    else
+    {
+        request = [_credential authenticatedRequestWithEndpoint:[listRequest endpoint] forStorageType:@"blob", nil];
+    }
+    
+    request.owner = self;
+    
+    // records are built as the body arrives; only the page being read is ever in memory
+    XmlStreamParser* parser = [[[XmlStreamParser alloc] init] autorelease];
+    NSMutableArray* items = [NSMutableArray arrayWithCapacity:(listRequest.maxResults > 0 ? listRequest.maxResults : 100)];
+    NSMutableArray* prefixes = [NSMutableArray arrayWithCapacity:10];
+    
+    if(listRequest.container)
+    {
+        [BlobParser addBlobRecordsToParser:parser container:listRequest.container blobs:items prefixes:prefixes];
+    }
+    else
+    {
+        [ContainerParser addContainerRecordsToParser:parser containers:items];
+    }
+    
+    [request fetchWithStreamParser:parser completion:^(NSError* error)
+     {
+         if(error)
+         {
+             block(nil, nil, nil, error);
+             return;
+         }
+         
+         NSString* marker = [parser.rootValues objectForKey:@"NextMarker"];
+         BlobListRequest* nextRequest = marker.length ? [listRequest listRequestWithPrefix:listRequest.prefix marker:marker] : nil;
+         
+         block(items, prefixes, nextRequest, nil);
+     }];
+}
+
+- (void)privateGetListing:(BlobListRequest *)listRequest listing:(BlobListing *)listing withBlock:(void (^)(NSError *))block
+{
+    CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:[listRequest endpoint] forStorageType:@"blob", nil];
+    
+    request.owner = self;
+    
+    BlobListingParser* parser = [[[BlobListingParser alloc] initWithListing:listing] autorelease];
+    
+    [request fetchWithStreamParser:parser completion:^(NSError* error)
+     {
+         NSString* marker = [parser.rootValues objectForKey:@"NextMarker"];
+         
+         if(error || !marker.length)
+         {
+             block(error);
+             return;
+         }
+         
+         [self privateGetListing:[listRequest listRequestWithPrefix:listRequest.prefix marker:marker] listing:listing withBlock:block];
+     }];
+}
+
+- (void)privateGetEntityPages:(TableFetchRequest *)fetchRequest handle:(CloudRequestHandle *)handle pageBlock:(BOOL (^)(NSArray *))pageBlock withBlock:(void (^)(NSError *))block
+{
+    __block BOOL stopped = NO;
+    __block void (^fetchPage)(TableFetchRequest*) = nil;
+    
+    // exactly one page request is outstanding at a time; whichever answer doesn't start another ends the chain
+    fetchPage = [^(TableFetchRequest* pageRequest)
+    {
+        [self privateGetEntityPage:pageRequest handle:handle withBlock:^(NSArray* entities, TableFetchRequest* nextRequest, NSError* error)
+         {
+             if (stopped)
+             {
+                 // the consumer stopped while this page was being prefetched
+                 [fetchPage release];
+                 return;
+             }
+             
+             if (error)
+             {
+                 [fetchPage release];
+                 block (error);
+                 return;
+             }
+             
+             // ask for the next page before handing this one over, so it downloads while this one is processed
+             if (nextRequest)
+             {
+                 fetchPage(nextRequest);
+             }
+             else
+             {
+                 [fetchPage release];
+             }
+             
+             if (!pageBlock(entities))
+             {
+                 stopped = YES;
+             }
+             
+             if (stopped || !nextRequest)
+             {
+                 block (nil);
+             }
+         }];
+    } copy];
+    
+    fetchPage(fetchRequest);
+}
+
+- (NSArray *)privateEntities:(NSArray *)entities matching:(NSPredicate *)predicate unseen:(NSMutableSet *)seen
+{
+    if (!predicate && !seen)
+    {
+        return entities;
+    }
+    
+    NSMutableArray* matches = [NSMutableArray arrayWithCapacity:[entities count]];
+    for (TableEntity* entity in entities)
+    {
+        if (predicate)
+        {
+            // the system properties aren't among the entity's keys, but a condition can name them
+            NSMutableDictionary* values = [NSMutableDictionary dictionaryWithCapacity:[[entity keys] count] + 3];
+            for (NSString* key in [entity keys])
+            {
+                [values setObject:[entity valueForKey:key] forKey:key];
+            }
+            if (entity.partitionKey)
+            {
+                [values setObject:entity.partitionKey forKey:@"PartitionKey"];
+            }
+            if (entity.rowKey)
+            {
+                [values setObject:entity.rowKey forKey:@"RowKey"];
+            }
+            if (entity.timeStamp)
+            {
+                [values setObject:entity.timeStamp forKey:@"Timestamp"];
+            }
+            
+            if (![predicate evaluateWithObject:values])
+            {
+                continue;
+            }
+        }
+        
+        if (seen)
+        {
+            // queries over the same partition can both return an entity; keep the first match
+            NSArray* key = [NSArray arrayWithObjects:entity.partitionKey, entity.rowKey, nil];
+            if ([seen containsObject:key])
+            {
+                continue;
+            }
+            [seen addObject:key];
+        }
+        
+        [matches addObject:entity];
+    }
+    
+    return matches;
+}
+
+- (void)privateGetEntityPage:(TableFetchRequest *)fetchRequest handle:(CloudRequestHandle *)handle withBlock:(void (^)(NSArray *, TableFetchRequest *, NSError *))block
+{
+    // each attempt parses into its own array, so a hedged page never mixes two responses
+    [self privateRead:handle hedged:YES attempt:^(CloudRequestHandle* attemptHandle, void (^done)(BOOL, dispatch_block_t))
+     {
+         NSString* endpoint = [fetchRequest endpoint];
+         CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"table" httpMethod:@"GET", nil];
+         
+         [self prepareTableRequest:request format:_tableFormat];
+         
+         __block CloudURLRequest* pageRequest = request;
+         request.owner = self;
+         
+         NSMutableArray* entities = [NSMutableArray arrayWithCapacity:50];
+         void (^addEntity)(NSMutableDictionary*) = ^(NSMutableDictionary* properties)
+         {
+             TableEntity* entity = [[TableEntity alloc] initWithDictionary:properties fromTable:fetchRequest.tableName];
+             [entities addObject:entity];
+             [entity release];
+         };
+         
+         id<CloudStreamParser> parser;
+         if (_tableFormat == CloudTableFormatJSON)
+         {
+             JsonStreamParser* jsonParser = [[[JsonStreamParser alloc] init] autorelease];
+             [jsonParser addRecordArray:@"value" block:addEntity];
+             parser = jsonParser;
+         }
+         else
+         {
+             XmlStreamParser* xmlParser = [[[XmlStreamParser alloc] init] autorelease];
+             [XmlHelper addAtomPubRecordsToParser:xmlParser block:addEntity];
+             parser = xmlParser;
+         }
+         
+         [request fetchWithStreamParser:parser completion:^(NSError *error)
+          {
+              done (!error, ^
+              {
+                  if (error)
+                  {
+                      block (nil, nil, error);
+                      return;
+                  }
+                  
+                  block (entities, [self privateContinuationOf:fetchRequest response:pageRequest.response], nil);
+              });
+          }];
+         [attemptHandle addMember:request];
+     }];
+}
+
+- (void)privateGetEntityResultsPage:(TableFetchRequest *)fetchRequest results:(TableResultSet *)results withBlock:(void (^)(TableFetchRequest *, NSError *))block
+{
+    CloudURLRequest* request = [_credential authenticatedRequestWithEndpoint:[fetchRequest endpoint] forStorageType:@"table" httpMethod:@"GET", nil];
+    
+    [self prepareTableRequest:request];
+    
+    __block CloudURLRequest* pageRequest = request;
+    request.owner = self;
+    
+    TableColumnParser* parser = [[[TableColumnParser alloc] initWithResultSet:results] autorelease];
+    
+    [request fetchWithStreamParser:parser completion:^(NSError *error)
+     {
+         if (error)
+         {
+             block (nil, error);
+             return;
+         }
+         
+         block ([self privateContinuationOf:fetchRequest response:pageRequest.response], nil);
+     }];
+}
+
+- (TableFetchRequest *)privateContinuationOf:(TableFetchRequest *)fetchRequest response:(NSHTTPURLResponse *)response
+{
+    // header names may come back in any case
+    NSString* nextPartitionKey = nil;
+    NSString* nextRowKey = nil;
+    NSDictionary* headers = [response allHeaderFields];
+    for (NSString* name in headers)
+    {
+        if ([name caseInsensitiveCompare:@"x-ms-continuation-NextPartitionKey"] == NSOrderedSame)
+        {
+            nextPartitionKey = [headers objectForKey:name];
+        }
+        else if ([name caseInsensitiveCompare:@"x-ms-continuation-NextRowKey"] == NSOrderedSame)
+        {
+            nextRowKey = [headers objectForKey:name];
+        }
+    }
+    
+    if (!nextPartitionKey && !nextRowKey)
+    {
+        return nil;
+    }
+    
+    return [fetchRequest continuationRequestWithNextPartitionKey:nextPartitionKey nextRowKey:nextRowKey];
+}
+
+- (NSData *)privateBodyForEntity:(TableEntity *)entity template:(NSString *)template entityID:(NSString *)entityID contentType:(NSString **)contentType
+{
+    if (_tableFormat == CloudTableFormatJSON)
+    {
+        *contentType = @"application/json";
+        return [entity jsonBody];
+    }
+    
+	NSString* properties = [entity propertyString];
+    if (!properties)
+    {
+        return nil;
+    }
+    
+	// Construct the date in the right format
+	NSDateFormatter *dateFormatter = [[[NSDateFormatter alloc] init] autorelease];
+	[dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ssZ"];
+	NSString *dateString = [dateFormatter stringFromDate:[NSDate date]];
+    
+    NSString* entry = [[template stringByReplacingOccurrencesOfString:@"$UPDATEDDATE$" withString:dateString] stringByReplacingOccurrencesOfString:@"$PROPERTIES$" withString:properties];
+    if (entityID)
+    {
+        entry = [entry stringByReplacingOccurrencesOfString:@"$ENTITYID$" withString:entityID];
+    }
+    
+    *contentType = @"application/atom+xml";
+    return [entry dataUsingEncoding:NSUTF8StringEncoding];
+}
+
+- (NSData *)privateBodyForBatch:(TableBatch *)batch batchBoundary:(NSString *)batchBoundary changesetBoundary:(NSString *)changesetBoundary
+{
+	// Construct the date in the right format
+	NSDateFormatter *dateFormatter = [[[NSDateFormatter alloc] init] autorelease];
+	[dateFormatter setDateFormat:@"yyyy-MM-dd'T'HH:mm:ssZ"];
+	NSString *dateString = [dateFormatter stringFromDate:[NSDate date]];
+    
+    NSString* tableURL = [[_credential URLforEndpoint:batch.tableName forStorageType:@"table"] absoluteString];
+    NSMutableString* body = [NSMutableString stringWithCapacity:batch.count * 700];
+    
+    [body appendFormat:@"--%@\r\nContent-Type: multipart/mixed; boundary=%@\r\n\r\n", batchBoundary, changesetBoundary];
+    
+    for(NSUInteger index = 0; index < batch.count; index++)
+    {
+        TableEntity* entity = [batch.entities objectAtIndex:index];
+        TableBatchOperation operation = [batch operationAtIndex:index];
+        NSString* entityURL = [[_credential URLforEndpoint:[entity endpoint] forStorageType:@"table"] absoluteString];
+        NSString* method;
+        NSString* entry = nil;
+        NSString* properties = (operation == TableBatchOperationDelete) ? nil : [entity propertyString];
+        
+        if(operation != TableBatchOperationDelete && !properties)
+        {
+            return nil;
+        }
+        
+        switch(operation)
+        {
+            case TableBatchOperationInsert:
+                method = @"POST";
+                entityURL = tableURL;
+                entry = [[TABLE_INSERT_ENTITY_REQUEST_STRING stringByReplacingOccurrencesOfString:@"$UPDATEDDATE$" withString:dateString] stringByReplacingOccurrencesOfString:@"$PROPERTIES$" withString:properties];
+                break;
+            case TableBatchOperationUpdate:
+            case TableBatchOperationMerge:
+                method = (operation == TableBatchOperationUpdate) ? @"PUT" : @"MERGE";
+                entry = [[[TABLE_UPDATE_ENTITY_REQUEST_STRING stringByReplacingOccurrencesOfString:@"$UPDATEDDATE$" withString:dateString] stringByReplacingOccurrencesOfString:@"$PROPERTIES$" withString:properties] stringByReplacingOccurrencesOfString:@"$ENTITYID$" withString:entityURL];
+                break;
+            default:
+                method = @"DELETE";
+                break;
+        }
+        
+        [body appendFormat:@"--%@\r\nContent-Type: application/http\r\nContent-Transfer-Encoding: binary\r\n\r\n", changesetBoundary];
+        [body appendFormat:@"%@ %@ HTTP/1.1\r\nContent-ID: %lu\r\n", method, entityURL, (unsigned long)index + 1];
+        if(operation != TableBatchOperationInsert)
+        {
+            [body appendString:@"If-Match: *\r\n"];
+        }
+        
+        if(entry)
+        {
+            [body appendFormat:@"Content-Type: application/atom+xml;type=entry\r\nContent-Length: %lu\r\n\r\n%@\r\n", 
+             (unsigned long)[entry lengthOfBytesUsingEncoding:NSUTF8StringEncoding], entry];
+        }
+        else
+        {
+            [body appendString:@"\r\n"];
+        }
+    }
+    
+    [body appendFormat:@"--%@--\r\n--%@--\r\n", changesetBoundary, batchBoundary];
+    
+    return [body dataUsingEncoding:NSUTF8StringEncoding];
 }
 
 - (void) dealloc 
 {
     _delegate = nil;
     [_credential release];
+    [_blobCache release];
+    dispatch_release(_callbackQueue);
+    dispatch_release(_deliveryQueue);
 
     [super dealloc];
 }
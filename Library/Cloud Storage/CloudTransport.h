@@ -0,0 +1,45 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+/*! Receives the progress of one request from a transport, one call at a time on a thread of the transport's choosing, in the order response, data, then either finish or failure. */
+@protocol CloudTransportClient <NSObject>
+
+/*! Called once the response headers have arrived. */
+- (void)transportDidReceiveResponse:(NSURLResponse *)response;
+/*! Called for each piece of the response body as it arrives. */
+- (void)transportDidReceiveData:(NSData *)data;
+/*! Called when the whole response has arrived. */
+- (void)transportDidFinishLoading;
+/*! Called when the request could not be completed. */
+- (void)transportDidFailWithError:(NSError *)error;
+
+@optional
+/*! Called before the request finishes with the time spent resolving the host and opening a new connection for it. Not called when the request reused a connection. */
+- (void)transportDidMeasureConnectTime:(NSTimeInterval)connectTime;
+
+@end
+
+/*! A transport carries requests to the storage service. The request scheduler hands every request it starts to its transport, so replacing the transport changes how all storage traffic reaches the network. */
+@protocol CloudTransport <NSObject>
+
+/*! Starts sending a request and reports its progress to client, which is retained until the request finishes or fails. Returns an object identifying the transfer. */
+- (id)startRequest:(NSURLRequest *)request client:(id<CloudTransportClient>)client;
+/*! Stops a transfer. Its client receives no further calls. */
+- (void)cancelTransfer:(id)transfer;
+
+@end
@@ -0,0 +1,79 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "QueueMessage.h"
+
+@class CloudStorageClient;
+
+/*! The most messages the queue service hands out per request. */
+#define QUEUE_MAX_FETCH_COUNT 32
+
+/*! Processes one message. Call done exactly once when the work is finished, with YES to delete the message or NO to leave it to reappear on the queue once its visibility timeout lapses. done may be called later, from the storage client's callbackQueue. */
+typedef void (^QueueMessageHandler)(QueueMessage *message, void (^done)(BOOL deleteMessage));
+
+/*! QueueMessagePump keeps a local buffer of messages filled with batched gets from one queue and hands them to a handler, with up to concurrency messages being handled at once. Messages held longer than half their visibility timeout are kept hidden with Update Message, and deletes are sent in the background as handlers finish. The pump stays alive while it is running. */
+@interface QueueMessagePump : NSObject
+{
+    CloudStorageClient* _client;
+    NSString* _queueName;
+    NSUInteger _concurrency;
+    NSUInteger _prefetchCount;
+    NSInteger _visibilityTimeout;
+    NSTimeInterval _pollInterval;
+    void (^_errorBlock)(QueueMessage *, NSError *);
+    
+    QueueMessageHandler _handler;
+    BOOL _running;
+    BOOL _fetching;
+    NSTimeInterval _idleDelay;
+    dispatch_source_t _fetchTimer;
+    dispatch_source_t _leaseTimer;
+    
+    NSMutableArray* _buffer;
+    NSUInteger _activeCount;
+    NSMutableDictionary* _leases;
+    NSMutableDictionary* _expiries;
+    NSMutableSet* _extending;
+    NSMutableArray* _deletes;
+    NSUInteger _deletesInFlight;
+    NSMutableArray* _stopBlocks;
+}
+
+/*! The most messages handled at once. Defaults to 4. */
+@property (assign) NSUInteger concurrency;
+/*! How many messages beyond those being handled are kept ready in the local buffer. Defaults to QUEUE_MAX_FETCH_COUNT. */
+@property (assign) NSUInteger prefetchCount;
+/*! How long, in seconds, fetched messages stay hidden from other consumers, and how far each extension pushes that out. Defaults to 60. */
+@property (assign) NSInteger visibilityTimeout;
+/*! The longest wait, in seconds, between polls of an empty queue. Polling backs off towards it while the queue stays empty. Defaults to 10. */
+@property (assign) NSTimeInterval pollInterval;
+/*! Called for each failed get, extension or delete. The message is nil when a get failed. */
+@property (copy) void (^errorBlock)(QueueMessage *, NSError *);
+/*! Whether the pump is fetching and dispatching messages. */
+@property (readonly) BOOL running;
+
+/*! Starts fetching messages and handing them to handler. */
+- (void)startWithHandler:(QueueMessageHandler)handler;
+/*! Stops fetching. Buffered messages are dropped and reappear on the queue once their visibility timeout lapses; handlers already running finish normally. */
+- (void)stop;
+/*! Stops fetching and calls block once every running handler has finished and its delete has been answered. */
+- (void)stopWithBlock:(void (^)(void))block;
+
+/*! Creates a pump for the named queue that works through the specified storage client. */
++ (QueueMessagePump*)pumpWithStorageClient:(CloudStorageClient*)client queueName:(NSString*)queueName;
+
+@end
@@ -0,0 +1,357 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "QueueMessagePump.h"
+#import "CloudStorageClient+Private.h"
+
+// the first wait after an empty get; it doubles on each empty get up to pollInterval
+static const NSTimeInterval QUEUE_PUMP_MIN_IDLE_DELAY = 0.25;
+
+@implementation QueueMessagePump
+
+@synthesize concurrency = _concurrency;
+@synthesize prefetchCount = _prefetchCount;
+@synthesize visibilityTimeout = _visibilityTimeout;
+@synthesize pollInterval = _pollInterval;
+@synthesize errorBlock = _errorBlock;
+@synthesize running = _running;
+
+- (id)initWithStorageClient:(CloudStorageClient*)client queueName:(NSString*)queueName
+{
+    if((self = [super init]))
+    {
+        _client = [client retain];
+        _queueName = [queueName copy];
+        _concurrency = 4;
+        _prefetchCount = QUEUE_MAX_FETCH_COUNT;
+        _visibilityTimeout = 60;
+        _pollInterval = 10.0;
+        _buffer = [[NSMutableArray alloc] initWithCapacity:QUEUE_MAX_FETCH_COUNT];
+        _leases = [[NSMutableDictionary alloc] initWithCapacity:QUEUE_MAX_FETCH_COUNT];
+        _expiries = [[NSMutableDictionary alloc] initWithCapacity:QUEUE_MAX_FETCH_COUNT];
+        _extending = [[NSMutableSet alloc] initWithCapacity:4];
+        _deletes = [[NSMutableArray alloc] initWithCapacity:QUEUE_MAX_FETCH_COUNT];
+        _stopBlocks = [[NSMutableArray alloc] initWithCapacity:1];
+    }
+    
+    return self;
+}
+
++ (QueueMessagePump*)pumpWithStorageClient:(CloudStorageClient*)client queueName:(NSString*)queueName
+{
+    return [[[QueueMessagePump alloc] initWithStorageClient:client queueName:queueName] autorelease];
+}
+
+- (void)dealloc
+{
+    [self cancelFetchTimer];
+    [self cancelLeaseTimer];
+    [_client release];
+    [_queueName release];
+    [_errorBlock release];
+    [_handler release];
+    [_buffer release];
+    [_leases release];
+    [_expiries release];
+    [_extending release];
+    [_deletes release];
+    [_stopBlocks release];
+    
+    [super dealloc];
+}
+
+#pragma mark Leases
+
+- (void)holdMessage:(QueueMessage*)message until:(NSTimeInterval)expiry
+{
+    [_leases setObject:message forKey:message.messageId];
+    [_expiries setObject:[NSNumber numberWithDouble:expiry] forKey:message.messageId];
+}
+
+- (void)releaseMessage:(QueueMessage*)message
+{
+    [_leases removeObjectForKey:message.messageId];
+    [_expiries removeObjectForKey:message.messageId];
+}
+
+- (void)extendMessage:(QueueMessage*)message
+{
+    NSString* messageId = message.messageId;
+    NSTimeInterval requested = [NSDate timeIntervalSinceReferenceDate];
+    
+    [_extending addObject:messageId];
+    [_client updateQueueMessage:message queueName:_queueName visibilityTimeout:_visibilityTimeout withBlock:^(NSError* error)
+     {
+         [_extending removeObject:messageId];
+         
+         if(error)
+         {
+             // the lease is gone; the message may already be with another consumer
+             [self releaseMessage:message];
+             if(_errorBlock)
+             {
+                 _errorBlock(message, error);
+             }
+         }
+         else if([_leases objectForKey:messageId])
+         {
+             [_expiries setObject:[NSNumber numberWithDouble:requested + _visibilityTimeout] forKey:messageId];
+         }
+         
+         // a delete held back for this extension can use the new pop receipt now
+         [self sendDeletes];
+         [self finishStopIfIdle];
+     }];
+}
+
+- (void)leaseTimerFired
+{
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    
+    for(NSString* messageId in [_leases allKeys])
+    {
+        if(![_extending containsObject:messageId] && [[_expiries objectForKey:messageId] doubleValue] - now <= _visibilityTimeout / 2.0)
+        {
+            [self extendMessage:[_leases objectForKey:messageId]];
+        }
+    }
+}
+
+#pragma mark Deleting
+
+- (void)sendDeletes
+{
+    NSUInteger index = 0;
+    
+    while(_deletesInFlight < MAX(_concurrency, (NSUInteger)1) && index < _deletes.count)
+    {
+        QueueMessage* message = [_deletes objectAtIndex:index];
+        
+        // an extension in flight is about to replace the pop receipt
+        if([_extending containsObject:message.messageId])
+        {
+            index++;
+            continue;
+        }
+        
+        [[message retain] autorelease];
+        [_deletes removeObjectAtIndex:index];
+        
+        _deletesInFlight++;
+        [_client deleteQueueMessage:message queueName:_queueName withBlock:^(NSError* error)
+         {
+             _deletesInFlight--;
+             
+             if(error && _errorBlock)
+             {
+                 _errorBlock(message, error);
+             }
+             
+             [self sendDeletes];
+             [self finishStopIfIdle];
+         }];
+    }
+}
+
+#pragma mark Fetching
+
+// Each timer's handler holds on to the pump until the timer is cancelled.
+
+- (void)cancelFetchTimer
+{
+    if(_fetchTimer)
+    {
+        dispatch_source_cancel(_fetchTimer);
+        dispatch_release(_fetchTimer);
+        _fetchTimer = nil;
+    }
+}
+
+- (void)cancelLeaseTimer
+{
+    if(_leaseTimer)
+    {
+        dispatch_source_cancel(_leaseTimer);
+        dispatch_release(_leaseTimer);
+        _leaseTimer = nil;
+    }
+}
+
+- (void)fetchTimerFired
+{
+    [self cancelFetchTimer];
+    [self fill];
+}
+
+- (void)dispatch
+{
+    while(_running && _activeCount < MAX(_concurrency, (NSUInteger)1) && _buffer.count > 0)
+    {
+        QueueMessage* message = [[[_buffer objectAtIndex:0] retain] autorelease];
+        [_buffer removeObjectAtIndex:0];
+        
+        __block BOOL finished = NO;
+        void (^done)(BOOL) = ^(BOOL deleteMessage)
+        {
+            if(finished)
+            {
+                return;
+            }
+            finished = YES;
+            _activeCount--;
+            
+            // the lease only has to outlive the handler; the delete goes out with the receipt it has now
+            [self releaseMessage:message];
+            if(deleteMessage)
+            {
+                [_deletes addObject:message];
+                [self sendDeletes];
+            }
+            
+            [self dispatch];
+            [self fill];
+            [self finishStopIfIdle];
+        };
+        
+        _activeCount++;
+        _handler(message, [[done copy] autorelease]);
+    }
+}
+
+- (void)fill
+{
+    if(!_running || _fetching || _fetchTimer)
+    {
+        return;
+    }
+    
+    // top up once the buffer is half empty, so each get brings back a worthwhile batch
+    NSUInteger wanted = MAX(_concurrency, (NSUInteger)1) + _prefetchCount;
+    NSUInteger held = _buffer.count + _activeCount;
+    if(held >= wanted || _buffer.count > _prefetchCount / 2)
+    {
+        return;
+    }
+    
+    NSUInteger count = MIN(wanted - held, (NSUInteger)QUEUE_MAX_FETCH_COUNT);
+    
+    _fetching = YES;
+    [_client getQueueMessages:_queueName fetchCount:count visibilityTimeout:_visibilityTimeout withBlock:^(NSArray* messages, NSError* error)
+     {
+         _fetching = NO;
+         
+         if(error && _errorBlock)
+         {
+             _errorBlock(nil, error);
+         }
+         
+         if(!_running)
+         {
+             // stopped while the get was out; these come back once their visibility timeout lapses
+             [self finishStopIfIdle];
+             return;
+         }
+         
+         NSTimeInterval expiry = [NSDate timeIntervalSinceReferenceDate] + _visibilityTimeout;
+         for(QueueMessage* message in messages)
+         {
+             [self holdMessage:message until:expiry];
+             [_buffer addObject:message];
+         }
+         
+         if(messages.count == 0)
+         {
+             _idleDelay = (_idleDelay > 0) ? MIN(_idleDelay * 2, _pollInterval) : MIN(QUEUE_PUMP_MIN_IDLE_DELAY, _pollInterval);
+             _fetchTimer = [_client privateTimerWithInterval:_idleDelay repeats:NO handler:^{
+                 [self fetchTimerFired];
+             }];
+         }
+         else
+         {
+             _idleDelay = 0;
+         }
+         
+         [self dispatch];
+         [self fill];
+     }];
+}
+
+#pragma mark Running
+
+- (void)startWithHandler:(QueueMessageHandler)handler
+{
+    if(_running)
+    {
+        return;
+    }
+    
+    [_handler release];
+    _handler = [handler copy];
+    _running = YES;
+    _idleDelay = 0;
+    
+    if(!_leaseTimer)
+    {
+        NSTimeInterval interval = MAX(_visibilityTimeout / 4.0, 1.0);
+        _leaseTimer = [_client privateTimerWithInterval:interval repeats:YES handler:^{
+            [self leaseTimerFired];
+        }];
+    }
+    
+    [self fill];
+}
+
+- (void)finishStopIfIdle
+{
+    if(_running || _fetching || _activeCount > 0 || _deletesInFlight > 0 || _deletes.count > 0 || _extending.count > 0)
+    {
+        return;
+    }
+    
+    [self cancelLeaseTimer];
+    
+    NSArray* blocks = [[_stopBlocks copy] autorelease];
+    [_stopBlocks removeAllObjects];
+    
+    for(void (^block)(void) in blocks)
+    {
+        block();
+    }
+}
+
+- (void)stop
+{
+    _running = NO;
+    
+    [self cancelFetchTimer];
+    
+    for(QueueMessage* message in _buffer)
+    {
+        [self releaseMessage:message];
+    }
+    [_buffer removeAllObjects];
+    
+    [self finishStopIfIdle];
+}
+
+- (void)stopWithBlock:(void (^)(void))block
+{
+    [_stopBlocks addObject:[[block copy] autorelease]];
+    
+    [self stop];
+}
+
+@end
@@ -0,0 +1,68 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class TableEntity;
+
+/*! The largest number of operations the table service accepts in one batch. */
+#define TABLE_BATCH_MAX_OPERATIONS 100
+
+typedef enum
+{
+    TableBatchOperationInsert,
+    TableBatchOperationUpdate,
+    TableBatchOperationMerge,
+    TableBatchOperationDelete
+} TableBatchOperation;
+
+/*! TableBatch collects insert, update, merge and delete operations on entities that share a table and PartitionKey, so they can be sent as one Entity Group Transaction. The service applies all of the operations or none of them. */
+@interface TableBatch : NSObject
+{
+    NSString* _tableName;
+    NSString* _partitionKey;
+    NSMutableArray* _entities;
+    NSMutableArray* _operations;
+    NSMutableSet* _rowKeys;
+}
+
+/*! The name of the table the batch writes to. */
+@property (readonly) NSString* tableName;
+/*! The PartitionKey shared by every entity in the batch, or nil while the batch is empty. */
+@property (readonly) NSString* partitionKey;
+/*! The entities in the batch, in the order their operations were added. */
+@property (readonly) NSArray* entities;
+/*! The number of operations in the batch. */
+@property (readonly) NSUInteger count;
+
+/*! Returns the operation added for the entity at index. */
+- (TableBatchOperation)operationAtIndex:(NSUInteger)index;
+
+/*! Adds an operation on an entity. Returns NO if the batch is full, the entity is in another table or partition, or the batch already has an operation on that RowKey. */
+- (BOOL)addOperation:(TableBatchOperation)operation entity:(TableEntity *)entity;
+/*! Adds an insert of a new entity. Returns NO under the same conditions as addOperation:entity:. */
+- (BOOL)insertEntity:(TableEntity *)newEntity;
+/*! Adds an update of an existing entity. Returns NO under the same conditions as addOperation:entity:. */
+- (BOOL)updateEntity:(TableEntity *)existingEntity;
+/*! Adds a merge into an existing entity. Returns NO under the same conditions as addOperation:entity:. */
+- (BOOL)mergeEntity:(TableEntity *)existingEntity;
+/*! Adds a delete of an existing entity. Returns NO under the same conditions as addOperation:entity:. */
+- (BOOL)deleteEntity:(TableEntity *)existingEntity;
+
+/*! Creates an empty batch for the specified table. */
++ (TableBatch*)batchForTable:(NSString*)tableName;
+
+@end
@@ -0,0 +1,120 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TableBatch.h"
+#import "TableEntity.h"
+
+@implementation TableBatch
+
+@synthesize tableName = _tableName;
+@synthesize partitionKey = _partitionKey;
+@synthesize entities = _entities;
+
+- (id)initWithTable:(NSString*)tableName
+{
+    if((self = [super init]))
+    {
+        _tableName = [tableName copy];
+        _entities = [[NSMutableArray alloc] initWithCapacity:TABLE_BATCH_MAX_OPERATIONS];
+        _operations = [[NSMutableArray alloc] initWithCapacity:TABLE_BATCH_MAX_OPERATIONS];
+        _rowKeys = [[NSMutableSet alloc] initWithCapacity:TABLE_BATCH_MAX_OPERATIONS];
+    }
+    
+    return self;
+}
+
++ (TableBatch*)batchForTable:(NSString*)tableName
+{
+    return [[[TableBatch alloc] initWithTable:tableName] autorelease];
+}
+
+- (void)dealloc
+{
+    [_tableName release];
+    [_partitionKey release];
+    [_entities release];
+    [_operations release];
+    [_rowKeys release];
+    
+    [super dealloc];
+}
+
+- (NSString*) description
+{
+    return [NSString stringWithFormat:@"TableBatch { tableName = %@, partitionKey = %@, count = %lu }", _tableName, _partitionKey, (unsigned long)[_entities count]];
+}
+
+- (NSUInteger)count
+{
+    return [_entities count];
+}
+
+- (TableBatchOperation)operationAtIndex:(NSUInteger)index
+{
+    return (TableBatchOperation)[[_operations objectAtIndex:index] intValue];
+}
+
+- (BOOL)addOperation:(TableBatchOperation)operation entity:(TableEntity *)entity
+{
+    if([_entities count] >= TABLE_BATCH_MAX_OPERATIONS || !entity.partitionKey || !entity.rowKey)
+    {
+        return NO;
+    }
+    
+    if(![entity.tableName isEqualToString:_tableName] || (_partitionKey && ![entity.partitionKey isEqualToString:_partitionKey]))
+    {
+        return NO;
+    }
+    
+    // the service rejects a changeset that touches the same entity twice
+    if([_rowKeys containsObject:entity.rowKey])
+    {
+        return NO;
+    }
+    
+    if(!_partitionKey)
+    {
+        _partitionKey = [entity.partitionKey copy];
+    }
+    
+    [_rowKeys addObject:entity.rowKey];
+    [_entities addObject:entity];
+    [_operations addObject:[NSNumber numberWithInt:operation]];
+    
+    return YES;
+}
+
+- (BOOL)insertEntity:(TableEntity *)newEntity
+{
+    return [self addOperation:TableBatchOperationInsert entity:newEntity];
+}
+
+- (BOOL)updateEntity:(TableEntity *)existingEntity
+{
+    return [self addOperation:TableBatchOperationUpdate entity:existingEntity];
+}
+
+- (BOOL)mergeEntity:(TableEntity *)existingEntity
+{
+    return [self addOperation:TableBatchOperationMerge entity:existingEntity];
+}
+
+- (BOOL)deleteEntity:(TableEntity *)existingEntity
+{
+    return [self addOperation:TableBatchOperationDelete entity:existingEntity];
+}
+
+@end
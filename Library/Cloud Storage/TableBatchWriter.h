@@ -0,0 +1,63 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "TableBatch.h"
+
+@class CloudStorageClient;
+
+/*! TableBatchWriter queues entity operations by table and PartitionKey and sends each partition through a CloudStorageClient as a batch, once it reaches batchSize operations or flushInterval after the first operation was queued. The writer stays alive until everything queued has been sent. */
+@interface TableBatchWriter : NSObject
+{
+    CloudStorageClient* _client;
+    NSMutableDictionary* _batches;
+    NSUInteger _batchSize;
+    NSTimeInterval _flushInterval;
+    dispatch_source_t _timer;
+    NSUInteger _inFlight;
+    NSMutableArray* _flushBlocks;
+    void (^_errorBlock)(TableEntity *, NSError *);
+}
+
+/*! The number of operations that sends a partition straight away. Defaults to, and is capped at, TABLE_BATCH_MAX_OPERATIONS. */
+@property (assign) NSUInteger batchSize;
+/*! The longest an operation waits to be sent, in seconds. Defaults to 1; 0 leaves partitions queued until they fill up or flush is called. */
+@property (assign) NSTimeInterval flushInterval;
+/*! Called for each operation that fails, with the entity it was queued for. */
+@property (copy) void (^errorBlock)(TableEntity *, NSError *);
+/*! The number of operations queued and not yet sent. */
+@property (readonly) NSUInteger pendingCount;
+
+/*! Queues an operation on an entity. Returns NO if the entity has no table, PartitionKey or RowKey. */
+- (BOOL)addOperation:(TableBatchOperation)operation entity:(TableEntity *)entity;
+/*! Queues an insert of a new entity. */
+- (BOOL)insertEntity:(TableEntity *)newEntity;
+/*! Queues an update of an existing entity. */
+- (BOOL)updateEntity:(TableEntity *)existingEntity;
+/*! Queues a merge into an existing entity. */
+- (BOOL)mergeEntity:(TableEntity *)existingEntity;
+/*! Queues a delete of an existing entity. */
+- (BOOL)deleteEntity:(TableEntity *)existingEntity;
+
+/*! Sends every queued operation now. */
+- (void)flush;
+/*! Sends every queued operation now and calls block once the service has answered all batches sent so far. */
+- (void)flushWithBlock:(void (^)(void))block;
+
+/*! Creates a writer that sends its batches through the specified storage client. */
++ (TableBatchWriter*)writerWithStorageClient:(CloudStorageClient*)client;
+
+@end
@@ -0,0 +1,201 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TableBatchWriter.h"
+#import "CloudStorageClient+Private.h"
+
+@implementation TableBatchWriter
+
+@synthesize batchSize = _batchSize;
+@synthesize flushInterval = _flushInterval;
+@synthesize errorBlock = _errorBlock;
+
+- (id)initWithStorageClient:(CloudStorageClient*)client
+{
+    if((self = [super init]))
+    {
+        _client = [client retain];
+        _batches = [[NSMutableDictionary alloc] initWithCapacity:10];
+        _flushBlocks = [[NSMutableArray alloc] initWithCapacity:1];
+        _batchSize = TABLE_BATCH_MAX_OPERATIONS;
+        _flushInterval = 1.0;
+    }
+    
+    return self;
+}
+
++ (TableBatchWriter*)writerWithStorageClient:(CloudStorageClient*)client
+{
+    return [[[TableBatchWriter alloc] initWithStorageClient:client] autorelease];
+}
+
+- (void)dealloc
+{
+    [self cancelTimer];
+    [_client release];
+    [_batches release];
+    [_flushBlocks release];
+    [_errorBlock release];
+    
+    [super dealloc];
+}
+
+- (NSUInteger)pendingCount
+{
+    NSUInteger count = 0;
+    
+    for(TableBatch* batch in [_batches allValues])
+    {
+        count += batch.count;
+    }
+    
+    return count;
+}
+
+#pragma mark Sending
+
+- (void)finishFlushIfIdle
+{
+    if(_inFlight > 0 || _flushBlocks.count == 0)
+    {
+        return;
+    }
+    
+    NSArray* blocks = [[_flushBlocks copy] autorelease];
+    [_flushBlocks removeAllObjects];
+    
+    for(void (^block)(void) in blocks)
+    {
+        block();
+    }
+}
+
+- (void)sendBatchForKey:(NSString*)key
+{
+    TableBatch* batch = [[[_batches objectForKey:key] retain] autorelease];
+    [_batches removeObjectForKey:key];
+    
+    _inFlight++;
+    [_client executeBatch:batch withBlock:^(NSArray* results, NSError* error)
+     {
+         _inFlight--;
+         
+         if(_errorBlock)
+         {
+             for(NSUInteger index = 0; index < batch.count; index++)
+             {
+                 id result = results ? [results objectAtIndex:index] : error;
+                 if(result != [NSNull null])
+                 {
+                     _errorBlock([batch.entities objectAtIndex:index], result);
+                 }
+             }
+         }
+         
+         [self finishFlushIfIdle];
+     }];
+}
+
+- (void)cancelTimer
+{
+    if(_timer)
+    {
+        // the handler holds on to us until the timer is cancelled
+        dispatch_source_cancel(_timer);
+        dispatch_release(_timer);
+        _timer = nil;
+    }
+}
+
+- (void)flush
+{
+    [self cancelTimer];
+    
+    for(NSString* key in [_batches allKeys])
+    {
+        [self sendBatchForKey:key];
+    }
+}
+
+- (void)flushWithBlock:(void (^)(void))block
+{
+    [_flushBlocks addObject:[[block copy] autorelease]];
+    
+    [self flush];
+    [self finishFlushIfIdle];
+}
+
+#pragma mark Queueing
+
+- (BOOL)addOperation:(TableBatchOperation)operation entity:(TableEntity *)entity
+{
+    if(!entity.tableName || !entity.partitionKey || !entity.rowKey)
+    {
+        return NO;
+    }
+    
+    NSString* key = [NSString stringWithFormat:@"%@\n%@", entity.tableName, entity.partitionKey];
+    TableBatch* batch = [_batches objectForKey:key];
+    
+    if(batch && ![batch addOperation:operation entity:entity])
+    {
+        // the batch is full or already touches this entity, so it goes now and a new one starts
+        [self sendBatchForKey:key];
+        batch = nil;
+    }
+    
+    if(!batch)
+    {
+        batch = [TableBatch batchForTable:entity.tableName];
+        [batch addOperation:operation entity:entity];
+        [_batches setObject:batch forKey:key];
+    }
+    
+    if(batch.count >= MIN(MAX(_batchSize, (NSUInteger)1), (NSUInteger)TABLE_BATCH_MAX_OPERATIONS))
+    {
+        [self sendBatchForKey:key];
+    }
+    else if(!_timer && _flushInterval > 0)
+    {
+        _timer = [_client privateTimerWithInterval:_flushInterval repeats:NO handler:^{
+            [self flush];
+        }];
+    }
+    
+    return YES;
+}
+
+- (BOOL)insertEntity:(TableEntity *)newEntity
+{
+    return [self addOperation:TableBatchOperationInsert entity:newEntity];
+}
+
+- (BOOL)updateEntity:(TableEntity *)existingEntity
+{
+    return [self addOperation:TableBatchOperationUpdate entity:existingEntity];
+}
+
+- (BOOL)mergeEntity:(TableEntity *)existingEntity
+{
+    return [self addOperation:TableBatchOperationMerge entity:existingEntity];
+}
+
+- (BOOL)deleteEntity:(TableEntity *)existingEntity
+{
+    return [self addOperation:TableBatchOperationDelete entity:existingEntity];
+}
+
+@end
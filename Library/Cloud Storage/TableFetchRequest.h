@@ -24,6 +24,11 @@
     NSString* _rowKey;
     NSString* _filter;
     NSInteger _topRows;
+    NSString* _nextPartitionKey;
+    NSString* _nextRowKey;
+    NSPredicate* _residualPredicate;
+    NSArray* _queries;
+    BOOL _queriesOverlap;
 }
 
 @property (readonly) NSString* tableName;
@@ -31,8 +36,16 @@
 @property (copy) NSString* rowKey;
 @property (copy) NSString* filter;
 @property (assign) NSInteger topRows;
+/*! The continuation token a query resumes from, as returned in the x-ms-continuation-NextPartitionKey and NextRowKey headers. */
+@property (copy) NSString* nextPartitionKey;
+@property (copy) NSString* nextRowKey;
+/*! The conditions of the predicate the service can't evaluate, such as LIKE, BEGINSWITH or custom selectors. getEntities: checks them on each entity as it arrives, against property values as the service returned them, which are strings apart from the Timestamp. */
+@property (readonly) NSPredicate* residualPredicate;
+/*! Set when the predicate splits into independent queries, one per partition or point lookup, which getEntities: runs concurrently and merges. nil for a single query. */
+@property (readonly) NSArray* queries;
 
 + (TableFetchRequest*)fetchRequestForTable:(NSString*)tableName;
+/*! Plans the queries for a predicate. Equality on PartitionKey and RowKey becomes a partition or point query, IN and OR over partitions become concurrent queries, and conditions the service can't evaluate are left in residualPredicate. Returns nil and sets error when such a condition compares a property with anything other than a string, which can't be checked on the string values either. */
 + (TableFetchRequest*)fetchRequestForTable:(NSString*)tableName predicate:(NSPredicate*)predicate error:(NSError**)error;
 
 @end
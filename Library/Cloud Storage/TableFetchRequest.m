@@ -15,7 +15,7 @@
  */
 
 #import "TableFetchRequest.h"
-#import "AzureFilterBuilder.h"
+#import "TableQueryPlanner.h"
 #import "CloudURLRequest.h"
 #import "NSString+URLEncode.h"
 
@@ -26,6 +26,10 @@
 @synthesize rowKey = _rowKey;
 @synthesize filter = _filter;
 @synthesize topRows = _topRows;
+@synthesize nextPartitionKey = _nextPartitionKey;
+@synthesize nextRowKey = _nextRowKey;
+@synthesize residualPredicate = _residualPredicate;
+@synthesize queries = _queries;
 
 - (id) initWithTable:(NSString*)tableName
 {
@@ -44,24 +48,105 @@
 
 + (TableFetchRequest*)fetchRequestForTable:(NSString*)tableName predicate:(NSPredicate*)predicate error:(NSError**)error
 {
-    NSString* filter = [AzureFilterBuilder filterStringWithPredicate:predicate error:error];
-    if(!filter)
+    if(!predicate)
+    {
+        return [self fetchRequestForTable:tableName];
+    }
+    
+    BOOL overlapping;
+    NSArray* queries = [TableQueryPlanner queriesForPredicate:predicate table:tableName overlapping:&overlapping error:error];
+    
+    if(!queries)
     {
         return nil;
     }
 
 #if FULL_LOGGING
-    NSLog(@"Filter=%@", filter);
+    for(TableFetchRequest* query in queries)
+    {
+        NSLog(@"Filter=%@ Residual=%@", query.filter, query.residualPredicate);
+    }
 #endif
     
+    if([queries count] == 1)
+    {
+        return [queries objectAtIndex:0];
+    }
+    
     TableFetchRequest* request = [[[TableFetchRequest alloc] initWithTable:tableName] autorelease];
     
-    request.filter = filter;
+    request->_queries = [queries retain];
+    request->_queriesOverlap = overlapping;
+    
+    return request;
+}
+
+- (void)setTopRows:(NSInteger)topRows
+{
+    _topRows = topRows;
+    
+    // each query of a split request reads up to the whole count; the merged result is cut back to it
+    for(TableFetchRequest* query in _queries)
+    {
+        query.topRows = topRows;
+    }
+}
+
+- (void)setResidualPredicate:(NSPredicate*)predicate
+{
+    if(predicate != _residualPredicate)
+    {
+        [_residualPredicate release];
+        _residualPredicate = [predicate retain];
+    }
+}
+
+- (BOOL)queriesOverlap
+{
+    return _queriesOverlap;
+}
+
+- (TableFetchRequest*)continuationRequestWithNextPartitionKey:(NSString*)nextPartitionKey nextRowKey:(NSString*)nextRowKey
+{
+    TableFetchRequest* request = [[[TableFetchRequest alloc] initWithTable:_tableName] autorelease];
+    
+    request.partitionKey = _partitionKey;
+    request.rowKey = _rowKey;
+    request.filter = _filter;
+    request.topRows = _topRows;
+    request.nextPartitionKey = nextPartitionKey;
+    request.nextRowKey = nextRowKey;
+    [request setResidualPredicate:_residualPredicate];
     
     return request;
 }
 
 - (NSString*)endpoint
+{
+    NSString* endpoint = [self queryEndpoint];
+    
+    if ((_partitionKey && _rowKey) || (!_nextPartitionKey && !_nextRowKey))
+    {
+        return endpoint;
+    }
+    
+    NSMutableString* continuation = [NSMutableString stringWithString:endpoint];
+    NSString* separator = ([endpoint rangeOfString:@"?"].location == NSNotFound) ? @"?" : @"&";
+    
+    if (_nextPartitionKey)
+    {
+        [continuation appendFormat:@"%@NextPartitionKey=%@", separator, [_nextPartitionKey URLEncode]];
+        separator = @"&";
+    }
+    if (_nextRowKey)
+    {
+        [continuation appendFormat:@"%@NextRowKey=%@", separator, [_nextRowKey URLEncode]];
+    }
+    
+    return continuation;
+}
+
+- (NSString*)queryEndpoint
 {
     if (_partitionKey && _rowKey)
     {
@@ -97,6 +182,10 @@
     [_partitionKey release];
     [_rowKey release];
     [_filter release];
+    [_nextPartitionKey release];
+    [_nextRowKey release];
+    [_residualPredicate release];
+    [_queries release];
     
     [super dealloc];
 }
@@ -26,5 +26,15 @@
 @property (readonly) NSURL* URL;
 /*! Container that the blob object belongs to */
 @property (readonly) BlobContainer* container;
+/*! Properties returned with the blob listing, keyed by element name (for example Content-MD5 or BlobType). */
+@property (readonly) NSDictionary* properties;
+/*! Size of the blob in bytes, or -1 if the listing did not include it. */
+@property (readonly) long long contentLength;
+/*! Content type of the blob */
+@property (readonly) NSString* contentType;
+/*! ETag of the blob */
+@property (readonly) NSString* etag;
+/*! Time the blob was last modified */
+@property (readonly) NSDate* lastModified;
 
 @end
@@ -14,6 +14,7 @@
  limitations under the License.
  */
 #import "Blob.h"
+#import "XmlHelper.h"
 
 
 @implementation Blob
@@ -21,6 +22,8 @@
 @synthesize name = _name;
 @synthesize URL = _URL;
 @synthesize container = _container;
+@synthesize properties = _properties;
+@synthesize lastModified = _lastModified;
 
 - (id)initBlobWithName:(NSString *)name URL:(NSString *)URL container:(BlobContainer*)container 
 {	
@@ -33,6 +36,32 @@
     return self;	
 }
 
+- (id)initBlobWithName:(NSString *)name URL:(NSString *)URL container:(BlobContainer*)container properties:(NSDictionary*)properties
+{
+    if ((self = [self initBlobWithName:name URL:URL container:container])) {
+        _properties = [properties retain];
+        _lastModified = [[XmlHelper parseHTTPDate:[properties objectForKey:@"Last-Modified"]] retain];
+    }
+    
+    return self;
+}
+
+- (long long)contentLength
+{
+    NSString* length = [_properties objectForKey:@"Content-Length"];
+    return length ? [length longLongValue] : -1;
+}
+
+- (NSString*)contentType
+{
+    return [_properties objectForKey:@"Content-Type"];
+}
+
+- (NSString*)etag
+{
+    return [_properties objectForKey:@"Etag"];
+}
+
 - (NSString*) description
 {
     return [NSString stringWithFormat:@"Blob { name = %@, url = %@, container = %@ }", _name, _URL, _container];
@@ -43,6 +72,8 @@
     [_name release];
     [_URL release];
     [_container release];
+    [_properties release];
+    [_lastModified release];
     [super dealloc];
 }
 
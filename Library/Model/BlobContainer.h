@@ -25,6 +25,12 @@
 @property (readonly) NSURL *URL;
 /*! Metadata associated with the blob container. */
 @property (readonly) NSString *metadata;
+/*! Properties returned with the container listing, keyed by element name. */
+@property (readonly) NSDictionary *properties;
+/*! ETag of the blob container. */
+@property (readonly) NSString *etag;
+/*! Time the blob container was last modified. */
+@property (readonly) NSDate *lastModified;
 
 /*! Intialize a new container with the name, URL, and any associated metadata */
 - (id)initContainerWithName:(NSString *)name URL:(NSString *)URL metadata:(NSString *)metadata;
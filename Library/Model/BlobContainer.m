@@ -15,12 +15,15 @@
  */
 
 #import "BlobContainer.h"
+#import "XmlHelper.h"
 
 @implementation BlobContainer
 
 @synthesize name = _name;
 @synthesize URL = _URL;
 @synthesize metadata = _metadata;
+@synthesize properties = _properties;
+@synthesize lastModified = _lastModified;
 
 - (id)initContainerWithName:(NSString *)name URL:(NSString *)URL metadata:(NSString *)metadata {
 	
@@ -32,6 +35,20 @@
     return self;
 }
 
+- (id)initContainerWithName:(NSString *)name URL:(NSString *)URL metadata:(NSString *)metadata properties:(NSDictionary *)properties
+{
+    if ((self = [self initContainerWithName:name URL:URL metadata:metadata])) {
+        _properties = [properties retain];
+        _lastModified = [[XmlHelper parseHTTPDate:[properties objectForKey:@"Last-Modified"]] retain];
+    }
+    return self;
+}
+
+- (NSString*)etag
+{
+    return [_properties objectForKey:@"Etag"];
+}
+
 - (NSString*) description
 {
     return [NSString stringWithFormat:@"BlobContainer { name = %@, url = %@, metadata = %@ }", _name, _URL, _metadata];
@@ -41,6 +58,8 @@
     [_name release];
     [_URL release];
     [_metadata release];
+    [_properties release];
+    [_lastModified release];
 
     [super dealloc];
 }
@@ -0,0 +1,71 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class Blob;
+@class BlobContainer;
+
+/*! BlobListing holds the blobs of a container listing in a compact form: every name and string property lives in one shared byte arena, each blob is a fixed-size record of offsets and native values, and repeated values such as content types are stored once. Blobs are kept in name order (by UTF-8 bytes, as the service lists them), so they can be walked in order or looked up by name with a binary search. URLs and Blob objects are only made when asked for. */
+@interface BlobListing : NSObject
+{
+    BlobContainer* _container;
+    NSString* _baseURL;
+    NSMutableData* _arena;
+    NSMutableData* _entries;
+    NSMutableData* _interned;
+    NSUInteger _internedNext;
+    NSUInteger _count;
+    NSMutableArray* _prefixes;
+    BOOL _sorted;
+}
+
+/*! The container the blobs were listed from. */
+@property (readonly) BlobContainer* container;
+/*! The number of blobs. */
+@property (readonly) NSUInteger count;
+/*! With a delimiter, the rolled-up prefixes seen in the listing, in the order they arrived. */
+@property (readonly) NSArray* prefixes;
+
+/*! The name of the blob at index. */
+- (NSString *)nameAtIndex:(NSUInteger)index;
+/*! The URL of the blob at index, made from the container URL and the name. A new URL is made on each call. */
+- (NSURL *)URLAtIndex:(NSUInteger)index;
+/*! Size of the blob at index in bytes, or -1 if the listing did not include it. */
+- (long long)contentLengthAtIndex:(NSUInteger)index;
+/*! Time the blob at index was last modified, or nil if the listing did not include it. */
+- (NSDate *)lastModifiedAtIndex:(NSUInteger)index;
+/*! ETag of the blob at index. */
+- (NSString *)etagAtIndex:(NSUInteger)index;
+/*! Content type of the blob at index. */
+- (NSString *)contentTypeAtIndex:(NSUInteger)index;
+/*! Base64 MD5 of the blob at index, if the service has one. */
+- (NSString *)contentMD5AtIndex:(NSUInteger)index;
+/*! BlockBlob, PageBlob or AppendBlob. */
+- (NSString *)blobTypeAtIndex:(NSUInteger)index;
+
+/*! The index of the blob with the given name, or NSNotFound. */
+- (NSUInteger)indexOfBlobNamed:(NSString *)name;
+/*! The indexes of the blobs whose names start with prefix; the range is empty, located where such names would go, if there are none. */
+- (NSRange)rangeOfBlobsWithPrefix:(NSString *)prefix;
+
+/*! Calls block for each blob in name order with the name's UTF-8 bytes, which are not NUL-terminated and are only valid for the duration of the call. Set *stop to YES to end early. */
+- (void)enumerateNamesUsingBlock:(void (^)(const char *name, NSUInteger length, NSUInteger index, BOOL *stop))block;
+
+/*! A Blob for the entry at index, for code written against Blob; its properties dictionary is rebuilt from the packed values. */
+- (Blob *)blobAtIndex:(NSUInteger)index;
+
+@end
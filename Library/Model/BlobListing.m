@@ -0,0 +1,406 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "BlobListing.h"
+#import "BlobListing+Private.h"
+#import "Blob.h"
+#import "BlobContainer.h"
+#import "NSString+URLEncode.h"
+#import <math.h>
+#import <time.h>
+#import <xlocale.h>
+
+@interface Blob (Private)
+
+- (id)initBlobWithName:(NSString *)name URL:(NSString *)URL container:(BlobContainer*)container properties:(NSDictionary*)properties;
+
+@end
+
+// Orders a stored name against the given bytes the way the service orders names: bytewise, shorter first on a tie.
+static int BlobListingCompare(const uint8_t* arena, BlobListingSpan span, const void* bytes, NSUInteger length)
+{
+    NSUInteger spanLength = span.length;
+    int order = memcmp(arena + span.offset, bytes, MIN(spanLength, length));
+    
+    if(order == 0 && spanLength != length)
+    {
+        order = (spanLength < length) ? -1 : 1;
+    }
+    
+    return order;
+}
+
+@implementation BlobListing
+
+@synthesize container = _container;
+@synthesize count = _count;
+@synthesize prefixes = _prefixes;
+
+- (id)initWithContainer:(BlobContainer*)container
+{
+    if((self = [super init]))
+    {
+        _container = [container retain];
+        
+        NSString* containerURL = [container.URL absoluteString];
+        if(containerURL)
+        {
+            _baseURL = [[containerURL hasSuffix:@"/"] ? containerURL : [containerURL stringByAppendingString:@"/"] copy];
+        }
+        
+        _arena = [[NSMutableData alloc] initWithCapacity:64 * 1024];
+        _entries = [[NSMutableData alloc] initWithCapacity:sizeof(BlobListingEntry) * 1024];
+        _interned = [[NSMutableData alloc] initWithLength:sizeof(BlobListingSpan) * BLOB_LISTING_INTERNED];
+        _prefixes = [[NSMutableArray alloc] initWithCapacity:10];
+        _sorted = YES;
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_container release];
+    [_baseURL release];
+    [_arena release];
+    [_entries release];
+    [_interned release];
+    [_prefixes release];
+    
+    [super dealloc];
+}
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"BlobListing { container = %@, count = %lu, arena = %lu bytes }", _container.name, (unsigned long)_count, (unsigned long)[_arena length]];
+}
+
+#pragma mark Building
+
+- (BlobListingSpan)appendBytes:(const void*)bytes length:(NSUInteger)length
+{
+    BlobListingSpan span = { [_arena length], length };
+    
+    [_arena appendBytes:bytes length:length];
+    return span;
+}
+
+- (BlobListingSpan)internBytes:(const void*)bytes length:(NSUInteger)length
+{
+    BlobListingSpan* interned = [_interned mutableBytes];
+    const uint8_t* arena = [_arena bytes];
+    
+    for(NSUInteger n = 0; n < BLOB_LISTING_INTERNED; n++)
+    {
+        if(interned[n].length == length && length > 0 && memcmp(arena + interned[n].offset, bytes, length) == 0)
+        {
+            return interned[n];
+        }
+    }
+    
+    BlobListingSpan span = [self appendBytes:bytes length:length];
+    
+    // the oldest value makes room; listings rarely have more distinct content types than this
+    interned[_internedNext] = span;
+    _internedNext = (_internedNext + 1) % BLOB_LISTING_INTERNED;
+    
+    return span;
+}
+
+- (void)addEntry:(const BlobListingEntry*)entry
+{
+    if(_sorted && _count > 0)
+    {
+        const BlobListingEntry* last = (const BlobListingEntry*)[_entries bytes] + _count - 1;
+        const uint8_t* arena = [_arena bytes];
+        
+        _sorted = (BlobListingCompare(arena, last->name, arena + entry->name.offset, entry->name.length) <= 0);
+    }
+    
+    [_entries appendBytes:entry length:sizeof(BlobListingEntry)];
+    _count++;
+}
+
+- (void)addPrefix:(NSString*)prefix
+{
+    [_prefixes addObject:prefix];
+}
+
+- (void)addEntriesFromListing:(BlobListing*)listing
+{
+    NSUInteger base = [_arena length];
+    NSUInteger first = _count;
+    
+    [_arena appendData:listing->_arena];
+    [_entries appendData:listing->_entries];
+    [_prefixes addObjectsFromArray:listing->_prefixes];
+    _count += listing->_count;
+    
+    BlobListingEntry* entries = [_entries mutableBytes];
+    for(NSUInteger index = first; index < _count; index++)
+    {
+        entries[index].name.offset += base;
+        entries[index].etag.offset += base;
+        entries[index].contentType.offset += base;
+        entries[index].contentMD5.offset += base;
+    }
+    
+    // the two runs are each in order, but not necessarily with each other
+    _sorted = NO;
+}
+
+- (void)sort
+{
+    if(_sorted)
+    {
+        return;
+    }
+    
+    const uint8_t* arena = [_arena bytes];
+    
+    qsort_b([_entries mutableBytes], _count, sizeof(BlobListingEntry), ^int(const void* a, const void* b)
+            {
+                BlobListingSpan right = ((const BlobListingEntry*)b)->name;
+                return BlobListingCompare(arena, ((const BlobListingEntry*)a)->name, arena + right.offset, right.length);
+            });
+    
+    _sorted = YES;
+}
+
+#pragma mark Reading
+
+- (const BlobListingEntry*)entryAtIndex:(NSUInteger)index
+{
+    if(index >= _count)
+    {
+        [NSException raise:NSRangeException format:@"index %lu beyond bounds [0 .. %lu]", (unsigned long)index, (unsigned long)_count];
+    }
+    
+    return (const BlobListingEntry*)[_entries bytes] + index;
+}
+
+- (NSString*)stringForSpan:(BlobListingSpan)span
+{
+    if(span.length == 0)
+    {
+        return nil;
+    }
+    
+    return [[[NSString alloc] initWithBytes:(const uint8_t*)[_arena bytes] + span.offset length:span.length encoding:NSUTF8StringEncoding] autorelease];
+}
+
+- (NSString*)nameAtIndex:(NSUInteger)index
+{
+    BlobListingSpan name = [self entryAtIndex:index]->name;
+    
+    // unlike the other values, an empty name is still a name
+    return name.length ? [self stringForSpan:name] : @"";
+}
+
+- (NSURL*)URLAtIndex:(NSUInteger)index
+{
+    if(!_baseURL)
+    {
+        return nil;
+    }
+    
+    return [NSURL URLWithString:[_baseURL stringByAppendingString:[[self nameAtIndex:index] URLEncode]]];
+}
+
+- (long long)contentLengthAtIndex:(NSUInteger)index
+{
+    return [self entryAtIndex:index]->contentLength;
+}
+
+- (NSDate*)lastModifiedAtIndex:(NSUInteger)index
+{
+    double lastModified = [self entryAtIndex:index]->lastModified;
+    return isnan(lastModified) ? nil : [NSDate dateWithTimeIntervalSinceReferenceDate:lastModified];
+}
+
+- (NSString*)etagAtIndex:(NSUInteger)index
+{
+    return [self stringForSpan:[self entryAtIndex:index]->etag];
+}
+
+- (NSString*)contentTypeAtIndex:(NSUInteger)index
+{
+    return [self stringForSpan:[self entryAtIndex:index]->contentType];
+}
+
+- (NSString*)contentMD5AtIndex:(NSUInteger)index
+{
+    return [self stringForSpan:[self entryAtIndex:index]->contentMD5];
+}
+
+- (NSString*)blobTypeAtIndex:(NSUInteger)index
+{
+    switch([self entryAtIndex:index]->blobType)
+    {
+        case BlobListingTypeBlock:
+            return @"BlockBlob";
+        case BlobListingTypePage:
+            return @"PageBlob";
+        case BlobListingTypeAppend:
+            return @"AppendBlob";
+        default:
+            return nil;
+    }
+}
+
+#pragma mark Lookup
+
+// The first index whose name orders at or after the given bytes.
+- (NSUInteger)lowerBoundForBytes:(const void*)bytes length:(NSUInteger)length
+{
+    const BlobListingEntry* entries = [_entries bytes];
+    const uint8_t* arena = [_arena bytes];
+    NSUInteger low = 0;
+    NSUInteger high = _count;
+    
+    while(low < high)
+    {
+        NSUInteger middle = low + (high - low) / 2;
+        
+        if(BlobListingCompare(arena, entries[middle].name, bytes, length) < 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    
+    return low;
+}
+
+- (NSUInteger)indexOfBlobNamed:(NSString*)name
+{
+    const char* bytes = [name UTF8String];
+    NSUInteger length = bytes ? strlen(bytes) : 0;
+    
+    if(!bytes)
+    {
+        return NSNotFound;
+    }
+    
+    NSUInteger index = [self lowerBoundForBytes:bytes length:length];
+    
+    if(index < _count && BlobListingCompare([_arena bytes], ((const BlobListingEntry*)[_entries bytes])[index].name, bytes, length) == 0)
+    {
+        return index;
+    }
+    
+    return NSNotFound;
+}
+
+- (NSRange)rangeOfBlobsWithPrefix:(NSString*)prefix
+{
+    const char* bytes = [prefix UTF8String];
+    NSUInteger length = bytes ? strlen(bytes) : 0;
+    
+    if(length == 0)
+    {
+        return NSMakeRange(0, _count);
+    }
+    
+    const BlobListingEntry* entries = [_entries bytes];
+    const uint8_t* arena = [_arena bytes];
+    NSUInteger first = [self lowerBoundForBytes:bytes length:length];
+    NSUInteger low = first;
+    NSUInteger high = _count;
+    
+    // the names that start with the prefix are the run from first on; find where it ends
+    while(low < high)
+    {
+        NSUInteger middle = low + (high - low) / 2;
+        BlobListingSpan name = entries[middle].name;
+        
+        if(name.length >= length && memcmp(arena + name.offset, bytes, length) == 0)
+        {
+            low = middle + 1;
+        }
+        else
+        {
+            high = middle;
+        }
+    }
+    
+    return NSMakeRange(first, low - first);
+}
+
+- (void)enumerateNamesUsingBlock:(void (^)(const char*, NSUInteger, NSUInteger, BOOL*))block
+{
+    const BlobListingEntry* entries = [_entries bytes];
+    const char* arena = [_arena bytes];
+    BOOL stop = NO;
+    
+    for(NSUInteger index = 0; index < _count && !stop; index++)
+    {
+        block(arena + entries[index].name.offset, entries[index].name.length, index, &stop);
+    }
+}
+
+#pragma mark Blob objects
+
+- (Blob*)blobAtIndex:(NSUInteger)index
+{
+    const BlobListingEntry* entry = [self entryAtIndex:index];
+    NSMutableDictionary* properties = [NSMutableDictionary dictionaryWithCapacity:6];
+    
+    if(entry->contentLength >= 0)
+    {
+        [properties setObject:[NSString stringWithFormat:@"%lld", (long long)entry->contentLength] forKey:@"Content-Length"];
+    }
+    
+    if(!isnan(entry->lastModified))
+    {
+        // back to the form it was listed in, which is what Blob parses
+        time_t seconds = (time_t)(entry->lastModified + NSTimeIntervalSince1970);
+        struct tm components;
+        char date[40];
+        
+        gmtime_r(&seconds, &components);
+        strftime_l(date, sizeof(date), "%a, %d %b %Y %H:%M:%S GMT", &components, NULL);
+        [properties setObject:[NSString stringWithUTF8String:date] forKey:@"Last-Modified"];
+    }
+    
+    NSString* value;
+    if((value = [self etagAtIndex:index]))
+    {
+        [properties setObject:value forKey:@"Etag"];
+    }
+    if((value = [self contentTypeAtIndex:index]))
+    {
+        [properties setObject:value forKey:@"Content-Type"];
+    }
+    if((value = [self contentMD5AtIndex:index]))
+    {
+        [properties setObject:value forKey:@"Content-MD5"];
+    }
+    if((value = [self blobTypeAtIndex:index]))
+    {
+        [properties setObject:value forKey:@"BlobType"];
+    }
+    
+    NSURL* URL = [self URLAtIndex:index];
+    Blob* blob = [[Blob alloc] initBlobWithName:[self nameAtIndex:index] URL:[URL absoluteString] container:_container properties:properties];
+    
+    return [blob autorelease];
+}
+
+@end
@@ -39,6 +39,13 @@
 }
 
 
+- (void)setPopReceipt:(NSString *)popReceipt timeNextVisible:(NSString *)timeNextVisible {
+    [_popReceipt autorelease];
+    _popReceipt = [popReceipt retain];
+    [_timeNextVisible autorelease];
+    _timeNextVisible = [timeNextVisible retain];
+}
+
 - (NSString*) description {
     return [NSString stringWithFormat:@"QueueMessage { messageId = %@, insertionTime = %@, expirationTime = %@, popReceipt = %@, timeNextVisible = %@, messageText = %@ }", _messageId, _insertionTime, _expirationTime, _popReceipt, _timeNextVisible, _messageText];
 }
@@ -16,6 +16,8 @@
 
 #import "TableEntity.h"
 #import "NSString+URLEncode.h"
+#import "EdmValue.h"
+#import "JsonWriter.h"
 
 @implementation TableEntity
 
@@ -34,12 +36,10 @@
         _rowKey = [[_dictionary objectForKey:@"RowKey"] retain];
         
         NSString* timeStamp = [_dictionary valueForKey:@"Timestamp"];        
-        if(timeStamp)
+        NSTimeInterval interval;
+        if(timeStamp && EdmParseDateTime([timeStamp UTF8String], [timeStamp lengthOfBytesUsingEncoding:NSUTF8StringEncoding], &interval))
         {
-            NSDateFormatter *dateFormat = [[NSDateFormatter alloc] init];
-            [dateFormat setDateFormat:@"yyyy-MM-dd'T'HH:mm:ss.SSSSSSS'Z'"];
-            _timeStamp = [[dateFormat dateFromString:timeStamp] retain];
-            [dateFormat release];
+            _timeStamp = [[NSDate alloc] initWithTimeIntervalSinceReferenceDate:interval];
         }
         
         [_dictionary removeObjectsForKeys:[NSArray arrayWithObjects:@"PartitionKey", @"RowKey", @"Timestamp", nil]];
@@ -84,6 +84,14 @@
     return [_dictionary setObject:value forKey:key];
 }
 
+// Whether values go out with their EDM type. A plain entity sends every value as its description,
+// which the service stores as a string; rows read into a TableResultSet override this so their
+// typed columns round-trip through an update.
+- (BOOL)writesTypedValues
+{
+    return NO;
+}
+
 - (NSString*)propertyString
 {
     if(!_partitionKey || !_rowKey)
@@ -98,15 +106,85 @@
 
     if(_dictionary.count)
     {
+        BOOL typed = [self writesTypedValues];
+        
         for (NSString *nextKey in [_dictionary allKeys])
         {
-			[properties appendFormat:@"<d:%@>%@</d:%@>", nextKey, [_dictionary valueForKey:nextKey], nextKey];
+            TableColumnType type = TableColumnTypeString;
+            id object = [_dictionary valueForKey:nextKey];
+            NSString* value = typed ? EdmStringForValue(object, &type) : [object description];
+            
+            if(!value)
+            {
+                return nil;
+            }
+            
+            if(type == TableColumnTypeString)
+            {
+                [properties appendFormat:@"<d:%@>%@</d:%@>", nextKey, value, nextKey];
+            }
+            else
+            {
+                [properties appendFormat:@"<d:%@ m:type=\"%@\">%@</d:%@>", nextKey, EdmNameForType(type), value, nextKey];
+            }
         }
     }
 
     return [[properties copy] autorelease];
 }
 
+- (NSData*)jsonBody
+{
+    if(!_partitionKey || !_rowKey)
+    {
+        return nil;
+    }
+    
+    JsonWriter* writer = [[[JsonWriter alloc] init] autorelease];
+    
+    [writer beginObject];
+    [writer writeKey:@"PartitionKey"];
+    [writer writeString:_partitionKey];
+    [writer writeKey:@"RowKey"];
+    [writer writeString:_rowKey];
+    
+    BOOL typed = [self writesTypedValues];
+    
+    for (NSString *nextKey in _dictionary)
+    {
+        TableColumnType type = TableColumnTypeString;
+        id object = [_dictionary valueForKey:nextKey];
+        NSString* value = typed ? EdmStringForValue(object, &type) : [object description];
+        
+        if(!value)
+        {
+            return nil;
+        }
+        
+        // without metadata the service infers Edm.Int32, Edm.Boolean or Edm.String from a bare
+        // value; anything else needs an annotation saying what it is
+        if(type != TableColumnTypeString && type != TableColumnTypeInt32 && type != TableColumnTypeBoolean)
+        {
+            [writer writeKey:[nextKey stringByAppendingString:@"@odata.type"]];
+            [writer writeString:EdmNameForType(type)];
+        }
+        
+        [writer writeKey:nextKey];
+        if(type == TableColumnTypeInt32 || type == TableColumnTypeBoolean || (type == TableColumnTypeDouble && isfinite([value doubleValue])))
+        {
+            [writer writeLiteral:value];
+        }
+        else
+        {
+            [writer writeString:value];
+        }
+    }
+    
+    [writer endObject];
+    
+    return writer.data;
+}
+
 - (NSString*)endpoint
 {
     if(!_tableName || !_partitionKey || !_rowKey)
@@ -0,0 +1,79 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class TableEntity;
+
+/*! The native type a table property is stored as, taken from its m:type on the wire. */
+typedef enum
+{
+    TableColumnTypeString = 0,
+    TableColumnTypeInt32,
+    TableColumnTypeInt64,
+    TableColumnTypeDouble,
+    TableColumnTypeBoolean,
+    TableColumnTypeDateTime,
+    TableColumnTypeGuid,
+    TableColumnTypeBinary
+} TableColumnType;
+
+/*! TableResultSet holds the entities of a table query column by column: each property is one contiguous array of native values with a validity bitmap, so scans over a property don't touch any objects. A property that comes back with more than one type has one column per type under the same name. */
+@interface TableResultSet : NSObject
+{
+    NSString* _tableName;
+    NSUInteger _count;
+    NSMutableArray* _columnNames;
+    NSMutableDictionary* _columnsByName;
+}
+
+/*! The name of the table the entities were read from. */
+@property (readonly) NSString* tableName;
+/*! The number of entities (rows). */
+@property (readonly) NSUInteger count;
+/*! The property names seen in any entity, in the order they first appeared. Shared by every row. */
+@property (readonly) NSArray* columnNames;
+
+/*! The type a property was first seen with. */
+- (TableColumnType)typeOfColumn:(NSString *)name;
+
+/*! Returns YES if the entity at row has a non-null value for the property. */
+- (BOOL)hasValueInColumn:(NSString *)name row:(NSUInteger)row;
+/*! One bit per row, least significant bit first, set where the property of the given type has a value. Returns NULL if there is no such column. */
+- (const uint8_t *)validityOfColumn:(NSString *)name type:(TableColumnType)type;
+
+/*! The values of an Edm.Int32 property, one per row; rows without a value read as 0. Returns NULL if there is no such column. The array lives as long as the result set. */
+- (const int32_t *)int32ValuesOfColumn:(NSString *)name;
+/*! The values of an Edm.Int64 property, one per row. */
+- (const int64_t *)int64ValuesOfColumn:(NSString *)name;
+/*! The values of an Edm.Double property, one per row. */
+- (const double *)doubleValuesOfColumn:(NSString *)name;
+/*! The values of an Edm.Boolean property, one per row. */
+- (const BOOL *)booleanValuesOfColumn:(NSString *)name;
+/*! The values of an Edm.DateTime property as seconds since the reference date, one per row. */
+- (const NSTimeInterval *)dateTimeValuesOfColumn:(NSString *)name;
+/*! The values of an Edm.Guid property, 16 bytes per row. */
+- (const uint8_t *)guidValuesOfColumn:(NSString *)name;
+
+/*! The string value of a property at row, or nil if it has none. */
+- (NSString *)stringInColumn:(NSString *)name row:(NSUInteger)row;
+/*! The value of a property at row as an object: NSString, NSNumber, NSDate, NSUUID or NSData, or nil if it has none. */
+- (id)valueInColumn:(NSString *)name row:(NSUInteger)row;
+
+/*! A TableEntity reading its values from the row, for code written against entities. Values are only copied out of the columns if the entity is changed. */
+- (TableEntity *)entityAtIndex:(NSUInteger)index;
+
+@end
@@ -0,0 +1,564 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TableResultSet.h"
+#import "TableResultSet+Private.h"
+#import "TableEntity.h"
+
+@interface TableEntity (Private)
+
+- (id)initWithDictionary:(NSMutableDictionary*)dictionary fromTable:(NSString*)tableName;
+- (BOOL)writesTypedValues;
+- (NSString*)propertyString;
+- (NSData*)jsonBody;
+- (NSString*)endpoint;
+
+@end
+
+#pragma mark -
+
+// A TableEntity over one row of a result set. Until something changes it, _dictionary stays nil
+// and every read goes to the columns; the first change copies the row out and from then on it
+// behaves like any other entity.
+@interface TableRowEntity : TableEntity
+{
+    TableResultSet* _results;
+    NSUInteger _row;
+}
+
+- (id)initWithResultSet:(TableResultSet*)results row:(NSUInteger)row;
+
+@end
+
+#pragma mark -
+
+@implementation TableColumn
+
+- (id)initWithName:(NSString*)name type:(TableColumnType)type
+{
+    if((self = [super init]))
+    {
+        _name = [name copy];
+        _type = type;
+        
+        switch(type)
+        {
+            case TableColumnTypeInt32:
+                _width = sizeof(int32_t);
+                break;
+            case TableColumnTypeInt64:
+                _width = sizeof(int64_t);
+                break;
+            case TableColumnTypeDouble:
+                _width = sizeof(double);
+                break;
+            case TableColumnTypeBoolean:
+                _width = sizeof(BOOL);
+                break;
+            case TableColumnTypeDateTime:
+                _width = sizeof(NSTimeInterval);
+                break;
+            case TableColumnTypeGuid:
+                _width = 16;
+                break;
+            default:
+                _width = sizeof(TableColumnSpan);
+                _heap = [[NSMutableData alloc] initWithCapacity:1024];
+                break;
+        }
+        
+        _values = [[NSMutableData alloc] initWithCapacity:_width * 64];
+        _validity = [[NSMutableData alloc] initWithCapacity:8];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_name release];
+    [_values release];
+    [_validity release];
+    [_heap release];
+    
+    [super dealloc];
+}
+
+- (BOOL)hasValueAtRow:(NSUInteger)row
+{
+    if(row / 8 >= [_validity length])
+    {
+        return NO;
+    }
+    
+    return (((const uint8_t*)[_validity bytes])[row / 8] >> (row % 8)) & 1;
+}
+
+- (void*)slotForRow:(NSUInteger)row
+{
+    if([_values length] < (row + 1) * _width)
+    {
+        [_values setLength:(row + 1) * _width];
+    }
+    
+    if([_validity length] <= row / 8)
+    {
+        [_validity setLength:row / 8 + 1];
+    }
+    
+    ((uint8_t*)[_validity mutableBytes])[row / 8] |= (uint8_t)(1 << (row % 8));
+    
+    return (uint8_t*)[_values mutableBytes] + row * _width;
+}
+
+- (void)setBytes:(const void*)bytes length:(NSUInteger)length forRow:(NSUInteger)row
+{
+    TableColumnSpan span = { [_heap length], length };
+    
+    [_heap appendBytes:bytes length:length];
+    memcpy([self slotForRow:row], &span, sizeof(span));
+}
+
+- (void)padToCount:(NSUInteger)count
+{
+    if([_values length] < count * _width)
+    {
+        [_values setLength:count * _width];
+    }
+    
+    if([_validity length] < (count + 7) / 8)
+    {
+        [_validity setLength:(count + 7) / 8];
+    }
+}
+
+- (void)truncateToCount:(NSUInteger)count
+{
+    if([_values length] > count * _width)
+    {
+        [_values setLength:count * _width];
+    }
+    
+    if([_validity length] > (count + 7) / 8)
+    {
+        [_validity setLength:(count + 7) / 8];
+    }
+    
+    // clear the bits of the dropped rows that share the last byte
+    if(count % 8 && [_validity length] == (count + 7) / 8)
+    {
+        ((uint8_t*)[_validity mutableBytes])[count / 8] &= (uint8_t)((1 << (count % 8)) - 1);
+    }
+}
+
+- (id)valueAtRow:(NSUInteger)row
+{
+    if(![self hasValueAtRow:row])
+    {
+        return nil;
+    }
+    
+    const void* slot = (const uint8_t*)[_values bytes] + row * _width;
+    const TableColumnSpan* span = slot;
+    
+    switch(_type)
+    {
+        case TableColumnTypeInt32:
+            return [NSNumber numberWithInt:*(const int32_t*)slot];
+        case TableColumnTypeInt64:
+            return [NSNumber numberWithLongLong:*(const int64_t*)slot];
+        case TableColumnTypeDouble:
+            return [NSNumber numberWithDouble:*(const double*)slot];
+        case TableColumnTypeBoolean:
+            return [NSNumber numberWithBool:*(const BOOL*)slot];
+        case TableColumnTypeDateTime:
+            return [NSDate dateWithTimeIntervalSinceReferenceDate:*(const NSTimeInterval*)slot];
+        case TableColumnTypeGuid:
+            return [[[NSUUID alloc] initWithUUIDBytes:slot] autorelease];
+        case TableColumnTypeBinary:
+            return [NSData dataWithBytes:(const uint8_t*)[_heap bytes] + span->offset length:span->length];
+        default:
+            return [[[NSString alloc] initWithBytes:(const uint8_t*)[_heap bytes] + span->offset length:span->length encoding:NSUTF8StringEncoding] autorelease];
+    }
+}
+
+@end
+
+#pragma mark -
+
+@implementation TableResultSet
+
+@synthesize tableName = _tableName;
+@synthesize count = _count;
+@synthesize columnNames = _columnNames;
+
+- (id)initWithTableName:(NSString*)tableName
+{
+    if((self = [super init]))
+    {
+        _tableName = [tableName copy];
+        _columnNames = [[NSMutableArray alloc] initWithCapacity:16];
+        _columnsByName = [[NSMutableDictionary alloc] initWithCapacity:16];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_tableName release];
+    [_columnNames release];
+    [_columnsByName release];
+    
+    [super dealloc];
+}
+
+- (NSString*)description
+{
+    return [NSString stringWithFormat:@"TableResultSet { tableName = %@, count = %lu, columns = %@ }", _tableName, (unsigned long)_count, _columnNames];
+}
+
+#pragma mark Building
+
+- (NSUInteger)addRow
+{
+    return _count++;
+}
+
+- (TableColumn*)columnNamed:(NSString*)name type:(TableColumnType)type
+{
+    NSMutableArray* columns = [_columnsByName objectForKey:name];
+    
+    for(TableColumn* column in columns)
+    {
+        if(column->_type == type)
+        {
+            return column;
+        }
+    }
+    
+    if(!columns)
+    {
+        columns = [NSMutableArray arrayWithCapacity:1];
+        [_columnsByName setObject:columns forKey:name];
+        [_columnNames addObject:name];
+    }
+    
+    TableColumn* column = [[TableColumn alloc] initWithName:name type:type];
+    [columns addObject:column];
+    [column release];
+    
+    return column;
+}
+
+- (void)truncateToCount:(NSUInteger)count
+{
+    if(count >= _count)
+    {
+        return;
+    }
+    
+    for(NSArray* columns in [_columnsByName allValues])
+    {
+        for(TableColumn* column in columns)
+        {
+            [column truncateToCount:count];
+        }
+    }
+    _count = count;
+}
+
+#pragma mark Reading
+
+- (TableColumn*)existingColumnNamed:(NSString*)name type:(TableColumnType)type
+{
+    for(TableColumn* column in [_columnsByName objectForKey:name])
+    {
+        if(column->_type == type)
+        {
+            return column;
+        }
+    }
+    
+    return nil;
+}
+
+- (const void*)valuesOfColumn:(NSString*)name type:(TableColumnType)type
+{
+    TableColumn* column = [self existingColumnNamed:name type:type];
+    
+    if(!column)
+    {
+        return NULL;
+    }
+    
+    [column padToCount:_count];
+    return [column->_values bytes];
+}
+
+- (TableColumnType)typeOfColumn:(NSString*)name
+{
+    TableColumn* column = [[_columnsByName objectForKey:name] objectAtIndex:0];
+    
+    return column ? column->_type : TableColumnTypeString;
+}
+
+- (BOOL)hasValueInColumn:(NSString*)name row:(NSUInteger)row
+{
+    for(TableColumn* column in [_columnsByName objectForKey:name])
+    {
+        if([column hasValueAtRow:row])
+        {
+            return YES;
+        }
+    }
+    
+    return NO;
+}
+
+- (const uint8_t*)validityOfColumn:(NSString*)name type:(TableColumnType)type
+{
+    TableColumn* column = [self existingColumnNamed:name type:type];
+    
+    if(!column)
+    {
+        return NULL;
+    }
+    
+    [column padToCount:_count];
+    return [column->_validity bytes];
+}
+
+- (const int32_t*)int32ValuesOfColumn:(NSString*)name
+{
+    return [self valuesOfColumn:name type:TableColumnTypeInt32];
+}
+
+- (const int64_t*)int64ValuesOfColumn:(NSString*)name
+{
+    return [self valuesOfColumn:name type:TableColumnTypeInt64];
+}
+
+- (const double*)doubleValuesOfColumn:(NSString*)name
+{
+    return [self valuesOfColumn:name type:TableColumnTypeDouble];
+}
+
+- (const BOOL*)booleanValuesOfColumn:(NSString*)name
+{
+    return [self valuesOfColumn:name type:TableColumnTypeBoolean];
+}
+
+- (const NSTimeInterval*)dateTimeValuesOfColumn:(NSString*)name
+{
+    return [self valuesOfColumn:name type:TableColumnTypeDateTime];
+}
+
+- (const uint8_t*)guidValuesOfColumn:(NSString*)name
+{
+    return [self valuesOfColumn:name type:TableColumnTypeGuid];
+}
+
+- (NSString*)stringInColumn:(NSString*)name row:(NSUInteger)row
+{
+    TableColumn* column = [self existingColumnNamed:name type:TableColumnTypeString];
+    
+    return [column valueAtRow:row];
+}
+
+- (id)valueInColumn:(NSString*)name row:(NSUInteger)row
+{
+    for(TableColumn* column in [_columnsByName objectForKey:name])
+    {
+        id value = [column valueAtRow:row];
+        if(value)
+        {
+            return value;
+        }
+    }
+    
+    return nil;
+}
+
+- (TableEntity*)entityAtIndex:(NSUInteger)index
+{
+    if(index >= _count)
+    {
+        return nil;
+    }
+    
+    return [[[TableRowEntity alloc] initWithResultSet:self row:index] autorelease];
+}
+
+@end
+
+#pragma mark -
+
+@implementation TableRowEntity
+
+- (id)initWithResultSet:(TableResultSet*)results row:(NSUInteger)row
+{
+    if((self = [super initWithDictionary:nil fromTable:results.tableName]))
+    {
+        _results = [results retain];
+        _row = row;
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_results release];
+    
+    [super dealloc];
+}
+
+- (BOOL)isSystemKey:(NSString*)key
+{
+    return [key isEqualToString:@"PartitionKey"] || [key isEqualToString:@"RowKey"] || [key isEqualToString:@"Timestamp"];
+}
+
+- (void)materialize
+{
+    if(_dictionary)
+    {
+        return;
+    }
+    
+    _dictionary = [[NSMutableDictionary alloc] initWithCapacity:_results.columnNames.count];
+    
+    for(NSString* name in _results.columnNames)
+    {
+        id value = [_results valueInColumn:name row:_row];
+        if(value)
+        {
+            [_dictionary setObject:value forKey:name];
+        }
+    }
+    
+    _partitionKey = [[_results stringInColumn:@"PartitionKey" row:_row] copy];
+    _rowKey = [[_results stringInColumn:@"RowKey" row:_row] copy];
+    
+    id timeStamp = [_dictionary objectForKey:@"Timestamp"];
+    if([timeStamp isKindOfClass:[NSDate class]])
+    {
+        _timeStamp = [timeStamp retain];
+    }
+    
+    [_dictionary removeObjectsForKeys:[NSArray arrayWithObjects:@"PartitionKey", @"RowKey", @"Timestamp", nil]];
+}
+
+- (NSString*)description
+{
+    [self materialize];
+    return [super description];
+}
+
+- (NSString*)partitionKey
+{
+    return _dictionary ? [super partitionKey] : [_results stringInColumn:@"PartitionKey" row:_row];
+}
+
+- (void)setPartitionKey:(NSString*)partitionKey
+{
+    [self materialize];
+    [super setPartitionKey:partitionKey];
+}
+
+- (NSString*)rowKey
+{
+    return _dictionary ? [super rowKey] : [_results stringInColumn:@"RowKey" row:_row];
+}
+
+- (void)setRowKey:(NSString*)rowKey
+{
+    [self materialize];
+    [super setRowKey:rowKey];
+}
+
+- (NSDate*)timeStamp
+{
+    if(_dictionary)
+    {
+        return [super timeStamp];
+    }
+    
+    id timeStamp = [_results valueInColumn:@"Timestamp" row:_row];
+    return [timeStamp isKindOfClass:[NSDate class]] ? timeStamp : nil;
+}
+
+- (NSArray*)keys
+{
+    if(_dictionary)
+    {
+        return [super keys];
+    }
+    
+    NSMutableArray* keys = [NSMutableArray arrayWithCapacity:_results.columnNames.count];
+    
+    for(NSString* name in _results.columnNames)
+    {
+        if(![self isSystemKey:name] && [_results hasValueInColumn:name row:_row])
+        {
+            [keys addObject:name];
+        }
+    }
+    
+    return keys;
+}
+
+- (id)valueForKey:(NSString*)key
+{
+    if(_dictionary)
+    {
+        return [super valueForKey:key];
+    }
+    
+    return [self isSystemKey:key] ? nil : [_results valueInColumn:key row:_row];
+}
+
+- (void)setValue:(id)value forKey:(NSString*)key
+{
+    [self materialize];
+    [super setValue:value forKey:key];
+}
+
+- (BOOL)writesTypedValues
+{
+    // the columns carry the types the service sent, so they go back the same way
+    return YES;
+}
+
+- (NSString*)propertyString
+{
+    [self materialize];
+    return [super propertyString];
+}
+
+- (NSData*)jsonBody
+{
+    [self materialize];
+    return [super jsonBody];
+}
+
+- (NSString*)endpoint
+{
+    [self materialize];
+    return [super endpoint];
+}
+
+@end
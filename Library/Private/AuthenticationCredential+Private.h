@@ -18,15 +18,29 @@
 #import "AuthenticationCredential.h"
 #import "CloudURLRequest.h"
 
+@class SharedAccessSignature;
+
 @interface AuthenticationCredential (Private)
 
 - (NSURL*)URLforEndpoint:(NSString *)endpoint forStorageType:(NSString *)storageType;
 - (CloudURLRequest *)authenticatedRequestWithEndpoint:(NSString *)endpoint forStorageType:(NSString *)storageType, ... NS_REQUIRES_NIL_TERMINATION;
 - (CloudURLRequest *)authenticatedRequestWithEndpoint:(NSString *)endpoint forStorageType:(NSString *)storageType httpMethod:(NSString*)httpMethod, ... NS_REQUIRES_NIL_TERMINATION;
 - (CloudURLRequest *)authenticatedRequestWithEndpoint:(NSString *)endpoint forStorageType:(NSString *)storageType httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType, ... NS_REQUIRES_NIL_TERMINATION;
+// As above, with further x-ms-* headers whose names aren't known until run time, such as blob metadata.
+// Returns nil when there are more headers than can be signed, as the service would refuse the request.
+- (CloudURLRequest *)authenticatedRequestWithEndpoint:(NSString *)endpoint forStorageType:(NSString *)storageType httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType headers:(NSDictionary *)headers, ... NS_REQUIRES_NIL_TERMINATION;
 
 - (CloudURLRequest *)authenticatedBlobRequestWithURL:(NSURL *)serviceURL forStorageType:(NSString *)storageType, ... NS_REQUIRES_NIL_TERMINATION;
 - (CloudURLRequest *)authenticatedBlobRequestWithURL:(NSURL *)serviceURL forStorageType:(NSString *)storageType httpMethod:(NSString*)httpMethod, ... NS_REQUIRES_NIL_TERMINATION;
 - (CloudURLRequest *)authenticatedBlobRequestWithURL:(NSURL *)serviceURL forStorageType:(NSString *)storageType httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType, ... NS_REQUIRES_NIL_TERMINATION;
 
+// Through the proxy, blob requests can skip the extra hop and go to the storage service directly under a
+// SAS for their container. The block receives a signature with time left to run, or nil when there is none
+// to be had (or the credential signs requests itself) and the request should be made as before. A cached
+// signature is handed over right away and replaced in the background ahead of its expiry while the
+// container stays in use; otherwise the block runs once the proxy has answered.
+- (void)sharedAccessSignatureForContainer:(NSString *)containerName withBlock:(void (^)(SharedAccessSignature *))block;
+// A request for endpoint on the blob service the signature was issued for; the signature is its only authorization.
+- (CloudURLRequest *)authenticatedRequestWithEndpoint:(NSString *)endpoint signature:(SharedAccessSignature *)signature httpMethod:(NSString*)httpMethod contentData:(NSData *)contentData contentType:(NSString*)contentType, ... NS_REQUIRES_NIL_TERMINATION;
+
 @end
\ No newline at end of file
@@ -15,11 +15,30 @@
  */
 
 #import <Foundation/Foundation.h>
+#include <sys/types.h>
+
+// The codec behind SimpleBase64, for callers that bring their own buffers. Whole blocks go through
+// an SSSE3 or AVX2 kernel picked at first use on x86, or NEON on arm64, and the remainder through
+// a table-driven scalar loop.
+
+// The number of characters the encoding of length bytes takes, padding included.
+size_t Base64EncodedLength(size_t length);
+// Writes Base64EncodedLength(length) characters to output, without a terminator, and returns that count.
+size_t Base64Encode(const uint8_t* input, size_t length, char* output);
+// Decodes padded base64 into output, which needs room for length / 4 * 3 bytes. Returns the number
+// of bytes written, or -1 if the length isn't a multiple of 4 or a character is outside the alphabet.
+ssize_t Base64Decode(const char* input, size_t length, uint8_t* output);
+
+// The scalar loops on their own, for comparison with the vector kernels.
+size_t Base64EncodeScalar(const uint8_t* input, size_t length, char* output);
+ssize_t Base64DecodeScalar(const char* input, size_t length, uint8_t* output);
 
 
 @interface SimpleBase64 : NSObject
 
 + (NSString*) encode:(NSData*) rawBytes;
++ (NSString*) encode:(const uint8_t*) input length:(NSInteger) length;
 + (NSData*) decode:(NSString*) string;
++ (NSData*) decode:(const char*) string length:(NSInteger) length;
 
 @end
@@ -15,156 +15,484 @@
  */
 
 #import "SimpleBase64.h"
+#include <dispatch/dispatch.h>
 
-static char ByteEncode(uint8_t byte);
-static uint8_t ByteDecode(char c);
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BASE64_X86 1
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#define BASE64_NEON 1
+#endif
 
-@implementation SimpleBase64
+static const char EncodeTable[64] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
 
-+ (NSString*) encode:(const uint8_t*) input length:(NSInteger) length 
+// 0xFF marks characters outside the alphabet, '=' included; valid entries never have the top two bits set
+static const uint8_t DecodeTable[256] =
+{
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,   62, 0xFF, 0xFF, 0xFF,   63,
+	  52,   53,   54,   55,   56,   57,   58,   59,   60,   61, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF,    0,    1,    2,    3,    4,    5,    6,    7,    8,    9,   10,   11,   12,   13,   14,
+	  15,   16,   17,   18,   19,   20,   21,   22,   23,   24,   25, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF,   26,   27,   28,   29,   30,   31,   32,   33,   34,   35,   36,   37,   38,   39,   40,
+	  41,   42,   43,   44,   45,   46,   47,   48,   49,   50,   51, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+	0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF
+};
+
+#pragma mark Scalar
+
+size_t Base64EncodedLength(size_t length)
 {
-	if(!length)
+	return (length + 2) / 3 * 4;
+}
+
+size_t Base64EncodeScalar(const uint8_t* input, size_t length, char* output)
+{
+	char* start = output;
+	size_t i = 0;
+	
+	for(; i + 3 <= length; i += 3)
 	{
-		return @"";
+		uint32_t triple = ((uint32_t)input[i] << 16) | ((uint32_t)input[i + 1] << 8) | input[i + 2];
+		
+		output[0] = EncodeTable[triple >> 18];
+		output[1] = EncodeTable[(triple >> 12) & 0x3F];
+		output[2] = EncodeTable[(triple >> 6) & 0x3F];
+		output[3] = EncodeTable[triple & 0x3F];
+		output += 4;
 	}
 	
-	char* output = malloc(1 + ((length + 2) / 3) * 4);
-	char* ptr = output;
-	
-	for(int i = 0; i < length; i += 3)
+	if(i < length)
 	{
-		uint8_t src1, src2, src3;
+		uint32_t triple = (uint32_t)input[i] << 16;
+		if(i + 1 < length)
+		{
+			triple |= (uint32_t)input[i + 1] << 8;
+		}
 		
-		src1 = input[i];
-		src2 = (i + 1 < length) ? input[i + 1] : 0;
-		src3 = (i + 2 < length) ? input[i + 2] : 0;
+		output[0] = EncodeTable[triple >> 18];
+		output[1] = EncodeTable[(triple >> 12) & 0x3F];
+		output[2] = (i + 1 < length) ? EncodeTable[(triple >> 6) & 0x3F] : '=';
+		output[3] = '=';
+		output += 4;
+	}
+	
+	return output - start;
+}
+
+ssize_t Base64DecodeScalar(const char* string, size_t length, uint8_t* output)
+{
+	const uint8_t* input = (const uint8_t*)string;
+	uint8_t* start = output;
+	
+	if(length % 4)
+	{
+		return -1;
+	}
+	
+	for(size_t i = 0; i < length; i += 4)
+	{
+		uint32_t a = DecodeTable[input[i]];
+		uint32_t b = DecodeTable[input[i + 1]];
+		uint32_t c = DecodeTable[input[i + 2]];
+		uint32_t d = DecodeTable[input[i + 3]];
 		
-		uint8_t dest1, dest2, dest3, dest4;
+		if(i + 4 == length && input[i + 3] == '=')
+		{
+			// one or two bytes in the final, padded quad
+			if(input[i + 2] == '=')
+			{
+				c = 0;
+			}
+			if((a | b | c) & 0xC0)
+			{
+				return -1;
+			}
+			
+			*output++ = (uint8_t)((a << 2) | (b >> 4));
+			if(input[i + 2] != '=')
+			{
+				*output++ = (uint8_t)((b << 4) | (c >> 2));
+			}
+			break;
+		}
 		
-		dest1 = src1 >> 2;
-		dest2 = ((src1 & 0x3) << 4) | (src2 >> 4);
-		dest3 = ((src2 & 0xF) << 2) | (src3 >> 6);
-		dest4 = src3 & 0x3F;
+		if((a | b | c | d) & 0xC0)
+		{
+			return -1;
+		}
 		
-		*ptr++ = ByteEncode(dest1);
-		*ptr++ = ByteEncode(dest2);
-		*ptr++ = (i + 1 < length) ? ByteEncode(dest3) : '=';
-		*ptr++ = (i + 2 < length) ? ByteEncode(dest4) : '=';
+		uint32_t triple = (a << 18) | (b << 12) | (c << 6) | d;
+		output[0] = (uint8_t)(triple >> 16);
+		output[1] = (uint8_t)(triple >> 8);
+		output[2] = (uint8_t)triple;
+		output += 3;
 	}
+	
+	return output - start;
+}
+
+#pragma mark Vector kernels
+
+// Each kernel handles whole blocks from the front of its input and returns how much it consumed
+// (input bytes for encoding, characters for decoding); the scalar loop finishes the rest. A decode
+// kernel stops in front of a block with a character outside the alphabet and leaves the scalar
+// loop to reject it.
+typedef size_t (*EncodeKernel)(const uint8_t* input, size_t length, char* output);
+typedef size_t (*DecodeKernel)(const uint8_t* input, size_t length, uint8_t* output);
 
-	*ptr++ = 0;
+static size_t EncodeNone(const uint8_t* input, size_t length, char* output)
+{
+	return 0;
+}
+
+static size_t DecodeNone(const uint8_t* input, size_t length, uint8_t* output)
+{
+	return 0;
+}
+
+#if BASE64_X86
+
+// 12 bytes to 16 characters per lane (Muła's pshufb method): spread each 3 bytes over 4 lanes of
+// 6 bits, then turn each 6 bit index into its character by adding an offset picked by range.
+#define ENCODE_LANES(BITS, PREFIX, in)                                                                            \
+({                                                                                                                \
+	__m##BITS##i spread = PREFIX##_shuffle_epi8(in, PREFIX##_setr_epi8(SHUFFLE_ENCODE));                      \
+	__m##BITS##i high = PREFIX##_mulhi_epu16(PREFIX##_and_si##BITS(spread, PREFIX##_set1_epi32(0x0FC0FC00)),   \
+	                                         PREFIX##_set1_epi32(0x04000040));                                 \
+	__m##BITS##i low = PREFIX##_mullo_epi16(PREFIX##_and_si##BITS(spread, PREFIX##_set1_epi32(0x003F03F0)),    \
+	                                        PREFIX##_set1_epi32(0x01000010));                                  \
+	__m##BITS##i indices = PREFIX##_or_si##BITS(high, low);                                                    \
+	__m##BITS##i range = PREFIX##_subs_epu8(indices, PREFIX##_set1_epi8(51));                                  \
+	range = PREFIX##_or_si##BITS(range, PREFIX##_and_si##BITS(PREFIX##_cmpgt_epi8(PREFIX##_set1_epi8(26), indices), \
+	                                                          PREFIX##_set1_epi8(13)));                        \
+	PREFIX##_add_epi8(indices, PREFIX##_shuffle_epi8(PREFIX##_setr_epi8(SHIFT_ENCODE), range));                \
+})
+
+// 16 characters to 12 bytes per lane: classify each character by its nibbles to validate it and
+// find its offset, then pack the 6 bit values with two multiply-adds. Evaluates to NO if a
+// character is outside the alphabet.
+#define DECODE_LANES(BITS, PREFIX, in, packed)                                                                    \
+({                                                                                                                \
+	__m##BITS##i highNibble = PREFIX##_and_si##BITS(PREFIX##_srli_epi32(in, 4), PREFIX##_set1_epi8(0x0F));      \
+	__m##BITS##i lowNibble = PREFIX##_and_si##BITS(in, PREFIX##_set1_epi8(0x0F));                               \
+	__m##BITS##i lo = PREFIX##_shuffle_epi8(PREFIX##_setr_epi8(LOW_NIBBLE_CLASSES), lowNibble);                \
+	__m##BITS##i hi = PREFIX##_shuffle_epi8(PREFIX##_setr_epi8(HIGH_NIBBLE_CLASSES), highNibble);              \
+	BOOL valid = PREFIX##_movemask_epi8(PREFIX##_cmpgt_epi8(PREFIX##_and_si##BITS(lo, hi), PREFIX##_setzero_si##BITS())) == 0; \
+	__m##BITS##i slash = PREFIX##_cmpeq_epi8(in, PREFIX##_set1_epi8('/'));                                      \
+	__m##BITS##i values = PREFIX##_add_epi8(in, PREFIX##_shuffle_epi8(PREFIX##_setr_epi8(SHIFT_DECODE),         \
+	                                                                 PREFIX##_add_epi8(slash, highNibble)));    \
+	__m##BITS##i pairs = PREFIX##_maddubs_epi16(values, PREFIX##_set1_epi32(0x01400140));                     \
+	packed = PREFIX##_shuffle_epi8(PREFIX##_madd_epi16(pairs, PREFIX##_set1_epi32(0x00011000)),                \
+	                               PREFIX##_setr_epi8(SHUFFLE_DECODE));                                         \
+	valid;                                                                                                     \
+})
+
+#define SHUFFLE_ENCODE_128 1, 0, 2, 1, 4, 3, 5, 4, 7, 6, 8, 7, 10, 9, 11, 10
+#define SHIFT_ENCODE_128 'a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '+' - 62, '/' - 63, 'A', 0, 0
+#define LOW_NIBBLE_CLASSES_128 0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A
+#define HIGH_NIBBLE_CLASSES_128 0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10
+#define SHIFT_DECODE_128 0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0
+#define SHUFFLE_DECODE_128 2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1
+
+#define SHUFFLE_ENCODE SHUFFLE_ENCODE_128
+#define SHIFT_ENCODE SHIFT_ENCODE_128
+#define LOW_NIBBLE_CLASSES LOW_NIBBLE_CLASSES_128
+#define HIGH_NIBBLE_CLASSES HIGH_NIBBLE_CLASSES_128
+#define SHIFT_DECODE SHIFT_DECODE_128
+#define SHUFFLE_DECODE SHUFFLE_DECODE_128
+
+__attribute__((target("ssse3")))
+static size_t EncodeSSSE3(const uint8_t* input, size_t length, char* output)
+{
+	size_t consumed = 0;
 	
-	NSString* result = [[NSString alloc] initWithCString:output encoding:NSASCIIStringEncoding];
-	free(output);
+	// each step reads 16 bytes to use 12
+	while(length - consumed >= 16)
+	{
+		__m128i in = _mm_loadu_si128((const __m128i*)(input + consumed));
+		_mm_storeu_si128((__m128i*)output, ENCODE_LANES(128, _mm, in));
+		
+		consumed += 12;
+		output += 16;
+	}
 	
-	return [result autorelease];
+	return consumed;
 }
 
-+ (NSString*) encode:(NSData*)rawBytes 
+__attribute__((target("ssse3")))
+static size_t DecodeSSSE3(const uint8_t* input, size_t length, uint8_t* output)
 {
-    return [self encode:(const uint8_t*) rawBytes.bytes length:rawBytes.length];
+	size_t consumed = 0;
+	
+	// each step stores 16 bytes of which 12 are kept, so it stays clear of the last 4 bytes the caller has room for
+	while(length - consumed >= 24)
+	{
+		__m128i in = _mm_loadu_si128((const __m128i*)(input + consumed));
+		__m128i packed;
+		
+		if(!DECODE_LANES(128, _mm, in, packed))
+		{
+			break;
+		}
+		_mm_storeu_si128((__m128i*)output, packed);
+		
+		consumed += 16;
+		output += 12;
+	}
+	
+	return consumed;
 }
 
-+ (NSData*) decode:(const char*)string length:(NSInteger)inputLength 
+#undef SHUFFLE_ENCODE
+#undef SHIFT_ENCODE
+#undef LOW_NIBBLE_CLASSES
+#undef HIGH_NIBBLE_CLASSES
+#undef SHIFT_DECODE
+#undef SHUFFLE_DECODE
+
+// AVX2 shuffles stay within each 128 bit lane, so the tables are the SSSE3 ones twice over
+#define SHUFFLE_ENCODE SHUFFLE_ENCODE_128, SHUFFLE_ENCODE_128
+#define SHIFT_ENCODE SHIFT_ENCODE_128, SHIFT_ENCODE_128
+#define LOW_NIBBLE_CLASSES LOW_NIBBLE_CLASSES_128, LOW_NIBBLE_CLASSES_128
+#define HIGH_NIBBLE_CLASSES HIGH_NIBBLE_CLASSES_128, HIGH_NIBBLE_CLASSES_128
+#define SHIFT_DECODE SHIFT_DECODE_128, SHIFT_DECODE_128
+#define SHUFFLE_DECODE SHUFFLE_DECODE_128, SHUFFLE_DECODE_128
+
+__attribute__((target("avx2")))
+static size_t EncodeAVX2(const uint8_t* input, size_t length, char* output)
 {
-	if ((string == NULL) || (inputLength % 4 != 0)) 
+	size_t consumed = 0;
+	
+	// two 12 byte groups, each loaded into its own lane; the second load ends 28 bytes in
+	while(length - consumed >= 28)
 	{
-		return nil;
+		__m256i in = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i*)(input + consumed))),
+		                                     _mm_loadu_si128((const __m128i*)(input + consumed + 12)), 1);
+		_mm256_storeu_si256((__m256i*)output, ENCODE_LANES(256, _mm256, in));
+		
+		consumed += 24;
+		output += 32;
 	}
 	
-	while (inputLength > 0 && string[inputLength - 1] == '=') 
+	return consumed;
+}
+
+__attribute__((target("avx2")))
+static size_t DecodeAVX2(const uint8_t* input, size_t length, uint8_t* output)
+{
+	size_t consumed = 0;
+	
+	while(length - consumed >= 44)
 	{
-		inputLength--;
+		__m256i in = _mm256_loadu_si256((const __m256i*)(input + consumed));
+		__m256i packed;
+		
+		if(!DECODE_LANES(256, _mm256, in, packed))
+		{
+			break;
+		}
+		// close the gap between the lanes' 12 byte results
+		packed = _mm256_permutevar8x32_epi32(packed, _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 3, 7));
+		_mm256_storeu_si256((__m256i*)output, packed);
+		
+		consumed += 32;
+		output += 24;
 	}
 	
-	NSInteger outputLength = inputLength * 3 / 4;
-	NSMutableData* output = [NSMutableData dataWithLength:outputLength];
-	uint8_t* outputBytes = output.mutableBytes;
+	return consumed;
+}
+
+#endif
+
+#if BASE64_NEON
+
+static size_t EncodeNEON(const uint8_t* input, size_t length, char* output)
+{
+	const uint8_t* table = (const uint8_t*)EncodeTable;
+	uint8x16x4_t lookup = { { vld1q_u8(table), vld1q_u8(table + 16), vld1q_u8(table + 32), vld1q_u8(table + 48) } };
+	size_t consumed = 0;
 	
-	for(int i = 0; i < inputLength; i += 4)
+	// 48 bytes, deinterleaved into the first, second and third byte of each triple
+	while(length - consumed >= 48)
 	{
-		char c1, c2, c3, c4;
+		uint8x16x3_t in = vld3q_u8(input + consumed);
+		uint8x16x4_t out;
 		
-		c1 = string[i];
-		c2 = (i + 1 < inputLength) ? string[i + 1] : '=';
-		c3 = (i + 2 < inputLength) ? string[i + 2] : '=';
-		c4 = (i + 3 < inputLength) ? string[i + 3] : '=';
+		out.val[0] = vshrq_n_u8(in.val[0], 2);
+		out.val[1] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[0], vdupq_n_u8(0x03)), 4), vshrq_n_u8(in.val[1], 4));
+		out.val[2] = vorrq_u8(vshlq_n_u8(vandq_u8(in.val[1], vdupq_n_u8(0x0F)), 2), vshrq_n_u8(in.val[2], 6));
+		out.val[3] = vandq_u8(in.val[2], vdupq_n_u8(0x3F));
 		
-		uint8_t b1 = ByteDecode(c1);
-		uint8_t b2 = ByteDecode(c2);
-		uint8_t b3 = ByteDecode(c3);
-		uint8_t b4 = ByteDecode(c4);
+		out.val[0] = vqtbl4q_u8(lookup, out.val[0]);
+		out.val[1] = vqtbl4q_u8(lookup, out.val[1]);
+		out.val[2] = vqtbl4q_u8(lookup, out.val[2]);
+		out.val[3] = vqtbl4q_u8(lookup, out.val[3]);
+		vst4q_u8((uint8_t*)output, out);
 		
-		*outputBytes++ = (b1 << 2) | (b2 >> 4);
+		consumed += 48;
+		output += 64;
+	}
+	
+	return consumed;
+}
 
-		if(c3 != '=')
-		{
-			*outputBytes++ = ((b2 & 0xF) << 4) | (b3 >> 2);
+static inline uint8x16_t DecodeLanesNEON(uint8x16_t chars, uint8x16x4_t low, uint8x16x4_t high)
+{
+	uint8x16_t values = vqtbl4q_u8(low, chars);
+	values = vqtbx4q_u8(values, high, vsubq_u8(chars, vdupq_n_u8(64)));
+	
+	// bytes from 128 up miss both tables and come out as 0
+	return vorrq_u8(values, vcgeq_u8(chars, vdupq_n_u8(128)));
+}
 
-			if(c4 != '=')
-			{
-				*outputBytes++ = ((b3 & 0x3) << 6) | b4;
-			}
+static size_t DecodeNEON(const uint8_t* input, size_t length, uint8_t* output)
+{
+	uint8x16x4_t low = { { vld1q_u8(DecodeTable), vld1q_u8(DecodeTable + 16), vld1q_u8(DecodeTable + 32), vld1q_u8(DecodeTable + 48) } };
+	uint8x16x4_t high = { { vld1q_u8(DecodeTable + 64), vld1q_u8(DecodeTable + 80), vld1q_u8(DecodeTable + 96), vld1q_u8(DecodeTable + 112) } };
+	size_t consumed = 0;
+	
+	while(length - consumed >= 64)
+	{
+		uint8x16x4_t in = vld4q_u8(input + consumed);
+		uint8x16_t a = DecodeLanesNEON(in.val[0], low, high);
+		uint8x16_t b = DecodeLanesNEON(in.val[1], low, high);
+		uint8x16_t c = DecodeLanesNEON(in.val[2], low, high);
+		uint8x16_t d = DecodeLanesNEON(in.val[3], low, high);
+		
+		if(vmaxvq_u8(vorrq_u8(vorrq_u8(a, b), vorrq_u8(c, d))) >= 64)
+		{
+			break;
 		}
+		
+		uint8x16x3_t out;
+		out.val[0] = vorrq_u8(vshlq_n_u8(a, 2), vshrq_n_u8(b, 4));
+		out.val[1] = vorrq_u8(vshlq_n_u8(b, 4), vshrq_n_u8(c, 2));
+		out.val[2] = vorrq_u8(vshlq_n_u8(c, 6), d);
+		vst3q_u8(output, out);
+		
+		consumed += 64;
+		output += 48;
 	}
 	
-	return output;
+	return consumed;
 }
 
-+ (NSData*) decode:(NSString*)string 
+#endif
+
+static EncodeKernel _encodeKernel = EncodeNone;
+static DecodeKernel _decodeKernel = DecodeNone;
+
+static void SelectKernels(void)
 {
-	return [self decode:[string cStringUsingEncoding:NSASCIIStringEncoding] length:string.length];
+	static dispatch_once_t once;
+	
+	dispatch_once(&once, ^{
+#if BASE64_X86
+		if(__builtin_cpu_supports("avx2"))
+		{
+			_encodeKernel = EncodeAVX2;
+			_decodeKernel = DecodeAVX2;
+		}
+		else if(__builtin_cpu_supports("ssse3"))
+		{
+			_encodeKernel = EncodeSSSE3;
+			_decodeKernel = DecodeSSSE3;
+		}
+#elif BASE64_NEON
+		_encodeKernel = EncodeNEON;
+		_decodeKernel = DecodeNEON;
+#endif
+	});
 }
 
-@end
-
-#pragma mark Byte encode/decode
+size_t Base64Encode(const uint8_t* input, size_t length, char* output)
+{
+	SelectKernels();
+	
+	size_t consumed = _encodeKernel(input, length, output);
+	return consumed / 3 * 4 + Base64EncodeScalar(input + consumed, length - consumed, output + consumed / 3 * 4);
+}
 
-static char ByteEncode(uint8_t byte) 
+ssize_t Base64Decode(const char* string, size_t length, uint8_t* output)
 {
-	if (byte < 26) 
+	if(length % 4)
 	{
-		return 'A' + byte;
-	}
-	if (byte < 52) 
-	{
-		return 'a' + (byte - 26);
-	}
-	if (byte < 62) 
-	{
-		return '0' + (byte - 52);
-	}
-	if (byte == 62) 
-	{
-		return '+';
+		return -1;
 	}
 	
-	return '/';
+	SelectKernels();
+	
+	// the last quad may be padded, so it is always left to the scalar loop
+	size_t consumed = (length > 4) ? _decodeKernel((const uint8_t*)string, length - 4, output) : 0;
+	ssize_t rest = Base64DecodeScalar(string + consumed, length - consumed, output + consumed / 4 * 3);
+	
+	return (rest < 0) ? -1 : (ssize_t)(consumed / 4 * 3) + rest;
 }
 
-static uint8_t ByteDecode(char c)
+#pragma mark -
+
+@implementation SimpleBase64
+
++ (NSString*) encode:(const uint8_t*) input length:(NSInteger) length 
 {
-	if (c >= 'A' && c <= 'Z')
+	if(length <= 0)
 	{
-		return c - 'A';
+		return @"";
 	}
 	
-	if (c >= 'a' && c <= 'z')
+	size_t outputLength = Base64EncodedLength(length);
+	
+	// signatures and MD5s fit on the stack; anything bigger is handed to the string without a copy
+	if(outputLength <= 256)
 	{
-		return c - 'a' + 26;
+		char output[256];
+		Base64Encode(input, length, output);
+		return [[[NSString alloc] initWithBytes:output length:outputLength encoding:NSASCIIStringEncoding] autorelease];
 	}
 	
-	if (c >= '0' && c <= '9')
+	char* output = malloc(outputLength);
+	Base64Encode(input, length, output);
+	
+	return [[[NSString alloc] initWithBytesNoCopy:output length:outputLength encoding:NSASCIIStringEncoding freeWhenDone:YES] autorelease];
+}
+
++ (NSString*) encode:(NSData*)rawBytes 
+{
+    return [self encode:(const uint8_t*) rawBytes.bytes length:rawBytes.length];
+}
+
++ (NSData*) decode:(const char*)string length:(NSInteger)inputLength 
+{
+	if ((string == NULL) || (inputLength % 4 != 0)) 
 	{
-		return  c - '0' + 52;
+		return nil;
 	}
 	
-	if(c == '+')
+	NSMutableData* output = [NSMutableData dataWithLength:inputLength / 4 * 3];
+	ssize_t outputLength = Base64Decode(string, inputLength, output.mutableBytes);
+	
+	if(outputLength < 0)
 	{
-		return 62;
+		return nil;
 	}
 	
-	return 63;
+	[output setLength:outputLength];
+	return output;
 }
 
-#pragma mark -
++ (NSData*) decode:(NSString*)string 
+{
+	return [self decode:[string cStringUsingEncoding:NSASCIIStringEncoding] length:string.length];
+}
+
+@end
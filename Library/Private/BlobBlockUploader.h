@@ -0,0 +1,68 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class AuthenticationCredential;
+@class SharedAccessSignature;
+
+// Uploads a block blob as a series of Put Block requests with up to `parallelism` in flight,
+// then commits them in order with Put Block List. The source is read one block at a time as
+// slots free up, so at most `parallelism` blocks are held in memory. A regular file is mapped
+// instead, and each block's body is a window onto the mapping, so file data is never copied into
+// our own buffers; a file that fits in one block goes up as a single Put Blob.
+@interface BlobBlockUploader : NSObject
+{
+    AuthenticationCredential* _credential;
+    SharedAccessSignature* _signature;
+    id _owner;
+    NSString* _endpoint;
+    NSString* _contentType;
+    NSUInteger _blockSize;
+    NSUInteger _parallelism;
+    NSUInteger _maxRetries;
+
+    int _fd;
+    NSData* _mapping;
+    NSInputStream* _stream;
+    long long _readOffset;
+    BOOL _sourceDone;
+
+    NSUInteger _blockCount;
+    NSMutableDictionary* _pending;
+    NSMutableArray* _retryBlocks;
+    NSMutableDictionary* _attempts;
+    NSUInteger _inFlight;
+    NSError* _error;
+    BOOL _committing;
+
+    void (^_completion)(NSError*);
+}
+
+// Maps fd from offset 0 if it is a regular file, and otherwise reads blocks from it with pread.
+// The file must not shrink while the upload runs.
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint contentType:(NSString*)contentType blockSize:(NSUInteger)blockSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries fileDescriptor:(int)fd;
+// Reads blocks from an open stream. Reads block the calling thread until a full block or the end of the stream is reached.
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint contentType:(NSString*)contentType blockSize:(NSUInteger)blockSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries stream:(NSInputStream*)stream;
+
+// The storage client issuing the requests, for scheduler fairness. Not retained.
+@property (assign) id owner;
+// When set, blocks are sent to the storage service under this signature instead of being signed with the credential.
+@property (retain) SharedAccessSignature* signature;
+
+- (void)startWithBlock:(void (^)(NSError*))block;
+
+@end
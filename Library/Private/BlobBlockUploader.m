@@ -0,0 +1,376 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "BlobBlockUploader.h"
+#import "AuthenticationCredential+Private.h"
+#import "CloudURLRequest.h"
+#import "SharedAccessSignature.h"
+#import "SimpleBase64.h"
+#import <unistd.h>
+#import <sys/mman.h>
+#import <sys/stat.h>
+
+@implementation BlobBlockUploader
+
+@synthesize owner = _owner;
+@synthesize signature = _signature;
+
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint contentType:(NSString*)contentType blockSize:(NSUInteger)blockSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries
+{
+    if((self = [super init]))
+    {
+        _credential = [credential retain];
+        _endpoint = [endpoint copy];
+        _contentType = [contentType copy];
+        _blockSize = blockSize ? blockSize : 1;
+        _parallelism = parallelism ? parallelism : 1;
+        _maxRetries = maxRetries;
+        _fd = -1;
+        _pending = [[NSMutableDictionary alloc] initWithCapacity:_parallelism];
+        _retryBlocks = [[NSMutableArray alloc] initWithCapacity:_parallelism];
+        _attempts = [[NSMutableDictionary alloc] initWithCapacity:_parallelism];
+    }
+
+    return self;
+}
+
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint contentType:(NSString*)contentType blockSize:(NSUInteger)blockSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries fileDescriptor:(int)fd
+{
+    if((self = [self initWithCredential:credential endpoint:endpoint contentType:contentType blockSize:blockSize parallelism:parallelism maxRetries:maxRetries]))
+    {
+        _fd = fd;
+    }
+
+    return self;
+}
+
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint contentType:(NSString*)contentType blockSize:(NSUInteger)blockSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries stream:(NSInputStream*)stream
+{
+    if((self = [self initWithCredential:credential endpoint:endpoint contentType:contentType blockSize:blockSize parallelism:parallelism maxRetries:maxRetries]))
+    {
+        _stream = [stream retain];
+    }
+
+    return self;
+}
+
+- (void)dealloc
+{
+    [_credential release];
+    [_signature release];
+    [_endpoint release];
+    [_contentType release];
+    [_stream release];
+    [_mapping release];
+    [_pending release];
+    [_retryBlocks release];
+    [_attempts release];
+    [_error release];
+    [_completion release];
+
+    [super dealloc];
+}
+
+#pragma mark Source reading
+
+- (void)mapSource
+{
+    struct stat status;
+    
+    if(fstat(_fd, &status) != 0 || !S_ISREG(status.st_mode) || status.st_size <= 0)
+    {
+        return;
+    }
+    
+    void* bytes = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+    if(bytes == MAP_FAILED)
+    {
+        return;
+    }
+    
+    // pages are read in as the transport sends them
+    madvise(bytes, (size_t)status.st_size, MADV_SEQUENTIAL);
+    _mapping = [[NSData alloc] initWithBytesNoCopy:bytes length:(NSUInteger)status.st_size deallocator:^(void* mapped, NSUInteger length)
+                {
+                    munmap(mapped, length);
+                }];
+}
+
+- (NSData*)nextMappedBlock
+{
+    NSUInteger length = (NSUInteger)MIN((long long)_blockSize, (long long)[_mapping length] - _readOffset);
+    NSData* mapping = _mapping;
+    
+    // the window keeps the whole mapping alive for as long as a request body refers to it
+    NSData* block = [[NSData alloc] initWithBytesNoCopy:(uint8_t*)[_mapping bytes] + _readOffset length:length deallocator:^(void* bytes, NSUInteger count)
+                     {
+                         [mapping self];
+                     }];
+    
+    _readOffset += length;
+    _sourceDone = (_readOffset >= (long long)[_mapping length]);
+    
+    return [block autorelease];
+}
+
+- (NSData*)readNextBlock
+{
+    if(_mapping)
+    {
+        return [self nextMappedBlock];
+    }
+    
+    NSMutableData* block = [NSMutableData dataWithLength:_blockSize];
+    uint8_t* bytes = [block mutableBytes];
+    NSUInteger length = 0;
+
+    while(length < _blockSize)
+    {
+        NSInteger count;
+
+        if(_stream)
+        {
+            count = [_stream read:bytes + length maxLength:_blockSize - length];
+            if(count < 0)
+            {
+                NSError* streamError = [_stream streamError];
+                _error = [(streamError ? streamError : [NSError errorWithDomain:NSPOSIXErrorDomain code:EIO userInfo:nil]) retain];
+                return nil;
+            }
+        }
+        else
+        {
+            count = pread(_fd, bytes + length, _blockSize - length, _readOffset);
+            if(count < 0)
+            {
+                if(errno == EINTR)
+                {
+                    continue;
+                }
+                _error = [[NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil] retain];
+                return nil;
+            }
+            _readOffset += count;
+        }
+
+        if(count == 0)
+        {
+            _sourceDone = YES;
+            break;
+        }
+        length += count;
+    }
+
+    if(length == 0)
+    {
+        return nil;
+    }
+
+    [block setLength:length];
+    return block;
+}
+
+#pragma mark Scheduling
+
+- (NSString*)blockIdForIndex:(NSUInteger)index
+{
+    // fixed-width decimal digits only produce base64 letters and digits, so the id needs no escaping in the query
+    NSData* raw = [[NSString stringWithFormat:@"%06lu", (unsigned long)index] dataUsingEncoding:NSASCIIStringEncoding];
+    return [SimpleBase64 encode:raw];
+}
+
+- (void)finish
+{
+    _completion(_error);
+}
+
+// A PUT for endpoint, under the signature when there is one. name and value add one more header and may be nil.
+- (CloudURLRequest*)putRequestWithEndpoint:(NSString*)endpoint contentData:(NSData*)contentData contentType:(NSString*)contentType header:(NSString*)name value:(NSString*)value
+{
+    if(_signature)
+    {
+        return [_credential authenticatedRequestWithEndpoint:endpoint signature:_signature httpMethod:@"PUT" contentData:contentData contentType:contentType, name, value, nil];
+    }
+    
+    return [_credential authenticatedRequestWithEndpoint:endpoint forStorageType:@"blob" httpMethod:@"PUT" contentData:contentData contentType:contentType, name, value, nil];
+}
+
+- (void)putBlock:(NSNumber*)index
+{
+    NSString* endpoint = [_endpoint stringByAppendingFormat:@"?comp=block&blockid=%@", [self blockIdForIndex:[index unsignedIntegerValue]]];
+    CloudURLRequest* request = [self putRequestWithEndpoint:endpoint contentData:[_pending objectForKey:index] contentType:nil header:nil value:nil];
+    request.priority = CloudRequestPriorityLow;
+    request.owner = _owner;
+    // failed blocks are retried by block:didFinishWithStatus:error:, which frees the slot in between
+    request.retryPolicy = nil;
+
+    __block CloudURLRequest* blockRequest = request;
+    _inFlight++;
+
+    [request fetchNoResponseWithBlock:^(NSError* error)
+     {
+         _inFlight--;
+         [self block:index didFinishWithStatus:[blockRequest.response statusCode] error:error];
+     }];
+}
+
+- (void)commit
+{
+    _committing = YES;
+
+    NSMutableString* blockList = [NSMutableString stringWithCapacity:40 + _blockCount * 30];
+    [blockList appendString:@"<?xml version=\"1.0\" encoding=\"utf-8\"?><BlockList>"];
+    for(NSUInteger index = 0; index < _blockCount; index++)
+    {
+        [blockList appendFormat:@"<Latest>%@</Latest>", [self blockIdForIndex:index]];
+    }
+    [blockList appendString:@"</BlockList>"];
+
+    NSString* endpoint = [_endpoint stringByAppendingString:@"?comp=blocklist"];
+    CloudURLRequest* request = [self putRequestWithEndpoint:endpoint contentData:[blockList dataUsingEncoding:NSUTF8StringEncoding] contentType:@"text/xml"
+                                                     header:(_contentType ? @"x-ms-blob-content-type" : nil) value:_contentType];
+    request.owner = _owner;
+
+    [request fetchNoResponseWithBlock:^(NSError* error)
+     {
+         if(error && !_error)
+         {
+             _error = [error retain];
+         }
+         [self finish];
+     }];
+}
+
+- (void)putBlob
+{
+    CloudURLRequest* request = [self putRequestWithEndpoint:_endpoint contentData:_mapping contentType:_contentType header:@"x-ms-blob-type" value:@"BlockBlob"];
+    request.priority = CloudRequestPriorityLow;
+    request.owner = _owner;
+    
+    [request fetchNoResponseWithBlock:^(NSError* error)
+     {
+         _error = [error retain];
+         [self finish];
+     }];
+}
+
+- (void)fill
+{
+    while(!_error && _inFlight < _parallelism)
+    {
+        NSNumber* index;
+
+        if([_retryBlocks count] > 0)
+        {
+            index = [[[_retryBlocks lastObject] retain] autorelease];
+            [_retryBlocks removeLastObject];
+        }
+        else if(!_sourceDone)
+        {
+            NSData* data = [self readNextBlock];
+            if(!data)
+            {
+                break;
+            }
+
+            index = [NSNumber numberWithUnsignedInteger:_blockCount++];
+            [_pending setObject:data forKey:index];
+        }
+        else
+        {
+            break;
+        }
+
+        [self putBlock:index];
+    }
+
+    if(_inFlight > 0)
+    {
+        return;
+    }
+
+    if(_error)
+    {
+        [self finish];
+    }
+    else if(_sourceDone && !_committing)
+    {
+        [self commit];
+    }
+}
+
+- (void)block:(NSNumber*)index didFinishWithStatus:(NSInteger)statusCode error:(NSError*)error
+{
+    if(!error)
+    {
+        // the block is on the service now; let its buffer go
+        [_pending removeObjectForKey:index];
+    }
+    else if(!_error)
+    {
+        NSUInteger attempts = [[_attempts objectForKey:index] unsignedIntegerValue] + 1;
+        BOOL retryable;
+
+        if(statusCode >= 300)
+        {
+            // the service answered; a 4xx other than a timeout will be answered the same way again
+            retryable = (statusCode >= 500 || statusCode == 408);
+        }
+        else
+        {
+            retryable = ![[error domain] isEqualToString:NSURLErrorDomain] || [error code] != NSURLErrorCancelled;
+        }
+
+        if(retryable && attempts <= _maxRetries)
+        {
+            [_attempts setObject:[NSNumber numberWithUnsignedInteger:attempts] forKey:index];
+            [_retryBlocks addObject:index];
+        }
+        else
+        {
+            _error = [error retain];
+        }
+    }
+
+    [self fill];
+}
+
+- (void)startWithBlock:(void (^)(NSError*))block
+{
+    _completion = [block copy];
+
+    if(_stream && [_stream streamStatus] == NSStreamStatusNotOpen)
+    {
+        [_stream open];
+    }
+    else if(_fd >= 0)
+    {
+        [self mapSource];
+    }
+    
+    if(_mapping && [_mapping length] <= _blockSize)
+    {
+        // no point in a block list for a single block
+        [self putBlob];
+        return;
+    }
+
+    [self fill];
+}
+
+#pragma mark -
+
+@end
@@ -0,0 +1,66 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "BlobListing.h"
+
+// {offset, length} of a string in the listing's arena. Names are at most 1024 characters and
+// every other value is shorter, so 24 bits of length leave 40 bits of offset.
+typedef struct
+{
+    uint64_t offset : 40;
+    uint64_t length : 24;
+} BlobListingSpan;
+
+typedef enum
+{
+    BlobListingTypeNone = 0,
+    BlobListingTypeBlock,
+    BlobListingTypePage,
+    BlobListingTypeAppend
+} BlobListingType;
+
+// One listed blob. An empty span means the listing didn't include the value.
+typedef struct
+{
+    BlobListingSpan name;
+    BlobListingSpan etag;
+    BlobListingSpan contentType;
+    BlobListingSpan contentMD5;
+    int64_t contentLength;
+    // seconds since the reference date, NAN if absent
+    double lastModified;
+    uint8_t blobType;
+} BlobListingEntry;
+
+// The number of recent distinct values internBytes:length: remembers.
+#define BLOB_LISTING_INTERNED 16
+
+// Building a listing, as the listing parser does.
+@interface BlobListing (Private)
+
+- (id)initWithContainer:(BlobContainer*)container;
+
+- (BlobListingSpan)appendBytes:(const void*)bytes length:(NSUInteger)length;
+// Like appendBytes:length:, but a value equal to one of the last few distinct values shares its bytes.
+- (BlobListingSpan)internBytes:(const void*)bytes length:(NSUInteger)length;
+- (void)addEntry:(const BlobListingEntry*)entry;
+- (void)addPrefix:(NSString*)prefix;
+// Appends the blobs and prefixes of a listing built separately, such as one shard's.
+- (void)addEntriesFromListing:(BlobListing*)listing;
+// Puts the entries back in name order after pages arrived out of order, as sharded listings do.
+- (void)sort;
+
+@end
@@ -0,0 +1,63 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@class AuthenticationCredential;
+@class SharedAccessSignature;
+
+// Fetches a blob as a set of x-ms-range segments with up to `parallelism` requests in flight.
+// The first segment also tells us the blob length (from Content-Range), after which the rest
+// are scheduled. Segments are written at their own offset, so arrival order does not matter.
+@interface BlobRangeDownloader : NSObject
+{
+    AuthenticationCredential* _credential;
+    SharedAccessSignature* _signature;
+    id _owner;
+    NSString* _endpoint;
+    NSUInteger _segmentSize;
+    NSUInteger _parallelism;
+    NSUInteger _maxRetries;
+
+    NSMutableData* _buffer;
+    int _fd;
+
+    long long _length;
+    // the version the first segment came from; every later segment has to match it
+    NSString* _etag;
+    long long _nextOffset;
+    NSMutableArray* _retryOffsets;
+    NSMutableDictionary* _attempts;
+    NSUInteger _inFlight;
+    NSError* _error;
+    BOOL _finished;
+
+    void (^_completion)(NSData*, NSError*);
+}
+
+// Reassembles the segments into one preallocated NSData.
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint segmentSize:(NSUInteger)segmentSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries;
+// Writes each segment to fd with pwrite as it arrives; the completion's data is always nil.
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint segmentSize:(NSUInteger)segmentSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries fileDescriptor:(int)fd;
+
+// The storage client issuing the requests, for scheduler fairness. Not retained.
+@property (assign) id owner;
+// When set, segments are fetched from the storage service under this signature instead of being signed with the credential.
+@property (retain) SharedAccessSignature* signature;
+
+- (void)startWithBlock:(void (^)(NSData*, NSError*))block;
+
+@end
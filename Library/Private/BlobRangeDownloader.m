@@ -0,0 +1,316 @@
+/*
+ Copyright 2010 Microsoft Corp
+
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+
+ http://www.apache.org/licenses/LICENSE-2.0
+
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "BlobRangeDownloader.h"
+#import "AuthenticationCredential+Private.h"
+#import "CloudURLRequest.h"
+#import "SharedAccessSignature.h"
+#import "XmlHelper.h"
+#import <libxml/parser.h>
+#import <unistd.h>
+
+@implementation BlobRangeDownloader
+
+@synthesize owner = _owner;
+@synthesize signature = _signature;
+
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint segmentSize:(NSUInteger)segmentSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries fileDescriptor:(int)fd
+{
+    if((self = [super init]))
+    {
+        _credential = [credential retain];
+        _endpoint = [endpoint copy];
+        _segmentSize = segmentSize ? segmentSize : 1;
+        _parallelism = parallelism ? parallelism : 1;
+        _maxRetries = maxRetries;
+        _fd = fd;
+        _length = -1;
+        _retryOffsets = [[NSMutableArray alloc] initWithCapacity:_parallelism];
+        _attempts = [[NSMutableDictionary alloc] initWithCapacity:_parallelism];
+    }
+
+    return self;
+}
+
+- (id)initWithCredential:(AuthenticationCredential*)credential endpoint:(NSString*)endpoint segmentSize:(NSUInteger)segmentSize parallelism:(NSUInteger)parallelism maxRetries:(NSUInteger)maxRetries
+{
+    return [self initWithCredential:credential endpoint:endpoint segmentSize:segmentSize parallelism:parallelism maxRetries:maxRetries fileDescriptor:-1];
+}
+
+- (void)dealloc
+{
+    [_credential release];
+    [_signature release];
+    [_endpoint release];
+    [_etag release];
+    [_buffer release];
+    [_retryOffsets release];
+    [_attempts release];
+    [_error release];
+    [_completion release];
+
+    [super dealloc];
+}
+
+#pragma mark Scheduling
+
+- (void)finish
+{
+    if(_finished)
+    {
+        return;
+    }
+    _finished = YES;
+
+    if(_error)
+    {
+        _completion(nil, _error);
+    }
+    else
+    {
+        _completion(_fd < 0 ? (_buffer ? _buffer : [NSData data]) : nil, nil);
+    }
+}
+
+- (void)fetchSegmentAtOffset:(long long)offset
+{
+    // until the first segment is back we don't know where the blob ends; the service clamps the range for us
+    long long last = (_length < 0) ? offset + _segmentSize - 1 : MIN(offset + (long long)_segmentSize, _length) - 1;
+    NSString* range = [NSString stringWithFormat:@"bytes=%lld-%lld", offset, last];
+
+    CloudURLRequest* request;
+    if(_signature)
+    {
+        request = _etag ? [_credential authenticatedRequestWithEndpoint:_endpoint signature:_signature httpMethod:@"GET" contentData:nil contentType:nil, @"x-ms-range", range, @"If-Match", _etag, nil]
+                        : [_credential authenticatedRequestWithEndpoint:_endpoint signature:_signature httpMethod:@"GET" contentData:nil contentType:nil, @"x-ms-range", range, nil];
+    }
+    else if(_etag)
+    {
+        request = [_credential authenticatedRequestWithEndpoint:_endpoint forStorageType:@"blob", @"x-ms-range", range, @"If-Match", _etag, nil];
+    }
+    else
+    {
+        request = [_credential authenticatedRequestWithEndpoint:_endpoint forStorageType:@"blob", @"x-ms-range", range, nil];
+    }
+    request.priority = CloudRequestPriorityLow;
+    request.owner = _owner;
+    // failed segments are retried by segmentAtOffset:didFinishWithResponse:data:error:, which frees the slot in between
+    request.retryPolicy = nil;
+
+    __block CloudURLRequest* segmentRequest = request;
+    _inFlight++;
+
+    [request fetchDataWithBlock:^(NSData* data, NSError* error)
+     {
+         _inFlight--;
+         [self segmentAtOffset:offset didFinishWithResponse:segmentRequest.response data:data error:error];
+     }];
+}
+
+- (void)fill
+{
+    while(!_error && _inFlight < _parallelism)
+    {
+        long long offset;
+
+        if([_retryOffsets count] > 0)
+        {
+            offset = [[_retryOffsets lastObject] longLongValue];
+            [_retryOffsets removeLastObject];
+        }
+        else if(_length >= 0 && _nextOffset < _length)
+        {
+            offset = _nextOffset;
+            _nextOffset += _segmentSize;
+        }
+        else
+        {
+            break;
+        }
+
+        [self fetchSegmentAtOffset:offset];
+    }
+
+    if(_inFlight == 0)
+    {
+        [self finish];
+    }
+}
+
+- (void)startWithBlock:(void (^)(NSData*, NSError*))block
+{
+    _completion = [block copy];
+    _nextOffset = _segmentSize;
+
+    [self fetchSegmentAtOffset:0];
+}
+
+#pragma mark Segment handling
+
+- (NSError*)errorForStatus:(NSInteger)statusCode data:(NSData*)data
+{
+    NSError* error = nil;
+
+    if(data)
+    {
+        xmlDocPtr doc = xmlReadMemory([data bytes], (int)[data length], NULL, NULL, (XML_PARSE_NOCDATA | XML_PARSE_NOBLANKS));
+        error = [XmlHelper checkForError:doc];
+        xmlFreeDoc(doc);
+    }
+
+    if(!error)
+    {
+        error = [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit"
+                                    code:-1
+                                userInfo:[NSDictionary dictionaryWithObject:[NSHTTPURLResponse localizedStringForStatusCode:statusCode] forKey:NSLocalizedDescriptionKey]];
+    }
+
+    return error;
+}
+
+- (BOOL)readLengthFromResponse:(NSHTTPURLResponse*)response data:(NSData*)data
+{
+    NSDictionary* headers = [response allHeaderFields];
+    NSString* etag = [headers objectForKey:@"ETag"] ? [headers objectForKey:@"ETag"] : [headers objectForKey:@"Etag"];
+    [_etag release];
+    _etag = [etag copy];
+    
+    if([response statusCode] == 200)
+    {
+        // the whole blob came back in one go
+        _length = [data length];
+        _nextOffset = _length;
+        return YES;
+    }
+
+    // Content-Range: bytes <first>-<last>/<total>
+    NSString* contentRange = [headers objectForKey:@"Content-Range"];
+    NSRange slash = [contentRange rangeOfString:@"/" options:NSBackwardsSearch];
+    if(slash.location == NSNotFound)
+    {
+        return NO;
+    }
+
+    _length = [[contentRange substringFromIndex:slash.location + 1] longLongValue];
+    return YES;
+}
+
+- (NSError*)writeData:(NSData*)data atOffset:(long long)offset
+{
+    if(_fd < 0)
+    {
+        if(!_buffer)
+        {
+            _buffer = [[NSMutableData alloc] initWithLength:(NSUInteger)_length];
+        }
+        [_buffer replaceBytesInRange:NSMakeRange((NSUInteger)offset, [data length]) withBytes:[data bytes]];
+        return nil;
+    }
+
+    const uint8_t* bytes = [data bytes];
+    NSUInteger remaining = [data length];
+
+    while(remaining > 0)
+    {
+        ssize_t written = pwrite(_fd, bytes, remaining, offset);
+        if(written < 0)
+        {
+            if(errno == EINTR)
+            {
+                continue;
+            }
+            return [NSError errorWithDomain:NSPOSIXErrorDomain code:errno userInfo:nil];
+        }
+        bytes += written;
+        offset += written;
+        remaining -= written;
+    }
+
+    return nil;
+}
+
+- (void)segmentAtOffset:(long long)offset didFinishWithResponse:(NSHTTPURLResponse*)response data:(NSData*)data error:(NSError*)error
+{
+    if(_error)
+    {
+        // another segment already failed for good; just drain what's in flight
+        [self fill];
+        return;
+    }
+
+    NSInteger statusCode = [response statusCode];
+    BOOL retryable = NO;
+
+    if(!error && _length < 0 && statusCode == 416)
+    {
+        // a range request against an empty blob
+        _length = 0;
+        _nextOffset = 0;
+        [self fill];
+        return;
+    }
+
+    if(error)
+    {
+        retryable = ![[error domain] isEqualToString:NSURLErrorDomain] || [error code] != NSURLErrorCancelled;
+    }
+    else if(statusCode >= 300)
+    {
+        // 412 means the blob was overwritten after the first segment; asking again can't stitch one version together
+        error = [self errorForStatus:statusCode data:data];
+        retryable = (statusCode >= 500 || statusCode == 408);
+    }
+    else if(_length < 0 && ![self readLengthFromResponse:response data:data])
+    {
+        error = [self errorForStatus:statusCode data:nil];
+    }
+    else
+    {
+        long long expected = (statusCode == 200) ? _length : MIN(offset + (long long)_segmentSize, _length) - offset;
+        if((long long)[data length] != expected)
+        {
+            // the connection closed early; the segment is incomplete
+            error = [NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorNetworkConnectionLost userInfo:nil];
+            retryable = YES;
+        }
+        else
+        {
+            error = [self writeData:data atOffset:offset];
+        }
+    }
+
+    if(error)
+    {
+        NSNumber* key = [NSNumber numberWithLongLong:offset];
+        NSUInteger attempts = [[_attempts objectForKey:key] unsignedIntegerValue] + 1;
+
+        if(retryable && attempts <= _maxRetries)
+        {
+            [_attempts setObject:[NSNumber numberWithUnsignedInteger:attempts] forKey:key];
+            [_retryOffsets addObject:key];
+        }
+        else
+        {
+            _error = [error retain];
+        }
+    }
+
+    [self fill];
+}
+
+#pragma mark -
+
+@end
@@ -0,0 +1,38 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "CloudRequestHandle.h"
+
+// What a handle stops and passes its deadline on to: the requests of its operation, and the
+// handles of a hedged read's attempts.
+@protocol CloudRequestHandleMember <NSObject>
+
+- (void)cancel;
+- (void)setDeadline:(NSTimeInterval)deadline;
+// Whether the member is over, so the handle can let it go.
+- (BOOL)isFinished;
+
+@end
+
+@interface CloudRequestHandle (Private) <CloudRequestHandleMember>
+
+// Makes member part of the operation. A member added after the handle was cancelled is cancelled
+// right away. Requests are added once they have been fetched, so that a cancel reaches their completion.
+- (void)addMember:(id<CloudRequestHandleMember>)member;
+// A handle for one attempt at the operation, cancelled with this one and bound by its deadline.
+- (CloudRequestHandle*)childHandle;
+
+@end
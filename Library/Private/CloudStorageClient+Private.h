@@ -0,0 +1,29 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "CloudStorageClient.h"
+
+// The client's internals that the operations built on it, such as BlobBulkOperation and
+// QueueMessagePump, drive directly.
+@interface CloudStorageClient (Private)
+
+// One page of a listing. The block gets the page's blobs and prefixes, and the request for the next
+// page, or nil after the last.
+- (void)privateGetListPage:(BlobListRequest *)listRequest withBlock:(void (^)(NSArray *, NSArray *, BlobListRequest *, NSError *))block;
+// A timer firing on the callback queue, so its handler never runs alongside the client's callbacks. Stop it with dispatch_source_cancel.
+- (dispatch_source_t)privateTimerWithInterval:(NSTimeInterval)interval repeats:(BOOL)repeats handler:(dispatch_block_t)handler;
+
+@end
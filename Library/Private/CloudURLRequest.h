@@ -16,27 +16,121 @@
 
 #import <Foundation/Foundation.h>
 #import <libxml/tree.h>
+#import "CloudRequestScheduler.h"
+#import "CloudTransport.h"
+#import "CloudRequestHandle+Private.h"
 
-#define USE_QUEUE	1   // set to 1 to perform requests in order rather than all at once
+@class CloudRetryPolicy;
+
+#define USE_QUEUE	1   // set to 1 to start requests through the shared CloudRequestScheduler rather than all at once
 #define FULL_LOGGING 0  // set to 1 to enable logging of request/response data
 
 typedef void (^xmlBlock)(xmlDocPtr doc, NSError* err);
 typedef void (^dataBlock)(NSData* data, NSError* err);
 typedef void (^noResponseBlock)(NSError* err);
+typedef BOOL (^chunkBlock)(NSData* chunk);
+
+// An incremental reader that fetchWithStreamParser: feeds a successful response body to as it arrives.
+@protocol CloudStreamParser <NSObject>
+
+- (BOOL)parseBytes:(const void*)bytes length:(NSUInteger)length;
+- (BOOL)finish;
+// The error described by the body, or a parse error if it was not well formed.
+- (NSError*)error;
+
+@end
+
+// Implemented by request owners that want completions somewhere other than the main queue.
+@protocol CloudRequestOwner <NSObject>
+
+// A serial queue; completions of the owner's requests are delivered on it, one at a time.
+- (dispatch_queue_t)requestCallbackQueue;
 
-@interface CloudURLRequest : NSMutableURLRequest {
+@end
+
+// Transport events are moved onto a serial queue of the request's own, which runs on a concurrent
+// queue shared by all requests, so bodies are read, parsed and handed to stream parsers and chunk
+// blocks off the networking thread, with several responses in progress at once. Completion blocks
+// run on the owner's requestCallbackQueue, or on the main queue if the owner has none.
+// A fetched request can be cancelled or given a deadline, through the handle of the operation it belongs to.
+@interface CloudURLRequest : NSMutableURLRequest <CloudTransportClient, CloudRequestHandleMember> {
     noResponseBlock _noResponseBlock;
     xmlBlock _xmlBlock;
     dataBlock _dataBlock;
+    chunkBlock _chunkBlock;
+    id<CloudStreamParser> _streamParser;
     long long _expectedContentLength;
+    NSInteger _statusCode;
+    NSHTTPURLResponse* _response;
+    CloudRequestPriority _priority;
+    id _owner;
+    NSTimeInterval _enqueueTime;
+    id<CloudTransport> _transport;
+    id _transfer;
+    CloudRetryPolicy* _retryPolicy;
+    NSUInteger _attempt;
+    NSTimeInterval _deadline;
+    BOOL _slotHeld;
+    BOOL _delivered;
+    BOOL _ended;
+    dispatch_queue_t _queue;
+    dispatch_queue_t _callbackQueue;
 	NSMutableData* _data;
-#if USE_QUEUE
-    CloudURLRequest* _next;
-#endif
+    uint8_t* _window;
+    NSUInteger _windowSize;
+    NSUInteger _windowLength;
+    
+    // phase timestamps, as reference-date intervals; only kept when metrics were recording at creation
+    BOOL _measured;
+    BOOL _failed;
+    NSTimeInterval _signStart;
+    NSTimeInterval _signEnd;
+    NSTimeInterval _firstSent;
+    NSTimeInterval _sent;
+    NSTimeInterval _connectTime;
+    NSTimeInterval _responded;
+    NSTimeInterval _loaded;
+    unsigned long long _bytesReceived;
 }
 
+// The HTTP response, once headers have arrived.
+@property (readonly) NSHTTPURLResponse* response;
+// Where the request waits in the scheduler when its endpoint is busy. Defaults to CloudRequestPriorityHigh.
+@property (assign) CloudRequestPriority priority;
+// The storage client that issued the request; the scheduler takes turns between owners. Not retained.
+@property (assign) id owner;
+// When the request was handed to the scheduler, as a reference-date interval.
+@property (assign) NSTimeInterval enqueueTime;
+// Whether the request's phases are being timed for CloudRequestMetrics.
+@property (readonly) BOOL measured;
+// Decides whether failures are retried before the completion sees them. Defaults to the scheduler's policy; nil turns retries off.
+@property (retain) CloudRetryPolicy* retryPolicy;
+
+// Records when signing began; the credential calls this once the request is signed.
+- (void) markSignedSince:(NSTimeInterval)signStart;
+// Puts the request on the network through transport. Called by the scheduler once the request has a slot.
+- (void) sendWithTransport:(id<CloudTransport>)transport;
+
 - (void) fetchNoResponseWithBlock:(noResponseBlock)block;
 - (void) fetchXMLWithBlock:(xmlBlock)block;
 - (void) fetchDataWithBlock:(dataBlock)block;
 
+// Hands the response body to chunk in pieces of at most windowSize bytes instead of buffering it.
+// Each chunk is only valid for the duration of the call; returning NO cancels the transfer.
+- (void) fetchStreamWithWindowSize:(NSUInteger)windowSize chunkBlock:(chunkBlock)chunk completion:(noResponseBlock)block;
+
+// Feeds the response body to parser as it arrives, so records are delivered before the transfer ends
+// and the body is never held in full. The completion receives the service error, if any.
+- (void) fetchWithStreamParser:(id<CloudStreamParser>)parser completion:(noResponseBlock)block;
+
+// Ends a fetched request that has not completed yet with an NSURLErrorCancelled error, whether it is
+// on the network, waiting for a slot or waiting to be retried.
+- (void) cancel;
+// Ends the request with an NSURLErrorTimedOut error if it has not completed by deadline, a reference-date
+// interval, and keeps it from retrying when the retry could not start in time. 0 removes the deadline.
+- (void) setDeadline:(NSTimeInterval)deadline;
+// The service's code for a failed response, such as OperationTimedOut, read from the error body; nil
+// for a success or a body without one.
+- (NSString*) reasonCode;
+
 @end
@@ -16,121 +16,330 @@
 
 #import "CloudURLRequest.h"
 #import "XmlHelper.h"
+#import "JsonStreamParser.h"
+#import "CloudPooledTransport.h"
+#import "CloudRetryPolicy.h"
+#import "CloudRequestMetrics.h"
 #import <libxml/parser.h>
 
-#if USE_QUEUE
-static CloudURLRequest* _head = nil;
-static CloudURLRequest* _tail = nil;
-static NSLock* _lock;
-#endif
+@interface CloudRequestMetrics (Private)
++ (BOOL)isRecording;
+- (void)recordRequest:(NSURLRequest*)request phases:(const NSTimeInterval*)phases bytesSent:(unsigned long long)bytesSent bytesReceived:(unsigned long long)bytesReceived retries:(NSUInteger)retries failed:(BOOL)failed;
+@end
+
+// Requests' own serial queues all run on this one, so the bodies of several responses are parsed at once.
+static dispatch_queue_t CloudParseQueue(void)
+{
+    static dispatch_queue_t queue;
+    static dispatch_once_t once;
+    
+    dispatch_once(&once, ^{
+        // libxml2 has to set up its globals before it is used from more than one thread
+        xmlInitParser();
+        queue = dispatch_queue_create("com.microsoft.AzureIOSToolkit.parse", DISPATCH_QUEUE_CONCURRENT);
+    });
+    
+    return queue;
+}
 
 @implementation CloudURLRequest
 
-#if USE_QUEUE
-#pragma mark Request Queuing support
+@synthesize response = _response;
+@synthesize priority = _priority;
+@synthesize owner = _owner;
+@synthesize enqueueTime = _enqueueTime;
+@synthesize retryPolicy = _retryPolicy;
+@synthesize measured = _measured;
 
-- (void) append:(CloudURLRequest*)request
+- (id)initWithURL:(NSURL *)URL cachePolicy:(NSURLRequestCachePolicy)cachePolicy timeoutInterval:(NSTimeInterval)timeoutInterval
 {
-    _tail = _next = [request retain];
+    if((self = [super initWithURL:URL cachePolicy:cachePolicy timeoutInterval:timeoutInterval]))
+    {
+        _retryPolicy = [[[CloudRequestScheduler sharedScheduler] retryPolicy] retain];
+        _measured = [CloudRequestMetrics isRecording];
+        _queue = dispatch_queue_create("com.microsoft.AzureIOSToolkit.request", DISPATCH_QUEUE_SERIAL);
+        dispatch_set_target_queue(_queue, CloudParseQueue());
+    }
+    
+    return self;
 }
 
-- (CloudURLRequest*)next
+- (void) start
 {
-    return _next;
+#if USE_QUEUE
+    [[CloudRequestScheduler sharedScheduler] enqueueRequest:self];
+#else
+	[self sendWithTransport:[CloudPooledTransport sharedTransport]];
+#endif
 }
 
-- (void) startNext
+- (void) markSignedSince:(NSTimeInterval)signStart
 {
-    [_lock lock];
-    @try
-    {
-        CloudURLRequest* next = [_head next];
-        [_head release];
-        if(next)
+    _signStart = signStart;
+    _signEnd = [NSDate timeIntervalSinceReferenceDate];
+}
+
+- (void) sendWithTransport:(id<CloudTransport>)transport
+{
+    // the scheduler may start us from any thread; the transfer is only ever touched on our own queue
+    dispatch_async(_queue, ^{
+        if(_ended)
         {
-            _head = next;
-            [NSURLConnection connectionWithRequest:_head delegate:_head];
+            // cancelled after the scheduler had already picked us; the slot goes straight back
+            [self releaseSlot];
+            return;
         }
-        else
+        
+        _slotHeld = YES;
+        
+        if(_measured)
         {
-            _head = _tail = nil;
+            _sent = [NSDate timeIntervalSinceReferenceDate];
+            _firstSent = _firstSent ? _firstSent : _sent;
+            _connectTime = 0;
+            _responded = 0;
+            _loaded = 0;
         }
+        
+        [_transport release];
+        [_transfer release];
+        _transport = [transport retain];
+        _transfer = [[transport startRequest:self client:self] retain];
+    });
+}
+
+// Sends the request again after the policy's delay if the failure allows it. Nothing may have reached
+// the completion or a chunk consumer yet, since they would otherwise see the response twice.
+- (BOOL) retryWithError:(NSError*)error
+{
+    if(!_retryPolicy || _delivered || ![_retryPolicy shouldRetryRequest:self statusCode:(error ? 0 : _statusCode) error:error attempt:_attempt])
+    {
+        return NO;
     }
-    @finally 
+    
+    NSTimeInterval delay = [_retryPolicy delayForAttempt:_attempt response:_response];
+    if(_deadline > 0 && [NSDate timeIntervalSinceReferenceDate] + delay >= _deadline)
     {
-        [_lock unlock];
+        // the next attempt could not even start in time, so this failure is the answer
+        return NO;
     }
+    _attempt++;
+    
+    _slotHeld = NO;
+    [self releaseSlot];
+    
+    [_transfer release];
+    _transfer = nil;
+    
+    [_response release];
+    _response = nil;
+    [_data release];
+    _data = nil;
+    _statusCode = 0;
+    _windowLength = 0;
+    
+    dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(delay * NSEC_PER_SEC)), _queue, ^{
+        if(!_ended)
+        {
+            [self start];
+        }
+    });
+    return YES;
+}
+
+- (void) releaseSlot
+{
+#if USE_QUEUE
+    [[CloudRequestScheduler sharedScheduler] requestDidFinish:self];
+#endif
 }
 
-- (void) queueRequest
+- (void) recordMetrics
 {
-    if(!_lock)
+    if(!_sent)
     {
-        _lock = [[NSLock alloc] init];
+        return;
     }
     
-    [_lock lock];
-    @try
+    NSTimeInterval now = [NSDate timeIntervalSinceReferenceDate];
+    // a failed transfer may stop before the headers or the end of the body
+    NSTimeInterval responded = _responded ? _responded : now;
+    NSTimeInterval loaded = _loaded ? _loaded : now;
+    NSTimeInterval phases[CloudRequestPhaseCount];
+    
+    phases[CloudRequestPhaseSigning] = _signEnd - _signStart;
+    phases[CloudRequestPhaseQueued] = _enqueueTime ? MAX(_sent - _enqueueTime, 0) : 0;
+    phases[CloudRequestPhaseRetrying] = _sent - _firstSent;
+    phases[CloudRequestPhaseConnecting] = _connectTime;
+    phases[CloudRequestPhaseFirstByte] = MAX(responded - _sent - _connectTime, 0);
+    phases[CloudRequestPhaseTransfer] = MAX(loaded - responded, 0);
+    phases[CloudRequestPhaseParsing] = now - loaded;
+    phases[CloudRequestPhaseTotal] = now - (_signStart ? _signStart : _firstSent);
+    
+    [[CloudRequestMetrics sharedMetrics] recordRequest:self 
+                                                phases:phases 
+                                             bytesSent:(unsigned long long)[[self HTTPBody] length] * (_attempt + 1) 
+                                         bytesReceived:_bytesReceived 
+                                               retries:_attempt 
+                                                failed:(_failed || _statusCode >= 400)];
+}
+
+// Gives up the request's slot, if it has one, and hands the outcome to the completion on the callback
+// queue. The slot goes first so a busy callback queue doesn't hold back the next request; a request
+// cancelled while it waited never got one. Metrics are recorded after the completion so parsing counts.
+- (void) deliver:(dispatch_block_t)completion
+{
+    if(_slotHeld)
     {
-        if(_tail)
+        _slotHeld = NO;
+        [self releaseSlot];
+    }
+    _ended = YES;
+    
+    dispatch_async(_callbackQueue, ^{
+        completion();
+        if(_measured)
         {
-            [_tail append:self];
+            [self recordMetrics];
         }
-        else
-        {
-            _head = _tail = [self retain];
+    });
+}
 
-            // if I'm the first in queue, start me right away
-            [NSURLConnection connectionWithRequest:self delegate:self];
+- (void) deliverError:(NSError*)error
+{
+    _failed = YES;
+    [self deliver:^{
+        if(_noResponseBlock)
+        {
+            _noResponseBlock(error);
+        }
+        else if(_xmlBlock)
+        {
+            _xmlBlock(nil, error);
+        }
+        else if(_dataBlock)
+        {
+            _dataBlock(nil, error);
         }
+    }];
+}
+
+// Ends the request early, wherever it is: on the network, waiting for a slot, or between attempts.
+- (void) stopWithError:(NSError*)error
+{
+    if(_ended || !_callbackQueue)
+    {
+        return;
     }
-    @finally 
+    
+    if(_transfer)
     {
-        [_lock unlock];
+        [_transport cancelTransfer:_transfer];
     }
+#if USE_QUEUE
+    [[CloudRequestScheduler sharedScheduler] removeRequest:self];
+#endif
+    
+    [self deliverError:error];
 }
 
-#pragma mark -
-#endif
+- (void) cancel
+{
+    dispatch_async(_queue, ^{
+        [self stopWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]];
+    });
+}
+
+- (void) setDeadline:(NSTimeInterval)deadline
+{
+    dispatch_async(_queue, ^{
+        _deadline = deadline;
+        if(_ended || deadline <= 0)
+        {
+            return;
+        }
+        
+        NSTimeInterval remaining = MAX(deadline - [NSDate timeIntervalSinceReferenceDate], 0);
+        dispatch_after(dispatch_time(DISPATCH_TIME_NOW, (int64_t)(remaining * NSEC_PER_SEC)), _queue, ^{
+            // a deadline that has since been moved or removed doesn't count
+            if(_deadline == deadline)
+            {
+                [self stopWithError:[NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorTimedOut userInfo:nil]];
+            }
+        });
+    });
+}
+
+- (BOOL) isFinished
+{
+    return _ended;
+}
+
+- (void) startFetch
+{
+    // settled now, while the owner is certainly still around
+    _callbackQueue = [_owner respondsToSelector:@selector(requestCallbackQueue)] ? [_owner requestCallbackQueue] : dispatch_get_main_queue();
+    dispatch_retain(_callbackQueue);
+    
+    [self start];
+}
 
 - (void) fetchNoResponseWithBlock:(noResponseBlock)block
 {
     _noResponseBlock = [block copy];
 	
-#if USE_QUEUE
-    [self queueRequest];
-#else
-	[NSURLConnection connectionWithRequest:self delegate:self];
-#endif
+    [self startFetch];
 }
 
 - (void) fetchXMLWithBlock:(xmlBlock)block
 {
     _xmlBlock = [block copy];
 	
-#if USE_QUEUE
-    [self queueRequest];
-#else
-	[NSURLConnection connectionWithRequest:self delegate:self];
-#endif
+    [self startFetch];
 }
 
 - (void) fetchDataWithBlock:(dataBlock)block
 {
     _dataBlock = [block copy];
 	
-#if USE_QUEUE
-    [self queueRequest];
-#else
-	[NSURLConnection connectionWithRequest:self delegate:self];
-#endif
+    [self startFetch];
+}
+
+- (void) fetchStreamWithWindowSize:(NSUInteger)windowSize chunkBlock:(chunkBlock)chunk completion:(noResponseBlock)block
+{
+    _chunkBlock = [chunk copy];
+    _noResponseBlock = [block copy];
+    _windowSize = windowSize ? windowSize : 1;
+	
+    [self startFetch];
+}
+
+- (void) fetchWithStreamParser:(id<CloudStreamParser>)parser completion:(noResponseBlock)block
+{
+    _streamParser = [parser retain];
+    _noResponseBlock = [block copy];
+	
+    [self startFetch];
 }
 
 - (void)dealloc
 {
+	[_noResponseBlock release];
 	[_xmlBlock release];
 	[_dataBlock release];
+	[_chunkBlock release];
+	[_streamParser release];
 	[_data release];
+	[_response release];
+	[_transport release];
+	[_transfer release];
+	[_retryPolicy release];
+	free(_window);
+	dispatch_release(_queue);
+	if(_callbackQueue)
+	{
+		dispatch_release(_callbackQueue);
+	}
 	
 	[super dealloc];
 }
@@ -153,15 +362,144 @@ static NSLock* _lock;
     }
 }
 
-#pragma mark NSURLConnectionDelegate
+#pragma mark Streaming support
+
+- (BOOL)isStreaming
+{
+    // error bodies are small XML documents; buffer them so they can be parsed at the end
+    return _chunkBlock && _statusCode < 300;
+}
 
-- (void)connection:(NSURLConnection *)connection didReceiveResponse:(NSURLResponse *)response
+- (BOOL)sendChunk:(const uint8_t*)bytes length:(NSUInteger)length
 {
+    NSData* chunk = [[NSData alloc] initWithBytesNoCopy:(void*)bytes length:length freeWhenDone:NO];
+    _delivered = YES;
+    BOOL keepGoing = _chunkBlock(chunk);
+    [chunk release];
+    
+    return keepGoing;
+}
+
+- (BOOL)streamBytes:(const uint8_t*)bytes length:(NSUInteger)length
+{
+    while(length > 0)
+    {
+        // a full window's worth with nothing pending goes straight to the consumer without a copy
+        if(_windowLength == 0 && length >= _windowSize)
+        {
+            if(![self sendChunk:bytes length:_windowSize])
+            {
+                return NO;
+            }
+            
+            bytes += _windowSize;
+            length -= _windowSize;
+            continue;
+        }
+        
+        NSUInteger count = MIN(length, _windowSize - _windowLength);
+        memcpy(_window + _windowLength, bytes, count);
+        _windowLength += count;
+        bytes += count;
+        length -= count;
+        
+        if(_windowLength == _windowSize)
+        {
+            _windowLength = 0;
+            if(![self sendChunk:_window length:_windowSize])
+            {
+                return NO;
+            }
+        }
+    }
+    
+    return YES;
+}
+
+- (NSError*)errorInBody
+{
+    const uint8_t* bytes = [_data bytes];
+    const uint8_t* end = bytes + [_data length];
+    
+    while(bytes < end && isspace(*bytes))
+    {
+        bytes++;
+    }
+    
+    // the table service answers JSON requests with JSON errors
+    if(bytes < end && *bytes == '{')
+    {
+        return [JsonStreamParser errorInBody:_data];
+    }
+    
+    xmlDocPtr doc = xmlReadMemory([_data bytes], (int)[_data length], NULL, NULL, (XML_PARSE_NOCDATA | XML_PARSE_NOBLANKS)); 
+    NSError* error = [XmlHelper checkForError:doc];
+    xmlFreeDoc(doc);
+    
+    return error;
+}
+
+- (NSString*)reasonCode
+{
+    if(_statusCode < 300 || !_data)
+    {
+        return nil;
+    }
+    
+    return [[[self errorInBody] userInfo] objectForKey:@"AzureReasonCode"];
+}
+
+#pragma mark -
+
+#pragma mark Transport events
+
+- (void)receiveResponse:(NSURLResponse *)response
+{
+    if(_measured)
+    {
+        _responded = [NSDate timeIntervalSinceReferenceDate];
+    }
+    
     _expectedContentLength = [response expectedContentLength];
+    
+    if([response isKindOfClass:[NSHTTPURLResponse class]])
+    {
+        [_response release];
+        _response = (NSHTTPURLResponse*)[response retain];
+        _statusCode = [_response statusCode];
+    }
+    
+    if([self isStreaming] && !_window)
+    {
+        _window = malloc(_windowSize);
+    }
 }
 
-- (void)connection:(NSURLConnection *)connection didReceiveData:(NSData *)data
+- (void)receiveData:(NSData *)data
 {
+    _bytesReceived += [data length];
+    
+    if(_streamParser && _statusCode < 300)
+    {
+        // a malformed body is reported once the transfer completes
+        [_streamParser parseBytes:[data bytes] length:[data length]];
+        _delivered = YES;
+        return;
+    }
+    
+    if([self isStreaming])
+    {
+        if(![self streamBytes:[data bytes] length:[data length]])
+        {
+            [_transport cancelTransfer:_transfer];
+            _failed = YES;
+            [self deliver:^{
+                _noResponseBlock([NSError errorWithDomain:NSURLErrorDomain code:NSURLErrorCancelled userInfo:nil]);
+            }];
+        }
+        return;
+    }
+    
 	if(!_data)
 	{
 		_data = [data mutableCopy];
@@ -172,9 +510,78 @@ static NSLock* _lock;
 	}
 }
 
--(void)connectionDidFinishLoading:(NSURLConnection *)connection
+- (void)finishLoading
 {
-    if(_noResponseBlock)
+    if(_measured)
+    {
+        _loaded = [NSDate timeIntervalSinceReferenceDate];
+    }
+    
+    if(_statusCode >= 300 && [self retryWithError:nil])
+    {
+        return;
+    }
+    
+    if(_streamParser)
+    {
+        NSError* error = nil;
+        
+        if(_statusCode < 300)
+        {
+            [_streamParser finish];
+            error = [_streamParser error];
+        }
+        else if(_data)
+        {
+            // error bodies were buffered rather than parsed, so a retry would have found the parser untouched
+            error = [self errorInBody];
+        }
+        
+        if(!error && _statusCode >= 300)
+        {
+            error = [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                        code:-1 
+                                    userInfo:[NSDictionary dictionaryWithObject:[NSHTTPURLResponse localizedStringForStatusCode:_statusCode] forKey:NSLocalizedDescriptionKey]];
+        }
+        
+        [self deliver:^{
+            _noResponseBlock(error);
+        }];
+    }
+    else if([self isStreaming])
+    {
+        if(_windowLength > 0)
+        {
+            // the transfer is complete, so a cancel here has nothing left to stop
+            [self sendChunk:_window length:_windowLength];
+            _windowLength = 0;
+        }
+        
+        [self deliver:^{
+            _noResponseBlock(nil);
+        }];
+    }
+    else if(_chunkBlock)
+    {
+        NSError* error = nil;
+        
+        if(_data)
+        {
+            error = [self errorInBody];
+        }
+        
+        if(!error)
+        {
+            error = [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                        code:-1 
+                                    userInfo:[NSDictionary dictionaryWithObject:[NSHTTPURLResponse localizedStringForStatusCode:_statusCode] forKey:NSLocalizedDescriptionKey]];
+        }
+        
+        [self deliver:^{
+            _noResponseBlock(error);
+        }];
+    }
+    else if(_noResponseBlock)
     {
 #if FULL_LOGGING
         if(_data)
@@ -185,23 +592,11 @@ static NSLock* _lock;
             [xmlStr release];
         }
 #endif
-        if(_data)
-        {
-            const char *baseURL = NULL;
-            const char *encoding = NULL;
-            
-            xmlDocPtr doc = xmlReadMemory([_data bytes], (int)[_data length], baseURL, encoding, (XML_PARSE_NOCDATA | XML_PARSE_NOBLANKS)); 
-            NSError* error = [XmlHelper checkForError:doc];
-            xmlFreeDoc(doc);
-            
-            if(error)
-            {
-                _noResponseBlock(error);
-                return;
-            }
-        }
+        NSError* error = _data ? [self errorInBody] : nil;
         
-        _noResponseBlock(nil);
+        [self deliver:^{
+            _noResponseBlock(error);
+        }];
     }
 	else if(_xmlBlock)
 	{
@@ -227,47 +622,80 @@ static NSLock* _lock;
         
         NSError* error = [XmlHelper checkForError:doc];
 
-        if(error)
-        {
-            _xmlBlock(nil, error);
-        }
-        else
-        {
-            _xmlBlock(doc, nil);
-        }
-		
-		xmlFreeDoc(doc);
+        // the document is read here; only building objects from it is left to the completion
+        [self deliver:^{
+            _xmlBlock(error ? NULL : doc, error);
+            xmlFreeDoc(doc);
+        }];
 	}
 	else if(_dataBlock)
 	{
-        _dataBlock(_data, nil);
+        [self deliver:^{
+            _dataBlock(_data, nil);
+        }];
 	}
-
-#if USE_QUEUE
-//  [self performSelector:@selector(startNext) withObject:nil afterDelay:0.0];
-    [self startNext];
-#endif
 }
 
-- (void)connection:(NSURLConnection *)connection didFailWithError:(NSError *)error
+- (void)failWithError:(NSError *)error
 {
-    if(_noResponseBlock)
+    if([self retryWithError:error])
     {
-        _noResponseBlock(error);
-    }
-	else if(_xmlBlock)
-	{
-        _xmlBlock(nil, error);
-    }
-    else if(_dataBlock)
-    {
-        _dataBlock(nil, error);
+        return;
     }
+    
+    [self deliverError:error];
+}
 
-#if USE_QUEUE
-//  [self performSelector:@selector(startNext) withObject:nil afterDelay:0.0];
-    [self startNext];
-#endif
+#pragma mark CloudTransportClient
+
+// The transport calls in on its own thread; everything after that happens in order on our queue.
+// Events still queued when the request has ended, as after a cancel or a timeout, are dropped.
+
+- (void)transportDidReceiveResponse:(NSURLResponse *)response
+{
+    dispatch_async(_queue, ^{
+        if(!_ended)
+        {
+            [self receiveResponse:response];
+        }
+    });
+}
+
+- (void)transportDidReceiveData:(NSData *)data
+{
+    dispatch_async(_queue, ^{
+        if(!_ended)
+        {
+            [self receiveData:data];
+        }
+    });
+}
+
+- (void)transportDidMeasureConnectTime:(NSTimeInterval)connectTime
+{
+    dispatch_async(_queue, ^{
+        _connectTime = connectTime;
+    });
+}
+
+- (void)transportDidFinishLoading
+{
+    dispatch_async(_queue, ^{
+        if(!_ended)
+        {
+            [self finishLoading];
+        }
+    });
+}
+
+- (void)transportDidFailWithError:(NSError *)error
+{
+    dispatch_async(_queue, ^{
+        if(!_ended)
+        {
+            [self failWithError:error];
+        }
+    });
 }
 
 #pragma mark -
@@ -0,0 +1,41 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "XmlStreamParser.h"
+#import "BlobListing+Private.h"
+
+// Reads a List Blobs page straight into a BlobListing. The text of each Blob's name and
+// properties is copied into the listing's arena as its end tag is read, so no per-blob
+// dictionaries or strings are made. BlobPrefix records, NextMarker and error documents go
+// through XmlStreamParser as usual.
+@interface BlobListingParser : XmlStreamParser
+{
+    BlobListing* _listing;
+    NSUInteger _blobDepth;
+    BOOL _inProperties;
+    
+    BlobListingEntry _entry;
+    BOOL _hasName;
+    int _field;
+    char* _value;
+    NSUInteger _valueLength;
+    NSUInteger _valueCapacity;
+}
+
+// Blobs are appended to listing, so one listing can collect several pages.
+- (id)initWithListing:(BlobListing*)listing;
+
+@end
@@ -0,0 +1,243 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "BlobListingParser.h"
+#import <math.h>
+#import <time.h>
+#import <xlocale.h>
+
+// The values of a Blob record that are kept.
+enum
+{
+    BlobFieldNone = 0,
+    BlobFieldName,
+    BlobFieldEtag,
+    BlobFieldContentLength,
+    BlobFieldContentType,
+    BlobFieldContentMD5,
+    BlobFieldLastModified,
+    BlobFieldBlobType
+};
+
+static int BlobFieldForProperty(const xmlChar* localname)
+{
+    if(xmlStrEqual(localname, BAD_CAST "Etag"))
+    {
+        return BlobFieldEtag;
+    }
+    if(xmlStrEqual(localname, BAD_CAST "Content-Length"))
+    {
+        return BlobFieldContentLength;
+    }
+    if(xmlStrEqual(localname, BAD_CAST "Content-Type"))
+    {
+        return BlobFieldContentType;
+    }
+    if(xmlStrEqual(localname, BAD_CAST "Content-MD5"))
+    {
+        return BlobFieldContentMD5;
+    }
+    if(xmlStrEqual(localname, BAD_CAST "Last-Modified"))
+    {
+        return BlobFieldLastModified;
+    }
+    if(xmlStrEqual(localname, BAD_CAST "BlobType"))
+    {
+        return BlobFieldBlobType;
+    }
+    
+    return BlobFieldNone;
+}
+
+@implementation BlobListingParser
+
+- (id)initWithListing:(BlobListing*)listing
+{
+    if((self = [super init]))
+    {
+        _listing = [listing retain];
+        _valueCapacity = 256;
+        _value = malloc(_valueCapacity);
+        
+        [self addRecordPath:@"EnumerationResults/Blobs/BlobPrefix" block:^(NSDictionary* record)
+         {
+             NSString* name = [record objectForKey:@"Name"];
+             if(name)
+             {
+                 [listing addPrefix:name];
+             }
+         }];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_listing release];
+    free(_value);
+    
+    [super dealloc];
+}
+
+- (void)endField
+{
+    // the value is NUL-terminated for the conversions below
+    _value[_valueLength] = 0;
+    
+    switch(_field)
+    {
+        case BlobFieldName:
+            _entry.name = [_listing appendBytes:_value length:_valueLength];
+            _hasName = YES;
+            break;
+        case BlobFieldEtag:
+            _entry.etag = [_listing appendBytes:_value length:_valueLength];
+            break;
+        case BlobFieldContentType:
+            _entry.contentType = [_listing internBytes:_value length:_valueLength];
+            break;
+        case BlobFieldContentMD5:
+            _entry.contentMD5 = [_listing appendBytes:_value length:_valueLength];
+            break;
+        case BlobFieldContentLength:
+            if(_valueLength > 0)
+            {
+                _entry.contentLength = strtoll(_value, NULL, 10);
+            }
+            break;
+        case BlobFieldLastModified:
+        {
+            struct tm components;
+            
+            memset(&components, 0, sizeof(components));
+            if(strptime_l(_value, "%a, %d %b %Y %H:%M:%S GMT", &components, NULL))
+            {
+                _entry.lastModified = timegm(&components) - NSTimeIntervalSince1970;
+            }
+            break;
+        }
+        case BlobFieldBlobType:
+            if(strcmp(_value, "BlockBlob") == 0)
+            {
+                _entry.blobType = BlobListingTypeBlock;
+            }
+            else if(strcmp(_value, "PageBlob") == 0)
+            {
+                _entry.blobType = BlobListingTypePage;
+            }
+            else if(strcmp(_value, "AppendBlob") == 0)
+            {
+                _entry.blobType = BlobListingTypeAppend;
+            }
+            break;
+    }
+}
+
+#pragma mark SAX callbacks
+
+- (void)startElement:(const xmlChar*)localname attributes:(const xmlChar**)attributes count:(int)count
+{
+    if(_blobDepth == 0)
+    {
+        if(_path.count == 2 && xmlStrEqual(localname, BAD_CAST "Blob") && [[_path lastObject] isEqualToString:@"Blobs"])
+        {
+            _blobDepth = 1;
+            memset(&_entry, 0, sizeof(_entry));
+            _entry.contentLength = -1;
+            _entry.lastModified = NAN;
+            _hasName = NO;
+            return;
+        }
+        
+        [super startElement:localname attributes:attributes count:count];
+        return;
+    }
+    
+    _blobDepth++;
+    _field = BlobFieldNone;
+    _valueLength = 0;
+    
+    if(_blobDepth == 2)
+    {
+        if(xmlStrEqual(localname, BAD_CAST "Name"))
+        {
+            _field = BlobFieldName;
+        }
+        else if(xmlStrEqual(localname, BAD_CAST "Properties"))
+        {
+            _inProperties = YES;
+        }
+    }
+    else if(_blobDepth == 3 && _inProperties)
+    {
+        _field = BlobFieldForProperty(localname);
+    }
+}
+
+- (void)endElement
+{
+    if(_blobDepth == 0)
+    {
+        [super endElement];
+        return;
+    }
+    
+    if(_blobDepth == 1)
+    {
+        if(_hasName)
+        {
+            [_listing addEntry:&_entry];
+        }
+    }
+    else if(_field != BlobFieldNone)
+    {
+        [self endField];
+        _field = BlobFieldNone;
+    }
+    else if(_blobDepth == 2)
+    {
+        _inProperties = NO;
+    }
+    
+    _blobDepth--;
+}
+
+- (void)characters:(const xmlChar*)chars length:(int)length
+{
+    if(_blobDepth == 0)
+    {
+        [super characters:chars length:length];
+        return;
+    }
+    
+    if(_field == BlobFieldNone)
+    {
+        return;
+    }
+    
+    // one byte spare for the terminator endField adds
+    if(_valueLength + length + 1 > _valueCapacity)
+    {
+        _valueCapacity = MAX(_valueCapacity * 2, _valueLength + length + 1);
+        _value = realloc(_value, _valueCapacity);
+    }
+    
+    memcpy(_value + _valueLength, chars, length);
+    _valueLength += length;
+}
+
+@end
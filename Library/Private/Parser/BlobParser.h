@@ -19,10 +19,14 @@
 #import <libxml/tree.h>
 
 @class BlobContainer;
+@class XmlStreamParser;
 
 @interface BlobParser : NSObject
 
 + (NSArray *)loadBlobs:(xmlDocPtr)doc container:(BlobContainer*)container;
++ (NSArray *)loadBlobPrefixes:(xmlDocPtr)doc;
+// Registers the Blob and BlobPrefix records of a List Blobs response with parser.
++ (void)addBlobRecordsToParser:(XmlStreamParser *)parser container:(BlobContainer*)container blobs:(NSMutableArray *)blobs prefixes:(NSMutableArray *)prefixes;
 + (NSArray *)loadBlobsForProxy:(xmlDocPtr)doc container:(BlobContainer*)container;
 
 @end
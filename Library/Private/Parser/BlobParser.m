@@ -17,10 +17,12 @@
 #import "BlobParser.h"
 #import "Blob.h"
 #import "XmlHelper.h"
+#import "XmlStreamParser.h"
 
 @interface Blob (Private)
 
 - (id)initBlobWithName:(NSString *)name URL:(NSString *)URL container:(BlobContainer*)container;
+- (id)initBlobWithName:(NSString *)name URL:(NSString *)URL container:(BlobContainer*)container properties:(NSDictionary*)properties;
 
 @end
 
@@ -41,13 +43,62 @@
      {
          NSString *name = [XmlHelper getElementValue:node name:@"Name"];
          NSString *url = [XmlHelper getElementValue:node name:@"Url"];
+         NSDictionary *properties = [XmlHelper getElementValues:node name:@"Properties"];
        
-         Blob *blob = [[Blob alloc] initBlobWithName:name URL:url container:container];
+         Blob *blob = [[Blob alloc] initBlobWithName:name URL:url container:container properties:properties];
          [blobs addObject:blob];
          [blob release];
      }];
 	
-	return [[blobs copy] autorelease];
+	return blobs;
+}
+
++ (NSArray *)loadBlobPrefixes:(xmlDocPtr)doc
+{
+    if (doc == nil) 
+    { 
+		return nil; 
+	}
+    
+	NSMutableArray *prefixes = [NSMutableArray arrayWithCapacity:10];
+    
+    [XmlHelper performXPath:@"/EnumerationResults/Blobs/BlobPrefix" 
+                 onDocument:doc 
+                      block:^(xmlNodePtr node)
+     {
+         NSString *name = [XmlHelper getElementValue:node name:@"Name"];
+         if (name)
+         {
+             [prefixes addObject:name];
+         }
+     }];
+	
+	return [[prefixes copy] autorelease];
+}
+
++ (void)addBlobRecordsToParser:(XmlStreamParser *)parser container:(BlobContainer*)container blobs:(NSMutableArray *)blobs prefixes:(NSMutableArray *)prefixes
+{
+    [parser addRecordPath:@"EnumerationResults/Blobs/Blob" block:^(NSDictionary *record)
+     {
+         NSDictionary *properties = [record objectForKey:@"Properties"];
+         if (![properties isKindOfClass:[NSDictionary class]])
+         {
+             properties = nil;
+         }
+         
+         Blob *blob = [[Blob alloc] initBlobWithName:[record objectForKey:@"Name"] URL:[record objectForKey:@"Url"] container:container properties:properties];
+         [blobs addObject:blob];
+         [blob release];
+     }];
+    
+    [parser addRecordPath:@"EnumerationResults/Blobs/BlobPrefix" block:^(NSDictionary *record)
+     {
+         NSString *name = [record objectForKey:@"Name"];
+         if (name)
+         {
+             [prefixes addObject:name];
+         }
+     }];
 }
 
 + (NSArray *)loadBlobsForProxy:(xmlDocPtr)doc container:(BlobContainer*)container
@@ -71,7 +122,7 @@
          [blob release];
      }];
 	
-	return [[blobs copy] autorelease];
+	return blobs;
 }
 
 @end
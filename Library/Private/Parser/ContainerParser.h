@@ -17,9 +17,13 @@
 #import <Foundation/Foundation.h>
 #import <libxml/tree.h>
 
+@class XmlStreamParser;
+
 @interface ContainerParser : NSObject
 
 + (NSArray *)loadContainers:(xmlDocPtr)doc;
+// Registers the Container records of a List Containers response with parser.
++ (void)addContainerRecordsToParser:(XmlStreamParser *)parser containers:(NSMutableArray *)containers;
 + (NSArray *)loadContainersForProxy:(xmlDocPtr)doc;
 
 @end
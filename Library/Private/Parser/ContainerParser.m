@@ -17,10 +17,12 @@
 #import "ContainerParser.h"
 #import "BlobContainer.h"
 #import "XmlHelper.h"
+#import "XmlStreamParser.h"
 
 @interface BlobContainer (Private)
 
 - (id)initContainerWithName:(NSString *)name URL:(NSString *)URL metadata:(NSString *)metadata;
+- (id)initContainerWithName:(NSString *)name URL:(NSString *)URL metadata:(NSString *)metadata properties:(NSDictionary *)properties;
 
 @end
 
@@ -42,8 +44,9 @@
          NSString *name = [XmlHelper getElementValue:node name:@"Name"];
          NSString *url = [XmlHelper getElementValue:node name:@"Url"];
          NSString *metadata = [XmlHelper getElementValue:node name:@"Metadata"];
+         NSDictionary *properties = [XmlHelper getElementValues:node name:@"Properties"];
 
-         BlobContainer *container = [[BlobContainer alloc] initContainerWithName:name URL:url metadata:metadata];
+         BlobContainer *container = [[BlobContainer alloc] initContainerWithName:name URL:url metadata:metadata properties:properties];
          [containers addObject:container];
          [container release];
      }];
@@ -51,6 +54,38 @@
     return [[containers copy] autorelease];
 }
 
++ (void)addContainerRecordsToParser:(XmlStreamParser *)parser containers:(NSMutableArray *)containers
+{
+    [parser addRecordPath:@"EnumerationResults/Containers/Container" block:^(NSDictionary *record)
+     {
+         NSDictionary *properties = [record objectForKey:@"Properties"];
+         if (![properties isKindOfClass:[NSDictionary class]])
+         {
+             properties = nil;
+         }
+         
+         // the DOM parser reports Metadata as the concatenated text of its children
+         id metadata = [record objectForKey:@"Metadata"];
+         if ([metadata isKindOfClass:[NSDictionary class]])
+         {
+             NSMutableString *text = [NSMutableString stringWithCapacity:64];
+             for (NSString *key in [[metadata allKeys] sortedArrayUsingSelector:@selector(compare:)])
+             {
+                 id value = [metadata objectForKey:key];
+                 if ([value isKindOfClass:[NSString class]])
+                 {
+                     [text appendString:value];
+                 }
+             }
+             metadata = text;
+         }
+         
+         BlobContainer *container = [[BlobContainer alloc] initContainerWithName:[record objectForKey:@"Name"] URL:[record objectForKey:@"Url"] metadata:metadata properties:properties];
+         [containers addObject:container];
+         [container release];
+     }];
+}
+
 + (NSArray *)loadContainersForProxy:(xmlDocPtr)doc {
     
     if (doc == nil) 
@@ -0,0 +1,44 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "TableResultSet.h"
+
+// Conversions between the OData (EDM) wire form of table properties and native values. They work
+// on raw bytes so the column parser can use them straight from libxml's buffers.
+
+// The column type named by an m:type attribute; TableColumnTypeString for names we don't know.
+TableColumnType EdmTypeForName(const char* name, NSUInteger length);
+// The m:type value for a column type, or nil for plain strings.
+NSString* EdmNameForType(TableColumnType type);
+
+// Parses yyyy-MM-ddTHH:mm:ss[.fffffff][Z|+hh:mm] into seconds since the reference date.
+BOOL EdmParseDateTime(const char* chars, NSUInteger length, NSTimeInterval* result);
+// Formats a date the way the table service writes it, with seven fractional digits.
+NSString* EdmFormatDateTime(NSTimeInterval interval);
+
+BOOL EdmParseInt32(const char* chars, NSUInteger length, int32_t* result);
+BOOL EdmParseInt64(const char* chars, NSUInteger length, int64_t* result);
+BOOL EdmParseDouble(const char* chars, NSUInteger length, double* result);
+BOOL EdmParseBoolean(const char* chars, NSUInteger length, BOOL* result);
+BOOL EdmParseGuid(const char* chars, NSUInteger length, uint8_t result[16]);
+
+// The wire text and type of a property value for an outgoing entity that writes typed values, as rows
+// read into a TableResultSet do. NSNumber, NSDate, NSData and NSUUID values get their EDM type;
+// anything else is sent as its description with no type. Numbers boxed from int or smaller are
+// Edm.Int32 and wider integers, NSInteger included, are Edm.Int64. Returns nil for an unsigned value
+// above INT64_MAX, which no EDM type can hold.
+NSString* EdmStringForValue(id value, TableColumnType* type);
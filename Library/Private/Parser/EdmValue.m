@@ -0,0 +1,334 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "EdmValue.h"
+#import "SimpleBase64.h"
+#import <uuid/uuid.h>
+#import <time.h>
+
+static const char* const EdmTypeNames[] =
+{
+    "Edm.String", "Edm.Int32", "Edm.Int64", "Edm.Double", "Edm.Boolean", "Edm.DateTime", "Edm.Guid", "Edm.Binary"
+};
+
+TableColumnType EdmTypeForName(const char* name, NSUInteger length)
+{
+    for(int type = TableColumnTypeInt32; type <= TableColumnTypeBinary; type++)
+    {
+        if(strlen(EdmTypeNames[type]) == length && memcmp(EdmTypeNames[type], name, length) == 0)
+        {
+            return (TableColumnType)type;
+        }
+    }
+    
+    return TableColumnTypeString;
+}
+
+NSString* EdmNameForType(TableColumnType type)
+{
+    if(type == TableColumnTypeString || type > TableColumnTypeBinary)
+    {
+        return nil;
+    }
+    
+    return [NSString stringWithUTF8String:EdmTypeNames[type]];
+}
+
+#pragma mark DateTime
+
+static BOOL ReadDigits(const char* chars, NSUInteger count, int* value)
+{
+    int result = 0;
+    
+    for(NSUInteger n = 0; n < count; n++)
+    {
+        unsigned digit = (unsigned)(chars[n] - '0');
+        if(digit > 9)
+        {
+            return NO;
+        }
+        result = result * 10 + digit;
+    }
+    
+    *value = result;
+    return YES;
+}
+
+// days between 1970-01-01 and a proleptic Gregorian date, without going through the calendar APIs
+static int64_t DaysFromCivil(int64_t year, unsigned month, unsigned day)
+{
+    year -= (month <= 2);
+    int64_t era = (year >= 0 ? year : year - 399) / 400;
+    unsigned yearOfEra = (unsigned)(year - era * 400);
+    unsigned dayOfYear = (153 * (month > 2 ? month - 3 : month + 9) + 2) / 5 + day - 1;
+    unsigned dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+    
+    return era * 146097 + (int64_t)dayOfEra - 719468;
+}
+
+BOOL EdmParseDateTime(const char* chars, NSUInteger length, NSTimeInterval* result)
+{
+    int year, month, day, hour, minute, second;
+    
+    if(length < 19 || chars[4] != '-' || chars[7] != '-' || chars[10] != 'T' || chars[13] != ':' || chars[16] != ':')
+    {
+        return NO;
+    }
+    
+    if(!ReadDigits(chars, 4, &year) || !ReadDigits(chars + 5, 2, &month) || !ReadDigits(chars + 8, 2, &day) ||
+       !ReadDigits(chars + 11, 2, &hour) || !ReadDigits(chars + 14, 2, &minute) || !ReadDigits(chars + 17, 2, &second) ||
+       month < 1 || month > 12 || day < 1 || day > 31 || hour > 23 || minute > 59 || second > 60)
+    {
+        return NO;
+    }
+    
+    NSUInteger position = 19;
+    double fraction = 0;
+    
+    if(position < length && chars[position] == '.')
+    {
+        double scale = 0.1;
+        
+        for(position++; position < length && chars[position] >= '0' && chars[position] <= '9'; position++)
+        {
+            fraction += (chars[position] - '0') * scale;
+            scale /= 10;
+        }
+    }
+    
+    int offset = 0;
+    
+    if(position < length && chars[position] == 'Z')
+    {
+        position++;
+    }
+    else if(position < length && (chars[position] == '+' || chars[position] == '-'))
+    {
+        int offsetHours, offsetMinutes;
+        
+        if(length - position != 6 || chars[position + 3] != ':' ||
+           !ReadDigits(chars + position + 1, 2, &offsetHours) || !ReadDigits(chars + position + 4, 2, &offsetMinutes))
+        {
+            return NO;
+        }
+        
+        offset = (offsetHours * 60 + offsetMinutes) * 60;
+        if(chars[position] == '-')
+        {
+            offset = -offset;
+        }
+        position = length;
+    }
+    
+    if(position != length)
+    {
+        return NO;
+    }
+    
+    int64_t seconds = DaysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second - offset;
+    *result = (double)seconds - NSTimeIntervalSince1970 + fraction;
+    
+    return YES;
+}
+
+NSString* EdmFormatDateTime(NSTimeInterval interval)
+{
+    double since1970 = interval + NSTimeIntervalSince1970;
+    double whole = floor(since1970);
+    long ticks = lround((since1970 - whole) * 1e7);
+    
+    if(ticks >= 10000000)
+    {
+        whole += 1;
+        ticks -= 10000000;
+    }
+    
+    time_t seconds = (time_t)whole;
+    struct tm parts;
+    char buffer[40];
+    
+    gmtime_r(&seconds, &parts);
+    snprintf(buffer, sizeof(buffer), "%04d-%02d-%02dT%02d:%02d:%02d.%07ldZ",
+             parts.tm_year + 1900, parts.tm_mon + 1, parts.tm_mday, parts.tm_hour, parts.tm_min, parts.tm_sec, ticks);
+    
+    return [NSString stringWithUTF8String:buffer];
+}
+
+#pragma mark Scalars
+
+static BOOL ParseInteger(const char* chars, NSUInteger length, int64_t max, int64_t* result)
+{
+    NSUInteger position = 0;
+    BOOL negative = NO;
+    
+    if(length > 0 && (chars[0] == '-' || chars[0] == '+'))
+    {
+        negative = (chars[0] == '-');
+        position = 1;
+    }
+    
+    if(position == length)
+    {
+        return NO;
+    }
+    
+    // the negative range reaches one further than the positive one
+    uint64_t limit = negative ? (uint64_t)max + 1 : (uint64_t)max;
+    uint64_t value = 0;
+    
+    for(; position < length; position++)
+    {
+        unsigned digit = (unsigned)(chars[position] - '0');
+        if(digit > 9 || value > (limit - digit) / 10)
+        {
+            return NO;
+        }
+        value = value * 10 + digit;
+    }
+    
+    *result = negative ? (int64_t)(0 - value) : (int64_t)value;
+    return YES;
+}
+
+BOOL EdmParseInt32(const char* chars, NSUInteger length, int32_t* result)
+{
+    int64_t value;
+    
+    if(!ParseInteger(chars, length, INT32_MAX, &value))
+    {
+        return NO;
+    }
+    
+    *result = (int32_t)value;
+    return YES;
+}
+
+BOOL EdmParseInt64(const char* chars, NSUInteger length, int64_t* result)
+{
+    return ParseInteger(chars, length, INT64_MAX, result);
+}
+
+BOOL EdmParseDouble(const char* chars, NSUInteger length, double* result)
+{
+    char buffer[64];
+    char* end;
+    
+    // strtod wants a terminated string; no double needs anywhere near this many characters
+    if(length == 0 || length >= sizeof(buffer))
+    {
+        return NO;
+    }
+    
+    memcpy(buffer, chars, length);
+    buffer[length] = 0;
+    *result = strtod(buffer, &end);
+    
+    return (end == buffer + length);
+}
+
+BOOL EdmParseBoolean(const char* chars, NSUInteger length, BOOL* result)
+{
+    if((length == 4 && memcmp(chars, "true", 4) == 0) || (length == 1 && chars[0] == '1'))
+    {
+        *result = YES;
+        return YES;
+    }
+    
+    if((length == 5 && memcmp(chars, "false", 5) == 0) || (length == 1 && chars[0] == '0'))
+    {
+        *result = NO;
+        return YES;
+    }
+    
+    return NO;
+}
+
+BOOL EdmParseGuid(const char* chars, NSUInteger length, uint8_t result[16])
+{
+    char buffer[37];
+    
+    if(length != 36)
+    {
+        return NO;
+    }
+    
+    memcpy(buffer, chars, 36);
+    buffer[36] = 0;
+    
+    return (uuid_parse(buffer, result) == 0);
+}
+
+#pragma mark Outgoing values
+
+NSString* EdmStringForValue(id value, TableColumnType* type)
+{
+    if([value isKindOfClass:[NSNumber class]])
+    {
+        const char* objCType = [value objCType];
+        
+        if(CFGetTypeID((CFTypeRef)value) == CFBooleanGetTypeID())
+        {
+            *type = TableColumnTypeBoolean;
+            return [value boolValue] ? @"true" : @"false";
+        }
+        
+        switch(objCType[0])
+        {
+            case 'f':
+            case 'd':
+                *type = TableColumnTypeDouble;
+                return [NSString stringWithFormat:@"%.17g", [value doubleValue]];
+            case 'I':
+            case 'l':
+            case 'q':
+                *type = TableColumnTypeInt64;
+                return [NSString stringWithFormat:@"%lld", [value longLongValue]];
+            case 'L':
+            case 'Q':
+                // Edm.Int64 is signed, so there is no way to write the top half of the unsigned range
+                if([value unsignedLongLongValue] > INT64_MAX)
+                {
+                    return nil;
+                }
+                *type = TableColumnTypeInt64;
+                return [NSString stringWithFormat:@"%llu", [value unsignedLongLongValue]];
+            default:
+                *type = TableColumnTypeInt32;
+                return [NSString stringWithFormat:@"%d", [value intValue]];
+        }
+    }
+    
+    if([value isKindOfClass:[NSDate class]])
+    {
+        *type = TableColumnTypeDateTime;
+        return EdmFormatDateTime([value timeIntervalSinceReferenceDate]);
+    }
+    
+    if([value isKindOfClass:[NSData class]])
+    {
+        *type = TableColumnTypeBinary;
+        return [SimpleBase64 encode:value];
+    }
+    
+    if([value isKindOfClass:[NSUUID class]])
+    {
+        *type = TableColumnTypeGuid;
+        return [[value UUIDString] lowercaseString];
+    }
+    
+    *type = TableColumnTypeString;
+    return [value description];
+}
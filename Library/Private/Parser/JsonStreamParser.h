@@ -0,0 +1,62 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "CloudURLRequest.h"
+
+// Incremental JSON reader, fed from the connection as bytes arrive. Each object inside a registered
+// member array of the root object (e.g. the @"value" array of an OData feed) is folded into a
+// dictionary as soon as its closing brace is read: scalar members map their name to their text as
+// it appeared on the wire (numbers and true/false unquoted), while nulls, annotations and nested
+// containers are dropped. Nothing else is kept apart from the code and message of an odata.error.
+@interface JsonStreamParser : NSObject <CloudStreamParser>
+{
+    NSMutableDictionary* _recordBlocks;
+    
+    int _state;
+    char _stack[32];
+    NSUInteger _depth;
+    BOOL _expectKey;
+    BOOL _sawRoot;
+    NSMutableData* _token;
+    uint32_t _unicode;
+    int _unicodeDigits;
+    uint32_t _highSurrogate;
+    
+    NSMutableArray* _keys;
+    NSString* _key;
+    NSMutableArray* _memberNames;
+    NSUInteger _member;
+    NSMutableDictionary* _record;
+    void (^_recordBlock)(NSMutableDictionary*);
+    
+    NSString* _errorCode;
+    NSString* _errorMessage;
+    BOOL _failed;
+}
+
+- (void)addRecordArray:(NSString*)key block:(void (^)(NSMutableDictionary*))block;
+
+- (BOOL)parseBytes:(const void*)bytes length:(NSUInteger)length;
+- (BOOL)finish;
+
+// The error described by an odata.error document, or a parse error if the body was not well formed.
+- (NSError*)error;
+
+// The odata.error a buffered body describes, or nil if it describes none.
++ (NSError*)errorInBody:(NSData*)data;
+
+@end
@@ -0,0 +1,498 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "JsonStreamParser.h"
+
+typedef enum
+{
+    JsonStateValue,
+    JsonStateString,
+    JsonStateEscape,
+    JsonStateUnicode,
+    JsonStateLiteral
+} JsonState;
+
+@implementation JsonStreamParser
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        _recordBlocks = [[NSMutableDictionary alloc] initWithCapacity:1];
+        _token = [[NSMutableData alloc] initWithCapacity:256];
+        _keys = [[NSMutableArray alloc] initWithCapacity:8];
+        _memberNames = [[NSMutableArray alloc] initWithCapacity:16];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_recordBlocks release];
+    [_token release];
+    [_keys release];
+    [_key release];
+    [_memberNames release];
+    [_record release];
+    [_recordBlock release];
+    [_errorCode release];
+    [_errorMessage release];
+    
+    [super dealloc];
+}
+
+- (void)addRecordArray:(NSString*)key block:(void (^)(NSMutableDictionary*))block
+{
+    [_recordBlocks setObject:[[block copy] autorelease] forKey:key];
+}
+
+#pragma mark Folding
+
+- (void)setKey:(NSString*)key
+{
+    if(key != _key)
+    {
+        [_key release];
+        _key = [key retain];
+    }
+}
+
+- (NSString*)keyAtDepth:(NSUInteger)depth
+{
+    id key = [_keys objectAtIndex:depth];
+    return (key == [NSNull null]) ? nil : key;
+}
+
+- (BOOL)inErrorDocument
+{
+    return _depth >= 2 && [[self keyAtDepth:1] isEqualToString:@"odata.error"];
+}
+
+- (NSString*)recordKeyForBytes:(const char*)bytes length:(NSUInteger)length
+{
+    // every entity in a feed lists its members in the same order, so compare against the name
+    // this position had last time before making a new string
+    if(_member < [_memberNames count])
+    {
+        NSString* name = [_memberNames objectAtIndex:_member];
+        const char* cached = CFStringGetCStringPtr((CFStringRef)name, kCFStringEncodingUTF8);
+        
+        if(cached && strlen(cached) == length && memcmp(cached, bytes, length) == 0)
+        {
+            return name;
+        }
+    }
+    
+    NSString* name = [[[NSString alloc] initWithBytes:bytes length:length encoding:NSUTF8StringEncoding] autorelease];
+    if(name)
+    {
+        if(_member < [_memberNames count])
+        {
+            [_memberNames replaceObjectAtIndex:_member withObject:name];
+        }
+        else if(_member == [_memberNames count])
+        {
+            [_memberNames addObject:name];
+        }
+    }
+    
+    return name;
+}
+
+- (void)foundKey
+{
+    NSString* key;
+    
+    if(_record && _depth == 3)
+    {
+        key = [self recordKeyForBytes:[_token bytes] length:[_token length]];
+        _member++;
+    }
+    else
+    {
+        key = [[[NSString alloc] initWithData:_token encoding:NSUTF8StringEncoding] autorelease];
+    }
+    
+    if(!key)
+    {
+        _failed = YES;
+    }
+    
+    [self setKey:key];
+    _expectKey = NO;
+}
+
+- (void)foundValue:(NSString*)value
+{
+    if(_record && _depth == 3)
+    {
+        // annotations (Name@odata.type, odata.etag) say nothing the caller reads
+        if(value && _key && [_key rangeOfString:@"@"].location == NSNotFound && ![_key hasPrefix:@"odata."])
+        {
+            [_record setObject:value forKey:_key];
+        }
+    }
+    else if([self inErrorDocument])
+    {
+        if(_depth == 2 && [_key isEqualToString:@"code"])
+        {
+            [_errorCode release];
+            _errorCode = [value copy];
+        }
+        else if((_depth == 2 && [_key isEqualToString:@"message"]) ||
+                (_depth == 3 && [[self keyAtDepth:2] isEqualToString:@"message"] && [_key isEqualToString:@"value"]))
+        {
+            [_errorMessage release];
+            _errorMessage = [value copy];
+        }
+    }
+}
+
+- (void)openContainer:(char)type
+{
+    if(_depth == sizeof(_stack) || (_depth == 0 && _sawRoot))
+    {
+        _failed = YES;
+        return;
+    }
+    
+    [_keys addObject:(_key ? (id)_key : (id)[NSNull null])];
+    _stack[_depth++] = type;
+    _sawRoot = YES;
+    _expectKey = (type == 'o');
+    
+    if(type == 'o' && _depth == 3 && _stack[0] == 'o' && _stack[1] == 'a')
+    {
+        void (^block)(NSMutableDictionary*) = [_recordBlocks objectForKey:[self keyAtDepth:1]];
+        if(block)
+        {
+            _record = [[NSMutableDictionary alloc] initWithCapacity:[_memberNames count]];
+            _recordBlock = [block retain];
+            _member = 0;
+        }
+    }
+    
+    [self setKey:nil];
+}
+
+- (void)closeContainer:(char)type
+{
+    if(_depth == 0 || _stack[_depth - 1] != type)
+    {
+        _failed = YES;
+        return;
+    }
+    
+    if(_record && _depth == 3)
+    {
+        _recordBlock(_record);
+        [_record release];
+        _record = nil;
+        [_recordBlock release];
+        _recordBlock = nil;
+    }
+    
+    _depth--;
+    [_keys removeLastObject];
+    [self setKey:nil];
+    _expectKey = NO;
+}
+
+- (void)endString
+{
+    if(_depth > 0 && _stack[_depth - 1] == 'o' && _expectKey)
+    {
+        [self foundKey];
+        return;
+    }
+    
+    NSString* value = [[NSString alloc] initWithData:_token encoding:NSUTF8StringEncoding];
+    if(!value || _depth == 0)
+    {
+        _failed = YES;
+    }
+    else
+    {
+        [self foundValue:value];
+    }
+    [value release];
+}
+
+- (void)endLiteral
+{
+    const char* bytes = [_token bytes];
+    NSUInteger length = [_token length];
+    
+    if(_depth == 0)
+    {
+        _failed = YES;
+    }
+    else if(bytes[0] == 'n')
+    {
+        if(length != 4 || memcmp(bytes, "null", 4) != 0)
+        {
+            _failed = YES;
+        }
+    }
+    else if((bytes[0] == 't' && (length != 4 || memcmp(bytes, "true", 4) != 0)) ||
+            (bytes[0] == 'f' && (length != 5 || memcmp(bytes, "false", 5) != 0)))
+    {
+        _failed = YES;
+    }
+    else
+    {
+        NSString* value = [[NSString alloc] initWithBytes:bytes length:length encoding:NSASCIIStringEncoding];
+        [self foundValue:value];
+        [value release];
+    }
+}
+
+- (void)appendCodePoint:(uint32_t)codePoint
+{
+    if(codePoint >= 0xD800 && codePoint < 0xDC00)
+    {
+        _highSurrogate = codePoint;
+        return;
+    }
+    
+    if(codePoint >= 0xDC00 && codePoint < 0xE000 && _highSurrogate)
+    {
+        codePoint = 0x10000 + ((_highSurrogate - 0xD800) << 10) + (codePoint - 0xDC00);
+    }
+    _highSurrogate = 0;
+    
+    uint8_t utf8[4];
+    NSUInteger length;
+    
+    if(codePoint < 0x80)
+    {
+        utf8[0] = (uint8_t)codePoint;
+        length = 1;
+    }
+    else if(codePoint < 0x800)
+    {
+        utf8[0] = 0xC0 | (codePoint >> 6);
+        utf8[1] = 0x80 | (codePoint & 0x3F);
+        length = 2;
+    }
+    else if(codePoint < 0x10000)
+    {
+        utf8[0] = 0xE0 | (codePoint >> 12);
+        utf8[1] = 0x80 | ((codePoint >> 6) & 0x3F);
+        utf8[2] = 0x80 | (codePoint & 0x3F);
+        length = 3;
+    }
+    else
+    {
+        utf8[0] = 0xF0 | (codePoint >> 18);
+        utf8[1] = 0x80 | ((codePoint >> 12) & 0x3F);
+        utf8[2] = 0x80 | ((codePoint >> 6) & 0x3F);
+        utf8[3] = 0x80 | (codePoint & 0x3F);
+        length = 4;
+    }
+    
+    [_token appendBytes:utf8 length:length];
+}
+
+#pragma mark Tokenizing
+
+- (BOOL)parseBytes:(const void*)bytes length:(NSUInteger)length
+{
+    const uint8_t* p = bytes;
+    const uint8_t* end = p + length;
+    
+    while(p < end && !_failed)
+    {
+        uint8_t c = *p;
+        
+        if(_state == JsonStateString)
+        {
+            // copy a run of plain characters at once
+            const uint8_t* run = p;
+            while(p < end && *p != '"' && *p != '\\')
+            {
+                p++;
+            }
+            [_token appendBytes:run length:p - run];
+            
+            if(p < end)
+            {
+                _state = (*p == '"') ? JsonStateValue : JsonStateEscape;
+                if(_state == JsonStateValue)
+                {
+                    [self endString];
+                }
+                p++;
+            }
+        }
+        else if(_state == JsonStateEscape)
+        {
+            static const char escapes[] = "\"\"\\\\//b\bf\fn\nr\rt\t";
+            const char* escape = NULL;
+            
+            for(NSUInteger i = 0; i < sizeof(escapes) - 1; i += 2)
+            {
+                if(escapes[i] == c)
+                {
+                    escape = &escapes[i + 1];
+                    break;
+                }
+            }
+            
+            if(c == 'u')
+            {
+                _unicode = 0;
+                _unicodeDigits = 0;
+                _state = JsonStateUnicode;
+            }
+            else if(escape)
+            {
+                [_token appendBytes:escape length:1];
+                _state = JsonStateString;
+            }
+            else
+            {
+                _failed = YES;
+            }
+            p++;
+        }
+        else if(_state == JsonStateUnicode)
+        {
+            int digit = (c >= '0' && c <= '9') ? c - '0' : (c >= 'a' && c <= 'f') ? c - 'a' + 10 : (c >= 'A' && c <= 'F') ? c - 'A' + 10 : -1;
+            if(digit < 0)
+            {
+                _failed = YES;
+            }
+            
+            _unicode = (_unicode << 4) | digit;
+            if(++_unicodeDigits == 4)
+            {
+                [self appendCodePoint:_unicode];
+                _state = JsonStateString;
+            }
+            p++;
+        }
+        else if(_state == JsonStateLiteral)
+        {
+            if(isalnum(c) || c == '.' || c == '+' || c == '-')
+            {
+                [_token appendBytes:p length:1];
+                p++;
+            }
+            else
+            {
+                // the literal ends at the first character that can't be part of it, which is read again as structure
+                [self endLiteral];
+                _state = JsonStateValue;
+            }
+        }
+        else
+        {
+            switch(c)
+            {
+                case ' ':
+                case '\t':
+                case '\r':
+                case '\n':
+                    break;
+                case '{':
+                case '[':
+                    [self openContainer:(c == '{') ? 'o' : 'a'];
+                    break;
+                case '}':
+                case ']':
+                    [self closeContainer:(c == '}') ? 'o' : 'a'];
+                    break;
+                case ',':
+                    _expectKey = (_depth > 0 && _stack[_depth - 1] == 'o');
+                    break;
+                case ':':
+                    break;
+                case '"':
+                    [_token setLength:0];
+                    _state = JsonStateString;
+                    break;
+                default:
+                    if(c == '-' || (c >= '0' && c <= '9') || c == 't' || c == 'f' || c == 'n')
+                    {
+                        [_token setLength:0];
+                        [_token appendBytes:p length:1];
+                        _state = JsonStateLiteral;
+                    }
+                    else
+                    {
+                        _failed = YES;
+                    }
+                    break;
+            }
+            p++;
+        }
+    }
+    
+    return !_failed;
+}
+
+- (BOOL)finish
+{
+    if(!_failed && _state == JsonStateLiteral)
+    {
+        [self endLiteral];
+        _state = JsonStateValue;
+    }
+    
+    if(_state != JsonStateValue || _depth != 0 || !_sawRoot)
+    {
+        _failed = YES;
+    }
+    
+    return !_failed;
+}
+
+- (NSError*)error
+{
+    if(_errorCode || _errorMessage)
+    {
+        return [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                   code:-1 
+                               userInfo:[NSDictionary dictionaryWithObjectsAndKeys:
+                                         (_errorMessage ? _errorMessage : @""), NSLocalizedDescriptionKey, 
+                                         _errorCode, @"AzureReasonCode", nil]];
+    }
+    
+    if(_failed)
+    {
+        return [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                   code:-1 
+                               userInfo:[NSDictionary dictionaryWithObject:@"The response was not well-formed JSON" forKey:NSLocalizedDescriptionKey]];
+    }
+    
+    return nil;
+}
+
++ (NSError*)errorInBody:(NSData*)data
+{
+    JsonStreamParser* parser = [[[JsonStreamParser alloc] init] autorelease];
+    
+    [parser parseBytes:[data bytes] length:[data length]];
+    [parser finish];
+    
+    return (parser->_errorCode || parser->_errorMessage) ? [parser error] : nil;
+}
+
+#pragma mark -
+
+@end
@@ -0,0 +1,39 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+// Writes a JSON object into one growing buffer as the caller goes, adding the separators itself.
+// Only what an entity body needs: one level of members with string or literal values.
+@interface JsonWriter : NSObject
+{
+    NSMutableData* _data;
+    BOOL _needsComma;
+}
+
+// The document so far.
+@property (readonly) NSData* data;
+
+- (void)beginObject;
+- (void)endObject;
+
+// Writes a member name; the next write is its value.
+- (void)writeKey:(NSString*)key;
+- (void)writeString:(NSString*)string;
+// Writes numbers, true, false and null as given.
+- (void)writeLiteral:(NSString*)literal;
+
+@end
@@ -0,0 +1,129 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "JsonWriter.h"
+
+@implementation JsonWriter
+
+@synthesize data = _data;
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        _data = [[NSMutableData alloc] initWithCapacity:512];
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_data release];
+    
+    [super dealloc];
+}
+
+- (void)appendUTF8:(NSString*)string
+{
+    const char* chars = CFStringGetCStringPtr((CFStringRef)string, kCFStringEncodingUTF8);
+    if(!chars)
+    {
+        chars = [string UTF8String];
+    }
+    
+    [_data appendBytes:chars length:strlen(chars)];
+}
+
+- (void)beginObject
+{
+    [_data appendBytes:"{" length:1];
+    _needsComma = NO;
+}
+
+- (void)endObject
+{
+    [_data appendBytes:"}" length:1];
+    _needsComma = YES;
+}
+
+- (void)writeKey:(NSString*)key
+{
+    if(_needsComma)
+    {
+        [_data appendBytes:"," length:1];
+    }
+    
+    [self writeString:key];
+    [_data appendBytes:":" length:1];
+    _needsComma = NO;
+}
+
+- (void)writeString:(NSString*)string
+{
+    static const char hex[] = "0123456789abcdef";
+    
+    const char* chars = CFStringGetCStringPtr((CFStringRef)string, kCFStringEncodingUTF8);
+    if(!chars)
+    {
+        chars = [string UTF8String];
+    }
+    
+    [_data appendBytes:"\"" length:1];
+    
+    // runs of characters that need no escaping go in with one append
+    const char* run = chars;
+    for(const char* p = chars; ; p++)
+    {
+        unsigned char c = *p;
+        
+        if(c != 0 && c >= 0x20 && c != '"' && c != '\\')
+        {
+            continue;
+        }
+        
+        [_data appendBytes:run length:p - run];
+        if(c == 0)
+        {
+            break;
+        }
+        
+        if(c == '"' || c == '\\')
+        {
+            char escaped[2] = { '\\', (char)c };
+            [_data appendBytes:escaped length:2];
+        }
+        else
+        {
+            char escaped[6] = { '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF] };
+            [_data appendBytes:escaped length:6];
+        }
+        run = p + 1;
+    }
+    
+    [_data appendBytes:"\"" length:1];
+    _needsComma = YES;
+}
+
+- (void)writeLiteral:(NSString*)literal
+{
+    [self appendUTF8:literal];
+    _needsComma = YES;
+}
+
+#pragma mark -
+
+@end
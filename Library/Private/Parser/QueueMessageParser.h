@@ -17,8 +17,12 @@
 #import <Foundation/Foundation.h>
 #import <libxml/tree.h>
 
+@class XmlStreamParser;
+
 @interface QueueMessageParser : NSObject
 
 + (NSArray *)loadQueueMessages:(xmlDocPtr)doc;
+// Registers the QueueMessage records of a Get Messages response with parser.
++ (void)addQueueMessageRecordsToParser:(XmlStreamParser *)parser queueMessages:(NSMutableArray *)queueMessages;
 
 @end
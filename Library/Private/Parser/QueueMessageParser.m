@@ -17,6 +17,7 @@
 #import "QueueMessageParser.h"
 #import "QueueMessage.h"
 #import "XmlHelper.h"
+#import "XmlStreamParser.h"
 
 @implementation QueueMessageParser
 
@@ -48,4 +49,19 @@
     return [[queueMessages copy] autorelease];
 }
 
++ (void)addQueueMessageRecordsToParser:(XmlStreamParser *)parser queueMessages:(NSMutableArray *)queueMessages
+{
+    [parser addRecordPath:@"QueueMessagesList/QueueMessage" block:^(NSDictionary *record)
+     {
+         QueueMessage *queueMessage = [[QueueMessage alloc] initQueueMessageWithMessageId:[record objectForKey:@"MessageId"] 
+                                                                            insertionTime:[record objectForKey:@"InsertionTime"] 
+                                                                           expirationTime:[record objectForKey:@"ExpirationTime"] 
+                                                                               popReceipt:[record objectForKey:@"PopReceipt"] 
+                                                                          timeNextVisible:[record objectForKey:@"TimeNextVisible"] 
+                                                                              messageText:[record objectForKey:@"MessageText"]];
+         [queueMessages addObject:queueMessage];
+         [queueMessage release];
+     }];
+}
+
 @end
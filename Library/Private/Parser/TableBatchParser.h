@@ -0,0 +1,27 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+@interface TableBatchParser : NSObject
+
+// The error for a response the service rejected outright, taken from its XML body when there is one.
++ (NSError *)errorForStatus:(NSInteger)statusCode data:(NSData *)data;
+// Splits a $batch response into one entry per operation: NSNull for success, NSError for failure.
+// Returns nil if the body is not a multipart batch response with an answer for every operation.
++ (NSArray *)loadResults:(NSData *)data contentType:(NSString *)contentType count:(NSUInteger)count;
+
+@end
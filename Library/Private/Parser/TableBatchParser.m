@@ -0,0 +1,166 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TableBatchParser.h"
+#import "XmlHelper.h"
+#import <libxml/parser.h>
+
+@implementation TableBatchParser
+
++ (NSString *)boundaryInString:(NSString *)string
+{
+    NSRange range = [string rangeOfString:@"boundary="];
+    if(range.location == NSNotFound)
+    {
+        return nil;
+    }
+    
+    NSString* boundary = [string substringFromIndex:NSMaxRange(range)];
+    NSRange end = [boundary rangeOfCharacterFromSet:[NSCharacterSet characterSetWithCharactersInString:@"\r\n;"]];
+    if(end.location != NSNotFound)
+    {
+        boundary = [boundary substringToIndex:end.location];
+    }
+    
+    return boundary.length ? boundary : nil;
+}
+
++ (NSError *)errorForStatus:(NSInteger)statusCode data:(NSData *)data
+{
+    NSError* error = nil;
+    
+    if(data.length)
+    {
+        xmlDocPtr doc = xmlReadMemory([data bytes], (int)[data length], NULL, NULL, (XML_PARSE_NOCDATA | XML_PARSE_NOBLANKS));
+        error = [XmlHelper checkForError:doc];
+        xmlFreeDoc(doc);
+    }
+    
+    if(!error)
+    {
+        error = [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                    code:-1 
+                                userInfo:[NSDictionary dictionaryWithObject:[NSHTTPURLResponse localizedStringForStatusCode:statusCode] forKey:NSLocalizedDescriptionKey]];
+    }
+    
+    return error;
+}
+
++ (NSArray *)loadResults:(NSData *)data contentType:(NSString *)contentType count:(NSUInteger)count
+{
+    NSString* body = [[[NSString alloc] initWithData:data encoding:NSUTF8StringEncoding] autorelease];
+    
+    // the operation responses sit inside a changeset; a request the service rejects as a whole
+    // is answered directly in the outer batch part
+    NSRange changeset = [body rangeOfString:@"boundary=changesetresponse_"];
+    NSString* boundary = (changeset.location != NSNotFound) ? [self boundaryInString:[body substringFromIndex:changeset.location]] : [self boundaryInString:contentType];
+    if(!body || !boundary)
+    {
+        return nil;
+    }
+    
+    NSArray* parts = [body componentsSeparatedByString:[@"--" stringByAppendingString:boundary]];
+    NSUInteger succeeded = 0;
+    NSInteger failedIndex = -1;
+    NSError* failure = nil;
+    
+    for(NSUInteger n = 1; n < parts.count; n++)
+    {
+        NSString* part = [parts objectAtIndex:n];
+        if([part hasPrefix:@"--"])
+        {
+            break;
+        }
+        
+        NSRange status = [part rangeOfString:@"HTTP/1.1 "];
+        if(status.location == NSNotFound)
+        {
+            continue;
+        }
+        
+        NSInteger statusCode = [[part substringFromIndex:NSMaxRange(status)] integerValue];
+        if(statusCode < 300)
+        {
+            succeeded++;
+            continue;
+        }
+        
+        NSRange headersEnd = [part rangeOfString:@"\r\n\r\n" options:0 range:NSMakeRange(status.location, part.length - status.location)];
+        if(headersEnd.location == NSNotFound)
+        {
+            headersEnd = NSMakeRange(part.length, 0);
+        }
+        failure = [self errorForStatus:statusCode data:[[part substringFromIndex:NSMaxRange(headersEnd)] dataUsingEncoding:NSUTF8StringEncoding]];
+        
+        // the failed operation comes back with our Content-ID; failing that, the message starts with "<index>:"
+        NSRange contentID = [part rangeOfString:@"Content-ID: " options:NSCaseInsensitiveSearch range:NSMakeRange(status.location, headersEnd.location - status.location)];
+        if(contentID.location != NSNotFound)
+        {
+            failedIndex = [[part substringFromIndex:NSMaxRange(contentID)] integerValue] - 1;
+        }
+        else
+        {
+            NSString* message = [failure localizedDescription];
+            NSRange colon = [message rangeOfString:@":"];
+            if(colon.location != NSNotFound && colon.location > 0)
+            {
+                NSString* index = [message substringToIndex:colon.location];
+                if([index rangeOfCharacterFromSet:[[NSCharacterSet decimalDigitCharacterSet] invertedSet]].location == NSNotFound)
+                {
+                    failedIndex = [index integerValue];
+                }
+            }
+        }
+        break;
+    }
+    
+    if(!failure && succeeded < count)
+    {
+        return nil;
+    }
+    
+    NSMutableArray* results = [NSMutableArray arrayWithCapacity:count];
+    NSError* rolledBack = nil;
+    
+    if(failure && failedIndex >= 0 && failedIndex < (NSInteger)count)
+    {
+        rolledBack = [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                         code:-1 
+                                     userInfo:[NSDictionary dictionaryWithObjectsAndKeys:
+                                               @"Operation rolled back because another operation in the batch failed", NSLocalizedDescriptionKey,
+                                               failure, NSUnderlyingErrorKey, nil]];
+    }
+    
+    for(NSUInteger n = 0; n < count; n++)
+    {
+        if(!failure)
+        {
+            [results addObject:[NSNull null]];
+        }
+        else if(!rolledBack || (NSInteger)n == failedIndex)
+        {
+            [results addObject:failure];
+        }
+        else
+        {
+            [results addObject:rolledBack];
+        }
+    }
+    
+    return results;
+}
+
+@end
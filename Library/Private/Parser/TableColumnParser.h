@@ -0,0 +1,45 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "XmlStreamParser.h"
+#import "TableResultSet.h"
+
+@class TableColumn;
+
+// Reads an AtomPub entity feed straight into the columns of a TableResultSet. Each entry becomes a
+// row, and each property is converted from its text according to its m:type as its end tag is
+// read, so no per-entity dictionaries or strings are made. Everything outside the entries, such
+// as an error document, goes through XmlStreamParser as usual.
+@interface TableColumnParser : XmlStreamParser
+{
+    TableResultSet* _results;
+    CFMutableDictionaryRef _columns;
+    NSUInteger _entryDepth;
+    NSUInteger _row;
+    BOOL _inProperties;
+    
+    const xmlChar* _property;
+    TableColumnType _type;
+    BOOL _null;
+    char* _value;
+    NSUInteger _valueLength;
+    NSUInteger _valueCapacity;
+}
+
+// Rows are appended to results, so one result set can collect several pages.
+- (id)initWithResultSet:(TableResultSet*)results;
+
+@end
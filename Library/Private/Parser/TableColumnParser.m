@@ -0,0 +1,256 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TableColumnParser.h"
+#import "TableResultSet+Private.h"
+#import "EdmValue.h"
+#import "SimpleBase64.h"
+
+@implementation TableColumnParser
+
+- (id)initWithResultSet:(TableResultSet*)results
+{
+    if((self = [super init]))
+    {
+        _results = [results retain];
+        // keyed by libxml's interned property name; holds the column the name was last written to
+        _columns = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        _valueCapacity = 256;
+        _value = malloc(_valueCapacity);
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    [_results release];
+    CFRelease(_columns);
+    free(_value);
+    
+    [super dealloc];
+}
+
+- (TableColumn*)columnForProperty:(const xmlChar*)property type:(TableColumnType)type
+{
+    TableColumn* column = (TableColumn*)CFDictionaryGetValue(_columns, property);
+    
+    if(!column || column->_type != type)
+    {
+        NSString* name = column ? column->_name : [NSString stringWithUTF8String:(const char*)property];
+        column = [_results columnNamed:name type:type];
+        CFDictionarySetValue(_columns, property, column);
+    }
+    
+    return column;
+}
+
+- (BOOL)storeValue:(const char*)chars length:(NSUInteger)length type:(TableColumnType)type
+{
+    TableColumn* column = [self columnForProperty:_property type:type];
+    
+    switch(type)
+    {
+        case TableColumnTypeInt32:
+        {
+            int32_t value;
+            if(!EdmParseInt32(chars, length, &value))
+            {
+                return NO;
+            }
+            *(int32_t*)[column slotForRow:_row] = value;
+            return YES;
+        }
+        case TableColumnTypeInt64:
+        {
+            int64_t value;
+            if(!EdmParseInt64(chars, length, &value))
+            {
+                return NO;
+            }
+            *(int64_t*)[column slotForRow:_row] = value;
+            return YES;
+        }
+        case TableColumnTypeDouble:
+        {
+            double value;
+            if(!EdmParseDouble(chars, length, &value))
+            {
+                return NO;
+            }
+            *(double*)[column slotForRow:_row] = value;
+            return YES;
+        }
+        case TableColumnTypeBoolean:
+        {
+            BOOL value;
+            if(!EdmParseBoolean(chars, length, &value))
+            {
+                return NO;
+            }
+            *(BOOL*)[column slotForRow:_row] = value;
+            return YES;
+        }
+        case TableColumnTypeDateTime:
+        {
+            NSTimeInterval value;
+            if(!EdmParseDateTime(chars, length, &value))
+            {
+                return NO;
+            }
+            *(NSTimeInterval*)[column slotForRow:_row] = value;
+            return YES;
+        }
+        case TableColumnTypeGuid:
+        {
+            uint8_t value[16];
+            if(!EdmParseGuid(chars, length, value))
+            {
+                return NO;
+            }
+            memcpy([column slotForRow:_row], value, 16);
+            return YES;
+        }
+        case TableColumnTypeBinary:
+        {
+            NSMutableData* value = [NSMutableData dataWithLength:length / 4 * 3];
+            ssize_t valueLength = Base64Decode(chars, length, [value mutableBytes]);
+            if(valueLength < 0)
+            {
+                return NO;
+            }
+            [column setBytes:[value bytes] length:valueLength forRow:_row];
+            return YES;
+        }
+        default:
+            [column setBytes:chars length:length forRow:_row];
+            return YES;
+    }
+}
+
+- (void)endProperty
+{
+    if(_null)
+    {
+        return;
+    }
+    
+    // an empty typed property carries no value, while an empty string is still a string
+    if(_type != TableColumnTypeString && _valueLength == 0)
+    {
+        return;
+    }
+    
+    if(![self storeValue:_value length:_valueLength type:_type])
+    {
+        // text that doesn't read as its declared type is kept rather than dropped
+        [self storeValue:_value length:_valueLength type:TableColumnTypeString];
+    }
+}
+
+#pragma mark SAX callbacks
+
+- (void)startElement:(const xmlChar*)localname attributes:(const xmlChar**)attributes count:(int)count
+{
+    if(_entryDepth == 0)
+    {
+        if(_path.count == 1 && xmlStrEqual(localname, BAD_CAST "entry"))
+        {
+            _entryDepth = 1;
+            _row = [_results addRow];
+            return;
+        }
+        
+        [super startElement:localname attributes:attributes count:count];
+        return;
+    }
+    
+    _entryDepth++;
+    
+    if(_entryDepth == 3 && xmlStrEqual(localname, BAD_CAST "properties"))
+    {
+        _inProperties = YES;
+    }
+    else if(_entryDepth == 4 && _inProperties)
+    {
+        _property = localname;
+        _type = TableColumnTypeString;
+        _null = NO;
+        _valueLength = 0;
+        
+        for(int n = 0; n < count; n++)
+        {
+            const xmlChar* name = attributes[n * 5];
+            const xmlChar* value = attributes[n * 5 + 3];
+            NSUInteger length = attributes[n * 5 + 4] - value;
+            
+            if(xmlStrEqual(name, BAD_CAST "type"))
+            {
+                _type = EdmTypeForName((const char*)value, length);
+            }
+            else if(xmlStrEqual(name, BAD_CAST "null"))
+            {
+                _null = (length == 4 && memcmp(value, "true", 4) == 0);
+            }
+        }
+    }
+}
+
+- (void)endElement
+{
+    if(_entryDepth == 0)
+    {
+        [super endElement];
+        return;
+    }
+    
+    if(_entryDepth == 4 && _property)
+    {
+        [self endProperty];
+        _property = NULL;
+    }
+    else if(_entryDepth == 3)
+    {
+        _inProperties = NO;
+    }
+    
+    _entryDepth--;
+}
+
+- (void)characters:(const xmlChar*)chars length:(int)length
+{
+    if(_entryDepth == 0)
+    {
+        [super characters:chars length:length];
+        return;
+    }
+    
+    if(!_property || _entryDepth != 4)
+    {
+        return;
+    }
+    
+    if(_valueLength + length > _valueCapacity)
+    {
+        _valueCapacity = MAX(_valueCapacity * 2, _valueLength + length);
+        _value = realloc(_value, _valueCapacity);
+    }
+    
+    memcpy(_value + _valueLength, chars, length);
+    _valueLength += length;
+}
+
+@end
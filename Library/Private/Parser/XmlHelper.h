@@ -21,12 +21,19 @@
 #import <libxml/xpathInternals.h>
 #import "AtomPubEntry.h"
 
+@class XmlStreamParser;
+
 @interface XmlHelper : NSObject
 
 + (void)performXPath:(NSString*)xpath onDocument:(xmlDocPtr)doc block:(void (^)(xmlNodePtr))block;
 + (void)performXPath:(NSString*)xpath onNode:(xmlNodePtr)node block:(void (^)(xmlNodePtr))block;
 + (NSString*)getElementValue:(xmlNodePtr)parent name:(NSString*)name;
++ (NSDictionary*)getElementValues:(xmlNodePtr)parent name:(NSString*)name;
++ (NSString*)getNextMarker:(xmlDocPtr)doc;
++ (NSDate*)parseHTTPDate:(NSString*)value;
 + (NSError*)checkForError:(xmlDocPtr)doc;
 + (void)parseAtomPub:(xmlDocPtr)doc block:(void (^)(AtomPubEntry *))entry;
+// Registers the feed's entries with parser; block receives each entry's content properties by name.
++ (void)addAtomPubRecordsToParser:(XmlStreamParser*)parser block:(void (^)(NSMutableDictionary *))block;
 
 @end
@@ -15,6 +15,9 @@
  */
 
 #import "XmlHelper.h"
+#import "XmlStreamParser.h"
+#import <time.h>
+#import <xlocale.h>
 
 
 @implementation XmlHelper
@@ -114,6 +117,62 @@
     return nil;
 }
 
+// Collects the text of every child of the named element, keyed by child name; nil if the element is missing.
++ (NSDictionary*)getElementValues:(xmlNodePtr)parent name:(NSString*)name
+{
+    xmlChar* nameStr = (xmlChar*)[name UTF8String];
+    
+    for(xmlNodePtr child = xmlFirstElementChild(parent); child; child = xmlNextElementSibling(child))
+    {
+        if(xmlStrcmp(child->name, nameStr) == 0)
+        {
+            NSMutableDictionary* values = [NSMutableDictionary dictionaryWithCapacity:10];
+            
+            for(xmlNodePtr property = xmlFirstElementChild(child); property; property = xmlNextElementSibling(property))
+            {
+                xmlChar* value = xmlNodeGetContent(property);
+                [values setObject:[NSString stringWithUTF8String:(const char*)value] forKey:[NSString stringWithUTF8String:(const char*)property->name]];
+                xmlFree(value);
+            }
+            
+            return values;
+        }
+    }
+    
+    return nil;
+}
+
++ (NSString*)getNextMarker:(xmlDocPtr)doc
+{
+    xmlNodePtr root = doc ? xmlDocGetRootElement(doc) : NULL;
+    if(!root)
+    {
+        return nil;
+    }
+    
+    NSString* marker = [self getElementValue:root name:@"NextMarker"];
+    return marker.length ? marker : nil;
+}
+
+// Parses an RFC 1123 date such as "Wed, 09 Jun 2010 20:11:49 GMT", independent of the user's locale.
++ (NSDate*)parseHTTPDate:(NSString*)value
+{
+    struct tm components;
+    
+    if(!value)
+    {
+        return nil;
+    }
+    
+    memset(&components, 0, sizeof(components));
+    if(!strptime_l([value UTF8String], "%a, %d %b %Y %H:%M:%S GMT", &components, NULL))
+    {
+        return nil;
+    }
+    
+    return [NSDate dateWithTimeIntervalSince1970:timegm(&components)];
+}
+
 + (NSError*)checkForError:(xmlDocPtr)doc
 {
     if(!doc)
@@ -161,4 +220,17 @@
      }];
 }
 
++ (void)addAtomPubRecordsToParser:(XmlStreamParser*)parser block:(void (^)(NSMutableDictionary *))block
+{
+    [parser addRecordPath:@"feed/entry" block:^(NSDictionary* record)
+     {
+         id content = [record objectForKey:@"content"];
+         id properties = [content isKindOfClass:[NSDictionary class]] ? [content objectForKey:@"properties"] : nil;
+         
+         // an entry without properties folds to an empty string rather than a dictionary; records are
+         // mutable and no longer referenced by the parser, so the entity can take the dictionary as is
+         block([properties isKindOfClass:[NSDictionary class]] ? properties : [NSMutableDictionary dictionaryWithCapacity:0]);
+     }];
+}
+
 @end
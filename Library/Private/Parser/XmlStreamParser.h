@@ -0,0 +1,62 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import <libxml/parser.h>
+#import "CloudURLRequest.h"
+
+// Incremental SAX2 parser, fed from the connection as bytes arrive. Each element matching a
+// registered record path (local names from the root, e.g. @"EnumerationResults/Blobs/Blob") is
+// folded into a dictionary as soon as its end tag is read: leaf children map their local name to
+// their text, and children with children of their own map to a nested dictionary. Nothing outside
+// the record being read is kept, apart from the text of the root's leaf children.
+@interface XmlStreamParser : NSObject <CloudStreamParser>
+{
+    xmlParserCtxtPtr _context;
+    CFMutableDictionaryRef _names;
+    NSMutableArray* _recordPaths;
+    NSMutableArray* _recordBlocks;
+    NSMutableArray* _path;
+    NSMutableArray* _frames;
+    NSMutableString* _text;
+    NSUInteger _recordDepth;
+    void (^_recordBlock)(NSDictionary*);
+    NSString* _rootName;
+    NSMutableDictionary* _rootValues;
+    BOOL _failed;
+}
+
+// The local name of the document element, once it has been read.
+@property (readonly) NSString* rootName;
+// Text of the document element's leaf children, such as NextMarker.
+@property (readonly) NSDictionary* rootValues;
+
+- (void)addRecordPath:(NSString*)path block:(void (^)(NSDictionary*))block;
+
+- (BOOL)parseBytes:(const void*)bytes length:(NSUInteger)length;
+- (BOOL)finish;
+
+// The error described by a storage service error document, or a parse error if the body was not well formed.
+- (NSError*)error;
+
+// SAX callbacks. A subclass may take over a subtree by not calling super for any element inside it;
+// the attributes are libxml's (localname, prefix, URI, value, end) quintuples.
+- (void)startElement:(const xmlChar*)localname attributes:(const xmlChar**)attributes count:(int)count;
+- (void)endElement;
+- (void)characters:(const xmlChar*)chars length:(int)length;
+- (void)fail;
+
+@end
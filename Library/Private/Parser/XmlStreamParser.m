@@ -0,0 +1,272 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "XmlStreamParser.h"
+
+static void StartElement(void* context, const xmlChar* localname, const xmlChar* prefix, const xmlChar* URI, int nb_namespaces, const xmlChar** namespaces, int nb_attributes, int nb_defaulted, const xmlChar** attributes)
+{
+    [(XmlStreamParser*)context startElement:localname attributes:attributes count:nb_attributes];
+}
+
+static void EndElement(void* context, const xmlChar* localname, const xmlChar* prefix, const xmlChar* URI)
+{
+    [(XmlStreamParser*)context endElement];
+}
+
+static void Characters(void* context, const xmlChar* chars, int length)
+{
+    [(XmlStreamParser*)context characters:chars length:length];
+}
+
+static void Error(void* context, const char* message, ...)
+{
+    [(XmlStreamParser*)context fail];
+}
+
+@implementation XmlStreamParser
+
+@synthesize rootName = _rootName;
+@synthesize rootValues = _rootValues;
+
+- (id)init
+{
+    if((self = [super init]))
+    {
+        xmlSAXHandler handler;
+        
+        memset(&handler, 0, sizeof(handler));
+        handler.initialized = XML_SAX2_MAGIC;
+        handler.startElementNs = StartElement;
+        handler.endElementNs = EndElement;
+        handler.characters = Characters;
+        handler.cdataBlock = Characters;
+        handler.error = Error;
+        
+        _context = xmlCreatePushParserCtxt(&handler, self, NULL, 0, NULL);
+        xmlCtxtUseOptions(_context, XML_PARSE_NOCDATA | XML_PARSE_NOBLANKS | XML_PARSE_NONET);
+        
+        // libxml interns element names, so each distinct name becomes an NSString only once per document
+        _names = CFDictionaryCreateMutable(kCFAllocatorDefault, 0, NULL, &kCFTypeDictionaryValueCallBacks);
+        
+        _recordPaths = [[NSMutableArray alloc] initWithCapacity:2];
+        _recordBlocks = [[NSMutableArray alloc] initWithCapacity:2];
+        _path = [[NSMutableArray alloc] initWithCapacity:8];
+        _frames = [[NSMutableArray alloc] initWithCapacity:8];
+        _text = [[NSMutableString alloc] initWithCapacity:256];
+        _rootValues = [[NSMutableDictionary alloc] initWithCapacity:4];
+        _recordDepth = NSNotFound;
+    }
+    
+    return self;
+}
+
+- (void)dealloc
+{
+    if(_context)
+    {
+        xmlFreeParserCtxt(_context);
+    }
+    CFRelease(_names);
+    [_recordPaths release];
+    [_recordBlocks release];
+    [_path release];
+    [_frames release];
+    [_text release];
+    [_rootName release];
+    [_rootValues release];
+    
+    [super dealloc];
+}
+
+- (void)addRecordPath:(NSString*)path block:(void (^)(NSDictionary*))block
+{
+    [_recordPaths addObject:[path componentsSeparatedByString:@"/"]];
+    [_recordBlocks addObject:[[block copy] autorelease]];
+}
+
+- (BOOL)parseBytes:(const void*)bytes length:(NSUInteger)length
+{
+    if(!_failed && xmlParseChunk(_context, bytes, (int)length, 0) != 0)
+    {
+        _failed = YES;
+    }
+    
+    return !_failed;
+}
+
+- (BOOL)finish
+{
+    if(!_failed && xmlParseChunk(_context, NULL, 0, 1) != 0)
+    {
+        _failed = YES;
+    }
+    
+    return !_failed;
+}
+
+- (NSError*)error
+{
+    if([_rootName isEqualToString:@"Error"])
+    {
+        return [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                   code:-1 
+                               userInfo:[NSDictionary dictionaryWithObjectsAndKeys:
+                                         [_rootValues objectForKey:@"Message"], NSLocalizedDescriptionKey, 
+                                         [_rootValues objectForKey:@"AuthenticationErrorDetail"], NSLocalizedFailureReasonErrorKey, 
+                                         [_rootValues objectForKey:@"Code"], @"AzureReasonCode", nil]];
+    }
+    
+    if([_rootName isEqualToString:@"error"])
+    {
+        return [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                   code:-1 
+                               userInfo:[NSDictionary dictionaryWithObjectsAndKeys:
+                                         [_rootValues objectForKey:@"message"], NSLocalizedDescriptionKey, 
+                                         [_rootValues objectForKey:@"code"], @"AzureReasonCode", nil]];
+    }
+    
+    if(_failed)
+    {
+        return [NSError errorWithDomain:@"com.microsoft.AzureIOSToolkit" 
+                                   code:-1 
+                               userInfo:[NSDictionary dictionaryWithObject:@"The response was not well-formed XML" forKey:NSLocalizedDescriptionKey]];
+    }
+    
+    return nil;
+}
+
+#pragma mark SAX callbacks
+
+- (NSString*)nameForLocalname:(const xmlChar*)localname
+{
+    NSString* name = (NSString*)CFDictionaryGetValue(_names, localname);
+    
+    if(!name)
+    {
+        name = [[NSString alloc] initWithUTF8String:(const char*)localname];
+        CFDictionarySetValue(_names, localname, name);
+        [name release];
+    }
+    
+    return name;
+}
+
+- (BOOL)pathMatches:(NSArray*)recordPath
+{
+    if(recordPath.count != _path.count)
+    {
+        return NO;
+    }
+    
+    for(NSUInteger n = 0; n < _path.count; n++)
+    {
+        if(![[recordPath objectAtIndex:n] isEqualToString:[_path objectAtIndex:n]])
+        {
+            return NO;
+        }
+    }
+    
+    return YES;
+}
+
+- (void)startElement:(const xmlChar*)localname attributes:(const xmlChar**)attributes count:(int)count
+{
+    NSString* name = [self nameForLocalname:localname];
+    
+    if(_path.count == 0)
+    {
+        _rootName = [name retain];
+    }
+    
+    // an element with children is a nested record rather than a value
+    if(_recordDepth != NSNotFound && [_frames lastObject] == [NSNull null])
+    {
+        NSMutableDictionary* parent = [[NSMutableDictionary alloc] initWithCapacity:8];
+        [_frames replaceObjectAtIndex:_frames.count - 1 withObject:parent];
+        [parent release];
+    }
+    
+    [_path addObject:name];
+    [_frames addObject:[NSNull null]];
+    [_text setString:@""];
+    
+    if(_recordDepth == NSNotFound)
+    {
+        for(NSUInteger n = 0; n < _recordPaths.count; n++)
+        {
+            if([self pathMatches:[_recordPaths objectAtIndex:n]])
+            {
+                _recordDepth = _path.count;
+                _recordBlock = [_recordBlocks objectAtIndex:n];
+                break;
+            }
+        }
+    }
+}
+
+- (void)endElement
+{
+    NSUInteger depth = _path.count;
+    id frame = [_frames lastObject];
+    
+    if(_recordDepth != NSNotFound && depth >= _recordDepth)
+    {
+        BOOL leaf = (frame == [NSNull null]);
+        
+        if(depth == _recordDepth)
+        {
+            _recordBlock(leaf ? [NSDictionary dictionary] : frame);
+            _recordDepth = NSNotFound;
+            _recordBlock = nil;
+        }
+        else
+        {
+            NSString* value = leaf ? [[_text copy] autorelease] : nil;
+            [[_frames objectAtIndex:_frames.count - 2] setObject:(leaf ? value : frame) forKey:[_path lastObject]];
+        }
+    }
+    else if(depth == 2 && frame == [NSNull null])
+    {
+        [_rootValues setObject:[[_text copy] autorelease] forKey:[_path lastObject]];
+    }
+    
+    [_frames removeLastObject];
+    [_path removeLastObject];
+    [_text setString:@""];
+}
+
+- (void)characters:(const xmlChar*)chars length:(int)length
+{
+    // only leaves keep their text, and outside a record only the root's children are of interest
+    if(_recordDepth == NSNotFound && _path.count != 2)
+    {
+        return;
+    }
+    
+    NSString* text = [[NSString alloc] initWithBytes:chars length:length encoding:NSUTF8StringEncoding];
+    if(text)
+    {
+        [_text appendString:text];
+        [text release];
+    }
+}
+
+- (void)fail
+{
+    _failed = YES;
+}
+
+@end
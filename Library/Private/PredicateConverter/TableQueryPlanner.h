@@ -0,0 +1,34 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+// Turns an NSPredicate into the table queries that answer it. Conditions the service can evaluate
+// go into each query's $filter, with PartitionKey and RowKey equalities first so the service can use
+// them as a point or partition query; everything else becomes the query's residualPredicate, checked
+// on the entities as they arrive. IN against a list becomes an OR of equalities, and an OR whose
+// every alternative is bound to one partition is split into a query per alternative, so the
+// partitions can be scanned at the same time instead of in one serial pass over the table.
+@interface TableQueryPlanner : NSObject
+
+// One TableFetchRequest per query, never empty. overlapping is set when two queries read the same
+// partition, so their results may hold the same entity twice. Entities arrive with their property
+// values as strings, so a residual condition may only compare them with strings (or Timestamp with
+// dates); otherwise this returns nil and sets error, as a comparison with a number or date would
+// throw or order the values as text.
++ (NSArray*) queriesForPredicate:(NSPredicate*)predicate table:(NSString*)tableName overlapping:(BOOL*)overlapping error:(NSError**)error;
+
+@end
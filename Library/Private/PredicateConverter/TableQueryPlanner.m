@@ -0,0 +1,507 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TableQueryPlanner.h"
+#import "AzureFilterBuilder.h"
+#import "TableFetchRequest.h"
+
+// bounds the number of queries distributing ORs over an AND can produce
+static const NSUInteger TABLE_QUERY_MAX_BRANCHES = 64;
+
+@interface TableFetchRequest (Private)
+
+- (void)setResidualPredicate:(NSPredicate*)predicate;
+
+@end
+
+@implementation TableQueryPlanner
+
++ (NSString*) constantEqualTo:(NSString*)key inPredicate:(NSPredicate*)predicate
+{
+	if(![predicate isKindOfClass:[NSComparisonPredicate class]])
+	{
+		return nil;
+	}
+	
+	NSComparisonPredicate* comparison = (NSComparisonPredicate*)predicate;
+	if([comparison predicateOperatorType] != NSEqualToPredicateOperatorType || 
+	   [comparison comparisonPredicateModifier] != NSDirectPredicateModifier || 
+	   [comparison options] != 0)
+	{
+		return nil;
+	}
+	
+	NSExpression* keyPath = [comparison leftExpression];
+	NSExpression* constant = [comparison rightExpression];
+	if([keyPath expressionType] != NSKeyPathExpressionType)
+	{
+		keyPath = [comparison rightExpression];
+		constant = [comparison leftExpression];
+	}
+	
+	if([keyPath expressionType] != NSKeyPathExpressionType || 
+	   [constant expressionType] != NSConstantValueExpressionType ||
+	   ![[keyPath keyPath] isEqualToString:key] || 
+	   ![[constant constantValue] isKindOfClass:[NSString class]])
+	{
+		return nil;
+	}
+	
+	return [constant constantValue];
+}
+
++ (NSPredicate*) expandIn:(NSPredicate*)predicate
+{
+	if([predicate isKindOfClass:[NSCompoundPredicate class]])
+	{
+		NSCompoundPredicate* compound = (NSCompoundPredicate*)predicate;
+		NSMutableArray* subpredicates = [NSMutableArray arrayWithCapacity:[[compound subpredicates] count]];
+		
+		for(NSPredicate* subpredicate in [compound subpredicates])
+		{
+			[subpredicates addObject:[self expandIn:subpredicate]];
+		}
+		
+		return [[[NSCompoundPredicate alloc] initWithType:[compound compoundPredicateType] subpredicates:subpredicates] autorelease];
+	}
+	
+	if(![predicate isKindOfClass:[NSComparisonPredicate class]])
+	{
+		return predicate;
+	}
+	
+	NSComparisonPredicate* comparison = (NSComparisonPredicate*)predicate;
+	NSExpression* list = [comparison rightExpression];
+	id values = nil;
+	
+	if([list expressionType] == NSConstantValueExpressionType)
+	{
+		values = [list constantValue];
+	}
+	else if([list expressionType] == NSAggregateExpressionType)
+	{
+		// a literal list, as in "Key IN {'a', 'b'}", is an aggregate of constant expressions
+		values = [NSMutableArray arrayWithCapacity:[[list collection] count]];
+		for(NSExpression* element in [list collection])
+		{
+			if([element expressionType] != NSConstantValueExpressionType)
+			{
+				return predicate;
+			}
+			[values addObject:[element constantValue]];
+		}
+	}
+	
+	if([comparison predicateOperatorType] != NSInPredicateOperatorType || 
+	   [comparison comparisonPredicateModifier] != NSDirectPredicateModifier || 
+	   [comparison options] != 0 ||
+	   [[comparison leftExpression] expressionType] != NSKeyPathExpressionType ||
+	   !([values isKindOfClass:[NSArray class]] || [values isKindOfClass:[NSSet class]]) ||
+	   [values count] == 0)
+	{
+		return predicate;
+	}
+	
+	// "Key IN {a, b}" is "Key == a OR Key == b", which the service can evaluate
+	NSMutableArray* equalities = [NSMutableArray arrayWithCapacity:[values count]];
+	for(id value in values)
+	{
+		[equalities addObject:[NSComparisonPredicate predicateWithLeftExpression:[comparison leftExpression] 
+																 rightExpression:[NSExpression expressionForConstantValue:value] 
+																		modifier:NSDirectPredicateModifier 
+																			type:NSEqualToPredicateOperatorType 
+																		 options:0]];
+	}
+	
+	return ([equalities count] == 1) ? [equalities objectAtIndex:0] : [NSCompoundPredicate orPredicateWithSubpredicates:equalities];
+}
+
++ (void) flatten:(NSPredicate*)predicate type:(NSCompoundPredicateType)type into:(NSMutableArray*)terms
+{
+	if([predicate isKindOfClass:[NSCompoundPredicate class]] && [(NSCompoundPredicate*)predicate compoundPredicateType] == type)
+	{
+		for(NSPredicate* subpredicate in [(NSCompoundPredicate*)predicate subpredicates])
+		{
+			[self flatten:subpredicate type:type into:terms];
+		}
+	}
+	else
+	{
+		[terms addObject:predicate];
+	}
+}
+
++ (BOOL) isBoundToPartition:(NSArray*)conjuncts
+{
+	for(NSPredicate* conjunct in conjuncts)
+	{
+		if([self constantEqualTo:@"PartitionKey" inPredicate:conjunct])
+		{
+			return YES;
+		}
+	}
+	
+	return NO;
+}
+
++ (NSArray*) conjuncts:(NSArray*)conjuncts replacing:(NSUInteger)index with:(NSPredicate*)alternative
+{
+	NSMutableArray* result = [NSMutableArray arrayWithCapacity:[conjuncts count] + 2];
+	
+	for(NSUInteger i = 0; i < [conjuncts count]; i++)
+	{
+		if(i == index)
+		{
+			[self flatten:alternative type:NSAndPredicateType into:result];
+		}
+		else
+		{
+			[result addObject:[conjuncts objectAtIndex:i]];
+		}
+	}
+	
+	return result;
+}
+
+// The predicate as a disjunction of conjunct lists. An OR inside an AND is distributed over it only
+// when every alternative that produces is bound to a partition; otherwise it stays one conjunct.
++ (NSArray*) disjunctsOf:(NSPredicate*)predicate
+{
+	NSMutableArray* alternatives = [NSMutableArray arrayWithCapacity:4];
+	NSMutableArray* pending = [NSMutableArray arrayWithCapacity:4];
+	NSMutableArray* done = [NSMutableArray arrayWithCapacity:4];
+	
+	[self flatten:predicate type:NSOrPredicateType into:alternatives];
+	for(NSPredicate* alternative in alternatives)
+	{
+		NSMutableArray* conjuncts = [NSMutableArray arrayWithCapacity:4];
+		[self flatten:alternative type:NSAndPredicateType into:conjuncts];
+		[pending addObject:conjuncts];
+	}
+	
+	while([pending count] > 0)
+	{
+		NSArray* conjuncts = [[[pending objectAtIndex:0] retain] autorelease];
+		NSArray* split = nil;
+		[pending removeObjectAtIndex:0];
+		
+		for(NSUInteger index = 0; index < [conjuncts count] && !split; index++)
+		{
+			NSPredicate* conjunct = [conjuncts objectAtIndex:index];
+			if(![conjunct isKindOfClass:[NSCompoundPredicate class]] || [(NSCompoundPredicate*)conjunct compoundPredicateType] != NSOrPredicateType)
+			{
+				continue;
+			}
+			
+			NSMutableArray* choices = [NSMutableArray arrayWithCapacity:4];
+			NSMutableArray* branches = [NSMutableArray arrayWithCapacity:4];
+			[self flatten:conjunct type:NSOrPredicateType into:choices];
+			
+			for(NSPredicate* choice in choices)
+			{
+				NSArray* branch = [self conjuncts:conjuncts replacing:index with:choice];
+				if(![self isBoundToPartition:branch])
+				{
+					branches = nil;
+					break;
+				}
+				[branches addObject:branch];
+			}
+			
+			if(branches && [done count] + [pending count] + [branches count] <= TABLE_QUERY_MAX_BRANCHES)
+			{
+				split = branches;
+			}
+		}
+		
+		if(split)
+		{
+			// the new alternatives may hold further ORs to distribute
+			[pending addObjectsFromArray:split];
+		}
+		else
+		{
+			[done addObject:conjuncts];
+		}
+	}
+	
+	return done;
+}
+
+// Comparison options, such as [c], and ANY/ALL aren't part of the filter syntax, so the service would
+// silently ignore them.
++ (BOOL) canPush:(NSPredicate*)predicate
+{
+	if([predicate isKindOfClass:[NSCompoundPredicate class]])
+	{
+		for(NSPredicate* subpredicate in [(NSCompoundPredicate*)predicate subpredicates])
+		{
+			if(![self canPush:subpredicate])
+			{
+				return NO;
+			}
+		}
+		return YES;
+	}
+	
+	return [predicate isKindOfClass:[NSComparisonPredicate class]] && 
+		   [(NSComparisonPredicate*)predicate options] == 0 && 
+		   [(NSComparisonPredicate*)predicate comparisonPredicateModifier] == NSDirectPredicateModifier;
+}
+
+// What a residual expression evaluates to on an entity: NSString for a property or string constant,
+// NSDate for the Timestamp or a date, NSNull for a nil constant, which compares with either, and nil
+// for anything else.
++ (Class) residualClassOf:(NSExpression*)expression
+{
+	if([expression expressionType] == NSKeyPathExpressionType)
+	{
+		NSString* keyPath = [expression keyPath];
+		if([keyPath rangeOfString:@"."].location != NSNotFound)
+		{
+			return nil;
+		}
+		return [keyPath isEqualToString:@"Timestamp"] ? [NSDate class] : [NSString class];
+	}
+	
+	NSMutableArray* values = [NSMutableArray arrayWithCapacity:1];
+	if([expression expressionType] == NSConstantValueExpressionType)
+	{
+		id value = [expression constantValue];
+		if(!value || value == [NSNull null])
+		{
+			return [NSNull class];
+		}
+		if([value isKindOfClass:[NSArray class]] || [value isKindOfClass:[NSSet class]])
+		{
+			[values addObjectsFromArray:[value isKindOfClass:[NSSet class]] ? [value allObjects] : value];
+		}
+		else
+		{
+			[values addObject:value];
+		}
+	}
+	else if([expression expressionType] == NSAggregateExpressionType)
+	{
+		for(NSExpression* element in [expression collection])
+		{
+			if([element expressionType] != NSConstantValueExpressionType)
+			{
+				return nil;
+			}
+			[values addObject:[element constantValue]];
+		}
+	}
+	
+	Class result = nil;
+	for(id value in values)
+	{
+		Class valueClass = [value isKindOfClass:[NSString class]] ? [NSString class] : ([value isKindOfClass:[NSDate class]] ? [NSDate class] : nil);
+		if(!valueClass || (result && result != valueClass))
+		{
+			return nil;
+		}
+		result = valueClass;
+	}
+	
+	return result;
+}
+
++ (BOOL) canEvaluateOnEntities:(NSPredicate*)predicate
+{
+	if([predicate isKindOfClass:[NSCompoundPredicate class]])
+	{
+		for(NSPredicate* subpredicate in [(NSCompoundPredicate*)predicate subpredicates])
+		{
+			if(![self canEvaluateOnEntities:subpredicate])
+			{
+				return NO;
+			}
+		}
+		return YES;
+	}
+	
+	if(![predicate isKindOfClass:[NSComparisonPredicate class]])
+	{
+		return YES;
+	}
+	
+	Class left = [self residualClassOf:[(NSComparisonPredicate*)predicate leftExpression]];
+	Class right = [self residualClassOf:[(NSComparisonPredicate*)predicate rightExpression]];
+	
+	if(!left || !right)
+	{
+		return NO;
+	}
+	
+	return left == right || left == [NSNull class] || right == [NSNull class];
+}
+
++ (TableFetchRequest*) queryForConjuncts:(NSArray*)conjuncts table:(NSString*)tableName partitionKey:(NSString**)partitionKey rowKey:(NSString**)rowKey
+{
+	NSMutableArray* keyFilters = [NSMutableArray arrayWithCapacity:2];
+	NSMutableArray* filters = [NSMutableArray arrayWithCapacity:[conjuncts count]];
+	NSMutableArray* residual = [NSMutableArray arrayWithCapacity:1];
+	
+	*partitionKey = nil;
+	*rowKey = nil;
+	
+	for(NSPredicate* conjunct in conjuncts)
+	{
+		NSString* filter = [self canPush:conjunct] ? [AzureFilterBuilder filterStringWithPredicate:conjunct error:NULL] : nil;
+		NSString* key = [self constantEqualTo:@"PartitionKey" inPredicate:conjunct];
+		NSString* row = [self constantEqualTo:@"RowKey" inPredicate:conjunct];
+		
+		if(!filter)
+		{
+			[residual addObject:conjunct];
+		}
+		else if(key || row)
+		{
+			if(key && !*partitionKey)
+			{
+				*partitionKey = key;
+			}
+			if(row && !*rowKey)
+			{
+				*rowKey = row;
+			}
+			// PartitionKey leads, then RowKey, so the filter reads as the point or partition query it is
+			[keyFilters insertObject:filter atIndex:(key ? 0 : [keyFilters count])];
+		}
+		else
+		{
+			[filters addObject:filter];
+		}
+	}
+	
+	[keyFilters addObjectsFromArray:filters];
+	
+	TableFetchRequest* query = [TableFetchRequest fetchRequestForTable:tableName];
+	if([keyFilters count] == 1)
+	{
+		query.filter = [keyFilters objectAtIndex:0];
+	}
+	else if([keyFilters count] > 1)
+	{
+		query.filter = [NSString stringWithFormat:@"(%@)", [keyFilters componentsJoinedByString:@") and ("]];
+	}
+	
+	if([residual count] == 1)
+	{
+		[query setResidualPredicate:[residual objectAtIndex:0]];
+	}
+	else if([residual count] > 1)
+	{
+		[query setResidualPredicate:[NSCompoundPredicate andPredicateWithSubpredicates:residual]];
+	}
+	
+	return query;
+}
+
++ (NSArray*) queriesForPredicate:(NSPredicate*)predicate table:(NSString*)tableName overlapping:(BOOL*)overlapping
+{
+	NSPredicate* expanded = [self expandIn:predicate];
+	NSArray* disjuncts = [self disjunctsOf:expanded];
+	NSString* partitionKey;
+	NSString* rowKey;
+	
+	*overlapping = NO;
+	
+	for(NSArray* conjuncts in disjuncts)
+	{
+		if(![self isBoundToPartition:conjuncts])
+		{
+			// one alternative needs a table scan anyway, which the rest can share
+			NSMutableArray* terms = [NSMutableArray arrayWithCapacity:4];
+			[self flatten:expanded type:NSAndPredicateType into:terms];
+			return [NSArray arrayWithObject:[self queryForConjuncts:terms table:tableName partitionKey:&partitionKey rowKey:&rowKey]];
+		}
+	}
+	
+	NSMutableArray* queries = [NSMutableArray arrayWithCapacity:[disjuncts count]];
+	NSMutableSet* wholePartitions = [NSMutableSet setWithCapacity:[disjuncts count]];
+	NSMutableSet* rowPartitions = [NSMutableSet setWithCapacity:[disjuncts count]];
+	NSMutableSet* rows = [NSMutableSet setWithCapacity:[disjuncts count]];
+	
+	for(NSArray* conjuncts in disjuncts)
+	{
+		TableFetchRequest* query = [self queryForConjuncts:conjuncts table:tableName partitionKey:&partitionKey rowKey:&rowKey];
+		BOOL duplicate = NO;
+		
+		// "PartitionKey IN {a, a}" needs only one query
+		for(TableFetchRequest* other in queries)
+		{
+			if([other.filter isEqualToString:query.filter] && 
+			   (other.residualPredicate == query.residualPredicate || [other.residualPredicate isEqual:query.residualPredicate]))
+			{
+				duplicate = YES;
+				break;
+			}
+		}
+		if(duplicate)
+		{
+			continue;
+		}
+		
+		// point queries for different rows of one partition can't return the same entity
+		if(rowKey)
+		{
+			NSArray* row = [NSArray arrayWithObjects:partitionKey, rowKey, nil];
+			*overlapping = *overlapping || [wholePartitions containsObject:partitionKey] || [rows containsObject:row];
+			[rowPartitions addObject:partitionKey];
+			[rows addObject:row];
+		}
+		else
+		{
+			*overlapping = *overlapping || [wholePartitions containsObject:partitionKey] || [rowPartitions containsObject:partitionKey];
+			[wholePartitions addObject:partitionKey];
+		}
+		
+		[queries addObject:query];
+	}
+	
+	return queries;
+}
+
++ (NSArray*) queriesForPredicate:(NSPredicate*)predicate table:(NSString*)tableName overlapping:(BOOL*)overlapping error:(NSError**)error
+{
+	NSArray* queries = [self queriesForPredicate:predicate table:tableName overlapping:overlapping];
+	
+	for(TableFetchRequest* query in queries)
+	{
+		if(query.residualPredicate && ![self canEvaluateOnEntities:query.residualPredicate])
+		{
+			if(error)
+			{
+				NSString* description = [NSString stringWithFormat:@"The condition %@ can't be sent to the service, and it compares entity values with something other than a string", query.residualPredicate];
+				*error = [NSError errorWithDomain:@"AzureFilterBuilder" 
+											 code:-1
+										 userInfo:[NSDictionary dictionaryWithObject:description forKey:NSLocalizedDescriptionKey]];
+			}
+			return nil;
+		}
+	}
+	
+	if(error)
+	{
+		*error = nil;
+	}
+	
+	return queries;
+}
+
+@end
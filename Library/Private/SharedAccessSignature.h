@@ -0,0 +1,42 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+
+// A container-scoped shared access signature handed out by the proxy service. Requests signed with
+// it go straight to the blob service named in the container URL the proxy returned, with the
+// signature's query appended to their own.
+@interface SharedAccessSignature : NSObject
+{
+    NSString* _serviceRoot;
+    NSString* _query;
+    NSTimeInterval _issued;
+    NSTimeInterval _expiry;
+}
+
+// Reads the service, query and se= expiry from a container URL such as
+// http://account.blob.core.windows.net/container?sv=...&se=...&sig=...; nil if it carries no signature.
+// A signature without an expiry is taken to last `lifetime` seconds from now.
++ (SharedAccessSignature*)signatureWithURLString:(NSString*)urlString assumedLifetime:(NSTimeInterval)lifetime;
+
+// Reference-date times at which the signature was received and stops being accepted.
+@property (readonly) NSTimeInterval issued;
+@property (readonly) NSTimeInterval expiry;
+
+// endpoint is a service-relative path such as /container/blob?comp=block, already escaped.
+- (NSURL*)URLForEndpoint:(NSString*)endpoint;
+
+@end
@@ -0,0 +1,88 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "SharedAccessSignature.h"
+#import <time.h>
+#import <xlocale.h>
+
+// se= is ISO 8601 in UTC, either to the second or just a date
+static NSTimeInterval ParseExpiry(NSString* value)
+{
+    const char* text = [[value stringByReplacingPercentEscapesUsingEncoding:NSUTF8StringEncoding] UTF8String];
+    struct tm components;
+    
+    memset(&components, 0, sizeof(components));
+    if(!text || (!strptime_l(text, "%Y-%m-%dT%H:%M:%S", &components, NULL) && !strptime_l(text, "%Y-%m-%d", &components, NULL)))
+    {
+        return 0;
+    }
+    
+    return timegm(&components) - NSTimeIntervalSince1970;
+}
+
+@implementation SharedAccessSignature
+
+@synthesize issued = _issued;
+@synthesize expiry = _expiry;
+
++ (SharedAccessSignature*)signatureWithURLString:(NSString*)urlString assumedLifetime:(NSTimeInterval)lifetime
+{
+    NSURL* url = [NSURL URLWithString:[urlString stringByTrimmingCharactersInSet:[NSCharacterSet whitespaceAndNewlineCharacterSet]]];
+    NSString* query = [url query];
+    
+    if(![url host] || [query rangeOfString:@"sig="].location == NSNotFound)
+    {
+        return nil;
+    }
+    
+    SharedAccessSignature* signature = [[[self alloc] init] autorelease];
+    signature->_serviceRoot = [([url port] ? [NSString stringWithFormat:@"%@://%@:%@", [url scheme], [url host], [url port]]
+                                           : [NSString stringWithFormat:@"%@://%@", [url scheme], [url host]]) retain];
+    signature->_query = [query copy];
+    signature->_issued = [NSDate timeIntervalSinceReferenceDate];
+    signature->_expiry = signature->_issued + lifetime;
+    
+    for(NSString* arg in [query componentsSeparatedByString:@"&"])
+    {
+        if([arg hasPrefix:@"se="])
+        {
+            NSTimeInterval expiry = ParseExpiry([arg substringFromIndex:3]);
+            if(expiry > 0)
+            {
+                signature->_expiry = expiry;
+            }
+            break;
+        }
+    }
+    
+    return signature;
+}
+
+- (void)dealloc
+{
+    [_serviceRoot release];
+    [_query release];
+    
+    [super dealloc];
+}
+
+- (NSURL*)URLForEndpoint:(NSString*)endpoint
+{
+    NSString* separator = ([endpoint rangeOfString:@"?"].location == NSNotFound) ? @"?" : @"&";
+    return [NSURL URLWithString:[NSString stringWithFormat:@"%@%@%@%@", _serviceRoot, endpoint, separator, _query]];
+}
+
+@end
@@ -0,0 +1,61 @@
+/*
+ Copyright 2010 Microsoft Corp
+ 
+ Licensed under the Apache License, Version 2.0 (the "License");
+ you may not use this file except in compliance with the License.
+ You may obtain a copy of the License at
+ 
+ http://www.apache.org/licenses/LICENSE-2.0
+ 
+ Unless required by applicable law or agreed to in writing, software
+ distributed under the License is distributed on an "AS IS" BASIS,
+ WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ See the License for the specific language governing permissions and
+ limitations under the License.
+ */
+
+#import "TableResultSet.h"
+
+// {offset, length} of a String or Binary value in its column's heap.
+typedef struct
+{
+    NSUInteger offset;
+    NSUInteger length;
+} TableColumnSpan;
+
+// One property of one type. Fixed-width values sit in _values at row * _width; String and Binary
+// columns keep a span there and their bytes in _heap. Arrays only grow as far as the last row
+// written, and are padded out to the row count when handed out.
+@interface TableColumn : NSObject
+{
+@public
+    NSString* _name;
+    TableColumnType _type;
+    NSUInteger _width;
+    NSMutableData* _values;
+    NSMutableData* _validity;
+    NSMutableData* _heap;
+}
+
+- (id)initWithName:(NSString*)name type:(TableColumnType)type;
+
+- (BOOL)hasValueAtRow:(NSUInteger)row;
+// The value slot of a row, marked valid; the caller fills in _width bytes.
+- (void*)slotForRow:(NSUInteger)row;
+- (void)setBytes:(const void*)bytes length:(NSUInteger)length forRow:(NSUInteger)row;
+- (void)padToCount:(NSUInteger)count;
+- (void)truncateToCount:(NSUInteger)count;
+
+@end
+
+// Building a result set, as the column parser does.
+@interface TableResultSet (Private)
+
+- (id)initWithTableName:(NSString*)tableName;
+// Starts a new, empty row and returns its index.
+- (NSUInteger)addRow;
+- (TableColumn*)columnNamed:(NSString*)name type:(TableColumnType)type;
+// Drops the rows from count on, for a query that read past its $top.
+- (void)truncateToCount:(NSUInteger)count;
+
+@end